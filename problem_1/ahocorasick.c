@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ahocorasick.h"
+#include "wordfreq.h"
+#include "wordcount.h"
+#include "utf8iter.h"
+#include "utf8.h"
+
+/**
+ * @brief Child of a state of the trie that no class has, since the root is nobody's child.
+ *
+ */
+#define NO_CHILD 0
+
+/**
+ * @brief The trie of the patterns, whose rows become the transitions of the automaton.
+ *
+ */
+typedef struct pattern_trie {
+    uint32_t *rows;         // The child of each state by class, or NO_CHILD.
+    size_t n_classes;
+    size_t n_states;
+    size_t capacity;
+    uint32_t *first_end;    // First pattern ending in each state plus one, or 0.
+    uint32_t *next_end;     // Next pattern ending in the same state plus one, or 0.
+} pattern_trie;
+
+/**
+ * @brief Adds a state with no children to the trie, growing it if needed.
+ *
+ * @return uint32_t The new state or NO_CHILD on failure.
+ */
+static uint32_t add_state(pattern_trie *trie) {
+    if (trie->n_states == trie->capacity) {
+        size_t capacity = trie->capacity * 2;
+        uint32_t *rows = realloc(trie->rows, sizeof(uint32_t) * capacity * trie->n_classes);
+        uint32_t *first_end;
+
+        if (rows == NULL) return NO_CHILD;
+        trie->rows = rows;
+
+        if ((first_end = realloc(trie->first_end, sizeof(uint32_t) * capacity)) == NULL) return NO_CHILD;
+        trie->first_end = first_end;
+        trie->capacity = capacity;
+    }
+
+    memset(&trie->rows[trie->n_states * trie->n_classes], 0, sizeof(uint32_t) * trie->n_classes);
+    trie->first_end[trie->n_states] = 0;
+    return trie->n_states++;
+}
+
+/**
+ * @brief Fills the transitions of the trie the patterns don't have with the ones of the failure
+ * link, from the root outwards, so each state only needs the ones of a state closer to the root.
+ *
+ * @param fail_out The failure link of each state: the longest proper suffix of it that is in the trie.
+ * @param order_out The states from the root outwards.
+ */
+static void fill_transitions(pattern_trie *trie, uint32_t *fail_out, uint32_t *order_out) {
+    size_t n_ordered = 1;
+
+    fail_out[0] = 0;
+    order_out[0] = 0;
+
+    for (size_t i = 0; i < n_ordered; i++) {
+        uint32_t state = order_out[i];
+        uint32_t *row = &trie->rows[state * trie->n_classes];
+        const uint32_t *fail_row = &trie->rows[fail_out[state] * trie->n_classes];
+
+        for (size_t class = 0; class < trie->n_classes; class++) {
+            if (row[class] == NO_CHILD) {
+                // The missing children of the root stay on it.
+                if (state != 0) row[class] = fail_row[class];
+                continue;
+            }
+
+            fail_out[row[class]] = state == 0 ? 0 : fail_row[class];
+            order_out[n_ordered++] = row[class];
+        }
+    }
+}
+
+/**
+ * @brief Frees the parts of a partly built automaton and sets errno back to the error that stopped it.
+ *
+ */
+static ac_automaton_t *fail_build(ac_automaton_t *automaton, pattern_trie *trie, int error) {
+    free(trie->rows);
+    free(trie->first_end);
+    free(trie->next_end);
+    a_c_destroy(automaton);
+
+    errno = error;
+    return NULL;
+}
+
+/**
+ * @brief Tells whether a folded pattern can be inside a word, i.e. it has no character that ends words.
+ *
+ */
+static bool can_be_in_word(const unsigned char *pattern, size_t size) {
+    utf8iter iter = {pattern, size, 0};
+    uint32_t utf8_char;
+
+    while (iter._pointer < size) {
+        if (!utf8iter_next_complete_char(&iter, &utf8_char)) break;
+        if (utf8_char_class(utf8_char) & WORD_END_CLASSES) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Grows an array to a new capacity, leaving it as it was on failure.
+ *
+ */
+static bool grow_array(void **array, size_t item_size, size_t capacity) {
+    void *grown = realloc(*array, item_size * capacity);
+
+    if (grown == NULL) return false;
+
+    *array = grown;
+    return true;
+}
+
+/**
+ * @brief Frees the lines and folded patterns read from a pattern file.
+ *
+ */
+static void free_patterns(char **names, unsigned char **patterns, size_t n_patterns) {
+    for (size_t i = 0; i < n_patterns; i++) {
+        free(names[i]);
+        free(patterns[i]);
+    }
+
+    free(names);
+    free(patterns);
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+ac_automaton_t *a_c_create(size_t n_patterns, const unsigned char **patterns, const size_t *sizes) {
+    ac_automaton_t *automaton;
+    pattern_trie trie = {NULL, 1, 0, 64, NULL, NULL};
+    uint32_t *fail, *order, *renumbered;
+    size_t n_matches = 0;
+    size_t n_plain = 0;
+    size_t match_idx = 0;
+
+    if ((automaton = calloc(1, sizeof(ac_automaton_t))) == NULL) return NULL;
+
+    automaton->n_patterns = n_patterns;
+
+    // The bytes of the patterns get a class of their own, the others share class 0.
+    for (size_t i = 0; i < n_patterns; i++) {
+        for (size_t j = 0; j < sizes[i]; j++) {
+            if (automaton->byte_class[patterns[i][j]] == 0) automaton->byte_class[patterns[i][j]] = trie.n_classes++;
+        }
+    }
+
+    trie.rows = malloc(sizeof(uint32_t) * trie.capacity * trie.n_classes);
+    trie.first_end = malloc(sizeof(uint32_t) * trie.capacity);
+    trie.next_end = calloc(n_patterns, sizeof(uint32_t));
+
+    if (trie.rows == NULL || trie.first_end == NULL || trie.next_end == NULL) return fail_build(automaton, &trie, errno);
+
+    add_state(&trie);
+
+    for (size_t i = 0; i < n_patterns; i++) {
+        uint32_t state = 0;
+
+        if (sizes[i] == 0) continue;
+
+        for (size_t j = 0; j < sizes[i]; j++) {
+            uint32_t *child = &trie.rows[state * trie.n_classes + automaton->byte_class[patterns[i][j]]];
+            uint32_t new_state;
+
+            if (*child == NO_CHILD) {
+                if ((new_state = add_state(&trie)) == NO_CHILD) return fail_build(automaton, &trie, errno);
+
+                // Growing the trie moves its rows.
+                child = &trie.rows[state * trie.n_classes + automaton->byte_class[patterns[i][j]]];
+                *child = new_state;
+            }
+
+            state = *child;
+        }
+
+        trie.next_end[i] = trie.first_end[state];
+        trie.first_end[state] = i + 1;
+    }
+
+    automaton->stride = trie.n_classes + 1;
+    automaton->n_states = trie.n_states;
+
+    // The ids are offsets into the rows, which must fit in them.
+    if (trie.n_states * automaton->stride > UINT32_MAX) return fail_build(automaton, &trie, EOVERFLOW);
+
+    fail = malloc(sizeof(uint32_t) * trie.n_states);
+    order = malloc(sizeof(uint32_t) * trie.n_states);
+    renumbered = malloc(sizeof(uint32_t) * trie.n_states);
+
+    if (fail == NULL || order == NULL || renumbered == NULL) {
+        free(fail);
+        free(order);
+        free(renumbered);
+        return fail_build(automaton, &trie, ENOMEM);
+    }
+
+    fill_transitions(&trie, fail, order);
+
+    // A state matches its own patterns and the ones of its failure link, which comes before it.
+    // The counts go into renumbered until the states are numbered.
+    for (size_t i = 0; i < trie.n_states; i++) {
+        uint32_t state = order[i];
+        uint32_t n_own = 0;
+
+        for (uint32_t pattern = trie.first_end[state]; pattern != 0; pattern = trie.next_end[pattern - 1]) n_own++;
+
+        renumbered[state] = n_own + (state == 0 ? 0 : renumbered[fail[state]]);
+        n_matches += renumbered[state];
+        if (renumbered[state] == 0) n_plain++;
+    }
+
+    automaton->n_match_states = trie.n_states - n_plain;
+    automaton->rows = malloc(sizeof(uint32_t) * trie.n_states * automaton->stride);
+    automaton->match_start = malloc(sizeof(uint32_t) * (automaton->n_match_states + 1));
+    automaton->matches = malloc(sizeof(uint32_t) * (n_matches == 0 ? 1 : n_matches));
+
+    if (automaton->rows == NULL || automaton->match_start == NULL || automaton->matches == NULL) {
+        free(fail);
+        free(order);
+        free(renumbered);
+        return fail_build(automaton, &trie, ENOMEM);
+    }
+
+    automaton->first_match = n_plain * automaton->stride;
+
+    // The states without matches come first, the root among them, each group from the root outwards.
+    for (size_t i = 0, next_plain = 0, next_match = n_plain; i < trie.n_states; i++) {
+        uint32_t state = order[i];
+        uint32_t n_state_matches = renumbered[state];
+        uint32_t *row;
+
+        renumbered[state] = (n_state_matches == 0 ? next_plain++ : next_match++) * automaton->stride;
+        row = &automaton->rows[renumbered[state]];
+        if (n_state_matches == 0) continue;
+
+        row[trie.n_classes] = next_match - 1 - n_plain;
+        automaton->match_start[row[trie.n_classes]] = match_idx;
+
+        for (uint32_t link = state; link != 0; link = fail[link]) {
+            for (uint32_t pattern = trie.first_end[link]; pattern != 0; pattern = trie.next_end[pattern - 1]) {
+                automaton->matches[match_idx++] = pattern - 1;
+            }
+        }
+    }
+
+    automaton->match_start[automaton->n_match_states] = match_idx;
+
+    for (size_t state = 0; state < trie.n_states; state++) {
+        uint32_t *row = &automaton->rows[renumbered[state]];
+
+        for (size_t class = 0; class < trie.n_classes; class++) {
+            row[class] = renumbered[trie.rows[state * trie.n_classes + class]];
+        }
+    }
+
+    free(fail);
+    free(order);
+    free(renumbered);
+    free(trie.rows);
+    free(trie.first_end);
+    free(trie.next_end);
+
+    return automaton;
+}
+
+
+ac_automaton_t *a_c_load(const char *path, size_t *bad_line_out) {
+    FILE *file;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_size;
+    char **names = NULL;
+    unsigned char **patterns = NULL;
+    size_t *sizes = NULL;
+    size_t n_patterns = 0;
+    size_t capacity = 0;
+    size_t line_number = 0;
+    ac_automaton_t *automaton = NULL;
+    int error = 0;
+
+    *bad_line_out = 0;
+
+    if ((file = fopen(path, "r")) == NULL) return NULL;
+
+    while ((line_size = getline(&line, &line_capacity, file)) != -1) {
+        unsigned char *folded;
+
+        line_number++;
+
+        while (line_size > 0 && (line[line_size - 1] == '\n' || line[line_size - 1] == '\r')) line_size--;
+        if (line_size == 0) continue;
+
+        if (n_patterns == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+
+            if (
+                !grow_array((void **) &names, sizeof(char *), capacity) ||
+                !grow_array((void **) &patterns, sizeof(unsigned char *), capacity) ||
+                !grow_array((void **) &sizes, sizeof(size_t), capacity)
+            ) {
+                error = errno;
+                break;
+            }
+        }
+
+        // A folded character never takes more than 4 bytes and the others take at least 1.
+        if ((folded = malloc(line_size * 4)) == NULL || (names[n_patterns] = strndup(line, line_size)) == NULL) {
+            error = errno;
+            free(folded);
+            break;
+        }
+
+        patterns[n_patterns] = folded;
+        sizes[n_patterns] = fold_word((unsigned char *) line, line_size, folded);
+        n_patterns++;
+
+        if (!can_be_in_word(folded, sizes[n_patterns - 1])) {
+            *bad_line_out = line_number;
+            break;
+        }
+    }
+
+    if (error == 0 && ferror(file)) error = errno;
+
+    free(line);
+    fclose(file);
+
+    if (error == 0 && *bad_line_out == 0) {
+        if ((automaton = a_c_create(n_patterns, (const unsigned char **) patterns, sizes)) == NULL) error = errno;
+    }
+
+    if (automaton == NULL) {
+        free_patterns(names, patterns, n_patterns);
+        free(sizes);
+
+        errno = error;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_patterns; i++) {
+        free(patterns[i]);
+    }
+
+    free(patterns);
+    free(sizes);
+
+    automaton->names = names;
+    return automaton;
+}
+
+
+void a_c_add_matches(const ac_automaton_t *automaton, uint64_t *visits, uint64_t *counts) {
+    for (size_t i = 0; i < automaton->n_match_states; i++) {
+        if (visits[i] == 0) continue;
+
+        for (uint32_t j = automaton->match_start[i]; j < automaton->match_start[i + 1]; j++) {
+            counts[automaton->matches[j]] += visits[i];
+        }
+
+        visits[i] = 0;
+    }
+}
+
+
+void a_c_destroy(ac_automaton_t *automaton) {
+    if (automaton->names != NULL) {
+        for (size_t i = 0; i < automaton->n_patterns; i++) {
+            free(automaton->names[i]);
+        }
+    }
+
+    free(automaton->names);
+    free(automaton->rows);
+    free(automaton->match_start);
+    free(automaton->matches);
+    free(automaton);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file ahocorasick.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief This module contains Aho-Corasick automatons, which find every occurrence of any of
+ * a set of patterns in a text in a single pass over its bytes, however many patterns there are.
+ *
+ * The automaton is a complete DFA: the failure links are followed once, when it is built, so each
+ * byte of the text takes exactly one transition. The bytes are first mapped to classes, the bytes
+ * that appear in no pattern sharing one, and the transitions of each state are a row of the
+ * classes in a single array, so the states near the root, which most bytes go through, take a
+ * few cache lines. The states with matches are numbered last, so telling them apart is a compare,
+ * and only the visits to them are counted while matching. They are turned into the matches of
+ * each pattern afterwards, a state matching its own patterns and those of its suffixes.
+ * @version 0.1
+ * @date 2022-05-11
+ *
+ */
+
+#ifndef AHOCORASICK_GUARD
+#define AHOCORASICK_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Data structure representing an automaton.
+ * It's fields must not be changed directly.
+ *
+ */
+typedef struct ac_automaton_t {
+    uint8_t byte_class[256];
+    size_t stride;          // Entries of a row: the classes, then the number of the state among the ones with matches.
+    uint32_t *rows;         // The row of a state starts at its id, which is its number times the stride.
+    size_t n_states;
+    uint32_t first_match;   // Id of the first state with matches, all of the following ones have them.
+    size_t n_match_states;
+    uint32_t *match_start;  // Where the patterns of each state with matches start in matches, plus where the last ones end.
+    uint32_t *matches;      // The patterns matched in each state with matches, longest first.
+    size_t n_patterns;
+    char **names;           // The lines of the pattern file, if the automaton was read from one.
+} ac_automaton_t;
+
+/**
+ * @brief Creates an automaton matching some patterns. Empty patterns never match.
+ *
+ * @param n_patterns
+ * @param patterns The bytes of each pattern, which are copied.
+ * @param sizes The number of bytes of each pattern.
+ * @return ac_automaton_t* A pointer to the automaton on success or NULL on failure, with errno set.
+ */
+ac_automaton_t *a_c_create(size_t n_patterns, const unsigned char **patterns, const size_t *sizes);
+
+/**
+ * @brief Creates an automaton matching the patterns of a file, one per line. Empty lines are skipped.
+ * The patterns are folded into lower case without diacritics, as the words are, and matched inside
+ * the words, so a pattern with a character that ends words, e.g. a space, can't match.
+ *
+ * @param path
+ * @param bad_line_out The number of the first line whose pattern can't match, or 0 if they all can,
+ * in which case no automaton is created.
+ * @return ac_automaton_t* A pointer to the automaton on success or NULL on failure, with errno set.
+ */
+ac_automaton_t *a_c_load(const char *path, size_t *bad_line_out);
+
+/**
+ * @brief Counts the visits of a text to the states with matches, which tell every occurrence of
+ * each pattern in it, overlapping ones included.
+ *
+ * @param automaton
+ * @param text
+ * @param size The number of bytes of the text.
+ * @param visits The visits to each state with matches, which the ones of the text are added to.
+ */
+static inline void a_c_count(const ac_automaton_t *automaton, const unsigned char *text, size_t size, uint64_t *visits) {
+    const uint32_t *rows = automaton->rows;
+    size_t n_classes = automaton->stride - 1;
+    uint32_t state = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        state = rows[state + automaton->byte_class[text[i]]];
+        if (state >= automaton->first_match) visits[rows[state + n_classes]]++;
+    }
+}
+
+/**
+ * @brief Adds the matches of each pattern the visits tell to their counts and sets the visits back to 0.
+ *
+ * @param automaton
+ * @param visits The visits to each state with matches, from a_c_count().
+ * @param counts The count of each pattern.
+ */
+void a_c_add_matches(const ac_automaton_t *automaton, uint64_t *visits, uint64_t *counts);
+
+/**
+ * @brief Deallocates the automaton.
+ *
+ * @param automaton
+ */
+void a_c_destroy(ac_automaton_t *automaton);
+
+#endif
@@ -0,0 +1,106 @@
+#!/bin/bash
+# Throughput benchmark of countWords on a synthetic corpus.
+#
+# Usage (from anywhere): bench/bench.sh
+#
+# Builds countWords and gencorpus, generates the corpus once for each set of options
+# and then runs countWords for every reader, placement, chunk size and number of threads,
+# with warmup runs that are discarded. The results are written as CSV with one line per
+# configuration: the mean and standard deviation of the elapsed time reported by
+# countWords, the throughput in MB/s and the speedup over the first thread count.
+# Placements other than "none" are passed as --pin or --numa, and the chunks the workers
+# found on their own NUMA node and on another one in the last run are reported too.
+#
+# Everything can be changed through environment variables, e.g.
+#   THREADS="1 2 4" CHUNKS="64k 1m" REPEATS=10 CORPUS_SIZE=4g bench/bench.sh
+#   PLACEMENTS="none pin numa" bench/bench.sh
+set -e
+
+cd "$(dirname "$0")/.."
+
+SEED=${SEED:-1}
+CORPUS_SIZE=${CORPUS_SIZE:-1g}
+MULTIBYTE=${MULTIBYTE:-0.1}
+WORD_LENGTH=${WORD_LENGTH:-4.5}
+PUNCTUATION=${PUNCTUATION:-0.1}
+THREADS=${THREADS:-"1 2 4 8"}
+CHUNKS=${CHUNKS:-"64k 1m"}
+READERS=${READERS:-"mmap"}
+PLACEMENTS=${PLACEMENTS:-"none"}
+WARMUP=${WARMUP:-1}
+REPEATS=${REPEATS:-5}
+EXTRA_ARGS=${EXTRA_ARGS:-""}
+OUTPUT=${OUTPUT:-bench/results.csv}
+
+gcc -Wall -O3 -o bench/countWords *.c -lpthread
+gcc -Wall -O3 -o bench/gencorpus bench/gencorpus.c
+
+mkdir -p bench/corpus
+CORPUS=bench/corpus/corpus-s${SEED}-b${CORPUS_SIZE}-u${MULTIBYTE}-l${WORD_LENGTH}-p${PUNCTUATION}.txt
+
+if [ ! -f "$CORPUS" ]; then
+    bench/gencorpus -s "$SEED" -b "$CORPUS_SIZE" -u "$MULTIBYTE" -l "$WORD_LENGTH" -p "$PUNCTUATION" "$CORPUS.tmp" >&2
+    mv "$CORPUS.tmp" "$CORPUS"
+fi
+
+CORPUS_BYTES=$(stat -c %s "$CORPUS")
+
+# Read the corpus once so every configuration starts with it in the page cache.
+cat "$CORPUS" > /dev/null
+
+echo "reader,placement,chunk_size,threads,runs,bytes,mean_s,stdev_s,min_s,mb_per_s,mb_per_s_stdev,speedup,cv,local_chunks,remote_chunks" > "$OUTPUT"
+
+for reader in $READERS; do
+    for placement in $PLACEMENTS; do
+        placement_args=""
+        if [ "$placement" != "none" ]; then placement_args="--$placement"; fi
+
+        for chunk in $CHUNKS; do
+            base_mean=""
+
+            for threads in $THREADS; do
+                times=""
+
+                for run in $(seq 1 $((WARMUP + REPEATS))); do
+                    output=$(bench/countWords -n "$threads" -r "$reader" -c "$chunk" $placement_args $EXTRA_ARGS "$CORPUS")
+                    elapsed=$(echo "$output" | awk '/^Elapsed time/ { print $4 }')
+
+                    if [ -z "$elapsed" ]; then
+                        echo "countWords failed with -n $threads -r $reader -c $chunk $placement_args" >&2
+                        exit 1
+                    fi
+
+                    if [ "$run" -gt "$WARMUP" ]; then times="$times $elapsed"; fi
+                done
+
+                # "Data on the node of the worker: X local, Y remote", only printed when the workers are placed.
+                local_remote=$(echo "$output" | awk '/^Data on the node of the worker/ { print $8 "," $10 }')
+                if [ -z "$local_remote" ]; then local_remote=","; fi
+
+                line=$(echo "$times" | awk -v bytes="$CORPUS_BYTES" -v base="$base_mean" '{
+                    n = NF; sum = 0; rate_sum = 0; min = $1
+                    for (i = 1; i <= n; i++) {
+                        sum += $i; rate[i] = bytes / 1e6 / $i; rate_sum += rate[i]
+                        if ($i < min) min = $i
+                    }
+                    mean = sum / n; rate_mean = rate_sum / n; var = 0; rate_var = 0
+                    for (i = 1; i <= n; i++) {
+                        var += ($i - mean) ^ 2; rate_var += (rate[i] - rate_mean) ^ 2
+                    }
+                    stdev = n > 1 ? sqrt(var / (n - 1)) : 0
+                    rate_stdev = n > 1 ? sqrt(rate_var / (n - 1)) : 0
+                    if (base == "") base = mean
+                    printf "%d,%d,%.6f,%.6f,%.6f,%.2f,%.2f,%.3f,%.4f\n", n, bytes, mean, stdev, min, \
+                           rate_mean, rate_stdev, base / mean, stdev / mean
+                }')
+
+                if [ -z "$base_mean" ]; then base_mean=$(echo "$line" | cut -d, -f3); fi
+
+                echo "$reader,$placement,$chunk,$threads,$line,$local_remote" >> "$OUTPUT"
+                echo "$reader $placement chunk $chunk, $threads threads: $(echo "$line" | cut -d, -f6) MB/s" >&2
+            done
+        done
+    done
+done
+
+echo "Results written to $OUTPUT" >&2
@@ -0,0 +1,178 @@
+/**
+ * @file circularbuffer.c
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Measures the reads of the circular buffer reader, by reading a file in chunks ending
+ * at a space as the workers do: first with the reads the buffer had before, one byte at a time
+ * with a modulo per byte, and then with c_b_read_chunk_until_delim() and c_b_read_all(), which
+ * search the delimiter with memchr() and copy at most two spans. Both must cut the same chunks.
+ *
+ * Build (from problem_1): gcc -Wall -O3 -o bench/circularbuffer bench/circularbuffer.c filereader.c
+ * Usage: bench/circularbuffer [-c chunk_size] [-r repeats] file
+ * @version 0.1
+ * @date 2022-05-11
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "../filereader.h"
+
+static double now_s() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+/**
+ * @brief How the buffer was read before, a byte at a time.
+ *
+ */
+static bool read_single_byte(circular_buffer_t *circular_buffer, unsigned char *byte_out) {
+    if (circular_buffer->size == 0) return false;
+
+    *byte_out = circular_buffer->buffer[circular_buffer->read_idx];
+    circular_buffer->read_idx = (circular_buffer->read_idx + 1) % circular_buffer->capacity;
+    circular_buffer->size--;
+    return true;
+}
+
+static size_t byte_read_all(circular_buffer_t *circular_buffer, unsigned char *out) {
+    size_t buffer_size = circular_buffer->size;
+
+    while (read_single_byte(circular_buffer, out)) out++;
+
+    return buffer_size;
+}
+
+static size_t byte_read_chunk_until_delim(
+    circular_buffer_t *circular_buffer, size_t min_chunk_size, unsigned char delim, unsigned char *out
+) {
+    size_t read_bytes = 0;
+
+    while (read_single_byte(circular_buffer, out)) {
+        read_bytes++;
+        if (read_bytes >= min_chunk_size && out[0] == delim) break;
+        out++;
+    }
+
+    return read_bytes;
+}
+
+/**
+ * @brief Reads a file in chunks as the workers do.
+ *
+ * @param checksum_out A hash of the size and last byte of each chunk, to tell the chunks apart.
+ * @return double The seconds spent reading out of the buffer, without filling it.
+ */
+static double read_file(char *file_name, size_t chunk_size, bool by_byte, uint64_t *checksum_out) {
+    circular_buffer_t *reader;
+    unsigned char *out;
+    uint64_t checksum = 1469598103934665603ULL;
+    double read_s = 0.0;
+
+    if ((reader = c_b_open(file_name, chunk_size * 2)) == NULL) {
+        printf("Error opening the file: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    if ((out = malloc(chunk_size * 2)) == NULL) {
+        printf("Error allocating memory for the chunks: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    while (c_b_size(reader) != 0) {
+        double start = now_s();
+        bool last = c_b_size(reader) != c_b_capacity(reader);
+        size_t size;
+
+        if (last) {
+            size = by_byte ? byte_read_all(reader, out) : c_b_read_all(reader, out);
+        } else if (by_byte) {
+            size = byte_read_chunk_until_delim(reader, chunk_size, ' ', out);
+        } else {
+            size = c_b_read_chunk_until_delim(reader, chunk_size, ' ', out);
+        }
+
+        read_s += now_s() - start;
+        checksum = (checksum ^ size ^ ((uint64_t) out[size - 1] << 56)) * 1099511628211ULL;
+
+        if (last) break;
+        c_b_fill(reader);
+    }
+
+    c_b_close(reader);
+    free(out);
+
+    *checksum_out = checksum;
+    return read_s;
+}
+
+int main(int argc, char *argv[]) {
+    size_t chunk_size = 64 * 1024;
+    int repeats = 5;
+    double best_s[2] = {1e30, 1e30};
+    uint64_t checksums[2];
+    size_t file_size = 0;
+    FILE *file;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:")) != -1) {
+        switch (opt) {
+            case 'c':
+                chunk_size = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                printf("Usage: %s [-c chunk_size] [-r repeats] file\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1 || chunk_size == 0 || repeats < 1) {
+        printf("Usage: %s [-c chunk_size] [-r repeats] file\n", argv[0]);
+        return 1;
+    }
+
+    if ((file = fopen(argv[optind], "r")) == NULL) {
+        printf("Error opening the file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    file_size = ftell(file);
+    fclose(file);
+
+    if (file_size == 0) {
+        printf("The file is empty\n");
+        return 1;
+    }
+
+    // The runs are interleaved, so both reads see the same state of the machine.
+    for (int i = 0; i < repeats; i++) {
+        for (int by_byte = 1; by_byte >= 0; by_byte--) {
+            double read_s = read_file(argv[optind], chunk_size, by_byte, &checksums[by_byte]);
+
+            if (read_s < best_s[by_byte]) best_s[by_byte] = read_s;
+        }
+    }
+
+    if (checksums[0] != checksums[1]) {
+        printf("The reads cut different chunks\n");
+        return 1;
+    }
+
+    printf("%lu bytes in chunks of %lu bytes, best of %d runs, reading out of the buffer only:\n", file_size, chunk_size, repeats);
+    printf("Byte at a time:  %.6f s, %8.1f MB/s\n", best_s[1], file_size / best_s[1] / (1024 * 1024));
+    printf("memchr + memcpy: %.6f s, %8.1f MB/s\n", best_s[0], file_size / best_s[0] / (1024 * 1024));
+    printf("Speedup: %.1fx\n", best_s[1] / best_s[0]);
+    return 0;
+}
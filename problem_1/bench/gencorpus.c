@@ -0,0 +1,290 @@
+/**
+ * @file gencorpus.c
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Generates a synthetic text corpus for the benchmarks of countWords. The same seed and
+ * options always give the same bytes, so runs on different machines measure the same input.
+ *
+ * Build (from problem_1): gcc -Wall -O3 -o bench/gencorpus bench/gencorpus.c
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+/**
+ * @brief Size of the buffer the text is written through.
+ *
+ */
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * @brief Longest word generated.
+ *
+ */
+#define MAX_WORD_LENGTH 32
+
+/**
+ * @brief Average number of words in a line.
+ *
+ */
+#define WORDS_PER_LINE 12
+
+static const char *ASCII_VOWELS = "aeiouAEIOU";
+static const char *ASCII_CONSONANTS = "bcdfghjklmnpqrstvwxyzBCDFGHJKLMNPQRSTVWXYZ";
+
+/**
+ * @brief Letters of more than one byte: accented Latin, Greek and Cyrillic.
+ *
+ */
+static const char *MULTIBYTE_VOWELS[] = {
+    "á", "à", "â", "ã", "é", "ê", "í", "ó", "ô", "õ", "ú", "Á", "É", "Ó", "α", "ε", "ο", "ά", "а", "е", "о", "и"
+};
+static const char *MULTIBYTE_CONSONANTS[] = {
+    "ç", "Ç", "ñ", "β", "γ", "δ", "λ", "π", "σ", "б", "в", "д", "к", "л", "м", "н"
+};
+
+/**
+ * @brief Marks put after a word and the characters that join words, like apostrophes.
+ *
+ */
+static const char *PUNCTUATION[] = {".", ",", ";", ":", "!", "?", "\xe2\x80\x94", "\xe2\x80\xa6", "\xc2\xbb"};
+static const char *MERGERS[] = {"'", "\xe2\x80\x99"};
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * @brief Options of the corpus.
+ *
+ */
+typedef struct corpus_options {
+    uint64_t seed;
+    uint64_t size;              // Bytes to generate.
+    double multibyte_ratio;     // Share of the letters with more than one byte.
+    double mean_word_length;    // Average number of letters of a word.
+    double punctuation_density; // Share of the words followed by a punctuation mark.
+} corpus_options;
+
+/**
+ * @brief State of the xorshift64* generator.
+ *
+ */
+static uint64_t random_state;
+
+static uint64_t next_random() {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545f4914f6cdd1dull;
+}
+
+/**
+ * @brief Gets a random number in [0, 1).
+ *
+ */
+static double next_uniform() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Gets the length of the next word. Lengths follow a geometric distribution
+ * starting at 1 with the given mean, so short words are the most common, like in text.
+ *
+ */
+static size_t next_word_length(double mean_word_length) {
+    double continue_probability = 1.0 - 1.0 / mean_word_length;
+    size_t length = 1;
+
+    while (length < MAX_WORD_LENGTH && next_uniform() < continue_probability) length++;
+
+    return length;
+}
+
+/**
+ * @brief Buffered output of the corpus.
+ *
+ */
+typedef struct corpus_output {
+    FILE *file;
+    unsigned char buffer[OUTPUT_BUFFER_SIZE];
+    size_t used;
+    uint64_t written;
+} corpus_output;
+
+static void flush_output(corpus_output *output) {
+    if (fwrite(output->buffer, 1, output->used, output->file) != output->used) {
+        fprintf(stderr, "Error writing the corpus: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    output->written += output->used;
+    output->used = 0;
+}
+
+static void put_text(corpus_output *output, const char *text) {
+    size_t size = strlen(text);
+
+    if (output->used + size > OUTPUT_BUFFER_SIZE) flush_output(output);
+
+    memcpy(output->buffer + output->used, text, size);
+    output->used += size;
+}
+
+/**
+ * @brief Writes a random letter, a vowel or a consonant with the same probability as
+ * in Portuguese text, of one or more bytes according to the multibyte ratio.
+ *
+ */
+static void put_letter(corpus_output *output, const corpus_options *options) {
+    bool vowel = next_uniform() < 0.45;
+    char ascii[2] = {0, 0};
+
+    if (next_uniform() < options->multibyte_ratio) {
+        if (vowel) {
+            put_text(output, MULTIBYTE_VOWELS[next_random() % ARRAY_SIZE(MULTIBYTE_VOWELS)]);
+        } else {
+            put_text(output, MULTIBYTE_CONSONANTS[next_random() % ARRAY_SIZE(MULTIBYTE_CONSONANTS)]);
+        }
+        return;
+    }
+
+    ascii[0] = vowel ? ASCII_VOWELS[next_random() % strlen(ASCII_VOWELS)]
+                     : ASCII_CONSONANTS[next_random() % strlen(ASCII_CONSONANTS)];
+    put_text(output, ascii);
+}
+
+/**
+ * @brief Writes words until the corpus has the requested size. The corpus is cut
+ * after the last word that fits, so it may be a few bytes short.
+ *
+ */
+static void generate(corpus_output *output, const corpus_options *options) {
+    random_state = options->seed * 0x9e3779b97f4a7c15ull + 1;
+
+    while (output->written + output->used + MAX_WORD_LENGTH * 4 + 8 < options->size) {
+        size_t length = next_word_length(options->mean_word_length);
+
+        for (size_t i = 0; i < length; i++) {
+            put_letter(output, options);
+
+            // Some words are joined by an apostrophe, like "d'água".
+            if (i + 1 < length && next_uniform() < 0.01) {
+                put_text(output, MERGERS[next_random() % ARRAY_SIZE(MERGERS)]);
+            }
+        }
+
+        if (next_uniform() < options->punctuation_density) {
+            put_text(output, PUNCTUATION[next_random() % ARRAY_SIZE(PUNCTUATION)]);
+        }
+
+        put_text(output, next_random() % WORDS_PER_LINE == 0 ? "\n" : " ");
+    }
+
+    flush_output(output);
+}
+
+/**
+ * @brief Parses a size in bytes with an optional 'k', 'm' or 'g' suffix.
+ *
+ * @return uint64_t The size in bytes or 0 if the text isn't a valid size.
+ */
+static uint64_t parse_size(const char *text) {
+    char *suffix;
+    unsigned long long size = strtoull(text, &suffix, 10);
+
+    if (suffix == text || text[0] == '-') return 0;
+
+    switch (*suffix) {
+        case 'k': case 'K': size <<= 10; suffix++; break;
+        case 'm': case 'M': size <<= 20; suffix++; break;
+        case 'g': case 'G': size <<= 30; suffix++; break;
+    }
+
+    return *suffix == '\0' ? size : 0;
+}
+
+static void program_usage(char *prog_path) {
+    printf("\nUSAGE: %s [options] <output_file>\n", prog_path);
+    printf("-h\t\tPrints this message\n");
+    printf("-s\t\tSets the seed (default 1)\n");
+    printf("-b\t\tSets the size in bytes, 'k', 'm' and 'g' suffixes allowed (default 1g)\n");
+    printf("-u\t\tSets the share of letters with more than one byte, from 0 to 1 (default 0.1)\n");
+    printf("-l\t\tSets the average word length in letters, at least 1 (default 4.5)\n");
+    printf("-p\t\tSets the share of words followed by punctuation, from 0 to 1 (default 0.1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    corpus_options options = {1, 1ull << 30, 0.1, 4.5, 0.1};
+    corpus_output *output;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:b:u:l:p:h")) != -1) {
+        switch (opt) {
+            case 's':
+                options.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'b':
+                if ((options.size = parse_size(optarg)) == 0) {
+                    printf("Option -b must be a positive size\n");
+                    return 1;
+                }
+                break;
+            case 'u':
+                options.multibyte_ratio = atof(optarg);
+                break;
+            case 'l':
+                options.mean_word_length = atof(optarg);
+                break;
+            case 'p':
+                options.punctuation_density = atof(optarg);
+                break;
+            case 'h':
+                program_usage(argv[0]);
+                return 0;
+            default:
+                program_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (
+        options.multibyte_ratio < 0 || options.multibyte_ratio > 1 || options.mean_word_length < 1 ||
+        options.punctuation_density < 0 || options.punctuation_density > 1
+    ) {
+        printf("Ratios must be between 0 and 1 and the word length at least 1\n");
+        program_usage(argv[0]);
+        return 1;
+    }
+
+    if (optind != argc - 1) {
+        printf("No output file given\n");
+        program_usage(argv[0]);
+        return 1;
+    }
+
+    if ((output = calloc(1, sizeof(corpus_output))) == NULL) {
+        printf("Error allocating memory for the output: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if ((output->file = fopen(argv[optind], "wb")) == NULL) {
+        printf("Error opening the file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    generate(output, &options);
+
+    if (fclose(output->file) != 0) {
+        printf("Error closing the file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    printf("Generated %lu bytes\n", (unsigned long) output->written);
+    free(output);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file overhead.c
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Measures the overhead of a call to the library, by counting the same small buffers
+ * over and over: first with one counter whose workers are kept between the calls and then
+ * creating and destroying a counter for every call, as countWords did with its threads.
+ *
+ * Build (from problem_1): gcc -Wall -O3 -o bench/overhead bench/overhead.c $(ls *.c | grep -v main.c) -lpthread
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "../countwords.h"
+
+static const char *WORDS[] = {"água", "o", "rato", "roeu", "a", "rolha", "é", "do", "rei", "Ü"};
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+static double now_s() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+/**
+ * @brief Fills a buffer with words separated by spaces, the same ones for the same buffer.
+ *
+ */
+static void fill_buffer(unsigned char *buffer, size_t size, size_t buffer_idx) {
+    size_t written = 0;
+    size_t word_idx = buffer_idx;
+
+    while (written < size) {
+        const char *word = WORDS[word_idx++ % ARRAY_SIZE(WORDS)];
+        size_t word_size = strlen(word);
+
+        if (word_size + 1 > size - written) break;
+
+        memcpy(buffer + written, word, word_size);
+        buffer[written + word_size] = ' ';
+        written += word_size + 1;
+    }
+
+    memset(buffer + written, ' ', size - written);
+}
+
+/**
+ * @brief Counts the buffers and checks the words against the first call.
+ *
+ */
+static void count_or_die(counter_t *counter, size_t n_buffers, const unsigned char **buffers, const size_t *sizes, size_t *n_words) {
+    measurements *results;
+    size_t total = 0;
+
+    if (!c_w_count_buffers(counter, n_buffers, buffers, sizes, &results, NULL)) {
+        printf("Error counting the buffers\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n_buffers; i++) {
+        total += results[i].n_words;
+    }
+
+    if (*n_words != 0 && *n_words != total) {
+        printf("Error: %lu words counted instead of %lu\n", total, *n_words);
+        exit(1);
+    }
+
+    *n_words = total;
+}
+
+static void program_usage(char *prog_path) {
+    printf("\nUSAGE: %s [options]\n", prog_path);
+    printf("-h\t\tPrints this message\n");
+    printf("-n\t\tSets the number of worker threads (default 4)\n");
+    printf("-b\t\tSets the size of each buffer in bytes (default 4096)\n");
+    printf("-k\t\tSets the number of buffers counted by each call (default 1)\n");
+    printf("-i\t\tSets the number of calls (default 10000)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    long n_threads = 4;
+    long buffer_size = 4096;
+    long n_buffers = 1;
+    long n_calls = 10000;
+    counter_options options = c_w_default_options();
+    counter_t *counter;
+    size_t n_words = 0;
+    double start, pooled_s, fresh_s;
+
+    while ((opt = getopt(argc, argv, "n:b:k:i:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                n_threads = atol(optarg);
+                break;
+            case 'b':
+                buffer_size = atol(optarg);
+                break;
+            case 'k':
+                n_buffers = atol(optarg);
+                break;
+            case 'i':
+                n_calls = atol(optarg);
+                break;
+            case 'h':
+                program_usage(argv[0]);
+                return 0;
+            default:
+                program_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (n_threads < 1 || buffer_size < 1 || n_buffers < 1 || n_calls < 1) {
+        printf("All the options must be positive numbers\n");
+        program_usage(argv[0]);
+        return 1;
+    }
+
+    const unsigned char *buffers[n_buffers];
+    size_t sizes[n_buffers];
+
+    for (long i = 0; i < n_buffers; i++) {
+        unsigned char *buffer = malloc(buffer_size);
+
+        if (buffer == NULL) {
+            printf("Error allocating memory for the buffers: %s\n", strerror(errno));
+            return 1;
+        }
+
+        fill_buffer(buffer, buffer_size, i);
+        buffers[i] = buffer;
+        sizes[i] = buffer_size;
+    }
+
+    if ((counter = c_w_create(n_threads, &options)) == NULL) {
+        printf("Error creating the counter: %s\n", strerror(errno));
+        return 1;
+    }
+
+    start = now_s();
+    for (long call = 0; call < n_calls; call++) {
+        count_or_die(counter, n_buffers, buffers, sizes, &n_words);
+    }
+    pooled_s = now_s() - start;
+
+    c_w_destroy(counter);
+
+    start = now_s();
+    for (long call = 0; call < n_calls; call++) {
+        if ((counter = c_w_create(n_threads, &options)) == NULL) {
+            printf("Error creating the counter: %s\n", strerror(errno));
+            return 1;
+        }
+
+        count_or_die(counter, n_buffers, buffers, sizes, &n_words);
+        c_w_destroy(counter);
+    }
+    fresh_s = now_s() - start;
+
+    printf("%ld calls of %ld buffers of %ld bytes, %ld workers, %lu words each\n", n_calls, n_buffers, buffer_size, n_threads, n_words);
+    printf("Persistent workers: %.3f us per call\n", pooled_s * 1000000.0 / n_calls);
+    printf("Workers per call:   %.3f us per call\n", fresh_s * 1000000.0 / n_calls);
+
+    for (long i = 0; i < n_buffers; i++) {
+        free((void *) buffers[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "chunkqueue.h"
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Checks the result of a pthread call on the queue and aborts if it failed. They only
+ * fail on a queue that wasn't created or was already destroyed, which is a bug of the caller.
+ *
+ */
+static void check_or_die(int error) {
+    if (error != 0) abort();
+}
+
+/**
+ * @brief Takes the item at the front of the queue, which must not be empty.
+ * Must be called with the lock of the queue.
+ *
+ */
+static void *unsafe_pop(chunk_queue_t *queue) {
+    void *item = queue->items[queue->read_idx];
+
+    queue->stats.n_pops++;
+    queue->stats.depth_sum += queue->size;
+
+    queue->read_idx = (queue->read_idx + 1) % queue->capacity;
+    queue->size--;
+
+    check_or_die(pthread_cond_signal(&queue->not_full));
+    return item;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+chunk_queue_t *c_q_create(size_t capacity) {
+    chunk_queue_t *queue;
+    int error;
+
+    if ((queue = malloc(sizeof(chunk_queue_t))) == NULL) return NULL;
+
+    if ((queue->items = malloc(sizeof(void *) * capacity)) == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    queue->capacity = capacity;
+    queue->size = 0;
+    queue->read_idx = 0;
+    queue->closed = false;
+    memset(&queue->stats, 0, sizeof(chunk_queue_stats));
+
+    if ((error = pthread_mutex_init(&queue->lock, NULL)) != 0) goto free_items;
+    if ((error = pthread_cond_init(&queue->not_empty, NULL)) != 0) goto destroy_lock;
+    if ((error = pthread_cond_init(&queue->not_full, NULL)) != 0) goto destroy_not_empty;
+
+    return queue;
+
+destroy_not_empty:
+    pthread_cond_destroy(&queue->not_empty);
+destroy_lock:
+    pthread_mutex_destroy(&queue->lock);
+free_items:
+    free(queue->items);
+    free(queue);
+    errno = error;
+    return NULL;
+}
+
+
+void c_q_push(chunk_queue_t *queue, void *item) {
+    check_or_die(pthread_mutex_lock(&queue->lock));
+
+    if (queue->size == queue->capacity) queue->stats.n_full_waits++;
+
+    while (queue->size == queue->capacity) {
+        check_or_die(pthread_cond_wait(&queue->not_full, &queue->lock));
+    }
+
+    queue->items[(queue->read_idx + queue->size) % queue->capacity] = item;
+    queue->size++;
+    if (queue->size > queue->stats.max_depth) queue->stats.max_depth = queue->size;
+
+    check_or_die(pthread_cond_signal(&queue->not_empty));
+    check_or_die(pthread_mutex_unlock(&queue->lock));
+}
+
+
+bool c_q_pop(chunk_queue_t *queue, void **item_out) {
+    check_or_die(pthread_mutex_lock(&queue->lock));
+
+    if (queue->size == 0 && !queue->closed) {
+        uint64_t wait_start_ns = now_ns();
+
+        queue->stats.n_empty_waits++;
+        while (queue->size == 0 && !queue->closed) {
+            check_or_die(pthread_cond_wait(&queue->not_empty, &queue->lock));
+        }
+        queue->stats.empty_wait_ns += now_ns() - wait_start_ns;
+    }
+
+    // Only empty when closed
+    if (queue->size == 0) {
+        check_or_die(pthread_mutex_unlock(&queue->lock));
+        return false;
+    }
+
+    *item_out = unsafe_pop(queue);
+
+    check_or_die(pthread_mutex_unlock(&queue->lock));
+    return true;
+}
+
+
+bool c_q_try_pop(chunk_queue_t *queue, void **item_out) {
+    bool found;
+
+    check_or_die(pthread_mutex_lock(&queue->lock));
+
+    if ((found = queue->size > 0)) *item_out = unsafe_pop(queue);
+
+    check_or_die(pthread_mutex_unlock(&queue->lock));
+    return found;
+}
+
+
+void c_q_close(chunk_queue_t *queue) {
+    check_or_die(pthread_mutex_lock(&queue->lock));
+
+    queue->closed = true;
+
+    check_or_die(pthread_cond_broadcast(&queue->not_empty));
+    check_or_die(pthread_mutex_unlock(&queue->lock));
+}
+
+
+void c_q_stats(chunk_queue_t *queue, chunk_queue_stats *stats_out) {
+    check_or_die(pthread_mutex_lock(&queue->lock));
+
+    *stats_out = queue->stats;
+
+    check_or_die(pthread_mutex_unlock(&queue->lock));
+}
+
+
+void c_q_destroy(chunk_queue_t *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
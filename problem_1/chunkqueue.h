@@ -0,0 +1,108 @@
+/**
+ * @file chunkqueue.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief This module contains a bounded queue that blocks producers while it is
+ * full and consumers while it is empty. It is used to pass chunk buffers between
+ * the prefetching reader and the worker threads and keeps statistics on how full
+ * it was and how often each side had to wait.
+ * @version 0.1
+ * @date 2022-05-06
+ *
+ */
+
+#ifndef CHUNKQUEUE_GUARD
+#define CHUNKQUEUE_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * @brief Statistics of a queue.
+ *
+ */
+typedef struct chunk_queue_stats {
+    size_t n_pops;          // Items taken from the queue.
+    size_t depth_sum;       // Sum of the number of items in the queue at each pop.
+    size_t max_depth;       // Largest number of items the queue held.
+    size_t n_empty_waits;   // Pops that had to wait for an item.
+    uint64_t empty_wait_ns; // Time spent waiting for items.
+    size_t n_full_waits;    // Pushes that had to wait for space.
+} chunk_queue_stats;
+
+/**
+ * @brief Data structure representing a queue.
+ * It's fields must not be changed directly.
+ *
+ */
+typedef struct chunk_queue_t {
+    void **items;
+    size_t capacity;
+    size_t size;
+    size_t read_idx;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    chunk_queue_stats stats;
+} chunk_queue_t;
+
+/**
+ * @brief Creates an empty queue.
+ *
+ * @param capacity The maximum number of items in the queue.
+ * @return chunk_queue_t* A pointer to the queue on success or NULL on failure, with errno set.
+ */
+chunk_queue_t *c_q_create(size_t capacity);
+
+/**
+ * @brief Adds an item to the end of the queue, waiting while the queue is full.
+ *
+ * @param queue
+ * @param item
+ */
+void c_q_push(chunk_queue_t *queue, void *item);
+
+/**
+ * @brief Takes the item at the front of the queue, waiting while the queue is empty.
+ *
+ * @param queue
+ * @param item_out The item taken.
+ * @return true if an item was taken or false if the queue is empty and closed.
+ */
+bool c_q_pop(chunk_queue_t *queue, void **item_out);
+
+/**
+ * @brief Takes the item at the front of the queue if there is one, without waiting.
+ *
+ * @param queue
+ * @param item_out The item taken.
+ * @return true if an item was taken or false if the queue is empty.
+ */
+bool c_q_try_pop(chunk_queue_t *queue, void **item_out);
+
+/**
+ * @brief Tells the consumers no more items will be pushed. They still get the items
+ * that are in the queue.
+ *
+ * @param queue
+ */
+void c_q_close(chunk_queue_t *queue);
+
+/**
+ * @brief Gets the statistics of the queue.
+ *
+ * @param queue
+ * @param stats_out
+ */
+void c_q_stats(chunk_queue_t *queue, chunk_queue_stats *stats_out);
+
+/**
+ * @brief Deallocates the queue. No thread may be using it.
+ *
+ * @param queue
+ */
+void c_q_destroy(chunk_queue_t *queue);
+
+#endif
@@ -1,102 +1,423 @@
+#define _GNU_SOURCE // qsort_r
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "concurrency.h"
 #include "filereader.h"
+#include "decompress.h"
+#include "prefetch.h"
+#include "preadreader.h"
+#include "ringreader.h"
+#include "wordfreq.h"
+#include "instrument.h"
 
 /**
- * @brief Tells whether all threads were sucessful or not
+ * @brief A file being read with the circular buffer reader. Each one has its own lock,
+ * so threads can take data from different files at once.
  * 
  */
-static bool success = true;
+typedef struct cb_slot {
+    pthread_mutex_t lock;
+    circular_buffer_t *reader;  // Kept for the next files, NULL until the first one is opened.
+    bool open;                  // Whether the reader has a file with data left.
+    size_t file_id;
+    size_t offset;              // Offset in the file of the data in the circular buffer.
+} cb_slot;
 
 /**
- * @brief Number of threads to be processed. 
+ * @brief Summary of a portion of data of a file.
  * 
  */
-static size_t n_threads = 0;
+typedef struct chunk_result {
+    size_t file_id;
+    size_t offset;
+    size_t size;
+    uint64_t start_ns;  // When the first portion was handed out.
+    uint64_t end_ns;    // When the summary of the last portion was submitted.
+    chunk_summary summary;
+    word_edges edges;   // Only used when the words are counted.
+} chunk_result;
 
 /**
- * @brief Exit status of the threads.
+ * @brief Size of a cache line. Data written by different threads is kept in
+ * different cache lines so they don't invalidate each other's caches.
  * 
  */
-static int *threads_status = NULL;
+#define CACHE_LINE_SIZE 64
 
 /**
- * @brief Mutex that controls access to the data read from the files
+ * @brief Summaries of the portions of data processed by a single thread. Since only the owner
+ * thread writes to it, submitting results doesn't need a lock. A summary that continues the
+ * previous one is merged right away, so there is usually one per run of consecutive portions.
  * 
  */
-static pthread_mutex_t access_data_region = PTHREAD_MUTEX_INITIALIZER;
+typedef struct thread_accumulator {
+    chunk_result *chunks;
+    size_t n_chunks;
+    size_t capacity;
+    size_t n_submissions;
+    uint64_t handed_out_ns;  // When the last portion was handed out.
+    uint64_t wait_ns;        // How long it took to get the last portion.
+    word_sink words;         // Where the thread counts the words, if they are counted or estimated.
+    hll_sketch_t **sketches; // Of each file the thread got data of, if the distinct words are estimated.
+    int pattern_file;        // File whose pattern matches are in the visits of words, or -1.
+} __attribute__((aligned(CACHE_LINE_SIZE))) thread_accumulator;
 
-/**
- * @brief Mutex that controls access to the results
- * 
- */
-static pthread_mutex_t access_results_region = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * @brief Number of files for processing
+ * @brief State of a run, shared by the worker and reader threads.
  * 
  */
-static size_t n_files = 0;
+struct shared_region {
+    /**
+     * @brief The first error of the run, which stops it, or 0 while there is none.
+     * 
+     */
+    atomic_int error;
+
+    /**
+     * @brief Number of threads to be processed. 
+     * 
+     */
+    size_t n_threads;
+
+    /**
+     * @brief Exit status of the threads.
+     * 
+     */
+    int *threads_status;
+
+    /**
+     * @brief Number of files for processing
+     * 
+     */
+    size_t n_files;
+
+    /**
+     * @brief Name of the files to be processed
+     * 
+     */
+    char **file_names;
+
+    /**
+     * @brief The first error reading each of the files, or 0. See get_file_error().
+     * 
+     */
+    atomic_int *file_errors;
+
+    /**
+     * @brief Order in which the files are handed out: largest first, by the sizes
+     * from stat, so the small files fill in the end of the run.
+     * 
+     */
+    size_t *file_order;
+
+    /**
+     * @brief When the shared region was initialized. The timings of the files are relative to it.
+     * 
+     */
+    uint64_t start_ns;
+
+    /**
+     * @brief Wall time of each of the files. They are only filled
+     * when the summaries of the threads are merged.
+     * 
+     */
+    file_timing *file_timings;
+
+    /**
+     * @brief What was already known of each of the files when the run started, or NULL
+     * if they are all counted from the start. See file_resume.
+     * 
+     */
+    file_resume *resumes;
+
+    /**
+     * @brief Summary of each of the files as a whole, including what was already known,
+     * and the number of bytes it covers. They are only filled when the summaries of the
+     * threads are merged.
+     * 
+     */
+    chunk_summary *file_summaries;
+    size_t *file_bytes;
+
+    /**
+     * @brief Reader used to get the data from the files
+     * 
+     */
+    reader_backend backend;
+
+    /**
+     * @brief Size of the portions of data of each of the files. It only changes
+     * when the adaptive chunk sizing is used.
+     * 
+     */
+    atomic_size_t *chunk_sizes;
+
+    /**
+     * @brief Largest size a portion of data can have. The circular buffers are sized after it.
+     * 
+     */
+    size_t max_chunk_size;
+
+    /**
+     * @brief Time processing a portion of data should take in nanoseconds
+     * or 0 if the chunk size is fixed.
+     * 
+     */
+    uint64_t target_chunk_latency_ns;
+
+    /**
+     * @brief Files open with the circular buffer reader.
+     * 
+     */
+    cb_slot *cb_slots;
+    size_t n_cb_slots;
+
+    /**
+     * @brief Slot the next thread starts looking for data at, so the threads spread over the open files.
+     * 
+     */
+    atomic_size_t next_cb_slot;
+
+    /**
+     * @brief Buffers where each thread gets its portion of data when using
+     * the circular buffer reader
+     * 
+     */
+    unsigned char **threads_buffers;
+
+    /**
+     * @brief Mapped files when using the memory mapped reader. They are only unmapped
+     * on cleanup since threads might still be processing views into them.
+     * 
+     */
+    mapped_file_t **mapped_files;
+
+    /**
+     * @brief Data and size of each input read in place, either a mapped file or a buffer
+     * given by the caller. Inputs that couldn't be mapped are empty.
+     * 
+     */
+    const unsigned char **files_data;
+    size_t *files_sizes;
+
+    /**
+     * @brief Next offset to be handed out of each of the mapped files. Threads claim portions
+     * by incrementing it with the chunk size, so no lock is needed to get data from the mapped files.
+     * 
+     */
+    atomic_size_t *next_offsets;
+
+    /**
+     * @brief Position in file_order of the mapped file whose portions are being handed out.
+     * 
+     */
+    atomic_size_t current_file;
+
+    /**
+     * @brief The buffers the reader threads read into and the queues they go through.
+     * 
+     */
+    prefetch_pool pool;
+
+    /**
+     * @brief Offset each file is read from by the reader threads, or PREFETCH_SKIP.
+     * 
+     */
+    size_t *read_offsets;
+
+    /**
+     * @brief The threads reading into the pool and whether they were started.
+     * 
+     */
+    pthread_t *reader_threads;
+    size_t n_reader_threads;
+    bool readers_started;
+
+    /**
+     * @brief The state of the reader threads, whichever of them are used, or NULL.
+     * 
+     */
+    pread_reader_t *pread_reader;
+    ring_reader_t *ring_reader;
+
+    /**
+     * @brief Position in file_order of the next file to be taken by a slot of the circular buffer reader.
+     * 
+     */
+    atomic_size_t next_read_file;
+
+    /**
+     * @brief Format of each of the files, found when they are scheduled.
+     * 
+     */
+    compression_format *file_formats;
+
+    /**
+     * @brief Name of the reader in use.
+     * 
+     */
+    const char *reader_name;
+
+    /**
+     * @brief The prefetch buffer each thread is processing. It is only given back
+     * on the next call to get_data_portion().
+     * 
+     */
+    prefetch_buffer **threads_prefetch_buffers;
+
+    /**
+     * @brief Results for the each of the files. They are only filled
+     * when the summaries of the threads are merged.
+     * 
+     */
+    measurements *results;
+
+    /**
+     * @brief Whether the words are counted besides the measurements.
+     * 
+     */
+    bool word_histogram;
+
+    /**
+     * @brief Whether the distinct words of each file are estimated besides the measurements.
+     * 
+     */
+    bool distinct_words;
+
+    /**
+     * @brief The number of counters of the summaries of the most frequent words, or 0 if there are none.
+     * 
+     */
+    size_t top_counters;
+
+    /**
+     * @brief Table with the words cut between the portions of data handed to different threads,
+     * which are only counted when the summaries of the threads are merged.
+     * 
+     */
+    word_table_t *edge_words;
+
+    /**
+     * @brief Summary of the most frequent words cut between the portions.
+     * 
+     */
+    space_saving_t *edge_top;
+
+    /**
+     * @brief Sink of the words cut between portions, over edge_words, the sketch of each file and edge_top.
+     * 
+     */
+    word_sink edge_sink;
+
+    /**
+     * @brief The summaries of the threads and edge_top merged.
+     * 
+     */
+    space_saving_t *top_words;
+
+    /**
+     * @brief The sketches of the threads merged by file and for all files.
+     * 
+     */
+    hll_sketch_t **file_sketches;
+    hll_sketch_t *all_sketch;
+
+    /**
+     * @brief The patterns counted in the words, or NULL if there are none.
+     * 
+     */
+    const ac_automaton_t *patterns;
+
+    /**
+     * @brief The matches of each pattern in each file, or NULL for a file without any yet. The threads
+     * add theirs to them, under patterns_lock, when they get data of another file.
+     * 
+     */
+    uint64_t **file_pattern_counts;
+    pthread_mutex_t patterns_lock;
+    bool patterns_lock_ready;
+
+    /**
+     * @brief The word tables of the threads merged into shards by hash.
+     * 
+     */
+    word_table_t **word_shards;
+    size_t n_word_shards;
+
+    /**
+     * @brief The results of each of the threads.
+     * 
+     */
+    thread_accumulator *threads_accumulators;
+};
 
-/**
- * @brief Number of processed files
- * 
- */
-static size_t n_files_processed = 0;
 
 /**
- * @brief Name of the files to be processed
+ * @brief Wrapper functions that serves to lock a mutex and if it
+ * fails, aborts. The mutexes of the region only fail to lock if they
+ * weren't initialized, which is a bug.
  * 
+ * @param mutex 
  */
-static char **file_names = NULL;
+static void lock_or_die(pthread_mutex_t *mutex) {
+    INSTRUMENT_START(lock_start_ns);
+
+    if (pthread_mutex_lock(mutex) != 0) abort();
+
+    INSTRUMENT_STOP(TIMER_LOCK_WAIT, lock_start_ns);
+}
 
 /**
- * @brief Current file being processed
+ * @brief Wrapper function that serves to unlock a mutex and if it
+ * fails, aborts, see lock_or_die().
  * 
+ * @param mutex 
  */
-static circular_buffer_t *cb_file_reader = NULL;
+static void unlock_or_die(pthread_mutex_t *mutex) {
+    if (pthread_mutex_unlock(mutex) != 0) abort();
+}
 
 /**
- * @brief Results for the each of the files 
+ * @brief Stops the run with an error, unless it already stopped with another one.
+ * The threads notice it the next time they get data.
  * 
  */
-static measurements *results = NULL;
+static void fail_region(shared_region_t *region, int error) {
+    int no_error = 0;
 
+    atomic_compare_exchange_strong(&region->error, &no_error, error);
+}
 
 /**
- * @brief Wrapper functions that serves to lock a mutex and if it
- * fails, prints the error message and exits.
+ * @brief Records the error reading a file, unless it already had another one.
  * 
- * @param thread_id 
- * @param mutex 
  */
-static void lock_or_die(int thread_id, pthread_mutex_t *mutex) {
-    if (pthread_mutex_lock(mutex) != 0) {
-        threads_status[thread_id] = errno;
-        fprintf(stderr, "Error locking mutex for thread %d: %s\n", thread_id, strerror(errno));
-        exit(1);
-    }
+static void set_file_error(shared_region_t *region, size_t file_id, int error) {
+    int no_error = 0;
+
+    atomic_compare_exchange_strong(&region->file_errors[file_id], &no_error, error);
 }
 
 /**
- * @brief Wrapper function that serves to unlock a mutex and if it
- * fails, prints the error message and exits.
+ * @brief Tells whether the run was stopped by an error.
  * 
- * @param thread_id 
- * @param mutex 
  */
-static void unlock_or_die(int thread_id, pthread_mutex_t *mutex) {
-    if (pthread_mutex_unlock(mutex) != 0) {
-        threads_status[thread_id] = errno;
-        fprintf(stderr, "Error locking mutex for thread %d: %s\n", thread_id, strerror(errno));
-        exit(1);
-    }
+static bool region_failed(shared_region_t *region) {
+    return atomic_load_explicit(&region->error, memory_order_relaxed) != 0;
 }
 
 /**
@@ -126,31 +447,606 @@ static void reset_results(measurements *_results, size_t n_results) {
 }
 
 /**
- * @brief Prints the initialization error and exits
+ * @brief Allocates memory that starts at a cache line and takes whole cache lines.
+ * 
+ */
+static void *cache_aligned_alloc(size_t size) {
+    size_t aligned_size = (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+    return aligned_alloc(CACHE_LINE_SIZE, aligned_size == 0 ? CACHE_LINE_SIZE : aligned_size);
+}
+
+/**
+ * @brief Orders summaries by file and then by offset.
+ * 
+ */
+static int compare_chunks(const void *a, const void *b) {
+    const chunk_result *chunk_a = a;
+    const chunk_result *chunk_b = b;
+
+    if (chunk_a->file_id != chunk_b->file_id) return chunk_a->file_id < chunk_b->file_id ? -1 : 1;
+    if (chunk_a->offset != chunk_b->offset) return chunk_a->offset < chunk_b->offset ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Gets the current time in nanoseconds.
+ * 
+ */
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Grows or shrinks the chunk size of a file so processing a portion gets closer
+ * to the target latency, at most doubling or halving it at a time. If getting the portion
+ * took longer than an eighth of processing it, the threads are fighting over the data
+ * and the chunk size is doubled instead.
+ * 
+ */
+static void adapt_chunk_size(shared_region_t *region, size_t file_id, size_t data_size, uint64_t process_ns, uint64_t wait_ns) {
+    size_t chunk_size = atomic_load_explicit(&region->chunk_sizes[file_id], memory_order_relaxed);
+    double scale = (double) region->target_chunk_latency_ns / (process_ns == 0 ? 1 : process_ns);
+
+    // The last portion of a file is usually cut short and says little about the others.
+    if (data_size < chunk_size) return;
+
+    if (scale > 2.0 || wait_ns * 8 > process_ns) scale = 2.0;
+    if (scale < 0.5) scale = 0.5;
+
+    chunk_size = (size_t) (chunk_size * scale);
+    if (chunk_size < CHUNK_SIZE_MIN) chunk_size = CHUNK_SIZE_MIN;
+    if (chunk_size > region->max_chunk_size) chunk_size = region->max_chunk_size;
+
+    atomic_store_explicit(&region->chunk_sizes[file_id], chunk_size, memory_order_relaxed);
+}
+
+/**
+ * @brief Frees what was set up of a region that couldn't be set up in full, keeping errno.
  * 
+ * @return shared_region_t* Always NULL, to be returned in place of the region.
  */
-static void print_error_and_exit() {
-    fprintf(stderr, "Error while initializing: %s\n", strerror(errno));
-    exit(1);
+static shared_region_t *discard_region(shared_region_t *region) {
+    int error = errno;
+
+    cleanup(region);
+    errno = error;
+    return NULL;
 }
 
 /**
- * @brief Switch to the next file if it's valid otherwise skip and repeat
- * until a valid one is found or all files are processed.
+ * @brief Merges the sketches of the threads into one for each file, freeing them, and creates
+ * the empty sketch of all files. The words cut between portions are added to them later.
  * 
+ * @return true on success and false if memory couldn't be allocated, with errno set.
  */
-static void swap_file() {
-    circular_buffer_t *new_cb_reader = NULL;
+static bool merge_sketches(shared_region_t *region) {
+    if ((region->file_sketches = calloc(region->n_files, sizeof(hll_sketch_t *))) == NULL) return false;
+    if ((region->all_sketch = h_l_create()) == NULL) return false;
+
+    for (size_t file_id = 0; file_id < region->n_files; file_id++) {
+        if ((region->file_sketches[file_id] = h_l_create()) == NULL) return false;
 
-    // While we don't reach the end of file names and we find a valid non empty file
-    // keep swaping files.
-    n_files_processed++;
-    while (n_files_processed < n_files) {
-        new_cb_reader = c_b_swap_file(cb_file_reader, file_names[n_files_processed]);
+        for (size_t thread_idx = 0; thread_idx < region->n_threads; thread_idx++) {
+            hll_sketch_t **sketches = region->threads_accumulators[thread_idx].sketches;
 
-        if (new_cb_reader != NULL && c_b_size(new_cb_reader) != 0) break; 
-        n_files_processed++;
+            if (sketches == NULL || sketches[file_id] == NULL) continue;
+
+            h_l_merge(region->file_sketches[file_id], sketches[file_id]);
+            h_l_destroy(sketches[file_id]);
+            sketches[file_id] = NULL;
+        }
     }
+
+    return true;
+}
+
+/**
+ * @brief Adds the matches of the patterns counted in a file to the ones of the file and sets them back to 0.
+ * 
+ * @param visits The visits of a sink to the states of the patterns with matches.
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool add_pattern_counts(shared_region_t *region, uint64_t *visits, const int file_id) {
+    uint64_t **file_counts = &region->file_pattern_counts[file_id];
+
+    // The counts of a file are only allocated once something matched in it.
+    for (size_t i = 0; i < region->patterns->n_match_states; i++) {
+        if (visits[i] == 0) continue;
+        if (*file_counts == NULL && (*file_counts = calloc(region->patterns->n_patterns, sizeof(uint64_t))) == NULL) {
+            return false;
+        }
+
+        a_c_add_matches(region->patterns, visits, *file_counts);
+        return true;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Tells whether a file name stands for the standard input.
+ * 
+ */
+static bool is_stdin(const char *file_name) {
+    return strcmp(file_name, STDIN_FILE_NAME) == 0;
+}
+
+/**
+ * @brief Tells whether all of a file was known before the run, in which case it isn't opened.
+ * 
+ */
+static bool is_known(shared_region_t *region, size_t file_id) {
+    return region->resumes != NULL && region->resumes[file_id].complete;
+}
+
+/**
+ * @brief Gets the offset a file is read from, after what was known of it before the run.
+ * 
+ */
+static size_t resume_offset(shared_region_t *region, size_t file_id) {
+    return region->resumes != NULL ? region->resumes[file_id].offset : 0;
+}
+
+/**
+ * @brief Orders files from largest to smallest and then by their position in the arguments.
+ * The sizes of the files come in sizes_arg.
+ * 
+ */
+static int compare_file_sizes(const void *a, const void *b, void *sizes_arg) {
+    const off_t *sizes = sizes_arg;
+    const size_t file_a = *(const size_t *) a;
+    const size_t file_b = *(const size_t *) b;
+
+    if (sizes[file_a] != sizes[file_b]) return sizes[file_a] > sizes[file_b] ? -1 : 1;
+    if (file_a != file_b) return file_a < file_b ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Puts the inputs in the order they will be handed out, largest first.
+ * 
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool order_files(shared_region_t *region, off_t *sizes) {
+    if ((region->file_order = malloc(sizeof(size_t) * region->n_files)) == NULL) return false;
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        region->file_order[i] = i;
+    }
+
+    qsort_r(region->file_order, region->n_files, sizeof(size_t), compare_file_sizes, sizes);
+    return true;
+}
+
+/**
+ * @brief Tells the format of a file from its first bytes. Files that can't be read are taken
+ * as not compressed, their error is reported when they are opened.
+ * 
+ */
+static compression_format detect_file_format(const char *file_name) {
+    unsigned char magic[COMPRESSION_MAGIC_SIZE];
+    ssize_t bytes_read;
+    int fd;
+
+    if ((fd = open(file_name, O_RDONLY)) == -1) return COMPRESSION_NONE;
+
+    bytes_read = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+
+    return bytes_read > 0 ? detect_compression(magic, bytes_read) : COMPRESSION_NONE;
+}
+
+/**
+ * @brief Puts the files in the order they will be handed out, largest first. Files that
+ * can't be stat'ed go last and their error is reported when they are opened. A pipe on the
+ * standard input has no size and goes first, since it might be the largest of them all.
+ * The format of each file is found along the way.
+ * 
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool schedule_files(shared_region_t *region) {
+    struct stat file_stat;
+    off_t *sizes;
+    bool ordered;
+
+    if ((region->file_formats = malloc(sizeof(compression_format) * region->n_files)) == NULL) return false;
+    if ((sizes = malloc(sizeof(off_t) * region->n_files)) == NULL) return false;
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        region->file_formats[i] = COMPRESSION_NONE;
+
+        if (is_stdin(region->file_names[i])) {
+            bool is_file = fstat(STDIN_FILENO, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+
+            sizes[i] = is_file ? file_stat.st_size : LLONG_MAX;
+        } else {
+            sizes[i] = stat(region->file_names[i], &file_stat) == 0 ? file_stat.st_size : -1;
+            if (sizes[i] > 0 && !is_known(region, i)) region->file_formats[i] = detect_file_format(region->file_names[i]);
+        }
+    }
+
+    ordered = order_files(region, sizes);
+    free(sizes);
+    return ordered;
+}
+
+/**
+ * @brief Opens the next valid and not empty file of the schedule in a slot of the
+ * circular buffer reader. The slot is left closed if there are no files left.
+ * Must be called with the lock of the slot.
+ * 
+ */
+static void open_next_file(shared_region_t *region, cb_slot *slot) {
+    size_t position;
+
+    slot->open = false;
+
+    while (!slot->open && (position = atomic_fetch_add(&region->next_read_file, 1)) < region->n_files) {
+        char *file_name = region->file_names[region->file_order[position]];
+
+        if (is_known(region, region->file_order[position])) continue;
+
+        if (slot->reader == NULL) {
+            slot->reader = c_b_open(file_name, region->max_chunk_size * 2);
+            if (slot->reader == NULL) {
+                set_file_error(region, region->file_order[position], errno);
+                continue;
+            }
+        } else if (c_b_swap_file(slot->reader, file_name) == NULL) {
+            set_file_error(region, region->file_order[position], errno);
+            continue;
+        }
+
+        slot->open = c_b_size(slot->reader) != 0;
+        slot->file_id = region->file_order[position];
+        slot->offset = 0;
+    }
+}
+
+/**
+ * @brief Maps all of the files. Files that can't be mapped are read as empty and their error recorded.
+ * 
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool map_files(shared_region_t *region) {
+    if ((region->mapped_files = calloc(region->n_files, sizeof(mapped_file_t *))) == NULL) return false;
+    if ((region->files_data = calloc(region->n_files, sizeof(unsigned char *))) == NULL) return false;
+    if ((region->files_sizes = calloc(region->n_files, sizeof(size_t))) == NULL) return false;
+    if ((region->next_offsets = malloc(sizeof(atomic_size_t) * region->n_files)) == NULL) return false;
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        atomic_init(&region->next_offsets[i], resume_offset(region, i));
+        if (is_known(region, i)) continue;
+
+        if ((region->mapped_files[i] = m_f_open(region->file_names[i])) == NULL) {
+            set_file_error(region, i, errno);
+            continue;
+        }
+
+        region->files_data[i] = m_f_data(region->mapped_files[i]);
+        region->files_sizes[i] = m_f_size(region->mapped_files[i]);
+    }
+
+    atomic_store(&region->current_file, 0);
+    return true;
+}
+
+/**
+ * @brief Allocates the pool of buffers and starts the reader threads. READER_URING
+ * falls back to PREAD_READER_THREADS reader threads when io_uring can't be used.
+ * Compressed files are decompressed by as many reader threads as there are workers.
+ * 
+ * @return true on success and false if the pool couldn't be allocated or the threads created, with errno set.
+ */
+static bool start_readers(shared_region_t *region, size_t pool_size) {
+    prefetch_pool *pool = &region->pool;
+    size_t buffer_size = (region->max_chunk_size + PREFETCH_BUFFER_ALIGNMENT - 1) / PREFETCH_BUFFER_ALIGNMENT
+                         * PREFETCH_BUFFER_ALIGNMENT;
+    void *(*reader_procedure)(void *) = p_r_read_files;
+    void *reader;
+    int error;
+
+    pool->n_buffers = pool_size != 0 ? pool_size : region->n_threads * PREFETCH_BUFFERS_PER_THREAD;
+    if (pool_size == 0 && region->backend == READER_URING && pool->n_buffers < URING_POOL_SIZE_MIN) {
+        pool->n_buffers = URING_POOL_SIZE_MIN;
+    }
+
+    if ((pool->buffers = calloc(pool->n_buffers, sizeof(prefetch_buffer))) == NULL) return false;
+    if ((region->threads_prefetch_buffers = calloc(region->n_threads, sizeof(prefetch_buffer *))) == NULL) return false;
+    if ((pool->filled = c_q_create(pool->n_buffers)) == NULL) return false;
+    if ((pool->empty = c_q_create(pool->n_buffers)) == NULL) return false;
+    if ((region->read_offsets = malloc(sizeof(size_t) * region->n_files)) == NULL) return false;
+
+    for (size_t i = 0; i < pool->n_buffers; i++) {
+        if ((pool->buffers[i].data = aligned_alloc(PREFETCH_BUFFER_ALIGNMENT, buffer_size)) == NULL) return false;
+
+        c_q_push(pool->empty, &pool->buffers[i]);
+    }
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        region->read_offsets[i] = is_known(region, i) ? PREFETCH_SKIP : resume_offset(region, i);
+    }
+
+    pool->n_files = region->n_files;
+    pool->file_names = region->file_names;
+    pool->file_order = region->file_order;
+    pool->start_offsets = region->read_offsets;
+    pool->chunk_sizes = region->chunk_sizes;
+    pool->error = &region->error;
+    pool->file_errors = region->file_errors;
+
+    region->n_reader_threads = 1;
+    region->reader_name = "prefetch";
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        if (region->file_formats[i] != COMPRESSION_NONE) {
+            region->n_reader_threads = region->n_threads;
+            region->reader_name = "prefetch with decompression";
+        }
+    }
+
+    if (region->backend == READER_URING) {
+        if ((region->ring_reader = r_r_create(pool)) != NULL) {
+            reader_procedure = r_r_read_files;
+            region->reader_name = "io_uring";
+        } else {
+            // The fallback shows in the name of the reader.
+            region->n_reader_threads = PREAD_READER_THREADS;
+            region->reader_name = "pread threads";
+        }
+    }
+
+    if (region->ring_reader != NULL) {
+        reader = region->ring_reader;
+    } else if ((reader = region->pread_reader = p_r_create(pool, region->file_formats, region->n_reader_threads)) == NULL) {
+        return false;
+    }
+
+    if ((region->reader_threads = calloc(region->n_reader_threads, sizeof(pthread_t))) == NULL) return false;
+
+    for (size_t i = 0; i < region->n_reader_threads; i++) {
+        if ((error = pthread_create(&region->reader_threads[i], NULL, reader_procedure, reader)) != 0) {
+            // The readers already started stop at their next buffer and are joined by cleanup().
+            fail_region(region, error);
+            region->n_reader_threads = i;
+            region->readers_started = i > 0;
+            errno = error;
+            return false;
+        }
+    }
+
+    region->readers_started = true;
+    return true;
+}
+
+/**
+ * @brief Claims the next portion of the mapped files. Portions are ranges of bytes of
+ * the chunk size of the file, so there is nothing to synchronize besides the counters.
+ * 
+ * @return true if a portion of data was found and false if all the files were handed out.
+ */
+static bool get_mapped_data_portion(
+    shared_region_t *region, int *file_id_out, size_t *offset_out, const unsigned char **data_out, size_t *data_size_out
+) {
+    size_t position;
+
+    while ((position = atomic_load_explicit(&region->current_file, memory_order_relaxed)) < region->n_files) {
+        size_t file_id = region->file_order[position];
+        size_t file_size = region->files_sizes[file_id];
+        size_t chunk_size = atomic_load_explicit(&region->chunk_sizes[file_id], memory_order_relaxed);
+        size_t start = atomic_fetch_add_explicit(&region->next_offsets[file_id], chunk_size, memory_order_relaxed);
+
+        // The whole file was handed out, move to the next one unless another thread already did.
+        if (start >= file_size) {
+            atomic_compare_exchange_strong(&region->current_file, &position, position + 1);
+            continue;
+        }
+
+        *file_id_out = file_id;
+        *offset_out = start;
+        *data_out = region->files_data[file_id] + start;
+        *data_size_out = file_size - start < chunk_size ? file_size - start : chunk_size;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Gives back the buffer the thread was processing and takes the next filled one.
+ * 
+ * @return true if a portion of data was found and false if all the files were read.
+ */
+static bool get_prefetched_data_portion(
+    shared_region_t *region, const int thread_id, int *file_id_out, size_t *offset_out,
+    const unsigned char **data_out, size_t *data_size_out
+) {
+    prefetch_buffer *buffer = region->threads_prefetch_buffers[thread_id];
+    void *item;
+
+    if (buffer != NULL) c_q_push(region->pool.empty, buffer);
+    region->threads_prefetch_buffers[thread_id] = NULL;
+
+    if (region_failed(region)) return false;
+
+    INSTRUMENT_START(pop_start_ns);
+    bool found = c_q_pop(region->pool.filled, &item);
+    INSTRUMENT_STOP(TIMER_QUEUE_WAIT, pop_start_ns);
+
+    if (!found) return false;
+
+    buffer = region->threads_prefetch_buffers[thread_id] = item;
+    *file_id_out = buffer->file_id;
+    *offset_out = buffer->offset;
+    *data_out = buffer->data;
+    *data_size_out = buffer->size;
+    return true;
+}
+
+/**
+ * @brief Gets a portion of data from the circular buffer of a slot into the thread's buffer.
+ * Must be called with the lock of the slot, which must have a file open.
+ * 
+ */
+static void get_buffered_data_portion(
+    shared_region_t *region, const int thread_id, cb_slot *slot, int *file_id_out, size_t *offset_out,
+    const unsigned char **data_out, size_t *data_size_out
+) {
+    unsigned char *thread_buffer = region->threads_buffers[thread_id];
+    circular_buffer_t *reader = slot->reader;
+
+    *data_out = thread_buffer;
+    *file_id_out = slot->file_id;
+    *offset_out = slot->offset;
+
+    // If the buffer isn't full, read everything in it and
+    // swap to the next valid file.
+    if (c_b_size(reader) != c_b_capacity(reader)) {
+        *data_size_out = c_b_read_all(reader, thread_buffer);
+        open_next_file(region, slot);
+        return;
+    }
+
+    // Try read a chunk with at least a minimum size and ending at a space character.
+    size_t chunk_size = atomic_load_explicit(&region->chunk_sizes[slot->file_id], memory_order_relaxed);
+
+    *data_size_out = c_b_read_chunk_until_delim(reader, chunk_size, ' ', thread_buffer);
+    slot->offset += *data_size_out;
+
+    // Fill the reader with more data.
+    INSTRUMENT_START(fill_start_ns);
+    c_b_fill(reader);
+    INSTRUMENT_STOP(TIMER_FILL, fill_start_ns);
+
+    // If the reader is empty, swap to the next valid file
+    if (c_b_size(reader) == 0) open_next_file(region, slot);
+}
+
+/**
+ * @brief Looks for data in the open files of the circular buffer reader, starting at a
+ * different slot each time. A closed slot opens the next file of the schedule.
+ * 
+ * @return true if a portion of data was found and false if all the files were read.
+ */
+static bool get_slot_data_portion(
+    shared_region_t *region, const int thread_id, int *file_id_out, size_t *offset_out,
+    const unsigned char **data_out, size_t *data_size_out
+) {
+    size_t first_slot = atomic_fetch_add_explicit(&region->next_cb_slot, 1, memory_order_relaxed);
+
+    for (size_t i = 0; i < region->n_cb_slots; i++) {
+        cb_slot *slot = &region->cb_slots[(first_slot + i) % region->n_cb_slots];
+        bool found;
+
+        lock_or_die(&slot->lock);
+
+        if (!slot->open) open_next_file(region, slot);
+        if ((found = slot->open)) {
+            get_buffered_data_portion(region, thread_id, slot, file_id_out, offset_out, data_out, data_size_out);
+        }
+
+        unlock_or_die(&slot->lock);
+
+        if (found) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Allocates the state of a run over n_files inputs that is common to all the readers.
+ * 
+ * @return shared_region_t* The region or NULL if memory couldn't be allocated, with errno set.
+ */
+static shared_region_t *create_region(
+    const size_t n_files, const size_t n_threads, const size_t chunk_size,
+    const size_t target_chunk_latency_us, const bool word_histogram, const bool distinct_words,
+    const size_t top_counters, const ac_automaton_t *patterns
+) {
+    shared_region_t *region;
+
+    if ((region = calloc(1, sizeof(shared_region_t))) == NULL) return NULL;
+
+    region->start_ns = now_ns();
+    atomic_init(&region->error, 0);
+    region->word_histogram = word_histogram;
+    region->distinct_words = distinct_words;
+    region->top_counters = top_counters;
+    region->patterns = patterns;
+
+    region->n_threads = n_threads;
+    region->n_files = n_files;
+
+    region->target_chunk_latency_ns = (uint64_t) target_chunk_latency_us * 1000;
+    region->max_chunk_size = chunk_size;
+
+    if (region->target_chunk_latency_ns != 0 && region->max_chunk_size < ADAPTIVE_CHUNK_SIZE_MAX) {
+        region->max_chunk_size = ADAPTIVE_CHUNK_SIZE_MAX;
+    }
+
+    if ((region->chunk_sizes = malloc(sizeof(atomic_size_t) * region->n_files)) == NULL) return discard_region(region);
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        atomic_init(&region->chunk_sizes[i], chunk_size);
+    }
+
+    if ((region->threads_status = malloc(sizeof(int) * region->n_threads)) == NULL) return discard_region(region);
+
+    reset_threads_status(region->threads_status, region->n_threads);
+
+    if ((region->file_errors = malloc(sizeof(atomic_int) * region->n_files)) == NULL) return discard_region(region);
+
+    for (size_t i = 0; i < region->n_files; i++) {
+        atomic_init(&region->file_errors[i], 0);
+    }
+
+    if ((region->results = malloc(sizeof(measurements) * region->n_files)) == NULL) return discard_region(region);
+
+    reset_results(region->results, region->n_files);
+
+    if ((region->file_timings = calloc(region->n_files, sizeof(file_timing))) == NULL) return discard_region(region);
+    if ((region->file_summaries = malloc(sizeof(chunk_summary) * region->n_files)) == NULL) return discard_region(region);
+    if ((region->file_bytes = calloc(region->n_files, sizeof(size_t))) == NULL) return discard_region(region);
+
+    if ((region->threads_accumulators = cache_aligned_alloc(sizeof(thread_accumulator) * region->n_threads)) == NULL) {
+        return discard_region(region);
+    }
+
+    for (size_t i = 0; i < region->n_threads; i++) {
+        region->threads_accumulators[i].chunks = NULL;
+        region->threads_accumulators[i].n_chunks = 0;
+        region->threads_accumulators[i].capacity = 0;
+        region->threads_accumulators[i].n_submissions = 0;
+        region->threads_accumulators[i].handed_out_ns = 0;
+        region->threads_accumulators[i].wait_ns = 0;
+        region->threads_accumulators[i].sketches = NULL;
+        region->threads_accumulators[i].pattern_file = -1;
+        init_word_sink(&region->threads_accumulators[i].words, NULL, NULL, NULL);
+    }
+
+    if (region->word_histogram && (region->edge_words = w_t_create()) == NULL) return discard_region(region);
+    if (region->top_counters != 0 && (region->edge_top = s_s_create(region->top_counters)) == NULL) return discard_region(region);
+    init_word_sink(&region->edge_sink, region->edge_words, NULL, region->edge_top);
+
+    if ((errno = pthread_mutex_init(&region->patterns_lock, NULL)) != 0) return discard_region(region);
+    region->patterns_lock_ready = true;
+
+    if (region->patterns != NULL) {
+        region->edge_sink.patterns = region->patterns;
+
+        // One more visit than the states, so there is something to allocate when nothing can match.
+        if ((region->edge_sink.match_visits = calloc(region->patterns->n_match_states + 1, sizeof(uint64_t))) == NULL) {
+            return discard_region(region);
+        }
+
+        if ((region->file_pattern_counts = calloc(region->n_files, sizeof(uint64_t *))) == NULL) return discard_region(region);
+    }
+
+    return region;
 }
 
 //
@@ -160,100 +1056,704 @@ static void swap_file() {
 //
 
 
-void initialize(const size_t _n_files, char **_file_names, const size_t _n_threads) {
-    n_threads = _n_threads;
-    n_files = _n_files;
-    file_names = _file_names;
+shared_region_t *initialize(
+    const size_t n_files, char **file_names,
+    const size_t n_threads, const reader_backend backend,
+    const size_t chunk_size, const size_t target_chunk_latency_us,
+    const size_t pool_size, const bool word_histogram, const bool distinct_words,
+    const size_t top_counters, const ac_automaton_t *patterns, const file_resume *resumes
+) {
+    shared_region_t *region = create_region(
+        n_files, n_threads, chunk_size, target_chunk_latency_us, word_histogram, distinct_words, top_counters, patterns
+    );
+
+    if (region == NULL) return NULL;
+
+    region->file_names = file_names;
+    region->backend = backend;
+
+    if (resumes != NULL) {
+        if ((region->resumes = malloc(sizeof(file_resume) * region->n_files)) == NULL) return discard_region(region);
+        memcpy(region->resumes, resumes, sizeof(file_resume) * region->n_files);
+    }
+
+    if (!schedule_files(region)) return discard_region(region);
+
+    // Only the prefetch reader can read the standard input, which has neither a size nor offsets,
+    // and compressed files, whose data only exists once a reader thread decompressed it.
+    // The switch shows in the name of the reader.
+    for (size_t i = 0; i < region->n_files && region->backend != READER_PREFETCH; i++) {
+        if (is_stdin(region->file_names[i]) || region->file_formats[i] != COMPRESSION_NONE) {
+            region->backend = READER_PREFETCH;
+        }
+    }
+
+    // The circular buffer reader can only read files from the start, and the offsets of
+    // compressed files are in their decompressed data, so they are counted in full instead.
+    for (size_t i = 0; i < region->n_files && region->resumes != NULL; i++) {
+        file_resume *resume = &region->resumes[i];
+
+        if (!resume->complete && (region->backend == READER_CIRCULAR_BUFFER || region->file_formats[i] != COMPRESSION_NONE)) {
+            resume->offset = 0;
+        }
+    }
+
+    if (region->backend == READER_MMAP) {
+        region->reader_name = "mmap";
+        return map_files(region) ? region : discard_region(region);
+    }
+
+    if (region->backend == READER_PREFETCH || region->backend == READER_URING) {
+        return start_readers(region, pool_size) ? region : discard_region(region);
+    }
+
+    region->reader_name = "circular buffer";
+
+    // The buffers themselves are allocated by their threads in initialize_thread().
+    if ((region->threads_buffers = calloc(region->n_threads, sizeof(unsigned char *))) == NULL) return discard_region(region);
+
+    // More open files than threads wouldn't be read any faster.
+    size_t n_cb_slots = CB_OPEN_FILES < region->n_threads ? CB_OPEN_FILES : region->n_threads;
+    if (n_cb_slots > region->n_files) n_cb_slots = region->n_files;
+
+    if ((region->cb_slots = calloc(n_cb_slots, sizeof(cb_slot))) == NULL) return discard_region(region);
+
+    // Only the slots whose lock was initialized are counted, so cleanup() destroys just those.
+    for (; region->n_cb_slots < n_cb_slots; region->n_cb_slots++) {
+        if ((errno = pthread_mutex_init(&region->cb_slots[region->n_cb_slots].lock, NULL)) != 0) return discard_region(region);
+    }
+
+    atomic_store(&region->next_read_file, 0);
+    atomic_store(&region->next_cb_slot, 0);
+
+    return region;
+}
+
+
+shared_region_t *initialize_buffers(
+    const size_t n_buffers, const unsigned char **buffers, const size_t *sizes,
+    const size_t n_threads, const size_t chunk_size, const size_t target_chunk_latency_us,
+    const bool word_histogram, const bool distinct_words, const size_t top_counters,
+    const ac_automaton_t *patterns
+) {
+    shared_region_t *region = create_region(
+        n_buffers, n_threads, chunk_size, target_chunk_latency_us, word_histogram, distinct_words, top_counters, patterns
+    );
+    off_t *order_sizes;
+    bool ordered;
+
+    if (region == NULL) return NULL;
+
+    region->backend = READER_MMAP;
+    region->reader_name = "memory";
+
+    if ((region->files_data = malloc(sizeof(unsigned char *) * n_buffers)) == NULL) return discard_region(region);
+    if ((region->files_sizes = malloc(sizeof(size_t) * n_buffers)) == NULL) return discard_region(region);
+    if ((region->next_offsets = malloc(sizeof(atomic_size_t) * n_buffers)) == NULL) return discard_region(region);
+    if ((order_sizes = malloc(sizeof(off_t) * n_buffers)) == NULL) return discard_region(region);
+
+    for (size_t i = 0; i < n_buffers; i++) {
+        region->files_data[i] = buffers[i];
+        region->files_sizes[i] = buffers[i] != NULL ? sizes[i] : 0;
+        order_sizes[i] = region->files_sizes[i];
+        atomic_init(&region->next_offsets[i], 0);
+    }
+
+    ordered = order_files(region, order_sizes);
+    free(order_sizes);
+    if (!ordered) return discard_region(region);
+
+    atomic_store(&region->current_file, 0);
+    return region;
+}
+
+
+bool initialize_thread(shared_region_t *region, const int thread_id) {
+    thread_accumulator *accumulator = &region->threads_accumulators[thread_id];
 
-    if ((threads_status = malloc(sizeof(int) * n_threads)) == NULL) print_error_and_exit();
+    if (region->threads_buffers != NULL && (region->threads_buffers[thread_id] = malloc(region->max_chunk_size * 2)) == NULL) {
+        goto fail;
+    }
+
+    if (region->word_histogram && (accumulator->words.table = w_t_create()) == NULL) goto fail;
+    if (region->top_counters != 0 && (accumulator->words.top = s_s_create(region->top_counters)) == NULL) goto fail;
+    if (region->distinct_words && (accumulator->sketches = calloc(region->n_files, sizeof(hll_sketch_t *))) == NULL) goto fail;
 
-    reset_threads_status(threads_status, n_threads);
+    if (region->patterns != NULL) {
+        accumulator->words.patterns = region->patterns;
+
+        if ((accumulator->words.match_visits = calloc(region->patterns->n_match_states + 1, sizeof(uint64_t))) == NULL) {
+            goto fail;
+        }
+    }
 
-    if ((results = malloc(sizeof(measurements) * n_files)) == NULL) print_error_and_exit();
+    return true;
 
-    reset_results(results, n_files);
+fail:
+    // Whatever was allocated is freed by cleanup().
+    report_thread_error(region, thread_id, errno);
+    return false;
+}
 
-    cb_file_reader = c_b_open(file_names[n_files_processed], CHUNK_MAX_SIZE);
 
-    // If the file reader is invalid then swap until a valid one is found
-    if (cb_file_reader == NULL) swap_file();
+void report_thread_error(shared_region_t *region, const int thread_id, int error) {
+    region->threads_status[thread_id] = error;
+    fail_region(region, error);
 }
 
 
 bool get_data_portion(
-    const int thread_id, int *file_id_out, 
-    unsigned char *data_out, size_t *data_size_out
+    shared_region_t *region, const int thread_id, int *file_id_out, size_t *offset_out,
+    const unsigned char **data_out, size_t *data_size_out
 ) {
-    lock_or_die(thread_id, &access_data_region);
+    thread_accumulator *accumulator = &region->threads_accumulators[thread_id];
+    uint64_t wait_start_ns = region->target_chunk_latency_ns != 0 ? now_ns() : 0;
+
+    if (region->backend == READER_MMAP) {
+        if (region_failed(region) || !get_mapped_data_portion(region, file_id_out, offset_out, data_out, data_size_out)) {
+            return false;
+        }
+
+        accumulator->handed_out_ns = now_ns();
+        return true;
+    }
 
-    // If all of the files are processed simply exit
-    if (n_files_processed == n_files) {
-        unlock_or_die(thread_id, &access_data_region);
+    if (region->backend == READER_PREFETCH || region->backend == READER_URING) {
+        if (!get_prefetched_data_portion(region, thread_id, file_id_out, offset_out, data_out, data_size_out)) {
+            return false;
+        }
+    } else if (region_failed(region) || !get_slot_data_portion(region, thread_id, file_id_out, offset_out, data_out, data_size_out)) {
         return false;
     }
 
-    // If the buffer isn't full, read everything in it and
-    // swap to the next valid file.
-    if (c_b_size(cb_file_reader) != c_b_capacity(cb_file_reader)) {
+    accumulator->handed_out_ns = now_ns();
+    if (region->target_chunk_latency_ns != 0) accumulator->wait_ns = accumulator->handed_out_ns - wait_start_ns;
 
-        *data_size_out = c_b_read_all(cb_file_reader, data_out);
-        *file_id_out = n_files_processed;
-        swap_file();
+    return true;
+}
 
-        unlock_or_die(thread_id, &access_data_region);
-        return true;
+
+void submit_results(
+    shared_region_t *region, const int thread_id, const int file_id, const size_t offset,
+    const size_t data_size, const chunk_summary *summary, word_edges *edges
+) {
+    thread_accumulator *accumulator = &region->threads_accumulators[thread_id];
+    chunk_result *last = accumulator->n_chunks > 0 ? &accumulator->chunks[accumulator->n_chunks - 1] : NULL;
+    uint64_t submitted_ns = now_ns();
+
+    accumulator->n_submissions++;
+
+    if (region->target_chunk_latency_ns != 0) {
+        adapt_chunk_size(region, file_id, data_size, submitted_ns - accumulator->handed_out_ns, accumulator->wait_ns);
     }
 
-    // Try read a chunk with at least a minimum size and ending at a space character.
-    *data_size_out = c_b_read_chunk_until_delim(cb_file_reader, CHUNK_MIN_SIZE, ' ', data_out);
-    *file_id_out = n_files_processed;
+    // The portion continues the last one of the thread, so both can be merged already.
+    if (last != NULL && last->file_id == (size_t) file_id && last->offset + last->size == offset) {
+        merge_summaries(&last->summary, summary);
+        // The sink still has the sketch of the file, which the thread just processed data of.
+        if (edges != NULL && !merge_word_edges(&accumulator->words, &last->edges, edges)) {
+            report_thread_error(region, thread_id, errno);
+        }
 
-    // Fill the reader with more data.
-    c_b_fill(cb_file_reader);
+        last->size += data_size;
+        last->end_ns = submitted_ns;
+        return;
+    }
 
-    // If the reader is empty, swap to the next valid file
-    if (c_b_size(cb_file_reader) == 0) swap_file();
+    if (accumulator->n_chunks == accumulator->capacity) {
+        size_t capacity = accumulator->capacity == 0 ? 64 : accumulator->capacity * 2;
+        chunk_result *chunks = realloc(accumulator->chunks, sizeof(chunk_result) * capacity);
+
+        if (chunks == NULL) {
+            report_thread_error(region, thread_id, errno);
+            if (edges != NULL) free_word_edges(edges);
+            return;
+        }
+
+        accumulator->chunks = chunks;
+        accumulator->capacity = capacity;
+    }
+
+    accumulator->chunks[accumulator->n_chunks++] = (chunk_result) {
+        .file_id = file_id,
+        .offset = offset,
+        .size = data_size,
+        .start_ns = accumulator->handed_out_ns,
+        .end_ns = submitted_ns,
+        .summary = *summary,
+        .edges = edges != NULL ? *edges : (word_edges) {0}
+    };
+}
+
+
+void get_final_results(
+    shared_region_t *region, bool *sucess_out, int **threads_status_out,
+    measurements **results_out, size_t *locks_avoided_out
+) {
+    size_t locks_avoided = 0;
+    size_t n_chunks = 0;
+    chunk_result *chunks;
+    bool counts_words = region->word_histogram || region->distinct_words || region->top_counters != 0 ||
+                        region->patterns != NULL;
+
+    for (size_t thread_idx = 0; thread_idx < region->n_threads; thread_idx++) {
+        n_chunks += region->threads_accumulators[thread_idx].n_chunks;
+        locks_avoided += region->threads_accumulators[thread_idx].n_submissions;
+    }
+
+    *threads_status_out = region->threads_status;
+    *results_out = region->results;
+    *locks_avoided_out = locks_avoided;
+
+    // The summaries of a run that was stopped are incomplete, and are freed by cleanup().
+    if (region_failed(region) || (chunks = malloc(sizeof(chunk_result) * (n_chunks + 1))) == NULL) {
+        if (!region_failed(region)) fail_region(region, errno);
+
+        errno = region->error;
+        *sucess_out = false;
+        return;
+    }
+
+    // Gather the summaries of all threads and put them in file order.
+    n_chunks = 0;
+    for (size_t thread_idx = 0; thread_idx < region->n_threads; thread_idx++) {
+        thread_accumulator *accumulator = &region->threads_accumulators[thread_idx];
+
+        // Threads that got no data, e.g. because the cache answered their files, have no chunks at all.
+        if (accumulator->n_chunks > 0) memcpy(chunks + n_chunks, accumulator->chunks, sizeof(chunk_result) * accumulator->n_chunks);
+        n_chunks += accumulator->n_chunks;
+
+        // The edges are counted and freed by the merge, so they are only taken once.
+        for (size_t i = 0; i < accumulator->n_chunks; i++) {
+            empty_word_edges(&accumulator->chunks[i].edges);
+        }
+    }
+
+    qsort(chunks, n_chunks, sizeof(chunk_result), compare_chunks);
+
+    if (region->distinct_words && !merge_sketches(region)) fail_region(region, errno);
+
+    for (size_t thread_idx = 0; thread_idx < region->n_threads && region->patterns != NULL; thread_idx++) {
+        thread_accumulator *accumulator = &region->threads_accumulators[thread_idx];
+
+        if (accumulator->pattern_file != -1 && !add_pattern_counts(region, accumulator->words.match_visits, accumulator->pattern_file)) {
+            fail_region(region, errno);
+        }
+        accumulator->pattern_file = -1;
+    }
+
+    // Merge the summaries of each file in order, after what was known of it.
+    for (size_t file_id = 0; file_id < region->n_files; file_id++) {
+        file_resume *resume = region->resumes != NULL ? &region->resumes[file_id] : NULL;
 
-    unlock_or_die(thread_id, &access_data_region);
+        if (resume != NULL && (resume->complete || resume->offset != 0)) {
+            region->file_summaries[file_id] = resume->summary;
+            region->file_bytes[file_id] = resume->offset;
+        } else {
+            empty_summary(&region->file_summaries[file_id]);
+            region->file_bytes[file_id] = 0;
+        }
+    }
+
+    for (size_t chunk_idx = 0; chunk_idx < n_chunks;) {
+        const size_t file_id = chunks[chunk_idx].file_id;
+        file_timing *timing = &region->file_timings[file_id];
+        chunk_summary *file_summary = &region->file_summaries[file_id];
+        word_edges file_edges;
+
+        empty_word_edges(&file_edges);
+        if (region->distinct_words && !region_failed(region)) region->edge_sink.sketch = region->file_sketches[file_id];
+        timing->processed = true;
+        timing->start_ns = chunks[chunk_idx].start_ns;
+        timing->end_ns = chunks[chunk_idx].end_ns;
+
+        for (; chunk_idx < n_chunks && chunks[chunk_idx].file_id == file_id; chunk_idx++) {
+            merge_summaries(file_summary, &chunks[chunk_idx].summary);
+            region->file_bytes[file_id] += chunks[chunk_idx].size;
+
+            // Once the merge failed, the edges left are only freed.
+            if (region_failed(region)) {
+                free_word_edges(&chunks[chunk_idx].edges);
+            } else if (counts_words && !merge_word_edges(&region->edge_sink, &file_edges, &chunks[chunk_idx].edges)) {
+                fail_region(region, errno);
+            }
+
+            if (chunks[chunk_idx].start_ns < timing->start_ns) timing->start_ns = chunks[chunk_idx].start_ns;
+            if (chunks[chunk_idx].end_ns > timing->end_ns) timing->end_ns = chunks[chunk_idx].end_ns;
+        }
+
+        timing->start_ns -= region->start_ns;
+        timing->end_ns -= region->start_ns;
+
+        if (region_failed(region)) {
+            free_word_edges(&file_edges);
+            continue;
+        }
+
+        if (counts_words && !finish_word_edges(&region->edge_sink, &file_edges)) fail_region(region, errno);
+        if (region->patterns != NULL && !add_pattern_counts(region, region->edge_sink.match_visits, file_id)) {
+            fail_region(region, errno);
+        }
+    }
+
+    if (region->distinct_words && !region_failed(region)) {
+        for (size_t file_id = 0; file_id < region->n_files; file_id++) {
+            h_l_merge(region->all_sketch, region->file_sketches[file_id]);
+        }
+    }
+
+    reset_results(region->results, region->n_files);
+    for (size_t file_id = 0; file_id < region->n_files; file_id++) {
+        summary_results(&region->file_summaries[file_id], &region->results[file_id]);
+    }
+
+    free(chunks);
+
+    if (region_failed(region)) errno = region->error;
+    *sucess_out = !region_failed(region);
+}
+
+int get_file_error(shared_region_t *region, const size_t file_id) {
+    return atomic_load(&region->file_errors[file_id]);
+}
+
+bool get_prefetch_stats(shared_region_t *region, size_t *pool_size_out, chunk_queue_stats *filled_out, chunk_queue_stats *empty_out) {
+    if (!region->readers_started) return false;
+
+    *pool_size_out = region->pool.n_buffers;
+    c_q_stats(region->pool.filled, filled_out);
+    c_q_stats(region->pool.empty, empty_out);
     return true;
 }
 
+word_sink *get_thread_words(shared_region_t *region, const int thread_id, const int file_id) {
+    thread_accumulator *accumulator = &region->threads_accumulators[thread_id];
+
+    if (!region->word_histogram && !region->distinct_words && region->top_counters == 0 && region->patterns == NULL) {
+        return NULL;
+    }
+
+    if (region->distinct_words) {
+        if (accumulator->sketches[file_id] == NULL && (accumulator->sketches[file_id] = h_l_create()) == NULL) {
+            report_thread_error(region, thread_id, errno);
+            return NULL;
+        }
 
-void submit_results(const int thread_id, const int file_id, const measurements *data_results) {
-    lock_or_die(thread_id, &access_results_region);
+        accumulator->words.sketch = accumulator->sketches[file_id];
+    }
+
+    // The matches are only handed over when the thread moves on, which is seldom, so the lock is rarely taken.
+    if (region->patterns != NULL && accumulator->pattern_file != file_id) {
+        if (accumulator->pattern_file != -1) {
+            bool added;
+
+            lock_or_die(&region->patterns_lock);
+            added = add_pattern_counts(region, accumulator->words.match_visits, accumulator->pattern_file);
+            unlock_or_die(&region->patterns_lock);
+
+            if (!added) {
+                report_thread_error(region, thread_id, errno);
+                return NULL;
+            }
+        }
 
-    results[file_id].n_words += data_results->n_words;
-    results[file_id].n_words_end_cons += data_results->n_words_end_cons;
-    results[file_id].n_words_start_vowel += data_results->n_words_start_vowel;
+        accumulator->pattern_file = file_id;
+    }
 
-    unlock_or_die(thread_id, &access_results_region);
+    return &accumulator->words;
 }
 
+bool get_word_histogram(shared_region_t *region, word_table_t ***shards_out, size_t *n_shards_out) {
+    if (!region->word_histogram) return false;
+
+    if (region->word_shards == NULL) {
+        word_table_t *tables[region->n_threads + 1];
 
-void get_final_results(bool *sucess_out, int **threads_status_out, measurements **results_out) {
-    *sucess_out = success;
-    *threads_status_out = threads_status;
-    *results_out = results;
+        for (size_t i = 0; i < region->n_threads; i++) {
+            tables[i] = region->threads_accumulators[i].words.table;
+        }
+        tables[region->n_threads] = region->edge_words;
+
+        if ((region->word_shards = w_t_merge_sharded(tables, region->n_threads + 1, region->n_threads)) == NULL) return false;
+        region->n_word_shards = region->n_threads;
+    }
+
+    *shards_out = region->word_shards;
+    *n_shards_out = region->n_word_shards;
+    return true;
+}
+
+bool get_distinct_words(shared_region_t *region, hll_sketch_t ***file_sketches_out, hll_sketch_t **all_sketch_out) {
+    if (!region->distinct_words) return false;
+
+    *file_sketches_out = region->file_sketches;
+    *all_sketch_out = region->all_sketch;
+    return true;
 }
 
-void cleanup() {
-    success = true;
-    n_threads = 0;
-    n_files = 0;
-    n_files_processed = 0;
-    file_names = NULL;
+bool get_top_words(shared_region_t *region, space_saving_t **top_out) {
+    if (region->top_counters == 0) return false;
+
+    if (region->top_words == NULL) {
+        space_saving_t *top_words;
+        bool merged;
+
+        if ((top_words = s_s_create(region->top_counters)) == NULL) return false;
+
+        merged = true;
+        for (size_t i = 0; i < region->n_threads && merged; i++) {
+            space_saving_t *thread_top = region->threads_accumulators[i].words.top;
+
+            if (thread_top != NULL) merged = s_s_merge(top_words, thread_top);
+        }
+
+        merged = merged && s_s_merge(top_words, region->edge_top);
+
+        if (!merged) {
+            int error = errno;
+
+            s_s_destroy(top_words);
+            errno = error;
+            return false;
+        }
+
+        region->top_words = top_words;
+    }
+
+    *top_out = region->top_words;
+    return true;
+}
+
+file_timing *get_file_timings(shared_region_t *region) {
+    return region->file_timings;
+}
+
+const chunk_summary *get_file_summary(shared_region_t *region, const size_t file_id, size_t *size_out) {
+    *size_out = region->file_bytes[file_id];
+    return &region->file_summaries[file_id];
+}
+
+bool get_pattern_counts(shared_region_t *region, uint64_t ***file_counts_out) {
+    if (region->patterns == NULL) return false;
+
+    *file_counts_out = region->file_pattern_counts;
+    return true;
+}
+
+const char *get_reader_name(shared_region_t *region) {
+    return region->reader_name;
+}
+
+void cleanup(shared_region_t *region) {
+    // Readers of a run that was stopped may be waiting for buffers the workers won't give back.
+    if (region->pool.empty != NULL) c_q_close(region->pool.empty);
+
+    if (region->readers_started) {
+        for (size_t i = 0; i < region->n_reader_threads; i++) {
+            pthread_join(region->reader_threads[i], NULL);
+        }
+
+        region->readers_started = false;
+    }
+
+    if (region->reader_threads != NULL) {
+        free(region->reader_threads);
+        region->reader_threads = NULL;
+        region->n_reader_threads = 0;
+    }
+
+    if (region->pread_reader != NULL) {
+        p_r_destroy(region->pread_reader);
+        region->pread_reader = NULL;
+    }
+
+    if (region->ring_reader != NULL) {
+        r_r_destroy(region->ring_reader);
+        region->ring_reader = NULL;
+    }
+
+    if (region->pool.buffers != NULL) {
+        for (size_t i = 0; i < region->pool.n_buffers; i++) {
+            free(region->pool.buffers[i].data);
+        }
+
+        free(region->pool.buffers);
+        region->pool.buffers = NULL;
+        region->pool.n_buffers = 0;
+    }
+
+    if (region->pool.filled != NULL) {
+        c_q_destroy(region->pool.filled);
+        region->pool.filled = NULL;
+    }
+
+    if (region->pool.empty != NULL) {
+        c_q_destroy(region->pool.empty);
+        region->pool.empty = NULL;
+    }
+
+    if (region->read_offsets != NULL) {
+        free(region->read_offsets);
+        region->read_offsets = NULL;
+    }
 
-    if (cb_file_reader != NULL) {
-        c_b_close(cb_file_reader);
-        cb_file_reader = NULL;
+    if (region->threads_prefetch_buffers != NULL) {
+        free(region->threads_prefetch_buffers);
+        region->threads_prefetch_buffers = NULL;
     }
 
-    if (threads_status != NULL) {
-        free(threads_status);
-        threads_status = NULL;
+    if (region->mapped_files != NULL) {
+        for (size_t i = 0; i < region->n_files; i++) {
+            if (region->mapped_files[i] != NULL) m_f_close(region->mapped_files[i]);
+        }
+
+        free(region->mapped_files);
+        region->mapped_files = NULL;
+    }
+
+    if (region->next_offsets != NULL) {
+        free(region->next_offsets);
+        region->next_offsets = NULL;
+    }
+
+    if (region->chunk_sizes != NULL) {
+        free(region->chunk_sizes);
+        region->chunk_sizes = NULL;
+    }
+
+    // The shards point to the words of the tables of the threads, so they go first.
+    if (region->word_shards != NULL) {
+        for (size_t i = 0; i < region->n_word_shards; i++) {
+            w_t_destroy(region->word_shards[i]);
+        }
+
+        free(region->word_shards);
+        region->word_shards = NULL;
+        region->n_word_shards = 0;
     }
 
-    if (results != NULL) {
-        free(results);
+    if (region->edge_words != NULL) {
+        w_t_destroy(region->edge_words);
+        region->edge_words = NULL;
+    }
+
+    free_word_sink(&region->edge_sink);
+
+    if (region->edge_top != NULL) {
+        s_s_destroy(region->edge_top);
+        region->edge_top = NULL;
+    }
+
+    if (region->top_words != NULL) {
+        s_s_destroy(region->top_words);
+        region->top_words = NULL;
+    }
+
+    if (region->file_sketches != NULL) {
+        for (size_t i = 0; i < region->n_files; i++) {
+            h_l_destroy(region->file_sketches[i]);
+        }
+
+        free(region->file_sketches);
+        region->file_sketches = NULL;
     }
+
+    if (region->all_sketch != NULL) {
+        h_l_destroy(region->all_sketch);
+        region->all_sketch = NULL;
+    }
+
+    if (region->file_pattern_counts != NULL) {
+        for (size_t i = 0; i < region->n_files; i++) {
+            free(region->file_pattern_counts[i]);
+        }
+
+        free(region->file_pattern_counts);
+        region->file_pattern_counts = NULL;
+    }
+
+    free(region->edge_sink.match_visits);
+    if (region->patterns_lock_ready) pthread_mutex_destroy(&region->patterns_lock);
+
+    if (region->threads_accumulators != NULL) {
+        for (size_t i = 0; i < region->n_threads; i++) {
+            thread_accumulator *accumulator = &region->threads_accumulators[i];
+
+            // The edges are only left in the chunks if the run was stopped before they were merged.
+            for (size_t chunk_idx = 0; chunk_idx < accumulator->n_chunks; chunk_idx++) {
+                free_word_edges(&accumulator->chunks[chunk_idx].edges);
+            }
+
+            free(accumulator->chunks);
+            if (accumulator->words.table != NULL) w_t_destroy(accumulator->words.table);
+            if (accumulator->words.top != NULL) s_s_destroy(accumulator->words.top);
+            free(accumulator->words.match_visits);
+            free_word_sink(&accumulator->words);
+
+            if (accumulator->sketches != NULL) {
+                for (size_t file_id = 0; file_id < region->n_files; file_id++) {
+                    h_l_destroy(accumulator->sketches[file_id]);
+                }
+
+                free(accumulator->sketches);
+            }
+        }
+
+        free(region->threads_accumulators);
+        region->threads_accumulators = NULL;
+    }
+
+    if (region->threads_buffers != NULL) {
+        for (size_t i = 0; i < region->n_threads; i++) {
+            free(region->threads_buffers[i]);
+        }
+
+        free(region->threads_buffers);
+        region->threads_buffers = NULL;
+    }
+
+    if (region->cb_slots != NULL) {
+        for (size_t i = 0; i < region->n_cb_slots; i++) {
+            if (region->cb_slots[i].reader != NULL) c_b_close(region->cb_slots[i].reader);
+            pthread_mutex_destroy(&region->cb_slots[i].lock);
+        }
+
+        free(region->cb_slots);
+        region->cb_slots = NULL;
+        region->n_cb_slots = 0;
+    }
+
+    if (region->file_order != NULL) {
+        free(region->file_order);
+        region->file_order = NULL;
+    }
+
+    if (region->file_formats != NULL) {
+        free(region->file_formats);
+        region->file_formats = NULL;
+    }
+
+    if (region->file_timings != NULL) {
+        free(region->file_timings);
+        region->file_timings = NULL;
+    }
+
+    if (region->threads_status != NULL) {
+        free(region->threads_status);
+        region->threads_status = NULL;
+    }
+
+    free(region->file_errors);
+
+    if (region->results != NULL) {
+        free(region->results);
+        region->results = NULL;
+    }
+
+    free(region->files_data);
+    free(region->files_sizes);
+    free(region->resumes);
+    free(region->file_summaries);
+    free(region->file_bytes);
+    free(region);
 }
\ No newline at end of file
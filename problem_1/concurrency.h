@@ -1,91 +1,405 @@
 /**
  * @file concurrency.h
  * @authors José Gonçalves, Maria João Sousa
- * @brief Module containing the access primitives to the shared region as well as
- * a typedef used to store partial results.
+ * @brief Module containing the access primitives to the shared region. The files are
+ * handed out in chunks whose summaries are merged back in order by get_final_results().
+ * Every run has its own shared region, so several of them can be in progress at once.
  * @version 0.1
  * @date 2022-04-04
  * 
  */
+#ifndef CONCURRENCY_GUARD
+#define CONCURRENCY_GUARD
+
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "wordcount.h"
+#include "chunkqueue.h"
+#include "wordtable.h"
+#include "wordfreq.h"
+
+
+/**
+ * @brief Default size of the portions of data handed out by get_data_portion().
+ * The memory mapped files are cut at any byte, since the summaries of the portions
+ * are merged, while the circular buffer reader extends the portion up to a space.
+ * 
+ */
+#define CHUNK_SIZE_DEFAULT (64 * 1024)
+
+/**
+ * @brief Smallest chunk size that can be used.
+ * 
+ */
+#define CHUNK_SIZE_MIN 512
+
+/**
+ * @brief Largest chunk size that can be used.
+ * 
+ */
+#define CHUNK_SIZE_MAX (256 * 1024 * 1024)
+
+/**
+ * @brief Largest chunk size the adaptive chunk sizing grows to. The circular buffer
+ * reader keeps buffers of twice this size for each thread when it is used.
+ * 
+ */
+#define ADAPTIVE_CHUNK_SIZE_MAX (4 * 1024 * 1024)
+
+/**
+ * @brief The readers that can be used to get the data from the files.
+ * READER_MMAP hands out views straight into a memory mapping of the file,
+ * READER_CIRCULAR_BUFFER copies the data through a circular buffer for each open file,
+ * READER_PREFETCH has a reader thread filling a pool of buffers ahead of the workers and
+ * READER_URING fills the pool with io_uring, keeping the opens and reads of many files in flight.
+ * 
+ */
+typedef enum reader_backend {
+    READER_MMAP,
+    READER_CIRCULAR_BUFFER,
+    READER_PREFETCH,
+    READER_URING
+} reader_backend;
+
+/**
+ * @brief File name that stands for the standard input. It is always read by READER_PREFETCH,
+ * whatever the reader asked for, so memory stays bounded by the pool however much arrives.
+ * 
+ */
+#define STDIN_FILE_NAME "-"
+
+/**
+ * @brief Number of files READER_CIRCULAR_BUFFER keeps open at once, if there are as many threads.
+ * 
+ */
+#define CB_OPEN_FILES 4
+
+/**
+ * @brief When the portions of a file were processed, in nanoseconds since initialize().
+ * 
+ */
+typedef struct file_timing {
+    bool processed;     // Whether the file had any data.
+    uint64_t start_ns;  // When its first portion was handed out.
+    uint64_t end_ns;    // When the summary of its last portion was submitted.
+} file_timing;
+
+/**
+ * @brief What is already known of a file before it is read, e.g. from a cache of earlier runs.
+ * The file is read from offset and the summaries of its portions are merged after summary.
+ * 
+ */
+typedef struct file_resume {
+    size_t offset;          // Bytes summarized by summary, 0 to read the whole file.
+    bool complete;          // Whether that's all of the file, so it isn't even opened.
+    chunk_summary summary;
+} file_resume;
+
+/**
+ * @brief Number of prefetch buffers for each worker thread when the pool size isn't given,
+ * so a worker can process one while the next is being read.
+ * 
+ */
+#define PREFETCH_BUFFERS_PER_THREAD 2
 
+/**
+ * @brief Alignment of the prefetch buffers.
+ * 
+ */
+#define PREFETCH_BUFFER_ALIGNMENT 4096
 
 /**
- * @brief Struct definition used to store results for a portion of data from a file
- * or the results of the file as a whole.
+ * @brief Smallest pool of buffers READER_URING uses when the pool size isn't given,
+ * so many small files can be read at once.
  * 
  */
-typedef struct measurements {
-    size_t n_words;
-    size_t n_words_start_vowel;
-    size_t n_words_end_cons;
-} measurements;
+#define URING_POOL_SIZE_MIN 32
 
 /**
- * @brief Expected minimum size that will be read into the data output buffer
- * for get_data_portion()
+ * @brief Number of reader threads READER_URING uses instead when io_uring is unavailable.
  * 
  */
-#define CHUNK_MIN_SIZE 512
+#define PREAD_READER_THREADS 4
 
 /**
- * @brief Maximum amount of data read into the the data output buffer for
- * get_data_portion()
+ * @brief State of a run, shared by its worker and reader threads. It's fields are private.
  * 
  */
-#define CHUNK_MAX_SIZE CHUNK_MIN_SIZE * 2
+typedef struct shared_region shared_region_t;
 
 /**
- * @brief Function used to initialize the shared region variables.
+ * @brief Function used to create the shared region of a run over some files.
+ * 
+ * The files are handed out from the largest to the smallest, by the sizes given by stat,
+ * so the threads end the run splitting the small files instead of waiting on a large one.
+ * 
+ * With a target chunk latency, the chunk size of each file starts at chunk_size and
+ * is grown or shrunk after every portion so that processing a portion takes about
+ * the target time. It is also grown when threads spend too long waiting for data.
  * 
  * @param n_files 
  * @param file_names
  * @param n_threads 
+ * @param backend The reader used to get the data from the files.
+ * @param chunk_size The size of the portions of data, between CHUNK_SIZE_MIN and CHUNK_SIZE_MAX.
+ * @param target_chunk_latency_us The time processing a portion should take in microseconds
+ * or 0 to always use chunk_size.
+ * @param pool_size The number of buffers READER_PREFETCH and READER_URING read into or 0 to use
+ * PREFETCH_BUFFERS_PER_THREAD for each thread.
+ * @param word_histogram Whether each thread gets a table to count the words in, see get_thread_words().
+ * The words before the offset of a resume aren't counted.
+ * @param distinct_words Whether each thread gets a HyperLogLog sketch for each file it gets data of,
+ * to estimate the distinct words of the files, see get_distinct_words(). The same goes for resumes.
+ * @param top_counters The number of counters of the Space-Saving summary each thread keeps the most
+ * frequent words of all files in, see get_top_words(), or 0 for none. The same goes for resumes.
+ * @param patterns The patterns counted in the words of each file, see get_pattern_counts(), or NULL
+ * for none. It must stay valid until cleanup(). The same goes for resumes.
+ * @param resumes What is already known of each file or NULL to read them all in full.
+ * READER_CIRCULAR_BUFFER and compressed files only use the complete ones.
+ * @return shared_region_t* The shared region, which must be freed with cleanup(), or NULL if it
+ * couldn't be set up, with errno set. Files that can't be read don't make it fail, see get_file_error().
+ */
+shared_region_t *initialize(
+    const size_t n_files, char **file_names,
+    const size_t n_threads, const reader_backend backend,
+    const size_t chunk_size, const size_t target_chunk_latency_us,
+    const size_t pool_size, const bool word_histogram, const bool distinct_words,
+    const size_t top_counters, const ac_automaton_t *patterns, const file_resume *resumes
+);
+
+/**
+ * @brief Creates the shared region of a run over buffers already in memory. They are handed
+ * out in place, like the files of READER_MMAP, largest first.
+ * 
+ * @param n_buffers
+ * @param buffers The data of each buffer, which must stay valid until cleanup().
+ * A NULL buffer is taken as empty.
+ * @param sizes
+ * @param n_threads
+ * @param chunk_size See initialize().
+ * @param target_chunk_latency_us See initialize().
+ * @param word_histogram See initialize().
+ * @param distinct_words See initialize().
+ * @param top_counters See initialize().
+ * @param patterns See initialize().
+ * @return shared_region_t* The shared region, which must be freed with cleanup(), or NULL if it
+ * couldn't be set up, with errno set.
  */
-void initialize(const size_t n_files, char **file_names, const size_t n_threads);
+shared_region_t *initialize_buffers(
+    const size_t n_buffers, const unsigned char **buffers, const size_t *sizes,
+    const size_t n_threads, const size_t chunk_size, const size_t target_chunk_latency_us,
+    const bool word_histogram, const bool distinct_words, const size_t top_counters,
+    const ac_automaton_t *patterns
+);
+
+
+/**
+ * @brief Allocates the buffers only used by a thread. It must be called by the thread itself
+ * before it gets any data, so that the memory is first touched, and therefore placed, on the
+ * NUMA node the thread runs on.
+ * 
+ * @param region
+ * @param thread_id The id of the thread.
+ * @return true on success and false if memory couldn't be allocated, in which case the error is
+ * reported as with report_thread_error() and the thread should quit.
+ */
+bool initialize_thread(shared_region_t *region, const int thread_id);
+
+/**
+ * @brief Records the error of a thread and stops the run: from then on get_data_portion()
+ * returns false to every thread and get_final_results() reports the run as failed.
+ * 
+ * @param region
+ * @param thread_id The id of the thread.
+ * @param error The errno of the failure.
+ */
+void report_thread_error(shared_region_t *region, const int thread_id, int error);
 
 
 /**
  * @brief Get a portion of data for processing. If the function
- * returns false it means there wasn't anymore data to process and
- * the thread should quit.
+ * returns false it means there wasn't anymore data to process, or the
+ * run was stopped by an error, and the thread should quit.
  * 
+ * The data is not copied for the thread. Instead a view of it is given which
+ * stays valid until the next call to this function by the same thread.
+ * 
+ * @param region
  * @param thread_id The id of the thread.
  * @param file_id_out Id of the file the portion of data belongs to.
- * @param data_out Pointer to the buffer where the data will be stored.
- * @param data_size_out The amount of bytes copied into the buffer.
+ * @param offset_out Offset of the portion of data in the file.
+ * @param data_out Pointer to the start of the portion of data.
+ * @param data_size_out The amount of bytes in the portion of data.
  * @return true if the thread should continue or false if it should exit.
  */
 bool get_data_portion(
-    const int thread_id, int *file_id_out, 
-    unsigned char *data_out, size_t *data_size_out
+    shared_region_t *region, const int thread_id, int *file_id_out, size_t *offset_out,
+    const unsigned char **data_out, size_t *data_size_out
 );
 
 
 /**
- * @brief Submit the results obtained after processing a portion data
- * of some file.
+ * @brief Submit the summary obtained after processing a portion data
+ * of some file. The summaries are kept by thread, so no lock is needed,
+ * and only merged by get_final_results().
  * 
+ * @param region
  * @param thread_id The id of the thread.
  * @param file_id The id of the file the processed data belonged to.
- * @param results The results obtained from processing.
+ * @param offset The offset of the processed data in the file.
+ * @param data_size The amount of bytes processed.
+ * @param summary The summary obtained from processing.
+ * @param edges The edges left by count_chunk_words(), which are taken over, or NULL if the words
+ * aren't counted. If they can't be stored the error is reported as with report_thread_error().
  */
-void submit_results(const int thread_id, const int file_id, const measurements *results);
+void submit_results(
+    shared_region_t *region, const int thread_id, const int file_id, const size_t offset,
+    const size_t data_size, const chunk_summary *summary, word_edges *edges
+);
 
 
 /**
- * @brief Get results from the processing including whether there were any errors and on which threads
+ * @brief Get results from the processing including whether there were any errors and on which threads.
+ * The summaries of the threads are merged here in the order of their offsets, so it should
+ * only be called after all threads exited.
  * 
+ * If the run was stopped, by a thread, a file that couldn't be read or the merge itself, running
+ * out of memory, sucess_out is false and errno is set to the first error. The measurements are
+ * then incomplete.
+ * 
+ * @param region
  * @param sucess_out If no threads had errors during their execution.
  * @param threads_status_out The statuses of the threads. This is used to know which thread failed and why.
  * @param results_out The measurements made for each of the files.
+ * @param locks_avoided_out The number of submissions that didn't need to lock the results.
+ */
+void get_final_results(
+    shared_region_t *region, bool *sucess_out, int **threads_status_out,
+    measurements **results_out, size_t *locks_avoided_out
+);
+
+/**
+ * @brief Gets the error reading a file. A file that can't be opened, mapped or, if compressed,
+ * decompressed at all is counted as empty, while an error in the middle of its data stops the run.
+ * The error of a compressed file whose data is corrupt is EBADMSG and of one whose format
+ * can't be decompressed, ENOTSUP.
+ * 
+ * @param region
+ * @param file_id
+ * @return int The errno of the first error reading the file or 0 if it had none.
+ */
+int get_file_error(shared_region_t *region, const size_t file_id);
+
+/**
+ * @brief Gets the statistics of the prefetching. It should only be called after all threads exited.
+ * 
+ * @param region
+ * @param pool_size_out The number of buffers in the pool.
+ * @param filled_out Statistics of the queue of filled buffers. Waits on it are the workers starving.
+ * @param empty_out Statistics of the queue of empty buffers. Waits on it are the reader
+ * running out of buffers.
+ * @return true if READER_PREFETCH or READER_URING were used and false otherwise.
  */
-void get_final_results(bool *sucess_out, int **threads_status_out, measurements **results_out);
+bool get_prefetch_stats(shared_region_t *region, size_t *pool_size_out, chunk_queue_stats *filled_out, chunk_queue_stats *empty_out);
 
 /**
- * @brief Cleans up the memory region after being used. This function should only be called
- * after all threads accessing it have exited
+ * @brief Gets the sink where a thread counts the words of a portion of data of a file, which is
+ * kept for the file until the thread gets data of another one. The table, summary and pattern counts
+ * of the sink are created by initialize_thread() and its sketch for the file the first time the thread
+ * gets data of it. The matches counted for the last file the thread got data of are added to the ones
+ * of that file here, see get_pattern_counts().
  * 
+ * @param region
+ * @param thread_id The id of the thread.
+ * @param file_id The id of the file the data belongs to.
+ * @return word_sink* The sink or NULL if the words are neither counted, estimated, summarized nor matched.
+ * It's also NULL if memory couldn't be allocated for it, in which case the error is reported as with
+ * report_thread_error().
  */
-void cleanup();
\ No newline at end of file
+word_sink *get_thread_words(shared_region_t *region, const int thread_id, const int file_id);
+
+/**
+ * @brief Gets the words of all files, merged into one shard by worker thread. The shards
+ * are merged in parallel on the first call, which must come after get_final_results().
+ * 
+ * @param region
+ * @param shards_out Tables with the words of each shard. No word is in more than one of them.
+ * @param n_shards_out The number of shards.
+ * @return true if the words were counted and false otherwise, or if they couldn't be merged,
+ * with errno set. Only the options of the run tell both apart.
+ */
+bool get_word_histogram(shared_region_t *region, word_table_t ***shards_out, size_t *n_shards_out);
+
+/**
+ * @brief Gets the sketches of the distinct words of each file and of all of them, merged from
+ * the sketches of the threads by get_final_results(). They are freed by cleanup().
+ * 
+ * @param region
+ * @param file_sketches_out The sketch of each file.
+ * @param all_sketch_out The sketch of all files.
+ * @return true if the distinct words were estimated and false otherwise.
+ */
+bool get_distinct_words(shared_region_t *region, hll_sketch_t ***file_sketches_out, hll_sketch_t **all_sketch_out);
+
+/**
+ * @brief Gets the most frequent words of all files. The summaries of the threads are merged,
+ * along with the words cut between their portions, on the first call, which must come after
+ * get_final_results(). The merged summary is freed by cleanup().
+ * 
+ * @param region
+ * @param top_out The merged summary, with as many counters as the ones of the threads.
+ * @return true if the most frequent words were kept and false otherwise, or if they couldn't be
+ * merged, with errno set. Only the options of the run tell both apart.
+ */
+bool get_top_words(shared_region_t *region, space_saving_t **top_out);
+
+/**
+ * @brief Gets the matches of each pattern in each file, added up from the threads and the words cut
+ * between their portions by get_final_results(). They are freed by cleanup().
+ * 
+ * @param region
+ * @param file_counts_out The count of each pattern in each file, in the order of the patterns, or NULL
+ * for a file where none of them matched.
+ * @return true if there were patterns and false otherwise.
+ */
+bool get_pattern_counts(shared_region_t *region, uint64_t ***file_counts_out);
+
+/**
+ * @brief Gets when each of the files started and finished being processed. It should only be called
+ * after get_final_results() and before cleanup().
+ * 
+ * @return file_timing* The timings of each of the files.
+ */
+file_timing *get_file_timings(shared_region_t *region);
+
+/**
+ * @brief Gets the summary of a whole file, including what was known of it, to carry it over
+ * to a later run. It should only be called after get_final_results() and before cleanup().
+ * 
+ * @param region
+ * @param file_id
+ * @param size_out The number of bytes the summary covers, which for compressed files are
+ * their decompressed bytes.
+ * @return const chunk_summary* 
+ */
+const chunk_summary *get_file_summary(shared_region_t *region, const size_t file_id, size_t *size_out);
+
+/**
+ * @brief Gets the name of the reader in use, which tells whether READER_URING had to fall back
+ * to reader threads. Only valid after initialize().
+ * 
+ * @return const char* "mmap", "circular buffer", "prefetch", "io_uring" or "pread threads",
+ * or "memory" for initialize_buffers().
+ */
+const char *get_reader_name(shared_region_t *region);
+
+/**
+ * @brief Cleans up and frees the memory region after being used. This function should only
+ * be called after all threads accessing it have exited
+ * 
+ */
+void cleanup(shared_region_t *region);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "countwords.h"
+#include "instrument.h"
+
+/**
+ * @brief A worker of the pool and the counter it belongs to.
+ *
+ */
+typedef struct counter_worker {
+    counter_t *counter;
+    size_t id;
+    pthread_t thread;
+} counter_worker;
+
+struct counter_t {
+    counter_options options;
+    size_t n_threads;
+    counter_worker *workers;
+    size_t n_started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t batch_ready;     // Signaled when a batch is handed out or the workers must stop.
+    pthread_cond_t batch_done;      // Signaled by the last worker to finish a batch.
+    uint64_t batch;                 // Number of batches handed out so far.
+    size_t n_done;                  // Workers that finished the current batch.
+    bool stopping;
+
+    shared_region_t *region;        // Of the current or last batch.
+    result_cache_t *cache;          // NULL without a cache.
+    placement_t *placement;
+#ifdef INSTRUMENT
+    instrument_t *instrument;
+#endif
+};
+
+/**
+ * @brief Checks the result of a pthread call on the counter and aborts if it failed. Once the
+ * counter is created they only fail if it was already destroyed, which is a bug of the caller.
+ *
+ */
+static void check_or_die(int error) {
+    if (error != 0) abort();
+}
+
+/**
+ * @brief Processes the portions of data of a batch until there are none left. The data is
+ * counted in the placement if the worker was placed, which is NULL otherwise.
+ *
+ */
+static void process_region(shared_region_t *region, const int thread_id, placement_t *placement) {
+    int file_id;
+    size_t offset;
+    size_t data_size;
+    const unsigned char *data;
+
+    if (!initialize_thread(region, thread_id)) return;
+
+    INSTRUMENT_START(get_data_start_ns);
+
+    while (get_data_portion(region, thread_id, &file_id, &offset, &data, &data_size)) {
+        word_sink *words = get_thread_words(region, thread_id, file_id);
+        chunk_summary summary;
+        word_edges edges;
+
+        INSTRUMENT_STOP(TIMER_GET_DATA, get_data_start_ns);
+        INSTRUMENT_START(process_start_ns);
+
+        // The run stops at the next portion, so the summary goes without the edges.
+        if (words == NULL) {
+            summarize_chunk(data, data_size, &summary);
+        } else if (!summarize_chunk_and_words(words, data, data_size, &summary, &edges)) {
+            report_thread_error(region, thread_id, errno);
+            words = NULL;
+        }
+
+        if (placement != NULL) placement_count_data(placement, thread_id, data);
+
+        INSTRUMENT_STOP(TIMER_PROCESS, process_start_ns);
+        INSTRUMENT_CHUNK(data_size, process_start_ns);
+        INSTRUMENT_START(submit_start_ns);
+
+        submit_results(region, thread_id, file_id, offset, data_size, &summary, words != NULL ? &edges : NULL);
+
+        INSTRUMENT_STOP(TIMER_SUBMIT, submit_start_ns);
+        INSTRUMENT_RESTART(get_data_start_ns);
+    }
+
+    INSTRUMENT_STOP(TIMER_GET_DATA, get_data_start_ns);
+}
+
+/**
+ * @brief The procedure of the workers. They wait for a batch, process it and wait for the next
+ * one until the counter is destroyed.
+ *
+ */
+static void *worker_procedure(void *worker_arg) {
+    counter_worker *worker = worker_arg;
+    counter_t *counter = worker->counter;
+    uint64_t last_batch = 0;
+    placement_t *placement = counter->placement;
+
+    // The worker is placed before it allocates anything, so its memory ends up on its node.
+    if (placement_place_worker(placement, worker->id) == -1) placement = NULL;
+
+#ifdef INSTRUMENT
+    instrument_bind(counter->instrument, (int) worker->id);
+#endif
+
+    while (true) {
+        shared_region_t *region;
+
+        check_or_die(pthread_mutex_lock(&counter->lock));
+
+        while (counter->batch == last_batch && !counter->stopping) {
+            check_or_die(pthread_cond_wait(&counter->batch_ready, &counter->lock));
+        }
+
+        if (counter->stopping) {
+            check_or_die(pthread_mutex_unlock(&counter->lock));
+            return NULL;
+        }
+
+        last_batch = counter->batch;
+        region = counter->region;
+
+        check_or_die(pthread_mutex_unlock(&counter->lock));
+
+        process_region(region, (int) worker->id, placement);
+
+        check_or_die(pthread_mutex_lock(&counter->lock));
+
+        if (++counter->n_done == counter->n_threads) {
+            check_or_die(pthread_cond_signal(&counter->batch_done));
+        }
+
+        check_or_die(pthread_mutex_unlock(&counter->lock));
+    }
+}
+
+/**
+ * @brief Hands a region out to the workers, waits for them to finish it and gets its results.
+ *
+ */
+static bool run_batch(counter_t *counter, shared_region_t *region, measurements **results_out, count_stats *stats_out) {
+    struct timespec start, finish;
+    count_stats stats;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+    check_or_die(pthread_mutex_lock(&counter->lock));
+
+    counter->region = region;
+    counter->n_done = 0;
+    counter->batch++;
+    check_or_die(pthread_cond_broadcast(&counter->batch_ready));
+
+    while (counter->n_done < counter->n_threads) {
+        check_or_die(pthread_cond_wait(&counter->batch_done, &counter->lock));
+    }
+
+    check_or_die(pthread_mutex_unlock(&counter->lock));
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &finish);
+
+    get_final_results(region, &stats.success, &stats.threads_status, results_out, &stats.locks_avoided);
+    stats.elapsed_s = (finish.tv_sec - start.tv_sec) / 1.0 + (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+    stats.n_cache_hits = stats.n_cache_appended = stats.n_cache_misses = 0;
+    stats.cache_error = 0;
+    stats.cache_started_over = false;
+
+    if (stats_out != NULL) *stats_out = stats;
+    return stats.success;
+}
+
+/**
+ * @brief Fills the statistics of a batch that couldn't be run, keeping errno.
+ *
+ * @return bool Always false, to be returned by the batch.
+ */
+static bool fail_batch(count_stats *stats_out) {
+    if (stats_out != NULL) *stats_out = (count_stats) {.success = false, .threads_status = NULL};
+    return false;
+}
+
+/**
+ * @brief Finds what the cache knows of each file. keys_out gets the key of each file,
+ * or a size of UINT64_MAX if the file has none, like the standard input.
+ *
+ * @return file_resume* The resumes or NULL if memory couldn't be allocated, with errno set.
+ */
+static file_resume *plan_resumes(counter_t *counter, size_t n_files, char **file_names, cache_key *keys_out) {
+    file_resume *resumes;
+
+    if ((resumes = calloc(n_files, sizeof(file_resume))) == NULL) return NULL;
+
+    for (size_t i = 0; i < n_files; i++) {
+        file_resume *resume = &resumes[i];
+        size_t size;
+
+        if (strcmp(file_names[i], STDIN_FILE_NAME) == 0 || !r_c_file_key(file_names[i], &keys_out[i])) {
+            keys_out[i].size = UINT64_MAX;
+            continue;
+        }
+
+        // The cache doesn't keep the words, so they can only be counted by reading everything.
+        if (
+            counter->options.word_histogram || counter->options.distinct_words || counter->options.top_counters != 0 ||
+            counter->options.patterns != NULL
+        ) continue;
+
+        switch (r_c_lookup(counter->cache, file_names[i], &keys_out[i], &size, &resume->summary)) {
+            case CACHE_HIT:
+                resume->offset = size;
+                resume->complete = true;
+                break;
+            case CACHE_APPENDED:
+                resume->offset = size;
+                break;
+            case CACHE_MISS:
+                break;
+        }
+    }
+
+    return resumes;
+}
+
+/**
+ * @brief Stores the files counted in the last batch in the cache, as long as they didn't
+ * change while they were read. Files that couldn't be read aren't stored.
+ *
+ * @return true on success and false if the cache couldn't be written, with errno set.
+ */
+static bool store_results(counter_t *counter, size_t n_files, char **file_names, const file_resume *resumes, const cache_key *keys) {
+    for (size_t i = 0; i < n_files; i++) {
+        const chunk_summary *summary;
+        cache_key key;
+        size_t size;
+
+        if (keys[i].size == UINT64_MAX || resumes[i].complete) continue;
+        if (!r_c_file_key(file_names[i], &key) || memcmp(&key, &keys[i], sizeof(cache_key)) != 0) continue;
+
+        summary = get_file_summary(counter->region, i, &size);
+        if (size == 0 && key.size != 0) continue;
+
+        if (!r_c_store(counter->cache, file_names[i], &key, summary, size)) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Frees the region of the last batch, if any.
+ *
+ */
+static void release_region(counter_t *counter) {
+    if (counter->region != NULL) {
+        cleanup(counter->region);
+        counter->region = NULL;
+    }
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+counter_options c_w_default_options() {
+    return (counter_options) {READER_MMAP, CHUNK_SIZE_DEFAULT, 0, 0, false, false, 0, NULL, PLACEMENT_NONE, NULL};
+}
+
+
+counter_t *c_w_create(size_t n_threads, const counter_options *options) {
+    counter_t *counter;
+    int error;
+
+    if ((counter = calloc(1, sizeof(counter_t))) == NULL) return NULL;
+
+    // With the lock and conditions in place, whatever fails next is undone by c_w_destroy().
+    if ((error = pthread_mutex_init(&counter->lock, NULL)) != 0) goto free_counter;
+    if ((error = pthread_cond_init(&counter->batch_ready, NULL)) != 0) goto destroy_lock;
+    if ((error = pthread_cond_init(&counter->batch_done, NULL)) != 0) goto destroy_batch_ready;
+
+    counter->options = *options;
+    counter->n_threads = n_threads;
+
+    if ((counter->workers = malloc(sizeof(counter_worker) * n_threads)) == NULL) {
+        c_w_destroy(counter);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (options->cache_path != NULL && (counter->cache = r_c_open(options->cache_path)) == NULL) {
+        error = errno;
+        c_w_destroy(counter);
+        errno = error;
+        return NULL;
+    }
+
+    // Without the topology the workers are left to the scheduler, see placement_get_mode().
+    if ((counter->placement = placement_create(options->placement, n_threads)) == NULL) {
+        counter->placement = placement_create(PLACEMENT_NONE, n_threads);
+    }
+
+#ifdef INSTRUMENT
+    counter->instrument = instrument_create(n_threads);
+#endif
+
+    if (
+        counter->placement == NULL
+#ifdef INSTRUMENT
+        || counter->instrument == NULL
+#endif
+    ) {
+        c_w_destroy(counter);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_threads; i++) {
+        counter->workers[i] = (counter_worker) {counter, i, 0};
+
+        if ((error = pthread_create(&counter->workers[i].thread, NULL, worker_procedure, &counter->workers[i])) != 0) {
+            c_w_destroy(counter);
+            errno = error;
+            return NULL;
+        }
+
+        counter->n_started++;
+    }
+
+    return counter;
+
+destroy_batch_ready:
+    pthread_cond_destroy(&counter->batch_ready);
+destroy_lock:
+    pthread_mutex_destroy(&counter->lock);
+free_counter:
+    free(counter);
+    errno = error;
+    return NULL;
+}
+
+
+bool c_w_count_files(
+    counter_t *counter, size_t n_files, char **file_names,
+    measurements **results_out, count_stats *stats_out
+) {
+    const counter_options *options = &counter->options;
+    file_resume *resumes = NULL;
+    cache_key *keys = NULL;
+    result_cache_stats cache_before, cache_after;
+    count_stats stats;
+    shared_region_t *region;
+    bool success;
+
+    release_region(counter);
+
+    if (counter->cache != NULL) {
+        r_c_stats(counter->cache, &cache_before);
+        if ((keys = malloc(sizeof(cache_key) * n_files)) == NULL) return fail_batch(stats_out);
+
+        if ((resumes = plan_resumes(counter, n_files, file_names, keys)) == NULL) {
+            int error = errno;
+
+            free(keys);
+            errno = error;
+            return fail_batch(stats_out);
+        }
+    }
+
+    region = initialize(
+        n_files, file_names, counter->n_threads, options->backend, options->chunk_size,
+        options->target_chunk_latency_us, options->pool_size, options->word_histogram,
+        options->distinct_words, options->top_counters, options->patterns, resumes
+    );
+
+    if (region == NULL) {
+        int error = errno;
+
+        free(resumes);
+        free(keys);
+        errno = error;
+        return fail_batch(stats_out);
+    }
+
+    success = run_batch(counter, region, results_out, &stats);
+
+    if (counter->cache != NULL) {
+        int error = errno;
+
+        // A cache that can't be written doesn't change the counts, so it's only reported.
+        if (success && !store_results(counter, n_files, file_names, resumes, keys)) stats.cache_error = errno;
+        errno = error;
+
+        r_c_stats(counter->cache, &cache_after);
+        stats.n_cache_hits = cache_after.n_hits - cache_before.n_hits;
+        stats.n_cache_appended = cache_after.n_appended - cache_before.n_appended;
+        stats.n_cache_misses = cache_after.n_misses - cache_before.n_misses;
+        stats.cache_started_over = cache_after.started_over;
+        free(resumes);
+        free(keys);
+    }
+
+    if (stats_out != NULL) *stats_out = stats;
+    return success;
+}
+
+
+bool c_w_count_buffers(
+    counter_t *counter, size_t n_buffers, const unsigned char **buffers, const size_t *sizes,
+    measurements **results_out, count_stats *stats_out
+) {
+    const counter_options *options = &counter->options;
+    shared_region_t *region;
+
+    release_region(counter);
+
+    region = initialize_buffers(
+        n_buffers, buffers, sizes, counter->n_threads, options->chunk_size,
+        options->target_chunk_latency_us, options->word_histogram, options->distinct_words,
+        options->top_counters, options->patterns
+    );
+
+    if (region == NULL) return fail_batch(stats_out);
+
+    return run_batch(counter, region, results_out, stats_out);
+}
+
+
+shared_region_t *c_w_last_run(counter_t *counter) {
+    return counter->region;
+}
+
+
+const placement_t *c_w_placement(const counter_t *counter) {
+    return counter->placement;
+}
+
+#ifdef INSTRUMENT
+
+const instrument_t *c_w_instrument(const counter_t *counter) {
+    return counter->instrument;
+}
+
+#endif
+
+
+void c_w_destroy(counter_t *counter) {
+    check_or_die(pthread_mutex_lock(&counter->lock));
+    counter->stopping = true;
+    check_or_die(pthread_cond_broadcast(&counter->batch_ready));
+    check_or_die(pthread_mutex_unlock(&counter->lock));
+
+    for (size_t i = 0; i < counter->n_started; i++) {
+        check_or_die(pthread_join(counter->workers[i].thread, NULL));
+    }
+
+    release_region(counter);
+
+    pthread_mutex_destroy(&counter->lock);
+    pthread_cond_destroy(&counter->batch_ready);
+    pthread_cond_destroy(&counter->batch_done);
+
+    if (counter->placement != NULL) placement_destroy(counter->placement);
+    if (counter->cache != NULL) r_c_close(counter->cache);
+#ifdef INSTRUMENT
+    if (counter->instrument != NULL) instrument_destroy(counter->instrument);
+#endif
+
+    free(counter->workers);
+    free(counter);
+}
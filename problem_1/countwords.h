@@ -0,0 +1,167 @@
+/**
+ * @file countwords.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Library interface of the word counting. A counter keeps a pool of worker threads
+ * alive between calls, so each batch of files or buffers only pays for handing the work out
+ * and not for creating and joining the threads. Every batch gets its own shared region,
+ * which is kept until the next batch so its word histogram and timings can be read.
+ *
+ * Each counter places its workers and instruments them on its own, so several counters can
+ * be alive at once, each used by its own thread. A counter itself must only be used by one
+ * thread at a time: a batch releases the region and the results of the previous one, which
+ * another thread could still be reading. Only the counting engine is still set for the whole
+ * process, see select_count_engine().
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#ifndef COUNTWORDS_GUARD
+#define COUNTWORDS_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "concurrency.h"
+#include "wordcount.h"
+#include "placement.h"
+#include "instrument.h"
+#include "resultcache.h"
+
+/**
+ * @brief How a counter reads and splits its inputs. See initialize() for the meaning of each field.
+ *
+ */
+typedef struct counter_options {
+    reader_backend backend;             // Only used by c_w_count_files().
+    size_t chunk_size;
+    size_t target_chunk_latency_us;     // 0 for a fixed chunk size.
+    size_t pool_size;                   // 0 for PREFETCH_BUFFERS_PER_THREAD for each worker.
+    bool word_histogram;
+    bool distinct_words;                // Estimated with HyperLogLog sketches, see get_distinct_words().
+    size_t top_counters;                // Of the summaries of the most frequent words, 0 for none, see get_top_words().
+    const ac_automaton_t *patterns;     // Counted in the words of each file or NULL, see get_pattern_counts().
+    placement_mode placement;
+    const char *cache_path;             // Cache of the files between runs or NULL, see resultcache.h.
+} counter_options;
+
+/**
+ * @brief What happened in a batch besides the measurements of each input.
+ *
+ */
+typedef struct count_stats {
+    bool success;
+    int *threads_status;    // The error of each worker or 0. Valid until the next batch, NULL if it never ran.
+    size_t locks_avoided;
+    double elapsed_s;       // From handing the batch to the workers until the last one finished.
+    size_t n_cache_hits;    // Files answered by the cache, all zero without one.
+    size_t n_cache_appended;
+    size_t n_cache_misses;
+    int cache_error;        // Why the results couldn't be stored in the cache, or 0.
+    bool cache_started_over; // The cache file wasn't valid when the counter was created and was started over.
+} count_stats;
+
+/**
+ * @brief Data structure representing a counter and its workers.
+ * It's fields are private.
+ *
+ */
+typedef struct counter_t counter_t;
+
+/**
+ * @brief Gets the default options: READER_MMAP, CHUNK_SIZE_DEFAULT, no adaptive chunk size,
+ * the default pool, no word histogram, distinct words, most frequent words nor patterns, the workers left to the scheduler
+ * and no cache.
+ *
+ */
+counter_options c_w_default_options();
+
+/**
+ * @brief Creates a counter and starts its workers, which are placed once, here. The cache,
+ * if any, is opened and locked until the counter is destroyed.
+ *
+ * @param n_threads The number of workers.
+ * @param options
+ * @return counter_t* or NULL on failure, with errno set.
+ */
+counter_t *c_w_create(size_t n_threads, const counter_options *options);
+
+/**
+ * @brief Counts the words of a batch of files and waits for the result. A file named
+ * STDIN_FILE_NAME is the standard input. Must not be called while another thread uses the
+ * counter.
+ *
+ * With a cache, the files it knows are answered from it, in full or up to where they were
+ * appended to, and the others are stored in it once counted. When the words are counted,
+ * estimated, summarized or matched the cache is only written, since it doesn't keep them.
+ * A cache that can't be written doesn't make the batch fail, see count_stats.
+ *
+ * A file that can't be opened is counted as empty and doesn't make the batch fail, its error
+ * is given by get_file_error() on c_w_last_run().
+ *
+ * @param counter
+ * @param n_files
+ * @param file_names Which must stay valid until the next batch.
+ * @param results_out The measurements of each file, valid until the next batch.
+ * @param stats_out Can be NULL.
+ * @return true if all the workers were successful and false otherwise, with errno set. If the
+ * batch couldn't even be set up, c_w_last_run() is NULL.
+ */
+bool c_w_count_files(
+    counter_t *counter, size_t n_files, char **file_names,
+    measurements **results_out, count_stats *stats_out
+);
+
+/**
+ * @brief Counts the words of a batch of buffers already in memory and waits for the result.
+ * The buffers are handed out to the workers in place, without being copied. Must not be
+ * called while another thread uses the counter.
+ *
+ * @param counter
+ * @param n_buffers
+ * @param buffers Which must stay valid until the next batch.
+ * @param sizes
+ * @param results_out The measurements of each buffer, valid until the next batch.
+ * @param stats_out Can be NULL.
+ * @return true if all the workers were successful and false otherwise, with errno set.
+ */
+bool c_w_count_buffers(
+    counter_t *counter, size_t n_buffers, const unsigned char **buffers, const size_t *sizes,
+    measurements **results_out, count_stats *stats_out
+);
+
+/**
+ * @brief Gets the shared region of the last batch, to read its word histogram, distinct and most frequent words, pattern counts, file timings,
+ * reader and prefetch statistics with the functions of concurrency.h.
+ *
+ * @return shared_region_t* The region or NULL if nothing was counted yet.
+ */
+shared_region_t *c_w_last_run(counter_t *counter);
+
+/**
+ * @brief Gets where the workers of a counter were placed, to report it with placement_report().
+ * Its mode is PLACEMENT_NONE when the topology couldn't be read, even if they should have been pinned.
+ *
+ * @return const placement_t* The placement, valid until the counter is destroyed.
+ */
+const placement_t *c_w_placement(const counter_t *counter);
+
+#ifdef INSTRUMENT
+
+/**
+ * @brief Gets the instrumentation of the workers of a counter, to report it with
+ * instrument_report() or instrument_write_json().
+ *
+ * @return const instrument_t* The instrumentation, valid until the counter is destroyed.
+ */
+const instrument_t *c_w_instrument(const counter_t *counter);
+
+#endif
+
+/**
+ * @brief Stops the workers and frees the counter along with the region of its last batch,
+ * the placement of the workers and their instrumentation, which must be reported before.
+ *
+ */
+void c_w_destroy(counter_t *counter);
+
+#endif
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "decompress.h"
+
+/**
+ * @brief Largest amount of input given to zlib at once, since its sizes are 32 bits.
+ *
+ */
+#define ZLIB_INPUT_MAX (1u << 30)
+
+/**
+ * @brief zlib stream, as laid out by its stable ABI. Only the fields used here are named.
+ *
+ */
+typedef struct z_stream {
+    const unsigned char *next_in;
+    unsigned avail_in;
+    unsigned long total_in;
+    unsigned char *next_out;
+    unsigned avail_out;
+    unsigned long total_out;
+    const char *msg;
+    void *state;
+    void *zalloc;
+    void *zfree;
+    void *opaque;
+    int data_type;
+    unsigned long adler;
+    unsigned long reserved;
+} z_stream;
+
+#define Z_OK 0
+#define Z_STREAM_END 1
+#define Z_BUF_ERROR (-5)
+#define Z_NO_FLUSH 0
+
+/**
+ * @brief Window bits of inflateInit2() that only accept gzip members.
+ *
+ */
+#define ZLIB_GZIP_WINDOW_BITS (15 + 16)
+
+/**
+ * @brief Buffers of the streaming API of libzstd.
+ *
+ */
+typedef struct zstd_in_buffer {
+    const void *src;
+    size_t size;
+    size_t pos;
+} zstd_in_buffer;
+
+typedef struct zstd_out_buffer {
+    void *dst;
+    size_t size;
+    size_t pos;
+} zstd_out_buffer;
+
+#define ZSTD_CONTENTSIZE_UNKNOWN (0ull - 1)
+#define ZSTD_CONTENTSIZE_ERROR (0ull - 2)
+
+/**
+ * @brief The functions of zlib and whether they were loaded.
+ *
+ */
+static struct {
+    int (*inflate_init)(z_stream *stream, int window_bits, const char *version, int stream_size);
+    int (*inflate)(z_stream *stream, int flush);
+    int (*inflate_reset)(z_stream *stream);
+    int (*inflate_end)(z_stream *stream);
+    bool loaded;
+} zlib;
+
+/**
+ * @brief The functions of libzstd and whether they were loaded.
+ *
+ */
+static struct {
+    void *(*create_stream)(void);
+    size_t (*free_stream)(void *stream);
+    size_t (*init_stream)(void *stream);
+    size_t (*decompress_stream)(void *stream, zstd_out_buffer *out, zstd_in_buffer *in);
+    unsigned (*is_error)(size_t code);
+    const char *(*get_error_name)(size_t code);
+    size_t (*find_frame_compressed_size)(const void *src, size_t size);
+    unsigned long long (*get_frame_content_size)(const void *src, size_t size);
+    bool loaded;
+} zstd;
+
+static pthread_once_t zlib_once = PTHREAD_ONCE_INIT;
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+
+struct decompressor_t {
+    compression_format format;
+    const unsigned char *data;
+    size_t size;
+    size_t position;    // Bytes of the data given to the library.
+    bool finished;
+    z_stream gzip_stream;
+    void *zstd_stream;
+};
+
+/**
+ * @brief Opens the first of the names of a library that can be found.
+ *
+ */
+static void *open_library(const char *names[], size_t n_names) {
+    void *library = NULL;
+
+    for (size_t i = 0; i < n_names && library == NULL; i++) {
+        library = dlopen(names[i], RTLD_NOW | RTLD_LOCAL);
+    }
+
+    return library;
+}
+
+/**
+ * @brief Looks up a function of a library, clearing loaded if it's missing.
+ *
+ */
+static void *load_function(void *library, const char *name, bool *loaded) {
+    void *function = dlsym(library, name);
+
+    if (function == NULL) *loaded = false;
+    return function;
+}
+
+static void load_zlib() {
+    const char *names[] = {"libz.so.1", "libz.so"};
+    void *library = open_library(names, 2);
+
+    if (library == NULL) return;
+
+    zlib.loaded = true;
+    zlib.inflate_init = load_function(library, "inflateInit2_", &zlib.loaded);
+    zlib.inflate = load_function(library, "inflate", &zlib.loaded);
+    zlib.inflate_reset = load_function(library, "inflateReset", &zlib.loaded);
+    zlib.inflate_end = load_function(library, "inflateEnd", &zlib.loaded);
+}
+
+static void load_zstd() {
+    const char *names[] = {"libzstd.so.1", "libzstd.so"};
+    void *library = open_library(names, 2);
+
+    if (library == NULL) return;
+
+    zstd.loaded = true;
+    zstd.create_stream = load_function(library, "ZSTD_createDStream", &zstd.loaded);
+    zstd.free_stream = load_function(library, "ZSTD_freeDStream", &zstd.loaded);
+    zstd.init_stream = load_function(library, "ZSTD_initDStream", &zstd.loaded);
+    zstd.decompress_stream = load_function(library, "ZSTD_decompressStream", &zstd.loaded);
+    zstd.is_error = load_function(library, "ZSTD_isError", &zstd.loaded);
+    zstd.get_error_name = load_function(library, "ZSTD_getErrorName", &zstd.loaded);
+    zstd.find_frame_compressed_size = load_function(library, "ZSTD_findFrameCompressedSize", &zstd.loaded);
+    zstd.get_frame_content_size = load_function(library, "ZSTD_getFrameContentSize", &zstd.loaded);
+}
+
+static inline uint16_t read_u16(const unsigned char *bytes) {
+    return bytes[0] | (uint16_t) bytes[1] << 8;
+}
+
+static inline uint32_t read_u32(const unsigned char *bytes) {
+    return read_u16(bytes) | (uint32_t) read_u16(bytes + 2) << 16;
+}
+
+/**
+ * @brief Gets the size of the BGZF block at the start of the data from the BC subfield of
+ * its header, which holds the size of the whole member.
+ *
+ * @return size_t The size of the block or 0 if the member isn't a BGZF block.
+ */
+static size_t bgzf_block_size(const unsigned char *data, size_t size) {
+    size_t extra_end;
+
+    // ID1 ID2 CM FLG with FEXTRA, MTIME, XFL, OS and XLEN.
+    if (size < 12 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 || !(data[3] & 4)) return 0;
+    if ((extra_end = 12 + (size_t) read_u16(data + 10)) > size) return 0;
+
+    for (size_t field = 12; field + 4 <= extra_end; field += 4 + read_u16(data + field + 2)) {
+        if (data[field] == 'B' && data[field + 1] == 'C' && read_u16(data + field + 2) == 2) {
+            if (field + 6 > extra_end) return 0;
+
+            return (size_t) read_u16(data + field + 4) + 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gets the next member or frame of a compressed file.
+ *
+ * @return true if it was found and its sizes are recorded in it.
+ */
+static bool next_part(
+    compression_format format, const unsigned char *data, size_t size,
+    size_t *part_size_out, size_t *decompressed_size_out
+) {
+    if (format == COMPRESSION_GZIP) {
+        size_t block_size = bgzf_block_size(data, size);
+
+        // The decompressed size is in the last 4 bytes of the member.
+        if (block_size < 12 + 8 || block_size > size) return false;
+
+        *part_size_out = block_size;
+        *decompressed_size_out = read_u32(data + block_size - 4);
+        return true;
+    }
+
+    size_t frame_size = zstd.find_frame_compressed_size(data, size);
+    unsigned long long content_size = zstd.get_frame_content_size(data, size);
+
+    if (zstd.is_error(frame_size) || frame_size > size) return false;
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR) return false;
+
+    *part_size_out = frame_size;
+    *decompressed_size_out = content_size;
+    return true;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+compression_format detect_compression(const unsigned char *data, size_t size) {
+    if (size >= 3 && data[0] == 0x1f && data[1] == 0x8b && data[2] == 8) return COMPRESSION_GZIP;
+    if (size >= 4 && read_u32(data) == 0xfd2fb528) return COMPRESSION_ZSTD;
+
+    return COMPRESSION_NONE;
+}
+
+
+const char *compression_name(compression_format format) {
+    switch (format) {
+        case COMPRESSION_GZIP: return "gzip";
+        case COMPRESSION_ZSTD: return "zstd";
+        default: return "none";
+    }
+}
+
+
+bool decompression_available(compression_format format) {
+    switch (format) {
+        case COMPRESSION_GZIP:
+            pthread_once(&zlib_once, load_zlib);
+            return zlib.loaded;
+        case COMPRESSION_ZSTD:
+            pthread_once(&zstd_once, load_zstd);
+            return zstd.loaded;
+        default:
+            return true;
+    }
+}
+
+
+bool split_compressed(
+    compression_format format, const unsigned char *data, size_t size, size_t min_part_size,
+    compressed_part **parts_out, size_t *n_parts_out
+) {
+    compressed_part *parts = NULL;
+    size_t n_parts = 0;
+    size_t capacity = 0;
+    size_t position = 0;
+
+    while (position < size) {
+        size_t part_size, decompressed_size;
+
+        if (!next_part(format, data + position, size - position, &part_size, &decompressed_size)) {
+            free(parts);
+            return false;
+        }
+
+        // Start a new part once the last one is large enough.
+        if (n_parts == 0 || parts[n_parts - 1].decompressed_size >= min_part_size) {
+            if (n_parts == capacity) {
+                compressed_part *grown;
+
+                capacity = capacity == 0 ? 16 : capacity * 2;
+                if ((grown = realloc(parts, sizeof(compressed_part) * capacity)) == NULL) {
+                    free(parts);
+                    return false;
+                }
+
+                parts = grown;
+            }
+
+            parts[n_parts++] = (compressed_part) {position, 0, 0};
+        }
+
+        parts[n_parts - 1].size += part_size;
+        parts[n_parts - 1].decompressed_size += decompressed_size;
+        position += part_size;
+    }
+
+    *parts_out = parts;
+    *n_parts_out = n_parts;
+    return n_parts != 0;
+}
+
+
+decompressor_t *d_s_create(compression_format format, const unsigned char *data, size_t size) {
+    decompressor_t *decompressor;
+
+    if ((decompressor = calloc(1, sizeof(decompressor_t))) == NULL) return NULL;
+
+    decompressor->format = format;
+    decompressor->data = data;
+    decompressor->size = size;
+
+    if (format == COMPRESSION_GZIP) {
+        if (zlib.inflate_init(&decompressor->gzip_stream, ZLIB_GZIP_WINDOW_BITS, "1.2.11", sizeof(z_stream)) != Z_OK) {
+            free(decompressor);
+            errno = ENOMEM;
+            return NULL;
+        }
+    } else if ((decompressor->zstd_stream = zstd.create_stream()) == NULL ||
+               zstd.is_error(zstd.init_stream(decompressor->zstd_stream))) {
+        if (decompressor->zstd_stream != NULL) zstd.free_stream(decompressor->zstd_stream);
+        free(decompressor);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return decompressor;
+}
+
+
+size_t d_s_read(decompressor_t *decompressor, unsigned char *out, size_t size, const char **error_out) {
+    size_t written = 0;
+
+    *error_out = NULL;
+
+    if (decompressor->format == COMPRESSION_ZSTD) {
+        zstd_in_buffer in = {decompressor->data, decompressor->size, decompressor->position};
+        zstd_out_buffer out_buffer = {out, size, 0};
+
+        // Frames follow one another, the stream starts the next one by itself.
+        while (out_buffer.pos < out_buffer.size && !decompressor->finished) {
+            size_t result = zstd.decompress_stream(decompressor->zstd_stream, &out_buffer, &in);
+
+            if (zstd.is_error(result)) {
+                *error_out = zstd.get_error_name(result);
+                break;
+            }
+
+            // A frame is complete when the result is 0, even if it filled the output, otherwise it needs more input.
+            if (in.pos == in.size && (result == 0 || out_buffer.pos < out_buffer.size)) {
+                if (result != 0) *error_out = "unexpected end of data";
+                decompressor->finished = true;
+            }
+        }
+
+        decompressor->position = in.pos;
+        return out_buffer.pos;
+    }
+
+    z_stream *stream = &decompressor->gzip_stream;
+
+    while (written < size && !decompressor->finished) {
+        size_t input_size = decompressor->size - decompressor->position;
+        size_t output_size = size - written < ZLIB_INPUT_MAX ? size - written : ZLIB_INPUT_MAX;
+        int result;
+
+        stream->next_in = decompressor->data + decompressor->position;
+        stream->avail_in = input_size < ZLIB_INPUT_MAX ? input_size : ZLIB_INPUT_MAX;
+        stream->next_out = out + written;
+        stream->avail_out = output_size;
+
+        result = zlib.inflate(stream, Z_NO_FLUSH);
+
+        decompressor->position = stream->next_in - decompressor->data;
+        written += output_size - stream->avail_out;
+
+        if (result == Z_STREAM_END) {
+            // Members follow one another. Whatever isn't a member after the last one is ignored, like gzip does.
+            if (detect_compression(decompressor->data + decompressor->position,
+                                   decompressor->size - decompressor->position) != COMPRESSION_GZIP) {
+                decompressor->finished = true;
+            } else {
+                zlib.inflate_reset(stream);
+            }
+        } else if (result == Z_BUF_ERROR || (result == Z_OK && decompressor->position == decompressor->size &&
+                                                 stream->avail_out != 0)) {
+            // No progress can be made without more input.
+            *error_out = "unexpected end of data";
+            break;
+        } else if (result != Z_OK) {
+            *error_out = stream->msg != NULL ? stream->msg : "invalid data";
+            break;
+        }
+    }
+
+    return written;
+}
+
+
+void d_s_destroy(decompressor_t *decompressor) {
+    if (decompressor->format == COMPRESSION_GZIP) {
+        zlib.inflate_end(&decompressor->gzip_stream);
+    } else {
+        zstd.free_stream(decompressor->zstd_stream);
+    }
+
+    free(decompressor);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file decompress.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Decompression of gzip and zstd files. zlib and libzstd are loaded when first needed,
+ * so the program builds and runs without them and only compressed files are refused.
+ *
+ * Files made of several gzip members or zstd frames whose decompressed sizes are recorded in
+ * them can be split at those boundaries and every part decompressed on its own, in parallel.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+
+#ifndef DECOMPRESS_GUARD
+#define DECOMPRESS_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Formats of the input files.
+ *
+ */
+typedef enum compression_format {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} compression_format;
+
+/**
+ * @brief Number of bytes at the start of a file needed to tell its format.
+ *
+ */
+#define COMPRESSION_MAGIC_SIZE 4
+
+/**
+ * @brief A range of a compressed file made of whole members or frames,
+ * along with the size of its data once decompressed.
+ *
+ */
+typedef struct compressed_part {
+    size_t start;
+    size_t size;
+    size_t decompressed_size;
+} compressed_part;
+
+/**
+ * @brief Data structure representing the decompression of a range of a compressed file.
+ * It's fields are private.
+ *
+ */
+typedef struct decompressor_t decompressor_t;
+
+/**
+ * @brief Tells the format of a file from its first bytes.
+ *
+ * @param data
+ * @param size The number of bytes available, which may be less than COMPRESSION_MAGIC_SIZE.
+ * @return compression_format
+ */
+compression_format detect_compression(const unsigned char *data, size_t size);
+
+/**
+ * @brief Gets the name of a format.
+ *
+ */
+const char *compression_name(compression_format format);
+
+/**
+ * @brief Loads the library that decompresses a format. It's safe to call from several threads.
+ *
+ * @return true if the format can be decompressed and false if the library couldn't be loaded.
+ */
+bool decompression_available(compression_format format);
+
+/**
+ * @brief Splits a compressed file into the members or frames it is made of, as long as the
+ * size of each one is recorded in it: the BGZF block size of gzip members, as written by
+ * bgzip, and the content size of zstd frames. Consecutive ones are grouped until they reach
+ * min_part_size once decompressed.
+ *
+ * @param format
+ * @param data
+ * @param size
+ * @param min_part_size
+ * @param parts_out Array of parts, which must be freed by the caller.
+ * @param n_parts_out
+ * @return true if the file was split and false if its boundaries or sizes aren't known without
+ * decompressing it, in which case it must be decompressed as a whole.
+ */
+bool split_compressed(
+    compression_format format, const unsigned char *data, size_t size, size_t min_part_size,
+    compressed_part **parts_out, size_t *n_parts_out
+);
+
+/**
+ * @brief Starts the decompression of a range of a compressed file, which must be made of whole
+ * members or frames. The library of the format must be loaded.
+ *
+ * @param format
+ * @param data The compressed data, which must stay valid until the decompressor is destroyed.
+ * @param size
+ * @return decompressor_t* or NULL on failure, with errno set.
+ */
+decompressor_t *d_s_create(compression_format format, const unsigned char *data, size_t size);
+
+/**
+ * @brief Decompresses the next bytes of the data.
+ *
+ * @param decompressor
+ * @param out
+ * @param size
+ * @param error_out Set to a description of the error if the data is corrupt and NULL otherwise.
+ * @return size_t The number of bytes written to out. It's only less than size at the end of the
+ * data or on an error.
+ */
+size_t d_s_read(decompressor_t *decompressor, unsigned char *out, size_t size, const char **error_out);
+
+/**
+ * @brief Frees the decompressor.
+ *
+ */
+void d_s_destroy(decompressor_t *decompressor);
+
+#endif
@@ -3,34 +3,68 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "filereader.h"
 
-static void unsafe_write_byte(circular_buffer_t *circular_buffer, unsigned char byte) {
-    size_t capacity = circular_buffer->capacity;
-    size_t write_idx = circular_buffer->write_idx;
-
-    circular_buffer->buffer[write_idx] = byte;
-    circular_buffer->write_idx = (write_idx + 1) % capacity;
-    circular_buffer->size++;
+/**
+ * @brief Moves an index of the buffer forward, wrapping around its end.
+ *
+ */
+static size_t advance(circular_buffer_t *circular_buffer, size_t idx, size_t n) {
+    idx += n;
+    return idx >= circular_buffer->capacity ? idx - circular_buffer->capacity : idx;
 }
 
-
-static void unsafe_read_byte(circular_buffer_t *circular_buffer, unsigned char *byte_out) {
+/**
+ * @brief Reads the first n bytes of the buffer, which are in at most two spans:
+ * up to the end of the buffer and then from its start.
+ *
+ */
+static void read_bytes(circular_buffer_t *circular_buffer, unsigned char *out, size_t n) {
     size_t read_idx = circular_buffer->read_idx;
-    
-    *byte_out = circular_buffer->buffer[read_idx];
-    circular_buffer->read_idx = (read_idx + 1) % circular_buffer->capacity;
-    circular_buffer->size--;
+    size_t first_span = circular_buffer->capacity - read_idx;
+
+    if (n <= first_span) {
+        memcpy(out, circular_buffer->buffer + read_idx, n);
+    } else {
+        memcpy(out, circular_buffer->buffer + read_idx, first_span);
+        memcpy(out + first_span, circular_buffer->buffer, n - first_span);
+    }
+
+    circular_buffer->read_idx = advance(circular_buffer, read_idx, n);
+    circular_buffer->size -= n;
 }
 
+/**
+ * @brief Finds the first occurrence of a byte in the buffer at or after an offset from its start.
+ *
+ * @return size_t The offset of the byte or the size of the buffer if it isn't there.
+ */
+static size_t find_byte(circular_buffer_t *circular_buffer, size_t offset, unsigned char byte) {
+    size_t size = circular_buffer->size;
+    size_t first_span = circular_buffer->capacity - circular_buffer->read_idx;
+    const unsigned char *found;
+
+    if (first_span > size) first_span = size;
 
-static bool read_single_byte(circular_buffer_t *circular_buffer, unsigned char *byte_out) {
-    if (circular_buffer->size == 0) return false;
+    if (offset < first_span) {
+        const unsigned char *start = circular_buffer->buffer + circular_buffer->read_idx;
 
-    unsafe_read_byte(circular_buffer, byte_out);
+        if ((found = memchr(start + offset, byte, first_span - offset)) != NULL) return found - start;
+        offset = first_span;
+    }
+
+    if (offset < size) {
+        const unsigned char *start = circular_buffer->buffer;
+
+        if ((found = memchr(start + offset - first_span, byte, size - offset)) != NULL) return first_span + (found - start);
+    }
 
-    return true;
+    return size;
 }
 
 
@@ -56,11 +90,21 @@ size_t c_b_capacity(circular_buffer_t *circular_buffer) {
 
 
 size_t c_b_fill(circular_buffer_t *circular_buffer) {
-    unsigned char temp_buffer[circular_buffer->capacity];
-    size_t bytes_read = fread(temp_buffer, 1, free_bytes(circular_buffer), circular_buffer->file);
+    size_t bytes_read = 0;
+
+    // The free space wraps around the end of the buffer at most once, so
+    // it is filled in at most two reads straight into the buffer.
+    while (free_bytes(circular_buffer) > 0) {
+        size_t write_idx = circular_buffer->write_idx;
+        size_t contiguous = circular_buffer->capacity - write_idx;
+        size_t to_read = free_bytes(circular_buffer) < contiguous ? free_bytes(circular_buffer) : contiguous;
+        size_t part_read = fread(circular_buffer->buffer + write_idx, 1, to_read, circular_buffer->file);
+
+        circular_buffer->write_idx = advance(circular_buffer, write_idx, part_read);
+        circular_buffer->size += part_read;
+        bytes_read += part_read;
 
-    for (size_t tb_read_idx = 0; tb_read_idx < bytes_read; tb_read_idx++) {
-        unsafe_write_byte(circular_buffer, temp_buffer[tb_read_idx]);
+        if (part_read < to_read) break;
     }
 
     return bytes_read;
@@ -69,9 +113,7 @@ size_t c_b_fill(circular_buffer_t *circular_buffer) {
 size_t c_b_read_all(circular_buffer_t *circular_buffer, unsigned char *out) {
     size_t buffer_size = circular_buffer->size;
 
-    while (read_single_byte(circular_buffer, out)) {
-        out++;
-    }
+    read_bytes(circular_buffer, out, buffer_size);
 
     return buffer_size;
 }
@@ -81,15 +123,13 @@ size_t c_b_read_chunk_until_delim(
     circular_buffer_t *circular_buffer, size_t min_chunk_size,
     unsigned char delim, unsigned char *out
 ) {
-    size_t read_bytes = 0;
+    // The chunk ends at the first delimiter that makes it at least min_chunk_size bytes long.
+    size_t delim_offset = find_byte(circular_buffer, min_chunk_size > 0 ? min_chunk_size - 1 : 0, delim);
+    size_t chunk_size = delim_offset < circular_buffer->size ? delim_offset + 1 : circular_buffer->size;
 
-    while (read_single_byte(circular_buffer, out)) {
-        read_bytes++;
-        if (read_bytes >= min_chunk_size && out[0] == delim) break;
-        out++;
-    }
-    
-    return read_bytes;
+    read_bytes(circular_buffer, out, chunk_size);
+
+    return chunk_size;
 }
 
 
@@ -98,21 +138,22 @@ circular_buffer_t *c_b_open(char *filename, size_t buffer_size) {
     FILE *file;
     circular_buffer_t *circular_buffer;
 
-    if ((buffer = malloc(buffer_size)) == NULL) {
-        printf("Error alocating memory for the buffer: %s\n", strerror(errno));
-        return NULL;
-    }
+    int error;
+
+    if ((buffer = malloc(buffer_size)) == NULL) return NULL;
 
     if ((file = fopen(filename, "r")) == NULL) {
-        printf("Error opening the file: %s\n", strerror(errno));
+        error = errno;
         free(buffer);
+        errno = error;
         return NULL;
     }
 
     if ((circular_buffer = malloc(sizeof(circular_buffer_t))) == NULL) {
-        printf("Error allocating memory for the struct: %s\n", strerror(errno));
+        error = errno;
         free(buffer);
         fclose(file);
+        errno = error;
         return NULL;
     }
 
@@ -135,10 +176,7 @@ circular_buffer_t *c_b_swap_file(
 
     FILE *new_file;
 
-    if ((new_file = fopen(filename, "r")) == NULL) {
-        printf("Unable to open new file: %s\n", strerror(errno));
-        return NULL;
-    }
+    if ((new_file = fopen(filename, "r")) == NULL) return NULL;
 
     fclose(circular_buffer->file);
 
@@ -157,4 +195,67 @@ void c_b_close(circular_buffer_t *circular_buffer) {
     fclose(circular_buffer->file);
     free(circular_buffer->buffer);
     free(circular_buffer);
+}
+
+
+size_t m_f_size(mapped_file_t *mapped_file) {
+    return mapped_file->size;
+}
+
+
+const unsigned char *m_f_data(mapped_file_t *mapped_file) {
+    return mapped_file->data;
+}
+
+
+mapped_file_t *m_f_open(char *filename) {
+    int fd;
+    struct stat file_stat;
+    void *data = NULL;
+    mapped_file_t *mapped_file;
+    int error;
+
+    if ((fd = open(filename, O_RDONLY)) == -1) return NULL;
+
+    if (fstat(fd, &file_stat) == -1) {
+        error = errno;
+        close(fd);
+        errno = error;
+        return NULL;
+    }
+
+    // Empty files can't be mapped so they are represented by a NULL mapping.
+    if (file_stat.st_size > 0) {
+        data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            error = errno;
+            close(fd);
+            errno = error;
+            return NULL;
+        }
+
+        madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+
+    if ((mapped_file = malloc(sizeof(mapped_file_t))) == NULL) {
+        error = errno;
+        if (data != NULL) munmap(data, file_stat.st_size);
+        errno = error;
+        return NULL;
+    }
+
+    mapped_file->data = data;
+    mapped_file->size = file_stat.st_size;
+
+    return mapped_file;
+}
+
+
+void m_f_close(mapped_file_t *mapped_file) {
+    if (mapped_file->data != NULL) munmap((void *) mapped_file->data, mapped_file->size);
+    free(mapped_file);
 }
\ No newline at end of file
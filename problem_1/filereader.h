@@ -3,7 +3,9 @@
  * @author José Gonçalves, Maria João Sousa
  * @brief This module contains functions that allow to read a file
  * by chunks whose size is controlled by a possible min size, a byte delimiter and
- * the maximum size of the buffer
+ * the maximum size of the buffer. Two readers are available: a circular buffer
+ * that copies the file contents and a memory mapped reader that hands out
+ * views straight into the mapping.
  * @version 0.1
  * @date 2022-04-23
  * 
@@ -63,6 +65,16 @@ size_t c_b_fill(circular_buffer_t *circular_buffer);
  */
 size_t c_b_read_all(circular_buffer_t *circular_buffer, unsigned char *out);
 
+/**
+ * @brief Reads a chunk of at least min_chunk_size bytes that ends at a delimiter, which
+ * is included, or everything in the buffer if it has no delimiter after that size.
+ *
+ * @param circular_buffer
+ * @param min_chunk_size
+ * @param delim
+ * @param out The output buffer for the data, with room for the whole buffer.
+ * @return size_t The amount of bytes read into the output buffer.
+ */
 size_t c_b_read_chunk_until_delim(
     circular_buffer_t *circular_buffer, size_t min_chunk_size,
     unsigned char delim, unsigned char *out
@@ -78,7 +90,7 @@ size_t c_b_read_chunk_until_delim(
  * @param filename The name of the file
  * @param buffer_size The size of the buffer
  * @return circular_buffer_t* A pointer to the circular buffer on success or 
- * NULL on failure.
+ * NULL on failure, with errno set.
  */
 circular_buffer_t *c_b_open(char *filename, size_t buffer_size);
 
@@ -89,7 +101,8 @@ circular_buffer_t *c_b_open(char *filename, size_t buffer_size);
  * 
  * @param circular_buffer The buffer whose file needs to be swaped
  * @param filename The name of the new file
- * @return circular_buffer_t* The reference to the buffer passed as argument if sucessful or NULL if unsucessful.
+ * @return circular_buffer_t* The reference to the buffer passed as argument if sucessful or NULL if unsucessful,
+ * with errno set and the buffer still reading its previous file.
  */
 circular_buffer_t *c_b_swap_file(
     circular_buffer_t *circular_buffer, char *filename
@@ -103,4 +116,51 @@ circular_buffer_t *c_b_swap_file(
  */
 void c_b_close(circular_buffer_t *circular_buffer);
 
+/**
+ * @brief Data structure representing a memory mapped file.
+ * It's fields must not be changed directly. The mapping is only read so
+ * it can be shared by several threads without synchronization.
+ * 
+ */
+typedef struct mapped_file_t {
+    const unsigned char *data;
+    size_t size;
+} mapped_file_t;
+
+/**
+ * @brief Get the size of the mapped file.
+ * 
+ * @param mapped_file 
+ * @return size_t The size of the file in bytes.
+ */
+size_t m_f_size(mapped_file_t *mapped_file);
+
+/**
+ * @brief Gets a pointer to the start of the mapped file.
+ * 
+ * @param mapped_file 
+ * @return const unsigned char* The data of the file. It is only valid while the file is open.
+ */
+const unsigned char *m_f_data(mapped_file_t *mapped_file);
+
+/**
+ * @brief Maps the whole file into memory for reading.
+ * 
+ * If the file could not be opened or mapped, allocated memory
+ * will be free and the opened file closed.
+ * 
+ * @param filename The name of the file
+ * @return mapped_file_t* A pointer to the mapped file on success or
+ * NULL on failure, with errno set.
+ */
+mapped_file_t *m_f_open(char *filename);
+
+/**
+ * @brief Unmaps the file and deallocates the memory for the struct.
+ * Any view obtained from it becomes invalid.
+ * 
+ * @param mapped_file 
+ */
+void m_f_close(mapped_file_t *mapped_file);
+
 #endif
\ No newline at end of file
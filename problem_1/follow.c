@@ -0,0 +1,327 @@
+#define _GNU_SOURCE // strdup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "follow.h"
+
+/**
+ * @brief Events of the files themselves: data appended, truncation and rotation.
+ *
+ */
+#define FILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/**
+ * @brief Events of the directories of the files: a file created or moved under a followed name.
+ *
+ */
+#define DIRECTORY_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+/**
+ * @brief Size of the buffer the inotify events are read into.
+ *
+ */
+#define EVENT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief A followed file.
+ *
+ */
+typedef struct followed_file {
+    char *name;
+    char *base_name;        // Name of the file in its directory, to match directory events.
+    int fd;                 // -1 while there's no file with the name.
+    dev_t device;
+    ino_t inode;
+    int file_wd;
+    int directory_wd;
+    size_t offset;          // Bytes read so far.
+    chunk_summary summary;  // Of the bytes read, except the pending ones.
+    unsigned char pending[UTF8_MAX_PARTIAL];
+    size_t n_pending;       // Incomplete utf8 sequence at the end of what was read.
+    measurements earlier;   // Counts of the texts rotated away or truncated.
+    bool changed;           // Since the last time it was printed.
+} followed_file;
+
+static volatile sig_atomic_t stop_following = 0;
+
+static void handle_stop_signal(int signal_number) {
+    (void) signal_number;
+    stop_following = 1;
+}
+
+static uint64_t now_ms() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Opens the file under the name of a followed file and starts watching it.
+ *
+ * @return true if there is a file with the name and false otherwise.
+ */
+static bool open_followed(int inotify_fd, followed_file *file) {
+    struct stat file_stat;
+
+    if ((file->fd = open(file->name, O_RDONLY)) == -1) return false;
+
+    if (fstat(file->fd, &file_stat) == -1) {
+        close(file->fd);
+        file->fd = -1;
+        return false;
+    }
+
+    file->device = file_stat.st_dev;
+    file->inode = file_stat.st_ino;
+    file->file_wd = inotify_add_watch(inotify_fd, file->name, FILE_EVENTS);
+    return true;
+}
+
+/**
+ * @brief Ends the text of a file: its counts go to the earlier ones and the next bytes start
+ * a new text. A sequence cut off at the end of the old text is dropped, as it would be at the
+ * end of any file.
+ *
+ */
+static void end_text(followed_file *file) {
+    summary_results(&file->summary, &file->earlier);
+    empty_summary(&file->summary);
+
+    file->offset = 0;
+    file->n_pending = 0;
+    file->changed = true;
+}
+
+/**
+ * @brief Reads the bytes of a file after its offset and merges their summary after the
+ * summary of the rest. An incomplete utf8 sequence at the end is kept pending until the rest
+ * of it is appended, so no summary starts or ends in the middle of a character.
+ *
+ */
+static void read_appended(followed_file *file, unsigned char *buffer, size_t read_size) {
+    while (true) {
+        ssize_t bytes_read;
+        size_t data_size, tail_size;
+        chunk_summary summary;
+
+        memcpy(buffer, file->pending, file->n_pending);
+
+        if ((bytes_read = pread(file->fd, buffer + file->n_pending, read_size, file->offset)) == -1 && errno == EINTR) continue;
+
+        if (bytes_read == -1) {
+            printf("Error reading the file %s: %s\n", file->name, strerror(errno));
+            return;
+        }
+
+        if (bytes_read == 0) return;
+
+        file->offset += bytes_read;
+        file->changed = true;
+
+        data_size = file->n_pending + bytes_read;
+        tail_size = partial_tail_size(buffer, data_size);
+
+        if (data_size > tail_size) {
+            summarize_chunk(buffer, data_size - tail_size, &summary);
+            merge_summaries(&file->summary, &summary);
+        }
+
+        memmove(file->pending, buffer + data_size - tail_size, tail_size);
+        file->n_pending = tail_size;
+    }
+}
+
+/**
+ * @brief Brings a file up to date. A file that was rotated has the rest of its old data read
+ * before the new file with its name is opened, and one that got shorter is read from the start.
+ *
+ */
+static void update_file(int inotify_fd, followed_file *file, unsigned char *buffer, size_t read_size) {
+    struct stat file_stat, name_stat;
+    bool has_name = stat(file->name, &name_stat) == 0;
+
+    if (file->fd != -1 && (!has_name || name_stat.st_dev != file->device || name_stat.st_ino != file->inode)) {
+        read_appended(file, buffer, read_size);
+
+        if (file->file_wd != -1) inotify_rm_watch(inotify_fd, file->file_wd);
+        close(file->fd);
+        file->fd = -1;
+        file->file_wd = -1;
+        end_text(file);
+    }
+
+    if (file->fd == -1 && (!has_name || !open_followed(inotify_fd, file))) return;
+
+    if (fstat(file->fd, &file_stat) == 0 && (size_t) file_stat.st_size < file->offset) end_text(file);
+
+    read_appended(file, buffer, read_size);
+}
+
+/**
+ * @brief Prints the measurements of the files that changed since they were last printed.
+ *
+ */
+static void print_changed(followed_file *files, size_t n_files, uint64_t start_ms) {
+    bool printed = false;
+
+    for (size_t i = 0; i < n_files; i++) {
+        measurements result = files[i].earlier;
+
+        if (!files[i].changed) continue;
+
+        if (!printed) {
+            printf("\nUpdate at %.3f s\n", (now_ms() - start_ms) / 1000.0);
+            printed = true;
+        }
+
+        summary_results(&files[i].summary, &result);
+        files[i].changed = false;
+
+        printf("File name: %s\n", files[i].name);
+        printf("Number of words = %lu\n", result.n_words);
+        printf("Number of words that start with vowel = %lu\n", result.n_words_start_vowel);
+        printf("Number of words that start with consonant = %lu\n", result.n_words_end_cons);
+    }
+
+    if (printed) fflush(stdout);
+}
+
+/**
+ * @brief Reads the pending inotify events and updates the files they are about.
+ *
+ */
+static void handle_events(int inotify_fd, followed_file *files, size_t n_files, unsigned char *buffer, size_t read_size) {
+    char events[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t size;
+
+    while ((size = read(inotify_fd, events, sizeof(events))) > 0) {
+        for (char *position = events; position < events + size;) {
+            const struct inotify_event *event = (const struct inotify_event *) position;
+
+            for (size_t i = 0; i < n_files; i++) {
+                followed_file *file = &files[i];
+                bool about_file = event->wd == file->file_wd;
+                bool about_name = event->wd == file->directory_wd && event->len > 0 && strcmp(event->name, file->base_name) == 0;
+
+                if (about_file || about_name) update_file(inotify_fd, file, buffer, read_size);
+            }
+
+            position += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+bool follow_files(
+    size_t n_files, char **file_names, const chunk_summary *summaries, const size_t *sizes,
+    size_t interval_ms, size_t read_size
+) {
+    followed_file *files;
+    unsigned char *buffer;
+    struct sigaction action;
+    uint64_t start_ms = now_ms();
+    uint64_t next_print_ms = start_ms + interval_ms;
+    int inotify_fd;
+
+    if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        printf("Error starting inotify: %s\n", strerror(errno));
+        return false;
+    }
+
+    if ((files = calloc(n_files, sizeof(followed_file))) == NULL || (buffer = malloc(read_size + UTF8_MAX_PARTIAL)) == NULL) {
+        fprintf(stderr, "Error allocating memory to follow the files: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n_files; i++) {
+        followed_file *file = &files[i];
+        char *slash;
+
+        if ((file->name = strdup(file_names[i])) == NULL) {
+            fprintf(stderr, "Error allocating memory to follow the files: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        // The directory is watched for files created under the name, once the file is rotated.
+        if ((slash = strrchr(file->name, '/')) == NULL) {
+            file->base_name = file->name;
+            file->directory_wd = inotify_add_watch(inotify_fd, ".", DIRECTORY_EVENTS);
+        } else {
+            *slash = '\0';
+            file->directory_wd = inotify_add_watch(inotify_fd, slash == file->name ? "/" : file->name, DIRECTORY_EVENTS);
+            *slash = '/';
+            file->base_name = slash + 1;
+        }
+
+        file->file_wd = -1;
+        file->summary = summaries[i];
+        file->offset = sizes[i];
+
+        // The sequence cut off at the end goes back in front of the appended bytes.
+        memcpy(file->pending, file->summary.tail, file->summary.tail_size);
+        file->n_pending = file->summary.tail_size;
+        file->summary.tail_size = 0;
+
+        if (file->directory_wd == -1) printf("Error watching the directory of %s: %s\n", file->name, strerror(errno));
+
+        if (!open_followed(inotify_fd, file)) printf("Waiting for the file %s to be created\n", file->name);
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("\nFollowing %lu files, printing the ones that change every %lu ms\n", n_files, interval_ms);
+    fflush(stdout);
+
+    // Whatever was appended since the files were counted is read first.
+    for (size_t i = 0; i < n_files; i++) {
+        update_file(inotify_fd, &files[i], buffer, read_size);
+    }
+
+    while (!stop_following) {
+        struct pollfd poll_fd = {inotify_fd, POLLIN, 0};
+        uint64_t now = now_ms();
+
+        if (now >= next_print_ms) {
+            print_changed(files, n_files, start_ms);
+            next_print_ms = now + interval_ms;
+        }
+
+        if (poll(&poll_fd, 1, (int) (next_print_ms - now)) > 0) {
+            handle_events(inotify_fd, files, n_files, buffer, read_size);
+        }
+    }
+
+    print_changed(files, n_files, start_ms);
+
+    for (size_t i = 0; i < n_files; i++) {
+        if (files[i].fd != -1) close(files[i].fd);
+        free(files[i].name);
+    }
+
+    free(files);
+    free(buffer);
+    close(inotify_fd);
+    return true;
+}
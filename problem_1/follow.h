@@ -0,0 +1,41 @@
+/**
+ * @file follow.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Follows files that keep growing, like logs. Each file is watched with inotify and
+ * only the bytes appended since it was last read are summarized and merged after the summary
+ * of the rest, so an update costs as much as what was appended and never rescans the file.
+ *
+ * A file that is rotated, i.e. renamed or removed and created again under its name, has the
+ * rest of its old data read and is then followed from the start of the new file. A file that
+ * is truncated, like logrotate's copytruncate does, is followed from its start as a new text.
+ * The counts of the texts left behind are kept, so the measurements of a file name only grow.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#ifndef FOLLOW_GUARD
+#define FOLLOW_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "wordcount.h"
+
+/**
+ * @brief Follows files until the process gets SIGINT or SIGTERM, printing the measurements
+ * of the files that changed every interval.
+ *
+ * @param n_files
+ * @param file_names
+ * @param summaries The summary of each file as it was counted already.
+ * @param sizes The number of bytes each summary covers, where the file is followed from.
+ * @param interval_ms
+ * @param read_size The size of the reads of the appended bytes.
+ * @return true if the files were followed until a signal and false if inotify couldn't be used.
+ */
+bool follow_files(
+    size_t n_files, char **file_names, const chunk_summary *summaries, const size_t *sizes,
+    size_t interval_ms, size_t read_size
+);
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "hyperloglog.h"
+
+/**
+ * @brief Bits of the hash left after the ones that choose the register.
+ *
+ */
+#define RANK_BITS (64 - HLL_PRECISION)
+
+/**
+ * @brief Natural logarithm of 2, as libm isn't linked.
+ *
+ */
+#define LN_2 0.693147180559945309417
+
+/**
+ * @brief Square root of a number between 0 and 1, by Newton's method from 1, which only
+ * gets smaller until it is reached.
+ *
+ */
+static double square_root(double x) {
+    double root = 1.0;
+    double next = 0.5 * (root + x / root);
+
+    while (next < root) {
+        root = next;
+        next = 0.5 * (root + x / root);
+    }
+
+    return root;
+}
+
+/**
+ * @brief x plus the sum of x^(2^k) * 2^(k-1) for k from 1, as in the estimator of Ertl, "New cardinality
+ * estimation algorithms for HyperLogLog sketches", 2017.
+ *
+ */
+static double sigma(double x) {
+    double y = 1.0;
+    double z = x;
+    double last_z;
+
+    do {
+        x *= x;
+        last_z = z;
+        z += x * y;
+        y += y;
+    } while (z != last_z);
+
+    return z;
+}
+
+/**
+ * @brief Sum of (1 - x^(2^-k))^2 * 2^-k for k from 1, over 3 and with the first term as 1 - x,
+ * from the same estimator.
+ *
+ */
+static double tau(double x) {
+    double y = 1.0;
+    double z = 1.0 - x;
+    double last_z;
+
+    if (x == 0.0 || x == 1.0) return 0.0;
+
+    do {
+        x = square_root(x);
+        last_z = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while (z != last_z);
+
+    return z / 3.0;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+hll_sketch_t *h_l_create() {
+    return calloc(1, sizeof(hll_sketch_t));
+}
+
+
+void h_l_add(hll_sketch_t *sketch, uint64_t hash) {
+    uint64_t rest = hash << HLL_PRECISION;
+    uint8_t rank = rest == 0 ? RANK_BITS + 1 : __builtin_clzll(rest) + 1;
+    uint8_t *reg = &sketch->registers[hash >> RANK_BITS];
+
+    if (rank > *reg) *reg = rank;
+}
+
+
+void h_l_merge(hll_sketch_t *into, const hll_sketch_t *from) {
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        if (from->registers[i] > into->registers[i]) into->registers[i] = from->registers[i];
+    }
+}
+
+
+uint64_t h_l_estimate(const hll_sketch_t *sketch) {
+    // Unlike the original estimator, this one has no bias to correct for few or many words.
+    size_t counts[RANK_BITS + 2] = {0};
+    double m = HLL_REGISTERS;
+    double z;
+
+    for (size_t i = 0; i < HLL_REGISTERS; i++) {
+        counts[sketch->registers[i]]++;
+    }
+
+    if (counts[0] == HLL_REGISTERS) return 0;
+
+    z = m * tau(1.0 - counts[RANK_BITS + 1] / m);
+    for (int k = RANK_BITS; k >= 1; k--) {
+        z = 0.5 * (z + counts[k]);
+    }
+    z += m * sigma(counts[0] / m);
+
+    return (uint64_t) (m * m / (2.0 * LN_2 * z) + 0.5);
+}
+
+
+void h_l_destroy(hll_sketch_t *sketch) {
+    free(sketch);
+}
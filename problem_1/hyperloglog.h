@@ -0,0 +1,80 @@
+/**
+ * @file hyperloglog.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief This module contains HyperLogLog sketches, which estimate how many distinct words
+ * were added to them in a fixed amount of memory, HLL_REGISTERS bytes, however many words
+ * there are. The estimates are within about 1.6% of the exact count, more for very few words.
+ *
+ * Sketches of different parts of a text are merged by keeping the largest value of each
+ * register, so adding a word twice, in the same sketch or in two merged ones, changes nothing.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+
+#ifndef HYPERLOGLOG_GUARD
+#define HYPERLOGLOG_GUARD
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * @brief Bits of the hash of a word that choose its register. The standard error of the
+ * estimates is 1.04 / sqrt(HLL_REGISTERS).
+ *
+ */
+#define HLL_PRECISION 12
+
+/**
+ * @brief Number of registers of a sketch, one byte each.
+ *
+ */
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+/**
+ * @brief Data structure representing a sketch.
+ * It's fields must not be changed directly.
+ *
+ */
+typedef struct hll_sketch_t {
+    uint8_t registers[HLL_REGISTERS];
+} hll_sketch_t;
+
+/**
+ * @brief Creates an empty sketch.
+ *
+ * @return hll_sketch_t* A pointer to the sketch on success or NULL on failure.
+ */
+hll_sketch_t *h_l_create();
+
+/**
+ * @brief Adds a word to the sketch, by its hash. The hash must have all 64 bits well mixed,
+ * like the ones of w_t_hash().
+ *
+ * @param sketch
+ * @param hash
+ */
+void h_l_add(hll_sketch_t *sketch, uint64_t hash);
+
+/**
+ * @brief Merges a sketch into another one, which then estimates the distinct words of both.
+ *
+ * @param into
+ * @param from
+ */
+void h_l_merge(hll_sketch_t *into, const hll_sketch_t *from);
+
+/**
+ * @brief Estimates the number of distinct words added to the sketch.
+ *
+ */
+uint64_t h_l_estimate(const hll_sketch_t *sketch);
+
+/**
+ * @brief Deallocates the sketch.
+ *
+ * @param sketch
+ */
+void h_l_destroy(hll_sketch_t *sketch);
+
+#endif
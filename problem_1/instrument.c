@@ -0,0 +1,200 @@
+#include "instrument.h"
+
+#ifdef INSTRUMENT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * @brief Size of a cache line. The counters of each worker take their own cache lines.
+ *
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief Counters of a worker. Only the worker writes to them.
+ *
+ */
+typedef struct thread_counters {
+    uint64_t timers_ns[N_TIMERS];
+    uint64_t n_chunks;
+    uint64_t n_bytes;
+    uint64_t latency_histogram[LATENCY_BUCKETS];
+} __attribute__((aligned(CACHE_LINE_SIZE))) thread_counters;
+
+static const char *TIMER_NAMES[N_TIMERS] = {"get_data", "lock_wait", "queue_wait", "fill", "process", "submit"};
+
+struct instrument_t {
+    thread_counters *counters;
+    size_t n_counters;
+};
+
+/**
+ * @brief The counters the calling thread counts into, NULL if it isn't bound to a worker.
+ *
+ */
+static __thread thread_counters *bound_counters = NULL;
+
+/**
+ * @brief Gets the bucket of the latency histogram of a chunk.
+ *
+ */
+static size_t latency_bucket(uint64_t latency_ns) {
+    uint64_t latency_us = latency_ns / 1000;
+    size_t bucket = 0;
+
+    while (latency_us != 0 && bucket < LATENCY_BUCKETS - 1) {
+        latency_us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+instrument_t *instrument_create(size_t n_threads) {
+    instrument_t *instrument;
+
+    if ((instrument = malloc(sizeof(instrument_t))) == NULL) return NULL;
+
+    if ((instrument->counters = aligned_alloc(CACHE_LINE_SIZE, sizeof(thread_counters) * n_threads)) == NULL) {
+        free(instrument);
+        return NULL;
+    }
+
+    memset(instrument->counters, 0, sizeof(thread_counters) * n_threads);
+    instrument->n_counters = n_threads;
+    return instrument;
+}
+
+
+void instrument_bind(instrument_t *instrument, int thread_id) {
+    bound_counters = &instrument->counters[thread_id];
+}
+
+
+uint64_t instrument_now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+void instrument_add(instrument_timer timer, uint64_t ns) {
+    if (bound_counters != NULL) bound_counters->timers_ns[timer] += ns;
+}
+
+
+void instrument_chunk(size_t bytes, uint64_t latency_ns) {
+    thread_counters *thread = bound_counters;
+
+    if (thread == NULL) return;
+
+    thread->n_chunks++;
+    thread->n_bytes += bytes;
+    thread->latency_histogram[latency_bucket(latency_ns)]++;
+}
+
+
+void instrument_report(const instrument_t *instrument, double elapsed_s) {
+    const thread_counters *counters = instrument->counters;
+    size_t n_counters = instrument->n_counters;
+    thread_counters total;
+
+    memset(&total, 0, sizeof(total));
+
+    printf("\n%-8s %10s %10s", "Thread", "Chunks", "MB");
+    for (size_t timer = 0; timer < N_TIMERS; timer++) printf(" %12s", TIMER_NAMES[timer]);
+    printf(" %8s\n", "busy");
+
+    for (size_t thread_idx = 0; thread_idx <= n_counters; thread_idx++) {
+        const thread_counters *thread = thread_idx < n_counters ? &counters[thread_idx] : &total;
+
+        if (thread_idx < n_counters) {
+            printf("%-8lu", thread_idx);
+        } else {
+            printf("%-8s", "total");
+        }
+
+        printf(" %10lu %10.1f", thread->n_chunks, thread->n_bytes / 1e6);
+        for (size_t timer = 0; timer < N_TIMERS; timer++) printf(" %11.6fs", thread->timers_ns[timer] / 1e9);
+
+        // Share of the elapsed time the worker was processing, averaged over the workers for the total.
+        printf(
+            " %7.1f%%\n", elapsed_s <= 0 ? 0.0 :
+            100.0 * thread->timers_ns[TIMER_PROCESS] / 1e9 / elapsed_s / (thread_idx < n_counters ? 1 : n_counters)
+        );
+
+        if (thread_idx == n_counters) break;
+
+        total.n_chunks += thread->n_chunks;
+        total.n_bytes += thread->n_bytes;
+        for (size_t timer = 0; timer < N_TIMERS; timer++) total.timers_ns[timer] += thread->timers_ns[timer];
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            total.latency_histogram[bucket] += thread->latency_histogram[bucket];
+        }
+    }
+
+    printf("\nChunk latency:\n");
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (total.latency_histogram[bucket] == 0) continue;
+
+        printf("  < %8lu us %10lu\n", 1ul << bucket, total.latency_histogram[bucket]);
+    }
+}
+
+
+bool instrument_write_json(const instrument_t *instrument, const char *file_name, double elapsed_s) {
+    const thread_counters *counters = instrument->counters;
+    size_t n_counters = instrument->n_counters;
+    FILE *file;
+
+    if ((file = fopen(file_name, "w")) == NULL) return false;
+
+    fprintf(file, "{\n  \"elapsed_s\": %.9f,\n  \"latency_bucket_upper_us\": [", elapsed_s);
+    for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        fprintf(file, "%s%lu", bucket == 0 ? "" : ", ", 1ul << bucket);
+    }
+    fprintf(file, "],\n  \"threads\": [\n");
+
+    for (size_t thread_idx = 0; thread_idx < n_counters; thread_idx++) {
+        const thread_counters *thread = &counters[thread_idx];
+
+        fprintf(
+            file, "    {\"id\": %lu, \"chunks\": %lu, \"bytes\": %lu",
+            thread_idx, thread->n_chunks, thread->n_bytes
+        );
+
+        for (size_t timer = 0; timer < N_TIMERS; timer++) {
+            fprintf(file, ", \"%s_s\": %.9f", TIMER_NAMES[timer], thread->timers_ns[timer] / 1e9);
+        }
+
+        fprintf(file, ", \"latency_histogram\": [");
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            fprintf(file, "%s%lu", bucket == 0 ? "" : ", ", thread->latency_histogram[bucket]);
+        }
+
+        fprintf(file, "]}%s\n", thread_idx + 1 < n_counters ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+
+void instrument_destroy(instrument_t *instrument) {
+    free(instrument->counters);
+    free(instrument);
+}
+
+#endif
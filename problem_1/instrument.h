@@ -0,0 +1,132 @@
+/**
+ * @file instrument.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Optional instrumentation of the worker threads. It records, for each worker, where
+ * its time goes (getting data, waiting on locks and queues, filling the circular buffer,
+ * processing and submitting) along with the bytes and chunks it handled and a histogram
+ * of how long chunks took to process.
+ *
+ * It is compiled out unless INSTRUMENT is defined (gcc -DINSTRUMENT); without it the
+ * INSTRUMENT_* macros expand to nothing and the hot path is left untouched.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#ifndef INSTRUMENT_GUARD
+#define INSTRUMENT_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Where the time of a worker is spent. TIMER_GET_DATA includes the lock, queue
+ * and fill timers, which only apply to some readers.
+ *
+ */
+typedef enum instrument_timer {
+    TIMER_GET_DATA,     // Inside get_data_portion().
+    TIMER_LOCK_WAIT,    // Blocked on the lock of a circular buffer.
+    TIMER_QUEUE_WAIT,   // Waiting for the prefetch readers to fill a buffer.
+    TIMER_FILL,         // Inside c_b_fill().
+    TIMER_PROCESS,      // Summarizing the chunk and counting its words.
+    TIMER_SUBMIT,       // Inside submit_results().
+    N_TIMERS
+} instrument_timer;
+
+/**
+ * @brief Number of buckets of the chunk latency histogram. Bucket i counts chunks that took
+ * less than 2^i microseconds and at least 2^(i-1), the last one also the ones that took longer.
+ *
+ */
+#define LATENCY_BUCKETS 24
+
+/**
+ * @brief Data structure representing the counters of the workers of a counter. Counters each
+ * have their own. It's fields are private.
+ *
+ */
+typedef struct instrument_t instrument_t;
+
+#ifdef INSTRUMENT
+
+/**
+ * @brief Allocates the counters of the workers. Must be called before they start.
+ *
+ * @param n_threads
+ * @return instrument_t* The counters on success or NULL on failure, with errno set.
+ */
+instrument_t *instrument_create(size_t n_threads);
+
+/**
+ * @brief Makes the INSTRUMENT_* macros of the calling thread count into the counters of a
+ * worker. Threads that aren't bound aren't counted.
+ *
+ * @param instrument
+ * @param thread_id
+ */
+void instrument_bind(instrument_t *instrument, int thread_id);
+
+/**
+ * @brief Gets the current time in nanoseconds.
+ *
+ */
+uint64_t instrument_now();
+
+/**
+ * @brief Adds time to a timer of the worker bound to the calling thread.
+ *
+ * @param timer
+ * @param ns
+ */
+void instrument_add(instrument_timer timer, uint64_t ns);
+
+/**
+ * @brief Counts a chunk processed by the worker bound to the calling thread.
+ *
+ * @param bytes The size of the chunk.
+ * @param latency_ns How long processing it took.
+ */
+void instrument_chunk(size_t bytes, uint64_t latency_ns);
+
+/**
+ * @brief Prints a table with the counters of each worker and the latency histogram.
+ * Must be called while the workers aren't processing data.
+ *
+ * @param instrument
+ * @param elapsed_s The time the workers ran for.
+ */
+void instrument_report(const instrument_t *instrument, double elapsed_s);
+
+/**
+ * @brief Writes the counters of each worker as JSON.
+ *
+ * @param instrument
+ * @param file_name
+ * @param elapsed_s The time the workers ran for.
+ * @return true on success and false on failure, with errno set.
+ */
+bool instrument_write_json(const instrument_t *instrument, const char *file_name, double elapsed_s);
+
+/**
+ * @brief Frees the counters.
+ *
+ * @param instrument
+ */
+void instrument_destroy(instrument_t *instrument);
+
+#define INSTRUMENT_START(start_var) uint64_t start_var = instrument_now()
+#define INSTRUMENT_RESTART(start_var) start_var = instrument_now()
+#define INSTRUMENT_STOP(timer, start_var) instrument_add((timer), instrument_now() - (start_var))
+#define INSTRUMENT_CHUNK(bytes, start_var) instrument_chunk((bytes), instrument_now() - (start_var))
+
+#else
+
+#define INSTRUMENT_START(start_var)
+#define INSTRUMENT_RESTART(start_var)
+#define INSTRUMENT_STOP(timer, start_var)
+#define INSTRUMENT_CHUNK(bytes, start_var)
+
+#endif
+
+#endif
@@ -5,98 +5,153 @@
 
 #include <time.h>
 #include <getopt.h>
-#include <pthread.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include "utf8iter.h"
-#include "utf8.h"
+#include "countwords.h"
 #include "concurrency.h"
+#include "wordcount.h"
+#include "instrument.h"
+#include "placement.h"
+#include "follow.h"
+#include "server.h"
+#include "decompress.h"
 
 /**
- * @brief Procedure to calculate the number of words, number of words starting with a vowel
- * and number of words ending with a consonant.
+ * @brief Values getopt_long() returns for the options that only have a long name.
  * 
- * @param data The text to process.
- * @param data_size The size of the text in bytes.
- * @param out Output of the measurements of the text provided.
  */
-void process_data(const unsigned char *data, const size_t data_size, measurements *out) {
-    uint32_t utf8_char = 0; // The current utf8 character.
-    uint32_t prev_utf8_char = 0; // The previous utf8 character.
-    utf8iter iter = UTF8ITER(data, data_size); // Iterator of utf8 characters.
-    bool in_word = false; // Flag to detected whether we are inside a word or not.
-    
-    while (!UTF8ITER_REACHED_END(&iter)) {
-        prev_utf8_char = utf8_char;
-        utf8_char = utf8iter_next_char(&iter);
-
-        if (!in_word) {
-            if(is_alphanumeric(utf8_char) || utf8_char == '_') {
-                in_word = true;
-                out->n_words++;
-
-                if (is_vowel(utf8_char)) {
-                    out->n_words_start_vowel++;
-                }
-            }
-        } else {
-            if (is_whitespace(utf8_char) || is_punctuation(utf8_char) || is_separator(utf8_char)) {
-                in_word = false;
+#define OPTION_PIN 256
+#define OPTION_NUMA 257
+#define OPTION_CACHE 258
+#define OPTION_FOLLOW 259
+#define OPTION_DISTINCT 260
+#define OPTION_TOP 261
+#define OPTION_PATTERNS 262
+#define OPTION_SERVE 263
 
-                if (is_consonant(prev_utf8_char)) {
-                    out->n_words_end_cons++;
-                }
-            }
-        }
-    }
+/**
+ * @brief Tells whether a file can be followed once counted: the standard input can't be read
+ * again and the appended bytes of a compressed file aren't text.
+ * 
+ */
+bool can_follow(const char *file_name) {
+    unsigned char magic[COMPRESSION_MAGIC_SIZE];
+    ssize_t bytes_read;
+    int fd;
+
+    if (strcmp(file_name, STDIN_FILE_NAME) == 0) return false;
+    if ((fd = open(file_name, O_RDONLY)) == -1) return true;
+
+    bytes_read = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+
+    return bytes_read <= 0 || detect_compression(magic, bytes_read) == COMPRESSION_NONE;
 }
 
 
 /**
- * @brief The procedure to be executed by the worker threads.
+ * @brief Parses a size in bytes with an optional 'k' or 'm' suffix.
  * 
- * @param thread_id_arg An application defined id for the thread.
- * @return void* 
+ * @param text The text to parse.
+ * @return size_t The size in bytes or 0 if the text isn't a valid size.
  */
-void *thread_procedure(void *thread_id_arg) {
-    int thread_id = *((int *) thread_id_arg);
-    int file_id;
-    size_t data_size;
-    unsigned char data[CHUNK_MAX_SIZE];
-
-    while (get_data_portion(thread_id, &file_id, data, &data_size)) {
-        measurements results = {0, 0, 0};
-
-        process_data(data, data_size, &results);
-        submit_results(thread_id, file_id, &results);
+size_t parse_size(const char *text) {
+    char *suffix;
+    unsigned long long size = strtoull(text, &suffix, 10);
+
+    if (suffix == text || text[0] == '-') return 0;
+
+    if (*suffix == 'k' || *suffix == 'K') {
+        size *= 1024;
+        suffix++;
+    } else if (*suffix == 'm' || *suffix == 'M') {
+        size *= 1024 * 1024;
+        suffix++;
     }
 
-    return 0;
+    return *suffix == '\0' ? (size_t) size : 0;
 }
 
 
 void program_usage(char *prog_path) {
     printf("\nUSAGE: .%s -n<number_of_threads> <file_1> [file_n]...\n", strrchr(prog_path, '/'));
+    printf("A file named '-' is the standard input, which is read through the prefetch pool\n");
+    printf("gzip and zstd files are decompressed by the prefetch readers when zlib or libzstd is installed\n");
     printf("-h\t\tPrints this message\n");
     printf("-n\t\tSets the number of threads\n");
+    printf("-r\t\tSets the reader used for the files: 'mmap' (default), 'cb' (circular buffer),\n");
+    printf("\t\t'prefetch' (reader thread filling a pool of buffers) or 'uring' (io_uring reading many files at once)\n");
+    printf("-p\t\tSets the number of buffers of the prefetch and uring pool (default 2 per thread)\n");
+    printf("-e\t\tSets the counting engine: 'simd' (default), 'scalar' or 'dfa'\n");
+    printf("-c\t\tSets the chunk size in bytes, 'k' and 'm' suffixes allowed (default 64k)\n");
+    printf("-a\t\tAdapts the chunk size of each file so a chunk takes the given microseconds to process\n");
+    printf("-w\t\tCounts every word, folded to lower case without accents, and prints the given number of most frequent ones\n");
+    printf("-o\t\tCounts every word and writes all of them with their counts to the given file\n");
+    printf("--distinct\tEstimates the distinct words of each file and of all of them with HyperLogLog sketches,\n");
+    printf("\t\twithin about 1.6%%, in a few KB per file instead of a table of every word\n");
+    printf("--top\t\tPrints the given number of most frequent words, kept in %d counters per word asked for by\n", SPACE_SAVING_FACTOR);
+    printf("\t\teach thread instead of a table of every word, with how much each count may be above the true one\n");
+    printf("--patterns\tCounts in each file the occurrences inside words of the patterns of the given file, one per line,\n");
+    printf("\t\tfolded to lower case without accents like the words\n");
+    printf("-j\t\tWrites the instrumentation of the workers as JSON to the given file (needs -DINSTRUMENT)\n");
+    printf("--pin\t\tPins each worker to a CPU, spread over the NUMA nodes and then over the physical cores\n");
+    printf("--numa\t\tPins the workers and allocates the memory of each one on its NUMA node\n");
+    printf("--cache\t\tKeeps the results of the files in the given file, so unchanged files aren't read again\n");
+    printf("\t\tand files that were appended to only have their new data read\n");
+    printf("--follow\tKeeps counting what is appended to the files, printing the ones that changed every given\n");
+    printf("\t\tmilliseconds until interrupted. Rotated and truncated files are followed from their start\n");
+    printf("--serve\t\tServes the counting on the Unix socket of the given path until interrupted, instead of counting files.\n");
+    printf("\t\tThe clients send files by path or inline and get their measurements, see server.h\n");
 }
 
 int main(int argc, char *argv[]) {
     int opt;
     int number_of_threads = 0;
+    reader_backend backend = READER_MMAP;
+    count_engine engine = ENGINE_VECTOR;
+    size_t chunk_size = CHUNK_SIZE_DEFAULT;
+    int target_chunk_latency_us = 0;
+    int pool_size = 0;
+    int top_words = -1;
+    placement_mode placement = PLACEMENT_NONE;
+    char *word_dump_path = NULL;
+    char *cache_path = NULL;
+    int follow_interval_ms = 0;
+    bool distinct_words = false;
+    int top_heavy = 0;
+    char *patterns_path = NULL;
+    char *serve_path = NULL;
+    ac_automaton_t *patterns = NULL;
+#ifdef INSTRUMENT
+    char *instrument_json_path = NULL;
+#endif
     char *prog_path = argv[0];
 
     char *file_names[argc];
     int number_of_files = 0;
 
+    struct option long_options[] = {
+        {"pin", no_argument, NULL, OPTION_PIN},
+        {"numa", no_argument, NULL, OPTION_NUMA},
+        {"cache", required_argument, NULL, OPTION_CACHE},
+        {"follow", required_argument, NULL, OPTION_FOLLOW},
+        {"distinct", no_argument, NULL, OPTION_DISTINCT},
+        {"top", required_argument, NULL, OPTION_TOP},
+        {"patterns", required_argument, NULL, OPTION_PATTERNS},
+        {"serve", required_argument, NULL, OPTION_SERVE},
+        {NULL, 0, NULL, 0}
+    };
+
     if (argc == 1) {
         printf("No arguments provided\n");
         program_usage(prog_path);
         return 1;
     }
 
-    while ((opt = getopt(argc, argv, "-:n:h")) != -1) {
+    while ((opt = getopt_long(argc, argv, "-:n:r:e:c:a:p:w:o:j:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'h':
                 program_usage(prog_path);
@@ -109,12 +164,127 @@ int main(int argc, char *argv[]) {
                     return 1;
                 }
                 break;
+            case 'r':
+                if (strcmp(optarg, "mmap") == 0) {
+                    backend = READER_MMAP;
+                } else if (strcmp(optarg, "cb") == 0) {
+                    backend = READER_CIRCULAR_BUFFER;
+                } else if (strcmp(optarg, "prefetch") == 0) {
+                    backend = READER_PREFETCH;
+                } else if (strcmp(optarg, "uring") == 0) {
+                    backend = READER_URING;
+                } else {
+                    printf("Option -r must be either 'mmap', 'cb', 'prefetch' or 'uring'\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case 'e':
+                if (strcmp(optarg, "simd") == 0) {
+                    engine = ENGINE_VECTOR;
+                } else if (strcmp(optarg, "scalar") == 0) {
+                    engine = ENGINE_SCALAR;
+                } else if (strcmp(optarg, "dfa") == 0) {
+                    engine = ENGINE_DFA;
+                } else {
+                    printf("Option -e must be either 'simd', 'scalar' or 'dfa'\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case 'c':
+                chunk_size = parse_size(optarg);
+                if (chunk_size < CHUNK_SIZE_MIN || chunk_size > CHUNK_SIZE_MAX) {
+                    printf("Option -c must be a size between %d and %d bytes\n", CHUNK_SIZE_MIN, CHUNK_SIZE_MAX);
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case 'a':
+                target_chunk_latency_us = atoi(optarg);
+                if (target_chunk_latency_us < 1) {
+                    printf("Option -a must be a positive number of microseconds\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case 'p':
+                pool_size = atoi(optarg);
+                if (pool_size < 1) {
+                    printf("Option -p must be a positive number of buffers\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case 'w':
+                top_words = atoi(optarg);
+                if (top_words < 0 || (top_words == 0 && strcmp(optarg, "0") != 0)) {
+                    printf("Option -w must be a number of words that isn't negative\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case 'o':
+                word_dump_path = optarg;
+                break;
+            case 'j':
+#ifdef INSTRUMENT
+                instrument_json_path = optarg;
+#else
+                printf("Option -j needs countWords to be built with -DINSTRUMENT\n");
+                return 1;
+#endif
+                break;
+            case OPTION_PIN:
+                if (placement == PLACEMENT_NONE) placement = PLACEMENT_PIN;
+                break;
+            case OPTION_NUMA:
+                placement = PLACEMENT_NUMA;
+                break;
+            case OPTION_CACHE:
+                cache_path = optarg;
+                break;
+            case OPTION_FOLLOW:
+                follow_interval_ms = atoi(optarg);
+                if (follow_interval_ms < 1) {
+                    printf("Option --follow must be a positive number of milliseconds\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case OPTION_DISTINCT:
+                distinct_words = true;
+                break;
+            case OPTION_TOP:
+                top_heavy = atoi(optarg);
+                if (top_heavy < 1) {
+                    printf("Option --top must be a positive number of words\n");
+                    program_usage(prog_path);
+                    return 1;
+                }
+                break;
+            case OPTION_PATTERNS:
+                patterns_path = optarg;
+                break;
+            case OPTION_SERVE:
+                serve_path = optarg;
+                break;
             case ':':
-                printf("Option -n requires an argument\n");
+                // Long options are reported by their name.
+                if (optopt < OPTION_PIN) {
+                    printf("Option -%c requires an argument\n", optopt);
+                } else {
+                    printf("Option %s requires an argument\n", argv[optind - 1]);
+                }
                 program_usage(prog_path);
                 return 1;
             case '?':
-                printf("Unknown option: %c\n", optopt);
+                // Long options have no character to report.
+                if (optopt != 0) {
+                    printf("Unknown option: %c\n", optopt);
+                } else {
+                    printf("Unknown option: %s\n", argv[optind - 1]);
+                }
                 program_usage(prog_path);
                 return 1;
             case 1:
@@ -130,62 +300,144 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    if (number_of_files == 0) {
+    if (serve_path != NULL && (number_of_files != 0 || follow_interval_ms != 0)) {
+        printf("Option --serve counts what the clients send, so no files can be given nor followed\n");
+        program_usage(prog_path);
+        return 1;
+    }
+
+    if (serve_path == NULL && number_of_files == 0) {
         printf("No files given for processing\n");
         program_usage(prog_path);
         return 1;
     }
 
+    if (patterns_path != NULL) {
+        size_t bad_line;
+
+        if ((patterns = a_c_load(patterns_path, &bad_line)) == NULL) {
+            if (bad_line != 0) {
+                printf("The pattern on line %lu of %s has a character that ends words, so it can't match\n", bad_line, patterns_path);
+            } else {
+                printf("Error reading the patterns of %s: %s\n", patterns_path, strerror(errno));
+            }
+            return 1;
+        }
+    }
+
+    if (!select_count_engine(engine)) {
+        printf("Error building the word automaton: %s\n", strerror(errno));
+        if (patterns != NULL) a_c_destroy(patterns);
+        return 1;
+    }
+
     printf("Number of worker threads: %d\n", number_of_threads);
-    printf("Number of files for processing: %d\n", number_of_files);
+    if (serve_path == NULL) printf("Number of files for processing: %d\n", number_of_files);
+    printf("Processing kernel: %s\n", process_data_kernel_name());
+    if (patterns != NULL) printf("Patterns: %lu in %lu states\n", patterns->n_patterns, patterns->n_states);
+
+    if (target_chunk_latency_us == 0) {
+        printf("Chunk size: %lu bytes\n", chunk_size);
+    } else {
+        printf("Chunk size: adaptive from %lu bytes, %d us per chunk\n", chunk_size, target_chunk_latency_us);
+    }
 
     //
     // Beginning of the threaded code
     //
-    pthread_t threads[number_of_threads];
-    int thread_ids[number_of_threads];
-
-    struct timespec start, finish;
-    bool threads_success = false;
-    int *threads_status;
+    counter_options options = c_w_default_options();
+    counter_t *counter;
+    shared_region_t *region;
+    count_stats stats;
     measurements *results;
 
-    initialize((size_t) number_of_files, file_names, (size_t) number_of_threads);
+    options.backend = backend;
+    options.chunk_size = chunk_size;
+    options.target_chunk_latency_us = (size_t) target_chunk_latency_us;
+    options.pool_size = (size_t) pool_size;
+    options.word_histogram = top_words >= 0 || word_dump_path != NULL;
+    options.distinct_words = distinct_words;
+    options.top_counters = (size_t) top_heavy * SPACE_SAVING_FACTOR;
+    options.patterns = patterns;
+    options.placement = placement;
+    options.cache_path = cache_path;
+
+    if (serve_path != NULL) {
+        if (options.word_histogram || options.distinct_words || options.top_counters != 0 || patterns != NULL) {
+            printf("Only the measurements of the requests are served, not their words\n");
+        }
 
-    clock_gettime (CLOCK_MONOTONIC_RAW, &start);
+        options.word_histogram = options.distinct_words = false;
+        options.top_counters = 0;
+        options.patterns = NULL;
+    }
 
-    // Create and start the threads.
-    for (int thread_idx = 0; thread_idx < number_of_threads; thread_idx++) {
-        thread_ids[thread_idx] = thread_idx;
-        if (pthread_create(&threads[thread_idx], NULL, thread_procedure, &thread_ids[thread_idx]) == -1) {
-            printf("Error creating thread %d: %s\n", thread_idx, strerror(errno));
-            return -1;
-        }
+    if (cache_path != NULL && (options.word_histogram || options.distinct_words || options.top_counters != 0 || options.patterns != NULL)) {
+        printf("The cache doesn't keep the words, so every file is read and the cache only updated\n");
     }
 
-    // Wait for the threads to finish.
-    for (int thread_idx = 0; thread_idx < number_of_threads; thread_idx++) {
-        if (pthread_join(threads[thread_idx], NULL) == -1) {
-            printf("Error joining thread %d: %s\n", thread_idx, strerror(errno));
-            return -1;
+    if ((counter = c_w_create((size_t) number_of_threads, &options)) == NULL) {
+        if (cache_path != NULL) {
+            printf("Error opening the cache %s or creating the worker threads: %s\n", cache_path, strerror(errno));
+        } else {
+            printf("Error creating the worker threads: %s\n", strerror(errno));
         }
+        return 1;
     }
 
-    clock_gettime (CLOCK_MONOTONIC_RAW, &finish);
+    if (placement != PLACEMENT_NONE && placement_get_mode(c_w_placement(counter)) == PLACEMENT_NONE) {
+        printf("The CPU topology couldn't be read, the workers won't be pinned\n");
+    }
 
-    get_final_results(&threads_success, &threads_status, &results);
+    if (serve_path != NULL) {
+        bool served = serve_socket(counter, serve_path);
+
+        c_w_destroy(counter);
+        if (patterns != NULL) a_c_destroy(patterns);
+        return served ? 0 : 1;
+    }
+
+    bool counted = c_w_count_files(counter, (size_t) number_of_files, file_names, &results, &stats);
+    int count_error = errno;
+
+    // The batch couldn't even be set up, so there is no run to tell about.
+    if ((region = c_w_last_run(counter)) == NULL) {
+        printf("Error counting the files: %s\n", strerror(count_error));
+        return 1;
+    }
+
+    printf("Reader: %s\n", get_reader_name(region));
+
+    for (int file_idx = 0; file_idx < number_of_files; file_idx++) {
+        int file_error = get_file_error(region, file_idx);
+
+        if (file_error != 0) printf("Error reading the file %s: %s\n", file_names[file_idx], strerror(file_error));
+    }
+
+    file_timing *timings = get_file_timings(region);
 
     // If there were any thread errors print them and exit with failure status.
-    if (!threads_success) {
+    if (!counted) {
+        bool thread_failed = false;
+
         for (int thread_idx = 0; thread_idx < number_of_threads; thread_idx++) {
 
-            if (threads_status[thread_idx] != 0) 
-                printf("Error at thread %d: %s\n", thread_idx, strerror(threads_status[thread_idx]));
+            if (stats.threads_status[thread_idx] != 0) {
+                printf("Error at thread %d: %s\n", thread_idx, strerror(stats.threads_status[thread_idx]));
+                thread_failed = true;
+            }
         }
 
+        if (!thread_failed) printf("Error counting the files: %s\n", strerror(count_error));
         return 1;
     }
 
+    hll_sketch_t **file_sketches;
+    hll_sketch_t *all_sketch;
+    bool estimated = get_distinct_words(region, &file_sketches, &all_sketch);
+    uint64_t **pattern_counts;
+    bool matched = get_pattern_counts(region, &pattern_counts);
+
     // Everything went smoothly. We can print the results
     for (int file_idx = 0; file_idx < number_of_files; file_idx++) {
         char *file_name = file_names[file_idx];
@@ -195,11 +447,192 @@ int main(int argc, char *argv[]) {
         printf("Number of words = %lu\n", result.n_words);
         printf("Number of words that start with vowel = %lu\n", result.n_words_start_vowel);
         printf("Number of words that start with consonant = %lu\n", result.n_words_end_cons);
+        if (estimated) printf("Distinct words (estimated) = %lu\n", h_l_estimate(file_sketches[file_idx]));
+
+        if (matched) {
+            uint64_t n_matches = 0;
+
+            for (size_t i = 0; pattern_counts[file_idx] != NULL && i < patterns->n_patterns; i++) {
+                n_matches += pattern_counts[file_idx][i];
+            }
+
+            printf("Pattern matches = %lu\n", n_matches);
+            for (size_t i = 0; pattern_counts[file_idx] != NULL && i < patterns->n_patterns; i++) {
+                if (pattern_counts[file_idx][i] != 0) printf("%10lu %s\n", pattern_counts[file_idx][i], patterns->names[i]);
+            }
+        }
+
+        if (timings[file_idx].processed) {
+            printf(
+                "Wall time = %.6f s (from %.6f s to %.6f s)\n",
+                (timings[file_idx].end_ns - timings[file_idx].start_ns) / 1000000000.0,
+                timings[file_idx].start_ns / 1000000000.0, timings[file_idx].end_ns / 1000000000.0
+            );
+        }
+    }
+
+    if (estimated) printf("\nDistinct words in all files (estimated) = %lu\n", h_l_estimate(all_sketch));
+
+    space_saving_t *top_summary;
+
+    if (options.top_counters != 0 && !get_top_words(region, &top_summary)) {
+        printf("Error merging the most frequent words: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (options.top_counters != 0) {
+        heavy_hitter *top = malloc(sizeof(heavy_hitter) * top_heavy);
+        size_t n_top;
+
+        if (top == NULL) {
+            printf("Error allocating memory for the most frequent words: %s\n", strerror(errno));
+            return 1;
+        }
+
+        n_top = s_s_top(top_summary, top_heavy, top);
+
+        // The error of a merged summary is at most the words over its counters, as for a single one.
+        printf(
+            "\nMost frequent words of %lu, every word seen more than %lu times has a counter:\n",
+            top_summary->n_words, top_summary->n_words / top_summary->capacity
+        );
+        printf("%10s %10s word\n", "count", "error");
+        for (size_t i = 0; i < n_top; i++) {
+            printf("%10lu %10lu %.*s\n", top[i].count, top[i].error, (int) top[i].size, top[i].word);
+        }
+
+        free(top);
+    }
+
+    struct timespec merge_start, merge_finish;
+    word_table_t **word_shards;
+    size_t n_word_shards;
+
+    clock_gettime (CLOCK_MONOTONIC_RAW, &merge_start);
+
+    if (options.word_histogram && !get_word_histogram(region, &word_shards, &n_word_shards)) {
+        printf("Error merging the words: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (options.word_histogram) {
+        size_t n_distinct_words = 0;
+        uint64_t n_words = 0;
+
+        clock_gettime (CLOCK_MONOTONIC_RAW, &merge_finish);
+
+        for (size_t shard = 0; shard < n_word_shards; shard++) {
+            n_distinct_words += w_t_size(word_shards[shard]);
+            n_words += word_shards[shard]->n_words;
+        }
+
+        printf("\nDistinct words = %lu of %lu words\n", n_distinct_words, n_words);
+        printf(
+            "Words merged in %.6f s\n",
+            (merge_finish.tv_sec - merge_start.tv_sec) / 1.0 + (merge_finish.tv_nsec - merge_start.tv_nsec) / 1000000000.0
+        );
+
+        if (top_words > 0) {
+            word_entry *top = malloc(sizeof(word_entry) * top_words);
+            size_t n_top;
+
+            if (top == NULL) {
+                printf("Error allocating memory for the most frequent words: %s\n", strerror(errno));
+                return 1;
+            }
+
+            n_top = w_t_top(word_shards, n_word_shards, top_words, top);
+
+            printf("Most frequent words:\n");
+            for (size_t i = 0; i < n_top; i++) {
+                printf("%10lu %.*s\n", top[i].count, (int) top[i].size, top[i].word);
+            }
+
+            free(top);
+        }
+
+        if (word_dump_path != NULL && !w_t_dump(word_shards, n_word_shards, word_dump_path)) {
+            printf("Error writing the words to %s: %s\n", word_dump_path, strerror(errno));
+            return 1;
+        }
     }
 
-    cleanup(); 
+    size_t prefetch_pool_size;
+    chunk_queue_stats filled_stats, empty_stats;
+    bool prefetched = get_prefetch_stats(region, &prefetch_pool_size, &filled_stats, &empty_stats);
+
+    printf ("\nElapsed time = %.6f s\n", stats.elapsed_s);
+    printf ("Result lock acquisitions avoided = %lu\n", stats.locks_avoided);
 
-    printf ("\nElapsed time = %.6f s\n",  (finish.tv_sec - start.tv_sec) / 1.0 + (finish.tv_nsec - start.tv_nsec) / 1000000000.0);
+    if (cache_path != NULL) {
+        if (stats.cache_started_over) printf("The cache %s wasn't valid, it was started over\n", cache_path);
+        printf(
+            "Cache: %lu hits, %lu appended, %lu misses\n",
+            stats.n_cache_hits, stats.n_cache_appended, stats.n_cache_misses
+        );
+        if (stats.cache_error != 0) printf("Error storing the results in the cache: %s\n", strerror(stats.cache_error));
+    }
+
+    if (prefetched) {
+        printf("Prefetch pool: %lu buffers, %lu chunks read\n", prefetch_pool_size, filled_stats.n_pops);
+        printf(
+            "Prefetch queue depth: average %.2f, maximum %lu\n",
+            filled_stats.n_pops == 0 ? 0.0 : (double) filled_stats.depth_sum / filled_stats.n_pops,
+            filled_stats.max_depth
+        );
+        printf(
+            "Workers starved: %lu times, %.6f s\n",
+            filled_stats.n_empty_waits, filled_stats.empty_wait_ns / 1000000000.0
+        );
+        printf(
+            "Reader out of buffers: %lu times, %.6f s\n",
+            empty_stats.n_empty_waits, empty_stats.empty_wait_ns / 1000000000.0
+        );
+    }
+
+    placement_report(c_w_placement(counter));
+
+#ifdef INSTRUMENT
+    instrument_report(c_w_instrument(counter), stats.elapsed_s);
+
+    if (instrument_json_path != NULL && !instrument_write_json(c_w_instrument(counter), instrument_json_path, stats.elapsed_s)) {
+        printf("Error writing the instrumentation to %s: %s\n", instrument_json_path, strerror(errno));
+        return 1;
+    }
+#endif
+
+    if (follow_interval_ms == 0) {
+        c_w_destroy(counter);
+        if (patterns != NULL) a_c_destroy(patterns);
+        return 0;
+    }
+
+    // The files are followed from where the count left them, after the workers are gone.
+    char *followed_names[number_of_files];
+    chunk_summary followed_summaries[number_of_files];
+    size_t followed_sizes[number_of_files];
+    size_t n_followed = 0;
+
+    for (int file_idx = 0; file_idx < number_of_files; file_idx++) {
+        if (!can_follow(file_names[file_idx])) {
+            printf("The file %s can't be followed\n", file_names[file_idx]);
+            continue;
+        }
+
+        followed_names[n_followed] = file_names[file_idx];
+        followed_summaries[n_followed] = *get_file_summary(region, file_idx, &followed_sizes[n_followed]);
+        n_followed++;
+    }
+
+    c_w_destroy(counter);
+    if (patterns != NULL) a_c_destroy(patterns);
+
+    if (n_followed == 0) return 0;
+    if (top_words >= 0 || word_dump_path != NULL || distinct_words || top_heavy != 0 || patterns_path != NULL) {
+        printf("Only the measurements of the files are followed, not their words\n");
+    }
 
-    return 0;
+    return follow_files(
+        n_followed, followed_names, followed_summaries, followed_sizes, (size_t) follow_interval_ms, chunk_size
+    ) ? 0 : 1;
 }
\ No newline at end of file
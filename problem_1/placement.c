@@ -0,0 +1,357 @@
+#define _GNU_SOURCE // CPU_SET and sched_setaffinity
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "placement.h"
+
+/**
+ * @brief Memory policy of set_mempolicy() that prefers the given node.
+ *
+ */
+#define MPOL_PREFERRED 1
+
+/**
+ * @brief Nodes the memory policy can name, the bits of a single mask word.
+ *
+ */
+#define MAX_POLICY_NODES (sizeof(unsigned long) * 8)
+
+/**
+ * @brief Size of a cache line. The counters of each worker take their own cache lines.
+ *
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief A CPU and where it is in the topology.
+ *
+ */
+typedef struct cpu_info {
+    int cpu;
+    int node;
+    int package;
+    int core;
+    int sibling_rank;   // 0 for the first hardware thread of a core, 1 for the second...
+} cpu_info;
+
+/**
+ * @brief Placement and counters of a worker.
+ *
+ */
+typedef struct worker_placement {
+    int cpu;
+    int node;
+    size_t n_local;
+    size_t n_remote;
+} __attribute__((aligned(CACHE_LINE_SIZE))) worker_placement;
+
+struct placement_t {
+    placement_mode mode;
+    cpu_info *cpus;             // The CPUs the process may run on, in the order they are given to the workers.
+    size_t n_cpus;
+    worker_placement *workers;
+    size_t n_workers;
+};
+
+/**
+ * @brief Reads a number from a file of sysfs.
+ *
+ * @return int The number or -1 if the file can't be read.
+ */
+static int read_sysfs_int(const char *path) {
+    FILE *file = fopen(path, "r");
+    int value = -1;
+
+    if (file == NULL) return -1;
+    if (fscanf(file, "%d", &value) != 1) value = -1;
+
+    fclose(file);
+    return value;
+}
+
+/**
+ * @brief Counts the CPUs of a sysfs CPU list, like "0-3,8", below a given CPU.
+ *
+ */
+static int count_cpus_below(const char *path, int cpu) {
+    FILE *file = fopen(path, "r");
+    int first, last, count = 0;
+    char separator = ',';
+
+    if (file == NULL) return 0;
+
+    while (separator == ',' && fscanf(file, "%d", &first) == 1) {
+        last = first;
+
+        if ((separator = fgetc(file)) == '-') {
+            if (fscanf(file, "%d", &last) != 1) break;
+            separator = fgetc(file);
+        }
+
+        for (int other = first; other <= last; other++) {
+            if (other < cpu) count++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+/**
+ * @brief Finds the node of a CPU from the nodeN link in its sysfs directory.
+ *
+ * @return int The node or 0 if the machine has no NUMA information.
+ */
+static int find_cpu_node(int cpu) {
+    char path[64];
+    DIR *dir;
+    struct dirent *entry;
+    int node = 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL) return 0;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) break;
+    }
+
+    closedir(dir);
+    return node;
+}
+
+/**
+ * @brief Orders CPUs by hardware thread of their core, so every physical core is used before
+ * their second threads, and then by where they are, to keep neighbouring workers close.
+ *
+ */
+static int compare_cpus(const void *a, const void *b) {
+    const cpu_info *cpu_a = a;
+    const cpu_info *cpu_b = b;
+
+    if (cpu_a->sibling_rank != cpu_b->sibling_rank) return cpu_a->sibling_rank - cpu_b->sibling_rank;
+    if (cpu_a->node != cpu_b->node) return cpu_a->node - cpu_b->node;
+    if (cpu_a->package != cpu_b->package) return cpu_a->package - cpu_b->package;
+    if (cpu_a->core != cpu_b->core) return cpu_a->core - cpu_b->core;
+    return cpu_a->cpu - cpu_b->cpu;
+}
+
+/**
+ * @brief Takes the sorted CPUs of each node in turn, so consecutive workers go to different
+ * nodes and share out the memory bandwidth of all of them.
+ *
+ */
+static bool interleave_nodes(placement_t *placement) {
+    const cpu_info *cpus = placement->cpus;
+    size_t n_cpus = placement->n_cpus;
+    cpu_info *ordered = malloc(sizeof(cpu_info) * n_cpus);
+    int *nodes = malloc(sizeof(int) * n_cpus);
+    size_t *next_cpus = calloc(n_cpus, sizeof(size_t));
+    size_t n_nodes = 0;
+    size_t n_ordered = 0;
+
+    if (ordered == NULL || nodes == NULL || next_cpus == NULL) {
+        free(ordered);
+        free(nodes);
+        free(next_cpus);
+        return false;
+    }
+
+    // The nodes in the order they first appear.
+    for (size_t i = 0; i < n_cpus; i++) {
+        size_t node_idx = 0;
+
+        while (node_idx < n_nodes && nodes[node_idx] != cpus[i].node) node_idx++;
+        if (node_idx == n_nodes) nodes[n_nodes++] = cpus[i].node;
+    }
+
+    while (n_ordered < n_cpus) {
+        for (size_t node_idx = 0; node_idx < n_nodes; node_idx++) {
+            size_t *next_cpu = &next_cpus[node_idx];
+
+            while (*next_cpu < n_cpus && cpus[*next_cpu].node != nodes[node_idx]) (*next_cpu)++;
+            if (*next_cpu < n_cpus) ordered[n_ordered++] = cpus[(*next_cpu)++];
+        }
+    }
+
+    free(placement->cpus);
+    free(nodes);
+    free(next_cpus);
+    placement->cpus = ordered;
+    return true;
+}
+
+/**
+ * @brief Reads the topology of the CPUs in the affinity mask of the process.
+ *
+ */
+static bool read_topology(placement_t *placement) {
+    cpu_set_t allowed;
+    char path[128];
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) return false;
+    if ((placement->cpus = malloc(sizeof(cpu_info) * CPU_COUNT(&allowed))) == NULL) return false;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        cpu_info *info;
+
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+
+        info = &placement->cpus[placement->n_cpus++];
+        info->cpu = cpu;
+        info->node = find_cpu_node(cpu);
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        info->package = read_sysfs_int(path);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        info->core = read_sysfs_int(path);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        info->sibling_rank = count_cpus_below(path, cpu);
+    }
+
+    if (placement->n_cpus == 0) {
+        errno = ENOENT;
+        return false;
+    }
+
+    qsort(placement->cpus, placement->n_cpus, sizeof(cpu_info), compare_cpus);
+    return interleave_nodes(placement);
+}
+
+/**
+ * @brief Gets the node of the page holding an address.
+ *
+ * @return int The node or -1 if the page isn't in memory.
+ */
+static int page_node(const void *address) {
+    void *page = (void *) ((uintptr_t) address & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1));
+    int status = -1;
+
+    // Without target nodes move_pages() only tells where the pages are.
+    if (syscall(SYS_move_pages, 0, 1, &page, NULL, &status, 0) == -1) return -1;
+
+    return status;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+placement_t *placement_create(placement_mode mode, size_t n_workers) {
+    placement_t *placement;
+    int error;
+
+    if ((placement = calloc(1, sizeof(placement_t))) == NULL) return NULL;
+
+    placement->mode = mode;
+    if (mode == PLACEMENT_NONE) return placement;
+
+    placement->n_workers = n_workers;
+    placement->workers = aligned_alloc(CACHE_LINE_SIZE, sizeof(worker_placement) * n_workers);
+
+    if (placement->workers == NULL || !read_topology(placement)) {
+        error = errno;
+        placement_destroy(placement);
+        errno = error;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n_workers; i++) {
+        placement->workers[i] = (worker_placement) {-1, -1, 0, 0};
+    }
+
+    return placement;
+}
+
+
+placement_mode placement_get_mode(const placement_t *placement) {
+    return placement->mode;
+}
+
+
+int placement_place_worker(placement_t *placement, size_t worker) {
+    const cpu_info *info;
+    cpu_set_t cpu_set;
+
+    if (placement->mode == PLACEMENT_NONE) return -1;
+
+    // More workers than CPUs share them in the same order again.
+    info = &placement->cpus[worker % placement->n_cpus];
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(info->cpu, &cpu_set);
+
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == -1) return -1;
+
+    placement->workers[worker].cpu = info->cpu;
+    placement->workers[worker].node = info->node;
+
+    if (placement->mode == PLACEMENT_NUMA && (size_t) info->node < MAX_POLICY_NODES) {
+        unsigned long node_mask = 1ul << info->node;
+
+        // Without a policy the pages would still come from the node that touches them first,
+        // this also holds when the process was started with another policy, e.g. by numactl.
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, &node_mask, MAX_POLICY_NODES + 1);
+    }
+
+    return info->node;
+}
+
+
+void placement_count_data(placement_t *placement, size_t worker, const void *data) {
+    worker_placement *worker_info;
+    int node;
+
+    if (placement->mode == PLACEMENT_NONE) return;
+
+    worker_info = &placement->workers[worker];
+    if (worker_info->node == -1 || (node = page_node(data)) < 0) return;
+
+    if (node == worker_info->node) {
+        worker_info->n_local++;
+    } else {
+        worker_info->n_remote++;
+    }
+}
+
+
+void placement_report(const placement_t *placement) {
+    size_t n_local = 0;
+    size_t n_remote = 0;
+
+    if (placement->mode == PLACEMENT_NONE) return;
+
+    printf("\nPlacement: %s\n", placement->mode == PLACEMENT_NUMA ? "pinned, memory on the node of the worker" : "pinned");
+
+    for (size_t i = 0; i < placement->n_workers; i++) {
+        const worker_placement *worker_info = &placement->workers[i];
+
+        printf(
+            "Worker %lu: cpu %d, node %d, data %lu local, %lu remote\n",
+            i, worker_info->cpu, worker_info->node, worker_info->n_local, worker_info->n_remote
+        );
+
+        n_local += worker_info->n_local;
+        n_remote += worker_info->n_remote;
+    }
+
+    printf("Data on the node of the worker: %lu local, %lu remote\n", n_local, n_remote);
+}
+
+
+void placement_destroy(placement_t *placement) {
+    free(placement->cpus);
+    free(placement->workers);
+    free(placement);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file placement.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Placement of the worker threads on the CPUs and NUMA nodes of the machine. The topology
+ * is read from sysfs and the workers are pinned in an order that spreads them over the nodes and
+ * over the physical cores before using their other hardware threads. With PLACEMENT_NUMA the
+ * memory each worker allocates afterwards is also taken from its own node.
+ *
+ * The data each worker processes can be checked to be on its node, to report how much of it
+ * was read from local and from remote memory.
+ *
+ * problem_1 holds the source of this module and problem_2 an identical copy, so changes are
+ * made here and copied over.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#ifndef PLACEMENT_GUARD
+#define PLACEMENT_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * @brief How the workers are placed.
+ *
+ */
+typedef enum placement_mode {
+    PLACEMENT_NONE,     // Left to the scheduler.
+    PLACEMENT_PIN,      // Pinned to a CPU each.
+    PLACEMENT_NUMA      // Pinned and allocating memory on the node of their CPU.
+} placement_mode;
+
+/**
+ * @brief Data structure representing the placement of a pool of workers: the topology of the
+ * CPUs and where each worker went. Each pool has its own.
+ * It's fields are private.
+ *
+ */
+typedef struct placement_t placement_t;
+
+/**
+ * @brief Reads the topology of the CPUs the process may run on and allocates the counters of
+ * the workers. Must be called before they start.
+ *
+ * @param mode
+ * @param n_workers
+ * @return placement_t* The placement on success or NULL if the topology couldn't be read or
+ * memory couldn't be allocated, with errno set. With PLACEMENT_NONE the topology isn't read.
+ */
+placement_t *placement_create(placement_mode mode, size_t n_workers);
+
+/**
+ * @brief Gets how the workers are placed.
+ *
+ * @param placement
+ * @return placement_mode
+ */
+placement_mode placement_get_mode(const placement_t *placement);
+
+/**
+ * @brief Pins the calling thread to the CPU of a worker and, with PLACEMENT_NUMA, makes the
+ * memory it touches from then on come from the node of that CPU.
+ *
+ * @param placement
+ * @param worker
+ * @return int The node of the worker or -1 if it wasn't placed.
+ */
+int placement_place_worker(placement_t *placement, size_t worker);
+
+/**
+ * @brief Counts a portion of data processed by a worker as local if its first page is on the
+ * node of the worker and as remote otherwise. Data that isn't in memory isn't counted.
+ *
+ * @param placement
+ * @param worker
+ * @param data
+ */
+void placement_count_data(placement_t *placement, size_t worker, const void *data);
+
+/**
+ * @brief Prints the CPU and node of each worker and how much of its data was local.
+ * Must be called while the workers aren't processing data.
+ *
+ * @param placement
+ */
+void placement_report(const placement_t *placement);
+
+/**
+ * @brief Frees the topology and the counters.
+ *
+ * @param placement
+ */
+void placement_destroy(placement_t *placement);
+
+#endif
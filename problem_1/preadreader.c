@@ -0,0 +1,327 @@
+#define _GNU_SOURCE // F_SETPIPE_SZ
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "preadreader.h"
+#include "concurrency.h"
+#include "filereader.h"
+
+/**
+ * @brief Work of a reader thread: a whole file or a range of a compressed file made of whole
+ * members or frames, whose data starts at offset once decompressed. The decompressed size of
+ * the range is only known if the file was split.
+ *
+ */
+typedef struct read_job {
+    size_t file_id;
+    compressed_part part;
+    size_t offset;
+    bool split;
+} read_job;
+
+struct pread_reader {
+    prefetch_pool *pool;
+    const compression_format *file_formats;
+
+    /**
+     * @brief The work of the reader threads in the order it is taken.
+     *
+     */
+    read_job *jobs;
+    size_t n_jobs;
+
+    /**
+     * @brief Position in jobs of the next job to be taken.
+     *
+     */
+    atomic_size_t next_job;
+
+    /**
+     * @brief Number of reader threads that haven't finished yet.
+     *
+     */
+    atomic_size_t n_running;
+
+    /**
+     * @brief The compressed files, mapped so that their members or frames can be decompressed
+     * by different reader threads. NULL for the other files.
+     *
+     */
+    mapped_file_t **compressed_files;
+};
+
+/**
+ * @brief Reads size bytes from the file at offset unless it ends first. The standard input
+ * is read from where it is instead, since pipes can't be read at an offset.
+ *
+ * @param size_out The amount of bytes read. It's only less than size at the end of the file.
+ * @return true on success and false if the file couldn't be read, with errno set.
+ */
+static bool read_fully(int fd, unsigned char *buffer, size_t size, size_t offset, size_t *size_out) {
+    size_t total_read = 0;
+
+    while (total_read < size) {
+        ssize_t bytes_read = fd == STDIN_FILENO ? read(fd, buffer + total_read, size - total_read)
+                                                : pread(fd, buffer + total_read, size - total_read, offset + total_read);
+
+        if (bytes_read == 0) break;
+        if (bytes_read == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        total_read += bytes_read;
+    }
+
+    *size_out = total_read;
+    return true;
+}
+
+/**
+ * @brief Reads a whole file into empty buffers of the pool, queueing them for the workers.
+ * A file that can't be opened is left out, and one that can't be read stops the run.
+ *
+ */
+static void read_file(prefetch_pool *pool, size_t file_id) {
+    char *file_name = pool->file_names[file_id];
+    size_t offset = pool->start_offsets[file_id];
+    int fd;
+
+    if (strcmp(file_name, STDIN_FILE_NAME) == 0) {
+        fd = STDIN_FILENO;
+
+        // A larger pipe lets the writer get further ahead. It's fine if it can't be resized.
+        fcntl(fd, F_SETPIPE_SZ, STDIN_PIPE_SIZE);
+    } else if ((fd = open(file_name, O_RDONLY)) == -1) {
+        p_f_set_file_error(pool, file_id, errno);
+        return;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (true) {
+        size_t chunk_size = atomic_load_explicit(&pool->chunk_sizes[file_id], memory_order_relaxed);
+        prefetch_buffer *buffer;
+
+        if ((buffer = p_f_take_empty(pool)) == NULL) break;
+
+        if (!read_fully(fd, buffer->data, chunk_size, offset, &buffer->size)) {
+            p_f_fail_file(pool, file_id, errno);
+            c_q_push(pool->empty, buffer);
+            break;
+        }
+
+        buffer->file_id = file_id;
+        buffer->offset = offset;
+        offset += buffer->size;
+
+        if (buffer->size == 0) {
+            c_q_push(pool->empty, buffer);
+            break;
+        }
+
+        c_q_push(pool->filled, buffer);
+        if (buffer->size < chunk_size) break;
+    }
+
+    if (fd != STDIN_FILENO) close(fd);
+}
+
+/**
+ * @brief Decompresses a range of a compressed file into empty buffers of the pool,
+ * queueing them for the workers. A range that can't be decompressed stops the run,
+ * with EBADMSG as the error of the file when its data is wrong.
+ *
+ */
+static void decompress_part(pread_reader_t *reader, const read_job *job) {
+    prefetch_pool *pool = reader->pool;
+    const unsigned char *data = m_f_data(reader->compressed_files[job->file_id]) + job->part.start;
+    size_t offset = job->offset;
+    decompressor_t *decompressor;
+    const char *error;
+
+    if ((decompressor = d_s_create(reader->file_formats[job->file_id], data, job->part.size)) == NULL) {
+        p_f_fail_file(pool, job->file_id, errno);
+        return;
+    }
+
+    while (true) {
+        size_t chunk_size = atomic_load_explicit(&pool->chunk_sizes[job->file_id], memory_order_relaxed);
+        prefetch_buffer *buffer;
+
+        if ((buffer = p_f_take_empty(pool)) == NULL) break;
+
+        buffer->size = d_s_read(decompressor, buffer->data, chunk_size, &error);
+        buffer->file_id = job->file_id;
+        buffer->offset = offset;
+        offset += buffer->size;
+
+        if (error != NULL) {
+            p_f_fail_file(pool, job->file_id, EBADMSG);
+            c_q_push(pool->empty, buffer);
+            break;
+        }
+
+        if (buffer->size == 0) {
+            c_q_push(pool->empty, buffer);
+            break;
+        }
+
+        c_q_push(pool->filled, buffer);
+        if (buffer->size < chunk_size) break;
+    }
+
+    d_s_destroy(decompressor);
+
+    // The ranges after this one were placed using the recorded size.
+    if (!p_f_failed(pool) && job->split && offset != job->offset + job->part.decompressed_size) {
+        p_f_fail_file(pool, job->file_id, EBADMSG);
+    }
+}
+
+/**
+ * @brief Adds a job to the work of the reader threads.
+ *
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool add_job(pread_reader_t *reader, size_t *capacity, read_job job) {
+    if (reader->n_jobs == *capacity) {
+        size_t grown_capacity = *capacity == 0 ? reader->pool->n_files : *capacity * 2;
+        read_job *grown = realloc(reader->jobs, sizeof(read_job) * grown_capacity);
+
+        if (grown == NULL) return false;
+
+        reader->jobs = grown;
+        *capacity = grown_capacity;
+    }
+
+    reader->jobs[reader->n_jobs++] = job;
+    return true;
+}
+
+/**
+ * @brief Lists the jobs of the files of the pool in their order, see p_r_create().
+ *
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool plan_jobs(pread_reader_t *reader) {
+    prefetch_pool *pool = reader->pool;
+    size_t capacity = 0;
+
+    if (pool->n_files == 0) return true;
+    if ((reader->compressed_files = calloc(pool->n_files, sizeof(mapped_file_t *))) == NULL) return false;
+
+    for (size_t position = 0; position < pool->n_files; position++) {
+        size_t file_id = pool->file_order[position];
+        compression_format format = reader->file_formats[file_id];
+        compressed_part *parts;
+        size_t n_parts, offset = 0;
+        mapped_file_t *mapped_file;
+
+        if (pool->start_offsets[file_id] == PREFETCH_SKIP) continue;
+
+        if (format == COMPRESSION_NONE) {
+            if (!add_job(reader, &capacity, (read_job) {file_id, {0, 0, 0}, 0, false})) return false;
+            continue;
+        }
+
+        if (!decompression_available(format)) {
+            p_f_set_file_error(pool, file_id, ENOTSUP);
+            continue;
+        }
+
+        if ((mapped_file = reader->compressed_files[file_id] = m_f_open(pool->file_names[file_id])) == NULL) {
+            p_f_set_file_error(pool, file_id, errno);
+            continue;
+        }
+
+        if (!split_compressed(format, m_f_data(mapped_file), m_f_size(mapped_file), DECOMPRESS_PART_SIZE, &parts, &n_parts)) {
+            if (!add_job(reader, &capacity, (read_job) {file_id, {0, m_f_size(mapped_file), 0}, 0, false})) return false;
+            continue;
+        }
+
+        for (size_t i = 0; i < n_parts; i++) {
+            if (!add_job(reader, &capacity, (read_job) {file_id, parts[i], offset, true})) {
+                free(parts);
+                return false;
+            }
+
+            offset += parts[i].decompressed_size;
+        }
+
+        free(parts);
+    }
+
+    return true;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+pread_reader_t *p_r_create(prefetch_pool *pool, const compression_format *file_formats, size_t n_threads) {
+    pread_reader_t *reader;
+    int error;
+
+    if ((reader = calloc(1, sizeof(pread_reader_t))) == NULL) return NULL;
+
+    reader->pool = pool;
+    reader->file_formats = file_formats;
+    atomic_init(&reader->next_job, 0);
+    atomic_init(&reader->n_running, n_threads);
+
+    if (!plan_jobs(reader)) {
+        error = errno;
+        p_r_destroy(reader);
+        errno = error;
+        return NULL;
+    }
+
+    return reader;
+}
+
+
+void *p_r_read_files(void *arg) {
+    size_t position;
+
+    pread_reader_t *reader = arg;
+
+    while ((position = atomic_fetch_add(&reader->next_job, 1)) < reader->n_jobs && !p_f_failed(reader->pool)) {
+        const read_job *job = &reader->jobs[position];
+
+        if (reader->file_formats[job->file_id] == COMPRESSION_NONE) {
+            read_file(reader->pool, job->file_id);
+        } else {
+            decompress_part(reader, job);
+        }
+    }
+
+    // The last reader to finish tells the workers there is no more data.
+    if (atomic_fetch_sub(&reader->n_running, 1) == 1) c_q_close(reader->pool->filled);
+    return NULL;
+}
+
+
+void p_r_destroy(pread_reader_t *reader) {
+    if (reader->compressed_files != NULL) {
+        for (size_t i = 0; i < reader->pool->n_files; i++) {
+            if (reader->compressed_files[i] != NULL) m_f_close(reader->compressed_files[i]);
+        }
+
+        free(reader->compressed_files);
+    }
+
+    free(reader->jobs);
+    free(reader);
+}
@@ -0,0 +1,74 @@
+/**
+ * @file preadreader.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Reader threads that fill the prefetch pool with pread, or by decompressing the
+ * compressed files. The work is split into jobs, a whole file or a range of whole members
+ * or frames of a compressed file, which the threads take in turn.
+ * @version 0.1
+ * @date 2022-05-06
+ *
+ */
+
+#ifndef PREADREADER_GUARD
+#define PREADREADER_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "prefetch.h"
+#include "decompress.h"
+
+/**
+ * @brief Size the pipe of the standard input is grown to, if it is a pipe.
+ *
+ */
+#define STDIN_PIPE_SIZE (1024 * 1024)
+
+/**
+ * @brief Decompressed size of the ranges of a compressed file given to different reader threads,
+ * when the file is made of several members or frames.
+ *
+ */
+#define DECOMPRESS_PART_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief State shared by the reader threads of a pool.
+ * It's fields are private.
+ *
+ */
+typedef struct pread_reader pread_reader_t;
+
+/**
+ * @brief Lists the work of the reader threads in the order of the files of the pool.
+ * Compressed files are mapped and split into ranges of whole members or frames when their
+ * sizes are recorded in them, so that a large file is decompressed by all of the reader
+ * threads at once. Files that can't be mapped or decompressed are left out and their error recorded.
+ *
+ * @param pool The pool the threads fill, which must outlive the reader.
+ * @param file_formats Format of each of the files of the pool, which must outlive the reader.
+ * @param n_threads Number of threads that will run p_r_read_files(). The last one
+ * to finish closes the filled queue of the pool.
+ * @return pread_reader_t* The reader or NULL if memory couldn't be allocated, with errno set.
+ */
+pread_reader_t *p_r_create(prefetch_pool *pool, const compression_format *file_formats, size_t n_threads);
+
+/**
+ * @brief Procedure of the reader threads. Each one takes the next job no other thread took,
+ * reading or decompressing it into empty buffers of the pool. Reads can be cut at any byte
+ * since the summaries of the portions are merged. A file that can't be opened is left out,
+ * and one that can't be read or decompressed stops the run, with EBADMSG as the error of
+ * the file when its data is wrong. The standard input is read from where it is.
+ *
+ * @param arg The reader.
+ * @return void* NULL.
+ */
+void *p_r_read_files(void *arg);
+
+/**
+ * @brief Unmaps the compressed files and frees the reader. Its threads must have been joined.
+ *
+ * @param reader
+ */
+void p_r_destroy(pread_reader_t *reader);
+
+#endif
@@ -0,0 +1,45 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "prefetch.h"
+
+
+prefetch_buffer *p_f_take_empty(prefetch_pool *pool) {
+    void *item;
+
+    // The queue is only closed once the workers are gone, when the buffers won't come back.
+    if (!c_q_pop(pool->empty, &item)) return NULL;
+
+    if (p_f_failed(pool)) {
+        c_q_push(pool->empty, item);
+        return NULL;
+    }
+
+    return item;
+}
+
+
+void p_f_fail(prefetch_pool *pool, int error) {
+    int no_error = 0;
+
+    atomic_compare_exchange_strong(pool->error, &no_error, error);
+}
+
+
+void p_f_set_file_error(prefetch_pool *pool, size_t file_id, int error) {
+    int no_error = 0;
+
+    atomic_compare_exchange_strong(&pool->file_errors[file_id], &no_error, error);
+}
+
+
+void p_f_fail_file(prefetch_pool *pool, size_t file_id, int error) {
+    p_f_set_file_error(pool, file_id, error);
+    p_f_fail(pool, error);
+}
+
+
+bool p_f_failed(prefetch_pool *pool) {
+    return atomic_load_explicit(pool->error, memory_order_relaxed) != 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file prefetch.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief The pool of buffers that reader threads fill ahead of the workers, shared by the
+ * readers in preadreader.h and ringreader.h. A reader takes empty buffers from the pool,
+ * reads a portion of a file into each and pushes it to the filled queue, where a worker
+ * gets it and gives it back to the empty queue once it is processed.
+ * @version 0.1
+ * @date 2022-05-06
+ *
+ */
+
+#ifndef PREFETCH_GUARD
+#define PREFETCH_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "chunkqueue.h"
+
+/**
+ * @brief A buffer of the pool and the portion of data read into it.
+ *
+ */
+typedef struct prefetch_buffer {
+    unsigned char *data;
+    size_t size;
+    size_t file_id;
+    size_t offset;
+    size_t requested;   // Bytes asked for by the io_uring reader.
+    size_t slot;        // Slot of the file in the io_uring reader.
+} prefetch_buffer;
+
+/**
+ * @brief Start offset of the files the readers leave out, since all of them is already known.
+ *
+ */
+#define PREFETCH_SKIP SIZE_MAX
+
+/**
+ * @brief The pool of buffers of a run and what the readers need to know of the run to fill it.
+ * Its fields are set up by the owner of the run, the readers only go through them.
+ *
+ */
+typedef struct prefetch_pool {
+    prefetch_buffer *buffers;
+    size_t n_buffers;
+    chunk_queue_t *filled;          // Buffers with data waiting for a worker.
+    chunk_queue_t *empty;           // Buffers given back by the workers waiting to be filled again.
+    size_t n_files;
+    char **file_names;
+    const size_t *file_order;       // Order in which the files are read.
+    const size_t *start_offsets;    // Offset each file is read from, or PREFETCH_SKIP.
+    atomic_size_t *chunk_sizes;     // Size of the portions of each file, which may change during the run.
+    atomic_int *error;              // The first error of the run, which stops it, or 0.
+    atomic_int *file_errors;        // The first error reading each file, or 0.
+} prefetch_pool;
+
+/**
+ * @brief Takes an empty buffer of the pool for a reader.
+ *
+ * @param pool
+ * @return prefetch_buffer* The buffer or NULL if the run was stopped, in which case the reader must stop too.
+ */
+prefetch_buffer *p_f_take_empty(prefetch_pool *pool);
+
+/**
+ * @brief Stops the run with an error, unless it already stopped with another one.
+ *
+ * @param pool
+ * @param error
+ */
+void p_f_fail(prefetch_pool *pool, int error);
+
+/**
+ * @brief Records the error reading a file, unless it already had another one.
+ * The file is left out but the run goes on.
+ *
+ * @param pool
+ * @param file_id
+ * @param error
+ */
+void p_f_set_file_error(prefetch_pool *pool, size_t file_id, int error);
+
+/**
+ * @brief Stops the run because of an error reading a file, which is recorded for it too.
+ *
+ * @param pool
+ * @param file_id
+ * @param error
+ */
+void p_f_fail_file(prefetch_pool *pool, size_t file_id, int error);
+
+/**
+ * @brief Tells whether the run was stopped by an error.
+ *
+ * @param pool
+ * @return true if it was and false otherwise.
+ */
+bool p_f_failed(prefetch_pool *pool);
+
+#endif
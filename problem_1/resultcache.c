@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "resultcache.h"
+
+/**
+ * @brief Start of the cache file. The entries follow it.
+ *
+ */
+typedef struct cache_header {
+    char magic[8];
+    uint32_t entry_size;    // Tells apart the caches of builds with a different summary.
+    uint32_t reserved;
+    uint64_t capacity;      // Always a power of two.
+    uint64_t n_entries;
+} cache_header;
+
+/**
+ * @brief Summary of a file as of its key.
+ *
+ */
+typedef struct cache_entry {
+    cache_key key;
+    uint64_t fingerprint;   // Of the last bytes of the file, if it can be appended to.
+    uint32_t used;
+    uint32_t appendable;    // Whether the summary covers all of key.size bytes.
+    chunk_summary summary;
+} cache_entry;
+
+struct result_cache_t {
+    int fd;
+    cache_header *header;
+    cache_entry *entries;
+    size_t mapping_size;
+    result_cache_stats stats;
+};
+
+static size_t mapping_size(uint64_t capacity) {
+    return sizeof(cache_header) + sizeof(cache_entry) * capacity;
+}
+
+/**
+ * @brief Maps the cache file at the size of a capacity, growing the file if needed.
+ *
+ */
+static bool map_cache(result_cache_t *cache, uint64_t capacity) {
+    size_t size = mapping_size(capacity);
+    void *data;
+
+    if (ftruncate(cache->fd, size) == -1) return false;
+    if ((data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0)) == MAP_FAILED) return false;
+
+    cache->header = data;
+    cache->entries = (cache_entry *) (cache->header + 1);
+    cache->mapping_size = size;
+    return true;
+}
+
+/**
+ * @brief Makes the mapped file an empty cache.
+ *
+ */
+static void reset_cache(result_cache_t *cache, uint64_t capacity) {
+    memcpy(cache->header->magic, CACHE_MAGIC, sizeof(cache->header->magic));
+    cache->header->entry_size = sizeof(cache_entry);
+    cache->header->reserved = 0;
+    cache->header->capacity = capacity;
+    cache->header->n_entries = 0;
+    memset(cache->entries, 0, sizeof(cache_entry) * capacity);
+}
+
+static uint64_t hash_file(uint64_t device, uint64_t inode) {
+    uint64_t hash = inode * 0x9e3779b97f4a7c15ull ^ device;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief Finds the slot of a file: its entry or the empty slot where it would go.
+ *
+ */
+static cache_entry *find_slot(result_cache_t *cache, uint64_t device, uint64_t inode) {
+    uint64_t mask = cache->header->capacity - 1;
+    uint64_t slot = hash_file(device, inode) & mask;
+
+    while (cache->entries[slot].used && (cache->entries[slot].key.device != device || cache->entries[slot].key.inode != inode)) {
+        slot = (slot + 1) & mask;
+    }
+
+    return &cache->entries[slot];
+}
+
+/**
+ * @brief Doubles the capacity of the table, putting the entries back in their new slots.
+ *
+ */
+static bool grow_cache(result_cache_t *cache) {
+    uint64_t capacity = cache->header->capacity;
+    cache_header *old_header = cache->header;
+    size_t old_mapping_size = cache->mapping_size;
+    cache_entry *old_entries = malloc(sizeof(cache_entry) * capacity);
+
+    if (old_entries == NULL) return false;
+
+    memcpy(old_entries, cache->entries, sizeof(cache_entry) * capacity);
+
+    // The old mapping is kept until the new one is there, so a failure leaves the cache as it was.
+    if (!map_cache(cache, capacity * 2)) {
+        ftruncate(cache->fd, old_mapping_size);
+        free(old_entries);
+        return false;
+    }
+
+    munmap(old_header, old_mapping_size);
+
+    reset_cache(cache, capacity * 2);
+
+    for (uint64_t i = 0; i < capacity; i++) {
+        if (!old_entries[i].used) continue;
+
+        *find_slot(cache, old_entries[i].key.device, old_entries[i].key.inode) = old_entries[i];
+        cache->header->n_entries++;
+    }
+
+    free(old_entries);
+    return true;
+}
+
+/**
+ * @brief Hashes the CACHE_FINGERPRINT_SIZE bytes of a file before an offset, with FNV-1a.
+ *
+ * @return true on success and false if the file couldn't be read.
+ */
+static bool fingerprint_file(const char *file_name, uint64_t end, uint64_t *fingerprint_out) {
+    unsigned char buffer[CACHE_FINGERPRINT_SIZE];
+    uint64_t start = end > CACHE_FINGERPRINT_SIZE ? end - CACHE_FINGERPRINT_SIZE : 0;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t total_read = 0;
+    int fd;
+
+    if ((fd = open(file_name, O_RDONLY)) == -1) return false;
+
+    while (total_read < end - start) {
+        ssize_t bytes_read = pread(fd, buffer + total_read, end - start - total_read, start + total_read);
+
+        if (bytes_read == -1 && errno == EINTR) continue;
+        if (bytes_read <= 0) break;
+        total_read += bytes_read;
+    }
+
+    close(fd);
+    if (total_read != end - start) return false;
+
+    for (size_t i = 0; i < total_read; i++) {
+        hash = (hash ^ buffer[i]) * 0x100000001b3ull;
+    }
+
+    *fingerprint_out = hash;
+    return true;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+result_cache_t *r_c_open(const char *path) {
+    result_cache_t *cache;
+    struct stat file_stat;
+    int error;
+
+    if ((cache = calloc(1, sizeof(result_cache_t))) == NULL) return NULL;
+
+    if ((cache->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+        free(cache);
+        return NULL;
+    }
+
+    if (flock(cache->fd, LOCK_EX) == -1 || fstat(cache->fd, &file_stat) == -1) goto fail;
+
+    // The capacity in the header is only trusted once the rest of the header checks out.
+    if ((size_t) file_stat.st_size >= mapping_size(0)) {
+        cache_header header;
+
+        if (pread(cache->fd, &header, sizeof(header), 0) == sizeof(header) &&
+            memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.entry_size == sizeof(cache_entry) && header.capacity >= CACHE_CAPACITY_MIN &&
+            (header.capacity & (header.capacity - 1)) == 0 && header.n_entries < header.capacity &&
+            (size_t) file_stat.st_size == mapping_size(header.capacity)) {
+
+            if (!map_cache(cache, header.capacity)) goto fail;
+            return cache;
+        }
+    }
+
+    cache->stats.started_over = file_stat.st_size != 0;
+
+    if (!map_cache(cache, CACHE_CAPACITY_MIN)) goto fail;
+    reset_cache(cache, CACHE_CAPACITY_MIN);
+    return cache;
+
+fail:
+    error = errno;
+    close(cache->fd);
+    free(cache);
+    errno = error;
+    return NULL;
+}
+
+
+bool r_c_file_key(const char *file_name, cache_key *key_out) {
+    struct stat file_stat;
+
+    if (stat(file_name, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) return false;
+
+    key_out->device = file_stat.st_dev;
+    key_out->inode = file_stat.st_ino;
+    key_out->size = file_stat.st_size;
+    key_out->mtime_ns = (uint64_t) file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+    return true;
+}
+
+
+cache_match r_c_lookup(
+    result_cache_t *cache, const char *file_name, const cache_key *key,
+    size_t *size_out, chunk_summary *summary_out
+) {
+    cache_entry *entry = find_slot(cache, key->device, key->inode);
+    uint64_t fingerprint;
+
+    if (!entry->used) {
+        cache->stats.n_misses++;
+        return CACHE_MISS;
+    }
+
+    if (entry->key.size == key->size && entry->key.mtime_ns == key->mtime_ns) {
+        *size_out = entry->key.size;
+        *summary_out = entry->summary;
+        cache->stats.n_hits++;
+        return CACHE_HIT;
+    }
+
+    // Summaries of fewer bytes than a utf8 sequence can only be merged at the end of a text.
+    if (
+        entry->appendable && entry->key.size > UTF8_MAX_PARTIAL && key->size > entry->key.size &&
+        fingerprint_file(file_name, entry->key.size, &fingerprint) && fingerprint == entry->fingerprint
+    ) {
+        *size_out = entry->key.size;
+        *summary_out = entry->summary;
+        cache->stats.n_appended++;
+        return CACHE_APPENDED;
+    }
+
+    cache->stats.n_misses++;
+    return CACHE_MISS;
+}
+
+
+bool r_c_store(
+    result_cache_t *cache, const char *file_name, const cache_key *key,
+    const chunk_summary *summary, size_t summarized_size
+) {
+    cache_entry *entry = find_slot(cache, key->device, key->inode);
+
+    if (!entry->used) {
+        if ((cache->header->n_entries + 1) * 2 > cache->header->capacity) {
+            if (!grow_cache(cache)) return false;
+            entry = find_slot(cache, key->device, key->inode);
+        }
+
+        cache->header->n_entries++;
+    }
+
+    entry->key = *key;
+    entry->used = 1;
+    entry->summary = *summary;
+    entry->appendable = summarized_size == key->size && fingerprint_file(file_name, key->size, &entry->fingerprint);
+
+    cache->stats.n_stored++;
+    return true;
+}
+
+
+void r_c_stats(result_cache_t *cache, result_cache_stats *stats_out) {
+    *stats_out = cache->stats;
+}
+
+
+void r_c_close(result_cache_t *cache) {
+    munmap(cache->header, cache->mapping_size);
+    close(cache->fd);
+    free(cache);
+}
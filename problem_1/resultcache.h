@@ -0,0 +1,145 @@
+/**
+ * @file resultcache.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Cache of the summaries of files between runs. It is a table kept in a memory mapped
+ * file and found by the device and inode of each file. A file whose size and modification
+ * time didn't change is answered from its entry without being opened.
+ *
+ * A file that only grew keeps the summary of its old bytes, which is merged with the summary
+ * of the new ones, so only what was appended is counted. To tell an append from a rewrite,
+ * the last CACHE_FINGERPRINT_SIZE bytes the entry covers are hashed and compared.
+ *
+ * The cache file is locked while it is open, so processes sharing it take turns.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+#ifndef RESULTCACHE_GUARD
+#define RESULTCACHE_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wordcount.h"
+
+/**
+ * @brief Magic bytes at the start of the cache file.
+ *
+ */
+#define CACHE_MAGIC "CLECACH1"
+
+/**
+ * @brief Number of entries of a new cache. The table doubles whenever it gets half full.
+ *
+ */
+#define CACHE_CAPACITY_MIN 1024
+
+/**
+ * @brief Bytes at the end of the cached part of a file compared to tell an append from a rewrite.
+ *
+ */
+#define CACHE_FINGERPRINT_SIZE 4096
+
+/**
+ * @brief What identifies the contents of a file, from stat.
+ *
+ */
+typedef struct cache_key {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    uint64_t mtime_ns;
+} cache_key;
+
+/**
+ * @brief How much of a file its entry answers.
+ *
+ */
+typedef enum cache_match {
+    CACHE_MISS,         // Nothing, the file must be counted.
+    CACHE_HIT,          // All of it.
+    CACHE_APPENDED      // Its first bytes, the rest was appended since.
+} cache_match;
+
+/**
+ * @brief Counts of the lookups and stores since the cache was opened.
+ *
+ */
+typedef struct result_cache_stats {
+    size_t n_hits;
+    size_t n_appended;
+    size_t n_misses;
+    size_t n_stored;
+    bool started_over;  // The file wasn't a valid cache when it was opened, so its contents were dropped.
+} result_cache_stats;
+
+/**
+ * @brief Data structure representing an open cache.
+ * It's fields are private.
+ *
+ */
+typedef struct result_cache_t result_cache_t;
+
+/**
+ * @brief Opens a cache file, creating it if it doesn't exist, and waits for the lock on it.
+ * A file that isn't a cache of this build is started over, which the stats tell.
+ *
+ * @param path
+ * @return result_cache_t* or NULL on failure, with errno set.
+ */
+result_cache_t *r_c_open(const char *path);
+
+/**
+ * @brief Gets the key of a file.
+ *
+ * @param file_name
+ * @param key_out
+ * @return true on success and false if the file couldn't be stat'ed or isn't a regular file.
+ */
+bool r_c_file_key(const char *file_name, cache_key *key_out);
+
+/**
+ * @brief Finds what the cache knows of a file.
+ *
+ * @param cache
+ * @param file_name Only read to check an append.
+ * @param key The key of the file now.
+ * @param size_out The number of bytes the summary covers, on CACHE_HIT and CACHE_APPENDED.
+ * @param summary_out The summary of those bytes.
+ * @return cache_match
+ */
+cache_match r_c_lookup(
+    result_cache_t *cache, const char *file_name, const cache_key *key,
+    size_t *size_out, chunk_summary *summary_out
+);
+
+/**
+ * @brief Stores the summary of a file, replacing the entry it had. An append can only be
+ * answered later if the summary covers all of the bytes of the key.
+ *
+ * @param cache
+ * @param file_name Only read to take the fingerprint.
+ * @param key The key of the file when it was counted.
+ * @param summary
+ * @param summarized_size The number of bytes the summary covers.
+ * @return true on success and false if the cache couldn't grow, with errno set.
+ */
+bool r_c_store(
+    result_cache_t *cache, const char *file_name, const cache_key *key,
+    const chunk_summary *summary, size_t summarized_size
+);
+
+/**
+ * @brief Gets the counts of the lookups and stores.
+ *
+ */
+void r_c_stats(result_cache_t *cache, result_cache_stats *stats_out);
+
+/**
+ * @brief Unmaps and unlocks the cache file and frees the cache.
+ *
+ */
+void r_c_close(result_cache_t *cache);
+
+#endif
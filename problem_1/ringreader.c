@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+
+#include "ringreader.h"
+#include "uring.h"
+
+/**
+ * @brief Operations tagged in the lower bit of the user_data of io_uring operations.
+ * The other bits are the slot of the file being opened or the index of the buffer being read into.
+ *
+ */
+#define URING_OPEN_OP 0
+#define URING_READ_OP 1
+
+/**
+ * @brief A file the reader is opening or reading.
+ *
+ */
+typedef struct uring_file {
+    bool in_use;
+    size_t file_id;
+    int fd;             // -1 while the file is being opened.
+    size_t size;
+    size_t next_offset; // Offset of the next read to be queued.
+    size_t n_reads;     // Reads in flight.
+} uring_file;
+
+struct ring_reader {
+    prefetch_pool *pool;
+    uring_t ring;
+};
+
+/**
+ * @brief Frees the slot of a file once all of it was read.
+ *
+ */
+static void release_file(uring_file *file, size_t *n_open_files) {
+    if (file->fd != -1) close(file->fd);
+
+    file->in_use = false;
+    (*n_open_files)--;
+}
+
+/**
+ * @brief Handles the completion of an open. A file that can't be opened is left out and its error recorded.
+ *
+ */
+static void complete_open(prefetch_pool *pool, uring_file *file, int32_t result, size_t *n_open_files) {
+    struct stat file_stat;
+
+    if (result < 0) {
+        p_f_set_file_error(pool, file->file_id, -result);
+        release_file(file, n_open_files);
+        return;
+    }
+
+    file->fd = result;
+
+    if (fstat(file->fd, &file_stat) == -1) {
+        p_f_set_file_error(pool, file->file_id, errno);
+        release_file(file, n_open_files);
+        return;
+    }
+
+    file->size = file_stat.st_size;
+    if (file->next_offset >= file->size) release_file(file, n_open_files);
+}
+
+/**
+ * @brief Handles the completion of a read. Short reads are continued where they stopped.
+ * A read that fails stops the run, and the file is taken as ending there.
+ *
+ * @return true if the read was continued and false if the buffer was queued.
+ */
+static bool complete_read(
+    ring_reader_t *reader, uring_file *files, prefetch_buffer *buffer, int32_t result, size_t *n_open_files
+) {
+    prefetch_pool *pool = reader->pool;
+    uring_file *file = &files[buffer->slot];
+
+    if (result < 0 && result != -EINTR && result != -EAGAIN) {
+        p_f_fail_file(pool, file->file_id, -result);
+        result = 0;
+    }
+
+    if (result > 0) buffer->size += result;
+
+    if (result != 0 && buffer->size < buffer->requested) {
+        u_r_queue_read(
+            &reader->ring, file->fd, buffer->data + buffer->size, buffer->requested - buffer->size,
+            buffer->offset + buffer->size, (uint64_t) (buffer - pool->buffers) << 1 | URING_READ_OP
+        );
+        return true;
+    }
+
+    // The file got shorter since it was opened, so there's nothing else to read.
+    if (buffer->size < buffer->requested) file->next_offset = file->size;
+
+    c_q_push(buffer->size > 0 ? pool->filled : pool->empty, buffer);
+
+    file->n_reads--;
+    if (file->n_reads == 0 && file->next_offset >= file->size) release_file(file, n_open_files);
+
+    return false;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+ring_reader_t *r_r_create(prefetch_pool *pool) {
+    ring_reader_t *reader;
+
+    if ((reader = malloc(sizeof(ring_reader_t))) == NULL) return NULL;
+
+    if (!u_r_init(&reader->ring, URING_OPEN_FILES + pool->n_buffers)) {
+        free(reader);
+        return NULL;
+    }
+
+    reader->pool = pool;
+    return reader;
+}
+
+
+void *r_r_read_files(void *arg) {
+    uring_file files[URING_OPEN_FILES];
+    prefetch_buffer *spare = NULL;
+    size_t next_file = 0;
+    size_t n_open_files = 0;
+    size_t n_in_flight = 0;
+
+    ring_reader_t *reader = arg;
+    prefetch_pool *pool = reader->pool;
+
+    for (size_t slot = 0; slot < URING_OPEN_FILES; slot++) {
+        files[slot].in_use = false;
+    }
+
+    while (next_file < pool->n_files || n_open_files > 0) {
+        // Once the run stopped, nothing else is opened or read, and the files are
+        // released as soon as their reads in flight complete.
+        if (p_f_failed(pool)) {
+            next_file = pool->n_files;
+
+            for (size_t slot = 0; slot < URING_OPEN_FILES; slot++) {
+                uring_file *file = &files[slot];
+
+                if (!file->in_use || file->fd == -1) continue;
+
+                file->next_offset = file->size;
+                if (file->n_reads == 0) release_file(file, &n_open_files);
+            }
+        }
+
+        // Open the next files in the free slots.
+        for (size_t slot = 0; slot < URING_OPEN_FILES && next_file < pool->n_files; slot++) {
+            size_t file_id;
+
+            if (files[slot].in_use) continue;
+
+            while (next_file < pool->n_files && pool->start_offsets[pool->file_order[next_file]] == PREFETCH_SKIP) next_file++;
+            if (next_file == pool->n_files) break;
+
+            file_id = pool->file_order[next_file];
+            if (!u_r_queue_open(&reader->ring, pool->file_names[file_id], (uint64_t) slot << 1 | URING_OPEN_OP)) break;
+
+            files[slot] = (uring_file) {true, file_id, -1, 0, pool->start_offsets[file_id], 0};
+            next_file++;
+            n_open_files++;
+            n_in_flight++;
+        }
+
+        // Queue reads of the open files while there are empty buffers. Only wait for
+        // one if nothing is in flight, otherwise the completions are collected first.
+        for (size_t slot = 0; slot < URING_OPEN_FILES; slot++) {
+            uring_file *file = &files[slot];
+
+            while (
+                file->in_use && file->fd != -1 &&
+                file->next_offset < file->size && file->n_reads < URING_READS_PER_FILE
+            ) {
+                size_t chunk_size = atomic_load_explicit(&pool->chunk_sizes[file->file_id], memory_order_relaxed);
+                size_t read_size = file->size - file->next_offset < chunk_size ? file->size - file->next_offset : chunk_size;
+                void *item;
+
+                if (spare == NULL) {
+                    if (!(n_in_flight == 0 ? c_q_pop(pool->empty, &item) : c_q_try_pop(pool->empty, &item))) break;
+                    spare = item;
+                }
+
+                if (p_f_failed(pool)) break;
+
+                if (!u_r_queue_read(
+                    &reader->ring, file->fd, spare->data, read_size, file->next_offset,
+                    (uint64_t) (spare - pool->buffers) << 1 | URING_READ_OP
+                )) break;
+
+                spare->file_id = file->file_id;
+                spare->offset = file->next_offset;
+                spare->size = 0;
+                spare->requested = read_size;
+                spare->slot = slot;
+                spare = NULL;
+
+                file->next_offset += read_size;
+                file->n_reads++;
+                n_in_flight++;
+            }
+        }
+
+        if (n_in_flight == 0) continue;
+
+        // The operations in flight can't be waited for anymore, their buffers are only freed with the pool.
+        if (!u_r_submit_and_wait(&reader->ring, 1)) {
+            p_f_fail(pool, errno);
+            break;
+        }
+
+        uint64_t user_data;
+        int32_t result;
+
+        while (u_r_next_completion(&reader->ring, &user_data, &result)) {
+            if ((user_data & 1) == URING_OPEN_OP) {
+                complete_open(pool, &files[user_data >> 1], result, &n_open_files);
+                n_in_flight--;
+            } else if (!complete_read(reader, files, &pool->buffers[user_data >> 1], result, &n_open_files)) {
+                n_in_flight--;
+            }
+        }
+    }
+
+    if (spare != NULL) c_q_push(pool->empty, spare);
+
+    c_q_close(pool->filled);
+    return NULL;
+}
+
+
+void r_r_destroy(ring_reader_t *reader) {
+    u_r_close(&reader->ring);
+    free(reader);
+}
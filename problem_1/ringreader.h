@@ -0,0 +1,65 @@
+/**
+ * @file ringreader.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief A single reader thread that fills the prefetch pool with io_uring, keeping the
+ * opens and reads of many files in flight at once.
+ * @version 0.1
+ * @date 2022-05-08
+ *
+ */
+
+#ifndef RINGREADER_GUARD
+#define RINGREADER_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "prefetch.h"
+
+/**
+ * @brief Number of files the reader opens or reads at once.
+ *
+ */
+#define URING_OPEN_FILES 32
+
+/**
+ * @brief Number of reads the reader keeps in flight for each file.
+ *
+ */
+#define URING_READS_PER_FILE 2
+
+/**
+ * @brief State of the reader thread.
+ * It's fields are private.
+ *
+ */
+typedef struct ring_reader ring_reader_t;
+
+/**
+ * @brief Sets up the io_uring instance of a reader, with room for an open of each of
+ * URING_OPEN_FILES files and a read into each buffer of the pool.
+ *
+ * @param pool The pool the thread fills, which must outlive the reader.
+ * @return ring_reader_t* The reader or NULL if io_uring can't be used or memory couldn't be allocated.
+ */
+ring_reader_t *r_r_create(prefetch_pool *pool);
+
+/**
+ * @brief Procedure of the reader thread. Files are read in the order of the pool and the buffers
+ * are queued for the workers as their reads complete, so they may be out of order. A file that
+ * can't be opened is left out, and one that can't be read stops the run. The filled queue of
+ * the pool is closed once all of the files were read.
+ *
+ * @param arg The reader.
+ * @return void* NULL.
+ */
+void *r_r_read_files(void *arg);
+
+/**
+ * @brief Closes the io_uring instance and frees the reader. Its thread must have been joined.
+ *
+ * @param reader
+ */
+void r_r_destroy(ring_reader_t *reader);
+
+#endif
@@ -0,0 +1,834 @@
+#define _GNU_SOURCE // accept4
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/**
+ * @brief Bytes each connection is read into, which only grows to fit a larger DATA request.
+ *
+ */
+#define SERVER_READ_SIZE (64 * 1024)
+
+/**
+ * @brief Longest request line, a FILE request with the longest path.
+ *
+ */
+#define SERVER_MAX_LINE (PATH_MAX + 8)
+
+/**
+ * @brief Answers a connection may have unsent before its requests stop being read, so a client
+ * that sends requests without reading the answers can't make the server grow without bound.
+ *
+ */
+#define SERVER_OUTPUT_LIMIT (1024 * 1024)
+
+/**
+ * @brief Bytes of files and payloads after which no more requests are added to a batch, so
+ * the requests of a client that sends many at once are answered as they are counted instead of
+ * all at the end. A larger request still makes a batch of its own.
+ *
+ */
+#define SERVER_BATCH_BYTES (1024 * 1024)
+
+/**
+ * @brief Longest answer line.
+ *
+ */
+#define SERVER_MAX_ANSWER 512
+
+/**
+ * @brief How long the server waits for the sockets before checking whether it got a signal.
+ *
+ */
+#define SERVER_POLL_MS 1000
+
+/**
+ * @brief When the bytes of an input up to an offset were received.
+ *
+ */
+typedef struct input_arrival {
+    size_t end;
+    uint64_t ns;
+} input_arrival;
+
+/**
+ * @brief A client of the server.
+ *
+ */
+typedef struct server_connection {
+    int fd;
+    unsigned char *input;   // Received bytes whose requests weren't answered yet.
+    size_t input_size;
+    size_t input_capacity;
+    size_t parsed;          // Bytes of input whose requests are in the current batch.
+    size_t needed;          // Capacity of input the next DATA request needs, or 0.
+    char *output;           // Answers not sent yet.
+    size_t output_size;
+    size_t output_capacity;
+    size_t output_sent;
+    input_arrival *arrivals; // One per time bytes were read, in order, for the bytes still in input.
+    size_t n_arrivals;
+    size_t arrivals_capacity;
+    uint64_t request_ns;    // When the request being parsed was received in full.
+    bool backlogged;        // Has requests left unparsed, because its answers weren't read or the batch was full.
+    bool closing;           // The client closed its side or broke the protocol.
+} server_connection;
+
+/**
+ * @brief The kinds of request.
+ *
+ */
+typedef enum request_kind {REQUEST_FILE, REQUEST_DATA, REQUEST_STATS, REQUEST_ERROR} request_kind;
+
+/**
+ * @brief A request of the current batch.
+ *
+ */
+typedef struct server_request {
+    size_t connection;
+    request_kind kind;
+    size_t input;           // Index of the file or buffer in its batch.
+    const char *error;      // Of a REQUEST_ERROR.
+    size_t size;
+    uint64_t received_ns;
+    measurements result;
+} server_request;
+
+/**
+ * @brief The counters of the server.
+ *
+ */
+typedef struct server_stats {
+    uint64_t start_ns;
+    uint64_t n_requests;
+    uint64_t n_errors;
+    uint64_t n_bytes;
+    uint64_t n_batches;
+    double counting_s;
+    uint64_t *latencies_ns; // The last SERVER_LATENCY_WINDOW, as a ring.
+    uint64_t *sorted_ns;    // Where the latencies are sorted to take their percentiles.
+    uint64_t max_latency_ns;
+} server_stats;
+
+/**
+ * @brief The state of the server, kept from one batch to the next.
+ *
+ */
+typedef struct server_state {
+    counter_t *counter;
+    int listen_fd;
+    server_connection *connections;
+    size_t n_connections;
+    size_t connections_capacity;
+    struct pollfd *poll_fds;
+    server_request *requests;
+    size_t n_requests;
+    size_t requests_capacity;
+    size_t batch_bytes;     // Of the files and payloads of the requests.
+    size_t first_parsed;    // Connection whose requests are added to the batch first, in turns.
+    char **file_names;      // Point into the inputs of the connections, like the buffers.
+    size_t n_files;
+    size_t files_capacity;
+    const unsigned char **buffers;
+    size_t *buffer_sizes;
+    size_t n_buffers;
+    size_t buffers_capacity;
+    server_stats stats;
+} server_state;
+
+static volatile sig_atomic_t stop_serving = 0;
+
+static void handle_stop_signal(int signal_number) {
+    (void) signal_number;
+    stop_serving = 1;
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void print_error_and_exit() {
+    fprintf(stderr, "Error allocating memory for the server: %s\n", strerror(errno));
+    exit(1);
+}
+
+/**
+ * @brief Grows an array to hold at least n elements, doubling it.
+ *
+ */
+static void *grow(void *array, size_t *capacity, size_t n, size_t element_size) {
+    size_t new_capacity = *capacity == 0 ? 16 : *capacity;
+
+    if (n <= *capacity) return array;
+    while (new_capacity < n) new_capacity *= 2;
+
+    if ((array = realloc(array, new_capacity * element_size)) == NULL) print_error_and_exit();
+
+    *capacity = new_capacity;
+    return array;
+}
+
+/**
+ * @brief Tells whether a socket file is left behind by a server that is gone.
+ *
+ */
+static bool is_stale(const struct sockaddr_un *address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool stale;
+
+    if (fd == -1) return false;
+
+    stale = connect(fd, (const struct sockaddr *) address, sizeof(*address)) == -1 && errno == ECONNREFUSED;
+    close(fd);
+    return stale;
+}
+
+/**
+ * @brief Creates the socket of the server and listens on it.
+ *
+ * @return int The socket or -1 on failure, with errno set.
+ */
+static int listen_on(const char *socket_path) {
+    struct sockaddr_un address;
+    int fd, error;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) return -1;
+
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        if (errno != EADDRINUSE || !is_stale(&address) || unlink(socket_path) == -1 ||
+            bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+            error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+    }
+
+    // No client can connect before listen(), so none gets in before the mode is set.
+    if (chmod(socket_path, SERVER_SOCKET_MODE) == -1 || listen(fd, SOMAXCONN) == -1) {
+        error = errno;
+        close(fd);
+        unlink(socket_path);
+        errno = error;
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Accepts the clients waiting for the server.
+ *
+ */
+static void accept_connections(server_state *server) {
+    int fd;
+
+    while ((fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        server_connection *connection;
+
+        server->connections = grow(
+            server->connections, &server->connections_capacity, server->n_connections + 1, sizeof(server_connection)
+        );
+        connection = &server->connections[server->n_connections++];
+
+        memset(connection, 0, sizeof(server_connection));
+        connection->fd = fd;
+        connection->input_capacity = SERVER_READ_SIZE;
+        if ((connection->input = malloc(SERVER_READ_SIZE)) == NULL) print_error_and_exit();
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        printf("Error accepting a client: %s\n", strerror(errno));
+    }
+}
+
+/**
+ * @brief Reads what a client sent until its input is full or nothing more was sent.
+ *
+ */
+static void read_connection(server_connection *connection) {
+    bool stamped = false;
+
+    if (connection->needed > connection->input_capacity) {
+        if ((connection->input = realloc(connection->input, connection->needed)) == NULL) print_error_and_exit();
+        connection->input_capacity = connection->needed;
+    }
+
+    while (connection->input_size < connection->input_capacity) {
+        ssize_t bytes_read = read(
+            connection->fd, connection->input + connection->input_size,
+            connection->input_capacity - connection->input_size
+        );
+
+        if (bytes_read > 0) {
+            connection->input_size += bytes_read;
+
+            // The reads of a single wakeup arrived together.
+            if (!stamped) {
+                connection->arrivals = grow(
+                    connection->arrivals, &connection->arrivals_capacity, connection->n_arrivals + 1, sizeof(input_arrival)
+                );
+                connection->arrivals[connection->n_arrivals++].ns = now_ns();
+                stamped = true;
+            }
+            connection->arrivals[connection->n_arrivals - 1].end = connection->input_size;
+        } else if (bytes_read == 0) {
+            connection->closing = true;
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) connection->closing = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Appends an answer line to what is sent to a client.
+ *
+ */
+static void answer(server_connection *connection, const char *format, ...) {
+    char line[SERVER_MAX_ANSWER];
+    va_list arguments;
+    int size;
+
+    va_start(arguments, format);
+    size = vsnprintf(line, sizeof(line) - 1, format, arguments);
+    va_end(arguments);
+
+    if (size < 0) size = 0;
+    if ((size_t) size > sizeof(line) - 2) size = sizeof(line) - 2;
+    line[size++] = '\n';
+
+    connection->output = grow(connection->output, &connection->output_capacity, connection->output_size + size, 1);
+    memcpy(connection->output + connection->output_size, line, size);
+    connection->output_size += size;
+}
+
+/**
+ * @brief Adds a request to the current batch.
+ *
+ */
+static server_request *add_request(server_state *server, size_t connection_id, request_kind kind) {
+    server_request *request;
+
+    server->requests = grow(server->requests, &server->requests_capacity, server->n_requests + 1, sizeof(server_request));
+    request = &server->requests[server->n_requests++];
+
+    memset(request, 0, sizeof(server_request));
+    request->connection = connection_id;
+    request->kind = kind;
+    request->received_ns = server->connections[connection_id].request_ns;
+    return request;
+}
+
+/**
+ * @brief Adds an error to the current batch, to be answered in its turn like the other requests.
+ *
+ */
+static void add_error(server_state *server, size_t connection_id, const char *error) {
+    add_request(server, connection_id, REQUEST_ERROR)->error = error;
+}
+
+/**
+ * @brief Adds a FILE request to the current batch if its file can be counted.
+ *
+ */
+static void add_file(server_state *server, size_t connection_id, char *path) {
+    server_request *request;
+    struct stat file_stat;
+
+    // The standard input of the server isn't the client's.
+    if (path[0] == '\0' || strcmp(path, STDIN_FILE_NAME) == 0) {
+        add_error(server, connection_id, "no file given");
+        return;
+    }
+
+    // The counter reads a file it can't open as empty, so the errors are found here.
+    if (stat(path, &file_stat) == -1 || access(path, R_OK) == -1) {
+        add_error(server, connection_id, strerror(errno));
+        return;
+    }
+
+    if (!S_ISREG(file_stat.st_mode)) {
+        add_error(server, connection_id, "not a regular file");
+        return;
+    }
+
+    request = add_request(server, connection_id, REQUEST_FILE);
+    request->size = file_stat.st_size;
+    server->batch_bytes += request->size;
+    request->input = server->n_files;
+
+    server->file_names = grow(server->file_names, &server->files_capacity, server->n_files + 1, sizeof(char *));
+    server->file_names[server->n_files++] = path;
+}
+
+/**
+ * @brief Adds a DATA request to the current batch.
+ *
+ */
+static void add_buffer(server_state *server, size_t connection_id, const unsigned char *data, size_t size) {
+    server_request *request = add_request(server, connection_id, REQUEST_DATA);
+
+    request->size = size;
+    request->input = server->n_buffers;
+    server->batch_bytes += size;
+
+    if (server->n_buffers == server->buffers_capacity) {
+        server->buffers_capacity = server->buffers_capacity == 0 ? 16 : server->buffers_capacity * 2;
+
+        if ((server->buffers = realloc(server->buffers, sizeof(unsigned char *) * server->buffers_capacity)) == NULL) print_error_and_exit();
+        if ((server->buffer_sizes = realloc(server->buffer_sizes, sizeof(size_t) * server->buffers_capacity)) == NULL) print_error_and_exit();
+    }
+
+    server->buffers[server->n_buffers] = data;
+    server->buffer_sizes[server->n_buffers++] = size;
+}
+
+/**
+ * @brief Gets when the input of a client was received up to an offset, for requests ending
+ * at increasing offsets.
+ *
+ * @param arrival The arrival the search starts at, left at the one found.
+ */
+static uint64_t received_at(const server_connection *connection, size_t *arrival, size_t end) {
+    while (*arrival < connection->n_arrivals - 1 && connection->arrivals[*arrival].end < end) (*arrival)++;
+
+    return connection->arrivals[*arrival].ns;
+}
+
+/**
+ * @brief Adds the requests a client sent in full to the current batch, unless its answers
+ * aren't being read or the batch is full. The paths of the FILE requests are null terminated in place.
+ *
+ */
+static void parse_requests(server_state *server, size_t connection_id) {
+    server_connection *connection = &server->connections[connection_id];
+    size_t position = 0, arrival = 0;
+
+    connection->backlogged = false;
+    connection->needed = 0;
+
+    while (position < connection->input_size) {
+        char *line = (char *) connection->input + position;
+        char *end, *size_end;
+        size_t line_size, request_size;
+        unsigned long long size;
+
+        if (connection->output_size - connection->output_sent > SERVER_OUTPUT_LIMIT || server->batch_bytes >= SERVER_BATCH_BYTES) {
+            connection->backlogged = true;
+            break;
+        }
+
+        if ((end = memchr(line, '\n', connection->input_size - position)) == NULL) {
+            if (connection->input_size - position > SERVER_MAX_LINE) {
+                connection->request_ns = received_at(connection, &arrival, connection->input_size);
+                add_error(server, connection_id, "request line too long");
+                connection->closing = true;
+                position = connection->input_size;
+            }
+            break;
+        }
+
+        // The newline was found at or after the start of the line, so its offset isn't negative.
+        line_size = (size_t) (end - line);
+        request_size = line_size + 1;
+        if (line_size > 0 && line[line_size - 1] == '\r') line_size--;
+        connection->request_ns = received_at(connection, &arrival, position + request_size);
+
+        if (line_size == 5 && memcmp(line, "STATS", 5) == 0) {
+            add_request(server, connection_id, REQUEST_STATS);
+        } else if (line_size >= 5 && memcmp(line, "FILE ", 5) == 0) {
+            line[line_size] = '\0';
+            add_file(server, connection_id, line + 5);
+        } else if (line_size >= 5 && memcmp(line, "DATA ", 5) == 0) {
+            errno = 0;
+            size = strtoull(line + 5, &size_end, 10);
+
+            if (line_size == 5 || line[5] == '-' || size_end != line + line_size || errno != 0 || size > SERVER_MAX_PAYLOAD) {
+                add_error(server, connection_id, "bad payload size");
+                connection->closing = true;
+                position = connection->input_size;
+                break;
+            }
+
+            // The payload is waited for in full, in an input grown to fit it with its line.
+            if (connection->input_size - position - request_size < size) {
+                connection->needed = request_size + size;
+                break;
+            }
+
+            connection->request_ns = received_at(connection, &arrival, position + request_size + size);
+            add_buffer(server, connection_id, (unsigned char *) line + request_size, size);
+            request_size += size;
+        } else {
+            add_error(server, connection_id, "unknown request");
+        }
+
+        position += request_size;
+    }
+
+    connection->parsed = position;
+}
+
+/**
+ * @brief Gets a percentile of the latencies in the window, in microseconds.
+ *
+ */
+static double latency_percentile(const uint64_t *sorted_ns, size_t n, double percentile) {
+    size_t rank;
+
+    if (n == 0) return 0.0;
+
+    rank = (size_t) (percentile / 100.0 * n + 0.5);
+    if (rank > 0) rank--;
+    if (rank >= n) rank = n - 1;
+    return sorted_ns[rank] / 1000.0;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+    uint64_t latency_a = *(const uint64_t *) a, latency_b = *(const uint64_t *) b;
+
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+/**
+ * @brief Answers a STATS request with the counters of the server.
+ *
+ */
+static void answer_stats(server_stats *stats, server_connection *connection) {
+    size_t n_latencies = stats->n_requests < SERVER_LATENCY_WINDOW ? stats->n_requests : SERVER_LATENCY_WINDOW;
+    double uptime_s = (now_ns() - stats->start_ns) / 1000000000.0;
+
+    memcpy(stats->sorted_ns, stats->latencies_ns, sizeof(uint64_t) * n_latencies);
+    qsort(stats->sorted_ns, n_latencies, sizeof(uint64_t), compare_latencies);
+
+    answer(
+        connection,
+        "STATS requests=%lu errors=%lu bytes=%lu batches=%lu uptime_s=%.3f counting_s=%.3f "
+        "p50_us=%.1f p99_us=%.1f max_us=%.1f requests_per_s=%.1f mb_per_s=%.3f",
+        stats->n_requests, stats->n_errors, stats->n_bytes, stats->n_batches, uptime_s, stats->counting_s,
+        latency_percentile(stats->sorted_ns, n_latencies, 50.0), latency_percentile(stats->sorted_ns, n_latencies, 99.0),
+        stats->max_latency_ns / 1000.0, stats->n_requests / uptime_s, stats->n_bytes / uptime_s / (1024 * 1024)
+    );
+}
+
+/**
+ * @brief Counts a batch of files or buffers and copies the result of each to its request.
+ * The requests of files that couldn't be read become errors.
+ *
+ * @return true if the workers were successful and false otherwise.
+ */
+static bool count_batch(server_state *server, request_kind kind) {
+    measurements *results;
+    count_stats batch_stats;
+    bool success;
+
+    if (kind == REQUEST_FILE) {
+        if (server->n_files == 0) return true;
+        success = c_w_count_files(server->counter, server->n_files, server->file_names, &results, &batch_stats);
+    } else {
+        if (server->n_buffers == 0) return true;
+        success = c_w_count_buffers(
+            server->counter, server->n_buffers, server->buffers, server->buffer_sizes, &results, &batch_stats
+        );
+    }
+
+    server->stats.n_batches++;
+    server->stats.counting_s += batch_stats.elapsed_s;
+
+    if (!success) return false;
+
+    for (size_t i = 0; i < server->n_requests; i++) {
+        server_request *request = &server->requests[i];
+        int file_error;
+
+        if (request->kind != kind) continue;
+
+        if (kind == REQUEST_FILE && (file_error = get_file_error(c_w_last_run(server->counter), request->input)) != 0) {
+            request->kind = REQUEST_ERROR;
+            request->error = strerror(file_error);
+            continue;
+        }
+
+        request->result = results[request->input];
+    }
+
+    return true;
+}
+
+/**
+ * @brief Counts the requests of the current batch and answers them in order.
+ *
+ */
+static void run_requests(server_state *server) {
+    server_stats *stats = &server->stats;
+    bool files_counted, buffers_counted;
+    uint64_t now;
+
+    if (server->n_requests == 0) return;
+
+    files_counted = count_batch(server, REQUEST_FILE);
+    buffers_counted = count_batch(server, REQUEST_DATA);
+    now = now_ns();
+
+    for (size_t i = 0; i < server->n_requests; i++) {
+        server_request *request = &server->requests[i];
+        server_connection *connection = &server->connections[request->connection];
+        bool counted = request->kind == REQUEST_FILE ? files_counted : buffers_counted;
+        uint64_t latency_ns = now - request->received_ns;
+
+        if (request->kind == REQUEST_STATS) {
+            answer_stats(stats, connection);
+            continue;
+        }
+
+        if (request->kind == REQUEST_ERROR || !counted) {
+            answer(connection, "ERROR %s", request->kind == REQUEST_ERROR ? request->error : "counting failed");
+            stats->n_errors++;
+        } else {
+            answer(
+                connection, "OK %lu %lu %lu",
+                request->result.n_words, request->result.n_words_start_vowel, request->result.n_words_end_cons
+            );
+            stats->n_bytes += request->size;
+        }
+
+        // The errors are requests too, so the rate is of everything the clients asked for.
+        stats->latencies_ns[stats->n_requests % SERVER_LATENCY_WINDOW] = latency_ns;
+        if (latency_ns > stats->max_latency_ns) stats->max_latency_ns = latency_ns;
+        stats->n_requests++;
+    }
+
+    server->n_requests = server->n_files = server->n_buffers = server->batch_bytes = 0;
+}
+
+/**
+ * @brief Sends what it can of the answers of a client.
+ *
+ */
+static void write_connection(server_connection *connection) {
+    while (connection->output_sent < connection->output_size) {
+        ssize_t bytes_sent = send(
+            connection->fd, connection->output + connection->output_sent,
+            connection->output_size - connection->output_sent, MSG_NOSIGNAL
+        );
+
+        if (bytes_sent == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+
+            // The client is gone, so are its requests.
+            connection->closing = true;
+            connection->input_size = connection->parsed = connection->n_arrivals = 0;
+            connection->backlogged = false;
+            connection->output_sent = connection->output_size;
+            break;
+        }
+
+        connection->output_sent += bytes_sent;
+    }
+
+    connection->output_size = connection->output_sent = 0;
+}
+
+/**
+ * @brief Removes the answered requests of a client from its input, keeping the rest.
+ *
+ */
+static void consume_input(server_connection *connection) {
+    size_t kept = 0;
+
+    if (connection->closing && !connection->backlogged) {
+        // What's left is a request that will never be complete.
+        connection->input_size = 0;
+    } else {
+        memmove(connection->input, connection->input + connection->parsed, connection->input_size - connection->parsed);
+        connection->input_size -= connection->parsed;
+    }
+
+    // The arrivals of the bytes left are kept, moved like them.
+    for (size_t i = 0; i < connection->n_arrivals && connection->input_size > 0; i++) {
+        if (connection->arrivals[i].end <= connection->parsed) continue;
+
+        connection->arrivals[kept] = connection->arrivals[i];
+        connection->arrivals[kept++].end -= connection->parsed;
+    }
+    connection->n_arrivals = kept;
+
+    connection->parsed = 0;
+}
+
+/**
+ * @brief Closes the clients that are done, once they got all of their answers.
+ *
+ */
+static void close_finished(server_state *server) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < server->n_connections; i++) {
+        server_connection *connection = &server->connections[i];
+
+        if (connection->closing && !connection->backlogged && connection->output_size == 0) {
+            close(connection->fd);
+            free(connection->input);
+            free(connection->arrivals);
+            free(connection->output);
+        } else {
+            server->connections[kept++] = *connection;
+        }
+    }
+
+    server->n_connections = kept;
+}
+
+/**
+ * @brief Waits for the sockets to be ready, filling poll_fds with the listening socket and then
+ * the clients.
+ *
+ * @return int The result of poll().
+ */
+static int wait_sockets(server_state *server) {
+    int timeout_ms = SERVER_POLL_MS;
+
+    server->poll_fds = realloc(server->poll_fds, sizeof(struct pollfd) * (server->n_connections + 1));
+    if (server->poll_fds == NULL) print_error_and_exit();
+
+    server->poll_fds[0] = (struct pollfd) {server->listen_fd, POLLIN, 0};
+
+    for (size_t i = 0; i < server->n_connections; i++) {
+        server_connection *connection = &server->connections[i];
+        short events = 0;
+
+        // The input is grown for a DATA request when it's read.
+        if (!connection->closing && (connection->input_size < connection->input_capacity || connection->needed > connection->input_capacity)) {
+            events |= POLLIN;
+        }
+        if (connection->output_size > connection->output_sent) events |= POLLOUT;
+
+        // Its requests can be parsed as soon as its answers are sent.
+        if (connection->backlogged && connection->output_size - connection->output_sent <= SERVER_OUTPUT_LIMIT) timeout_ms = 0;
+
+        server->poll_fds[i + 1] = (struct pollfd) {connection->fd, events, 0};
+    }
+
+    return poll(server->poll_fds, server->n_connections + 1, timeout_ms);
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+bool serve_socket(counter_t *counter, const char *socket_path) {
+    server_state server;
+    struct sigaction action;
+
+    memset(&server, 0, sizeof(server));
+    server.counter = counter;
+
+    if ((server.listen_fd = listen_on(socket_path)) == -1) {
+        printf("Error listening on %s: %s\n", socket_path, strerror(errno));
+        return false;
+    }
+
+    if ((server.stats.latencies_ns = malloc(sizeof(uint64_t) * SERVER_LATENCY_WINDOW)) == NULL) print_error_and_exit();
+    if ((server.stats.sorted_ns = malloc(sizeof(uint64_t) * SERVER_LATENCY_WINDOW)) == NULL) print_error_and_exit();
+    server.stats.start_ns = now_ns();
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("\nServing on %s until interrupted\n", socket_path);
+    fflush(stdout);
+
+    while (!stop_serving) {
+        size_t n_polled = server.n_connections;
+
+        if (wait_sockets(&server) == -1) {
+            if (errno == EINTR) continue;
+
+            printf("Error waiting for the clients: %s\n", strerror(errno));
+            break;
+        }
+
+        if (server.poll_fds[0].revents & POLLIN) accept_connections(&server);
+
+        for (size_t i = 0; i < n_polled; i++) {
+            if (server.poll_fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) read_connection(&server.connections[i]);
+        }
+
+        // A client that sends many requests at once can't keep filling the batches of the others.
+        for (size_t i = 0; i < server.n_connections; i++) {
+            parse_requests(&server, (server.first_parsed + i) % server.n_connections);
+        }
+        server.first_parsed++;
+
+        run_requests(&server);
+
+        for (size_t i = 0; i < server.n_connections; i++) {
+            consume_input(&server.connections[i]);
+            write_connection(&server.connections[i]);
+        }
+
+        close_finished(&server);
+    }
+
+    printf(
+        "Served %lu requests, %lu errors, %lu bytes in %lu batches\n",
+        server.stats.n_requests, server.stats.n_errors, server.stats.n_bytes, server.stats.n_batches
+    );
+
+    for (size_t i = 0; i < server.n_connections; i++) {
+        close(server.connections[i].fd);
+        free(server.connections[i].input);
+        free(server.connections[i].arrivals);
+        free(server.connections[i].output);
+    }
+
+    close(server.listen_fd);
+    unlink(socket_path);
+
+    free(server.connections);
+    free(server.poll_fds);
+    free(server.requests);
+    free(server.file_names);
+    free(server.buffers);
+    free(server.buffer_sizes);
+    free(server.stats.latencies_ns);
+    free(server.stats.sorted_ns);
+    return true;
+}
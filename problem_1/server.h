@@ -0,0 +1,76 @@
+/**
+ * @file server.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Serves the word counting over a Unix domain socket, so the clients that count many
+ * small texts don't pay for a process, its threads and its buffers each time. The counter and
+ * its workers are created once, and the buffers the requests are received and answered in are
+ * kept for the next ones.
+ *
+ * Each request is a line, answered by a line, in the order the requests were sent, so a client
+ * can send many of them before reading the answers:
+ *
+ *     FILE <path>\n            Counts a file, whose path is relative to the server's directory.
+ *     DATA <size>\n<bytes>     Counts the size bytes after the line.
+ *     STATS\n                  Gets the counters of the server.
+ *
+ *     OK <words> <words starting with vowel> <words ending with consonant>\n
+ *     ERROR <message>\n
+ *     STATS requests=... errors=... bytes=... batches=... uptime_s=... counting_s=... p50_us=...
+ *           p99_us=... max_us=... requests_per_s=... mb_per_s=...\n
+ *
+ * The requests of the STATS answer are every FILE and DATA request answered, with OK or ERROR,
+ * and the errors are how many of them were answered with ERROR. The STATS requests themselves
+ * aren't counted. The bytes are of the files and payloads that were counted.
+ *
+ * Every request received by the time the workers are free, from every client, is counted in a
+ * single batch, so a batch of small texts pays once for handing the work out. The latency of a
+ * request goes from when it was received in full to when its answer was ready, and its
+ * percentiles are of the last SERVER_LATENCY_WINDOW requests. The rates are over the uptime of
+ * the server.
+ *
+ * tools/serve_client.py sends files, inline or by path, and prints the answers.
+ * @version 0.1
+ * @date 2022-05-11
+ *
+ */
+#ifndef SERVER_GUARD
+#define SERVER_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "countwords.h"
+
+/**
+ * @brief Largest payload of a DATA request. A larger one is answered with an error and its
+ * connection closed, since its bytes can't be told from the next requests without reading them.
+ *
+ */
+#define SERVER_MAX_PAYLOAD (64 * 1024 * 1024)
+
+/**
+ * @brief Mode of the socket file. Anyone who can connect can make the server read any file it
+ * can read, so only the user running it can by default.
+ *
+ */
+#define SERVER_SOCKET_MODE 0600
+
+/**
+ * @brief Number of the last requests the latency percentiles are taken from.
+ *
+ */
+#define SERVER_LATENCY_WINDOW 65536
+
+/**
+ * @brief Serves the counting until the process gets SIGINT or SIGTERM. A socket left behind by a
+ * server that is gone is replaced, the socket is given SERVER_SOCKET_MODE and it is removed when
+ * the server stops.
+ *
+ * @param counter The counter the requests are counted with. Only the measurements are answered,
+ * so it should count nothing else.
+ * @param socket_path
+ * @return true if the socket was served until a signal and false if it couldn't be listened on.
+ */
+bool serve_socket(counter_t *counter, const char *socket_path);
+
+#endif
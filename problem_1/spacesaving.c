@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "spacesaving.h"
+
+/**
+ * @brief Gets the number of slots of a summary, so at most half of them are ever used.
+ *
+ */
+static size_t slots_for(size_t capacity) {
+    size_t n_slots = 16;
+
+    while (n_slots < capacity * 2) n_slots *= 2;
+    return n_slots;
+}
+
+/**
+ * @brief Finds the slot of a word: the one of its counter or the empty slot where it would go.
+ *
+ */
+static size_t find_slot(const space_saving_t *summary, const unsigned char *word, size_t size, uint64_t hash) {
+    size_t mask = summary->n_slots - 1;
+    size_t slot = hash & mask;
+
+    while (summary->slots[slot] != 0) {
+        const heavy_hitter *counter = &summary->counters[summary->slots[slot] - 1];
+
+        if (counter->hash == hash && counter->size == size && memcmp(counter->word, word, size) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/**
+ * @brief Empties the slot of a counter, moving the slots after it back so no probe
+ * stops short of a word.
+ *
+ */
+static void remove_slot(space_saving_t *summary, size_t counter_idx) {
+    size_t mask = summary->n_slots - 1;
+    size_t hole = summary->counters[counter_idx].hash & mask;
+
+    while (summary->slots[hole] != counter_idx + 1) hole = (hole + 1) & mask;
+    summary->slots[hole] = 0;
+
+    for (size_t next = (hole + 1) & mask; summary->slots[next] != 0; next = (next + 1) & mask) {
+        size_t home = summary->counters[summary->slots[next] - 1].hash & mask;
+
+        // A slot can only move back if the hole is between the home of its word and itself.
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            summary->slots[hole] = summary->slots[next];
+            summary->slots[next] = 0;
+            hole = next;
+        }
+    }
+}
+
+/**
+ * @brief Takes a free bucket and puts it after another one in the list of buckets, or first
+ * if after is SPACE_SAVING_NONE.
+ *
+ */
+static uint32_t new_bucket(space_saving_t *summary, uint64_t count, uint32_t after) {
+    uint32_t bucket_idx = summary->free_buckets;
+    count_bucket *bucket = &summary->buckets[bucket_idx];
+
+    summary->free_buckets = bucket->first;
+    bucket->count = count;
+    bucket->first = SPACE_SAVING_NONE;
+    bucket->previous = after;
+
+    if (after == SPACE_SAVING_NONE) {
+        bucket->next = summary->smallest;
+        summary->smallest = bucket_idx;
+    } else {
+        bucket->next = summary->buckets[after].next;
+        summary->buckets[after].next = bucket_idx;
+    }
+
+    if (bucket->next != SPACE_SAVING_NONE) summary->buckets[bucket->next].previous = bucket_idx;
+    return bucket_idx;
+}
+
+/**
+ * @brief Takes an empty bucket out of the list of buckets and frees it.
+ *
+ */
+static void free_bucket(space_saving_t *summary, uint32_t bucket_idx) {
+    count_bucket *bucket = &summary->buckets[bucket_idx];
+
+    if (bucket->previous == SPACE_SAVING_NONE) summary->smallest = bucket->next;
+    else summary->buckets[bucket->previous].next = bucket->next;
+    if (bucket->next != SPACE_SAVING_NONE) summary->buckets[bucket->next].previous = bucket->previous;
+
+    bucket->first = summary->free_buckets;
+    summary->free_buckets = bucket_idx;
+}
+
+/**
+ * @brief Frees every bucket, for a summary with no counters.
+ *
+ */
+static void reset_buckets(space_saving_t *summary) {
+    summary->smallest = SPACE_SAVING_NONE;
+    summary->free_buckets = 0;
+
+    for (size_t i = 0; i <= summary->capacity; i++) {
+        summary->buckets[i].first = i + 1;
+    }
+}
+
+static void attach_counter(space_saving_t *summary, uint32_t counter_idx, uint32_t bucket_idx) {
+    heavy_hitter *counter = &summary->counters[counter_idx];
+    count_bucket *bucket = &summary->buckets[bucket_idx];
+
+    counter->bucket = bucket_idx;
+    counter->previous = SPACE_SAVING_NONE;
+    counter->next = bucket->first;
+    if (bucket->first != SPACE_SAVING_NONE) summary->counters[bucket->first].previous = counter_idx;
+    bucket->first = counter_idx;
+}
+
+/**
+ * @brief Takes a counter out of its bucket, freeing the bucket if it was the last one.
+ *
+ */
+static void detach_counter(space_saving_t *summary, uint32_t counter_idx) {
+    heavy_hitter *counter = &summary->counters[counter_idx];
+
+    if (counter->previous == SPACE_SAVING_NONE) summary->buckets[counter->bucket].first = counter->next;
+    else summary->counters[counter->previous].next = counter->next;
+    if (counter->next != SPACE_SAVING_NONE) summary->counters[counter->next].previous = counter->previous;
+
+    if (summary->buckets[counter->bucket].first == SPACE_SAVING_NONE) free_bucket(summary, counter->bucket);
+}
+
+/**
+ * @brief Adds one to the count of a counter, moving it to the bucket of the next count,
+ * which is the next bucket if there is one.
+ *
+ */
+static void increment(space_saving_t *summary, uint32_t counter_idx) {
+    heavy_hitter *counter = &summary->counters[counter_idx];
+    uint32_t next = summary->buckets[counter->bucket].next;
+
+    // The bucket is made before the counter leaves its own one, which is where it goes.
+    if (next == SPACE_SAVING_NONE || summary->buckets[next].count != counter->count + 1) {
+        next = new_bucket(summary, counter->count + 1, counter->bucket);
+    }
+
+    detach_counter(summary, counter_idx);
+    counter->count++;
+    attach_counter(summary, counter_idx, next);
+}
+
+/**
+ * @brief Gets the smallest count of a full summary, which no word missing from it can be
+ * above, or 0 if the summary isn't full and every word it was given has a counter.
+ *
+ */
+static uint64_t missing_count(const space_saving_t *summary) {
+    return summary->n_counters == summary->capacity ? summary->buckets[summary->smallest].count : 0;
+}
+
+/**
+ * @brief Makes a counter count a word, reusing the memory of its last word if it fits.
+ *
+ * @return true on success and false if memory couldn't be allocated, leaving the counter as it was.
+ */
+static bool set_word(heavy_hitter *counter, const unsigned char *word, size_t size, uint64_t hash) {
+    if (size > counter->word_capacity) {
+        unsigned char *grown;
+
+        if ((grown = malloc(size)) == NULL) return false;
+
+        free(counter->word);
+        counter->word = grown;
+        counter->word_capacity = size;
+    }
+
+    memcpy(counter->word, word, size);
+    counter->size = size;
+    counter->hash = hash;
+    return true;
+}
+
+/**
+ * @brief Tells whether the first counter has a smaller count than the second one, or the
+ * same count with a word that sorts after it.
+ *
+ */
+static bool counter_less(const heavy_hitter *a, const heavy_hitter *b) {
+    size_t size = a->size < b->size ? a->size : b->size;
+    int order;
+
+    if (a->count != b->count) return a->count < b->count;
+
+    order = memcmp(a->word, b->word, size);
+    if (order != 0) return order > 0;
+    return a->size > b->size;
+}
+
+static int compare_counters_desc(const void *a, const void *b) {
+    if (counter_less(a, b)) return 1;
+    if (counter_less(b, a)) return -1;
+    return 0;
+}
+
+/**
+ * @brief Moves the counter at index down a min heap until the heap is valid again.
+ *
+ */
+static void sift_down(heavy_hitter *heap, size_t size, size_t index) {
+    while (true) {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if (left < size && counter_less(&heap[left], &heap[smallest])) smallest = left;
+        if (right < size && counter_less(&heap[right], &heap[smallest])) smallest = right;
+        if (smallest == index) return;
+
+        heavy_hitter swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+space_saving_t *s_s_create(size_t capacity) {
+    space_saving_t *summary;
+
+    if (capacity == 0 || capacity >= SPACE_SAVING_NONE || (summary = calloc(1, sizeof(space_saving_t))) == NULL) return NULL;
+
+    summary->capacity = capacity;
+    summary->n_slots = slots_for(capacity);
+    summary->counters = malloc(sizeof(heavy_hitter) * capacity);
+    summary->buckets = malloc(sizeof(count_bucket) * (capacity + 1));
+    summary->slots = calloc(summary->n_slots, sizeof(uint32_t));
+
+    if (summary->counters == NULL || summary->buckets == NULL || summary->slots == NULL) {
+        s_s_destroy(summary);
+        return NULL;
+    }
+
+    reset_buckets(summary);
+
+    return summary;
+}
+
+
+bool s_s_add(space_saving_t *summary, const unsigned char *word, size_t size, uint64_t hash) {
+    size_t slot = find_slot(summary, word, size, hash);
+    uint32_t counter_idx;
+    heavy_hitter *counter;
+
+    if (summary->slots[slot] != 0) {
+        increment(summary, summary->slots[slot] - 1);
+    } else if (summary->n_counters < summary->capacity) {
+        uint32_t bucket_idx = summary->smallest;
+
+        counter_idx = summary->n_counters;
+        counter = &summary->counters[counter_idx];
+        counter->word = NULL;
+        counter->word_capacity = 0;
+        if (!set_word(counter, word, size, hash)) return false;
+
+        summary->n_counters++;
+        counter->count = 1;
+        counter->error = 0;
+
+        if (bucket_idx == SPACE_SAVING_NONE || summary->buckets[bucket_idx].count != 1) {
+            bucket_idx = new_bucket(summary, 1, SPACE_SAVING_NONE);
+        }
+
+        attach_counter(summary, counter_idx, bucket_idx);
+        summary->slots[slot] = counter_idx + 1;
+    } else {
+        // The word takes over a counter with the smallest count, which it may have had.
+        counter_idx = summary->buckets[summary->smallest].first;
+        counter = &summary->counters[counter_idx];
+        remove_slot(summary, counter_idx);
+
+        if (!set_word(counter, word, size, hash)) {
+            summary->slots[find_slot(summary, counter->word, counter->size, counter->hash)] = counter_idx + 1;
+            return false;
+        }
+
+        counter->error = counter->count;
+        summary->slots[find_slot(summary, word, size, hash)] = counter_idx + 1;
+        increment(summary, counter_idx);
+    }
+
+    summary->n_words++;
+    return true;
+}
+
+
+bool s_s_merge(space_saving_t *into, const space_saving_t *from) {
+    uint64_t into_missing = missing_count(into);
+    uint64_t from_missing = missing_count(from);
+    size_t n_merged = 0;
+    heavy_hitter *merged = malloc(sizeof(heavy_hitter) * (into->n_counters + from->n_counters + 1));
+
+    if (merged == NULL) return false;
+
+    for (size_t i = 0; i < into->n_counters; i++) {
+        heavy_hitter *counter = &into->counters[i];
+        size_t slot = find_slot(from, counter->word, counter->size, counter->hash);
+
+        merged[n_merged] = *counter;
+
+        if (from->slots[slot] != 0) {
+            merged[n_merged].count += from->counters[from->slots[slot] - 1].count;
+            merged[n_merged].error += from->counters[from->slots[slot] - 1].error;
+        } else {
+            merged[n_merged].count += from_missing;
+            merged[n_merged].error += from_missing;
+        }
+
+        n_merged++;
+    }
+
+    for (size_t i = 0; i < from->n_counters; i++) {
+        const heavy_hitter *counter = &from->counters[i];
+
+        if (into->slots[find_slot(into, counter->word, counter->size, counter->hash)] != 0) continue;
+
+        merged[n_merged] = *counter;
+        merged[n_merged].word = NULL;
+        merged[n_merged].word_capacity = 0;
+
+        // Only the words copied from the other summary belong to the merge so far.
+        if (!set_word(&merged[n_merged], counter->word, counter->size, counter->hash)) {
+            for (size_t j = into->n_counters; j < n_merged; j++) free(merged[j].word);
+
+            free(merged);
+            return false;
+        }
+
+        merged[n_merged].count += into_missing;
+        merged[n_merged].error += into_missing;
+        n_merged++;
+    }
+
+    // Only the largest counts are kept, as a summary of the merged capacity would have.
+    qsort(merged, n_merged, sizeof(heavy_hitter), compare_counters_desc);
+
+    for (size_t i = into->capacity; i < n_merged; i++) {
+        free(merged[i].word);
+    }
+
+    if (n_merged > into->capacity) n_merged = into->capacity;
+
+    memcpy(into->counters, merged, sizeof(heavy_hitter) * n_merged);
+    into->n_counters = n_merged;
+    into->n_words += from->n_words;
+    free(merged);
+
+    // The buckets are made again from the largest count, each one before the last.
+    memset(into->slots, 0, sizeof(uint32_t) * into->n_slots);
+    reset_buckets(into);
+
+    for (size_t i = 0; i < into->n_counters; i++) {
+        heavy_hitter *counter = &into->counters[i];
+        uint32_t bucket_idx = into->smallest;
+
+        if (bucket_idx == SPACE_SAVING_NONE || into->buckets[bucket_idx].count != counter->count) {
+            bucket_idx = new_bucket(into, counter->count, SPACE_SAVING_NONE);
+        }
+
+        into->slots[find_slot(into, counter->word, counter->size, counter->hash)] = i + 1;
+        attach_counter(into, i, bucket_idx);
+    }
+
+    return true;
+}
+
+
+size_t s_s_top(const space_saving_t *summary, size_t n, heavy_hitter *top_out) {
+    size_t size = 0;
+
+    if (n == 0) return 0;
+
+    // Keep the n largest counts in a min heap, so the smallest is the one replaced.
+    for (size_t i = 0; i < summary->n_counters; i++) {
+        const heavy_hitter *counter = &summary->counters[i];
+
+        if (size < n) {
+            top_out[size++] = *counter;
+
+            if (size == n) {
+                for (size_t j = n / 2; j-- > 0;) sift_down(top_out, size, j);
+            }
+        } else if (counter_less(&top_out[0], counter)) {
+            top_out[0] = *counter;
+            sift_down(top_out, size, 0);
+        }
+    }
+
+    qsort(top_out, size, sizeof(heavy_hitter), compare_counters_desc);
+    return size;
+}
+
+
+void s_s_destroy(space_saving_t *summary) {
+    if (summary->counters != NULL) {
+        for (size_t i = 0; i < summary->n_counters; i++) {
+            free(summary->counters[i].word);
+        }
+    }
+
+    free(summary->counters);
+    free(summary->buckets);
+    free(summary->slots);
+    free(summary);
+}
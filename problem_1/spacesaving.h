@@ -0,0 +1,131 @@
+/**
+ * @file spacesaving.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief This module contains Space-Saving summaries, which keep the most frequent words of a
+ * text in a fixed number of counters, however many distinct words there are. A word that isn't
+ * counted yet takes the counter with the smallest count, which it inherits as its error, so the
+ * count of a word is never below its true count and at most its error above it. Every word seen
+ * more than n_words / capacity times is in the summary.
+ *
+ * Summaries are merged as in Agarwal et al., "Mergeable summaries", 2012: the counts of the
+ * words in both are added and a word missing from a full summary is given its smallest count,
+ * as both count and error, before the capacity largest counts are kept.
+ * @version 0.1
+ * @date 2022-05-10
+ *
+ */
+
+#ifndef SPACESAVING_GUARD
+#define SPACESAVING_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Counters kept for each of the words asked for, since the counts of the last
+ * counters of a summary are the least accurate.
+ *
+ */
+#define SPACE_SAVING_FACTOR 16
+
+/**
+ * @brief A word of a summary.
+ *
+ */
+typedef struct heavy_hitter {
+    unsigned char *word;    // Not null terminated.
+    uint32_t size;
+    uint32_t word_capacity; // Bytes allocated for the word, which is reused by the next word of the counter.
+    uint64_t hash;
+    uint64_t count;         // Never below the true count of the word.
+    uint64_t error;         // The count is at most this much above the true count.
+    uint32_t bucket;
+    uint32_t previous;      // Counters of the same bucket, or SPACE_SAVING_NONE.
+    uint32_t next;
+} heavy_hitter;
+
+/**
+ * @brief The counters with the same count. The buckets are kept in a list from the smallest
+ * count, so a counter only ever moves to the next bucket, or a new one, when it is incremented.
+ *
+ */
+typedef struct count_bucket {
+    uint64_t count;
+    uint32_t first;         // Counter of the bucket, or the next free bucket.
+    uint32_t previous;      // Buckets with the closest smaller and larger counts, or SPACE_SAVING_NONE.
+    uint32_t next;
+} count_bucket;
+
+/**
+ * @brief Index of no counter nor bucket.
+ *
+ */
+#define SPACE_SAVING_NONE UINT32_MAX
+
+/**
+ * @brief Data structure representing a summary.
+ * It's fields must not be changed directly.
+ *
+ */
+typedef struct space_saving_t {
+    heavy_hitter *counters;
+    size_t n_counters;
+    size_t capacity;
+    count_bucket *buckets;  // One more than the counters, for the bucket made before one is emptied.
+    uint32_t smallest;      // Bucket with the smallest count, or SPACE_SAVING_NONE.
+    uint32_t free_buckets;
+    uint32_t *slots;        // Index of the counter plus one, or 0 if the slot is empty.
+    size_t n_slots;         // Always a power of 2.
+    uint64_t n_words;       // Words added, counting the ones of the merged summaries.
+} space_saving_t;
+
+/**
+ * @brief Creates an empty summary.
+ *
+ * @param capacity The number of counters.
+ * @return space_saving_t* A pointer to the summary on success or NULL on failure.
+ */
+space_saving_t *s_s_create(size_t capacity);
+
+/**
+ * @brief Adds an occurrence of a word to the summary. The word is copied.
+ *
+ * @param summary
+ * @param word
+ * @param size The number of bytes of the word.
+ * @param hash The hash of the word, from w_t_hash().
+ * @return true on success and false if memory couldn't be allocated, with errno set,
+ * in which case the summary is left as it was.
+ */
+bool s_s_add(space_saving_t *summary, const unsigned char *word, size_t size, uint64_t hash);
+
+/**
+ * @brief Merges a summary into another one, which then summarizes the words of both.
+ *
+ * @param into
+ * @param from
+ * @return true on success and false if memory couldn't be allocated, with errno set,
+ * in which case into is left as it was.
+ */
+bool s_s_merge(space_saving_t *into, const space_saving_t *from);
+
+/**
+ * @brief Gets the n words of a summary with the largest counts. Ties are broken by the bytes of the words.
+ *
+ * @param summary
+ * @param n
+ * @param top_out Array of at least n entries, filled from the largest count. They point to
+ * the words of the summary, which are valid until it changes.
+ * @return size_t The number of entries in top_out, less than n if the summary has fewer words.
+ */
+size_t s_s_top(const space_saving_t *summary, size_t n, heavy_hitter *top_out);
+
+/**
+ * @brief Deallocates the summary.
+ *
+ * @param summary
+ */
+void s_s_destroy(space_saving_t *summary);
+
+#endif
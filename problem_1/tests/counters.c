@@ -0,0 +1,153 @@
+/**
+ * @file counters.c
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Checks that counters with pinned workers don't share state: two of them with
+ * different numbers of workers are alive at once, count the same files at the same time from
+ * two threads and must agree with each other, and the one left must still count and report
+ * its placement once the other is destroyed. Best built with AddressSanitizer.
+ *
+ * Build (from problem_1): gcc -Wall -g -fsanitize=address -o tests/counters tests/counters.c $(ls *.c | grep -v main.c) -lpthread
+ * Usage: tests/counters file...
+ * @version 0.1
+ * @date 2022-05-12
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../countwords.h"
+
+/**
+ * @brief Number of batches each counter counts while the other one counts too.
+ *
+ */
+#define N_ROUNDS 20
+
+/**
+ * @brief A counter and what it counted, for a thread of its own.
+ *
+ */
+typedef struct counter_run {
+    counter_t *counter;
+    size_t n_files;
+    char **file_names;
+    const measurements *expected;
+    bool success;
+} counter_run;
+
+/**
+ * @brief Counts the files once and checks the measurements against the expected ones.
+ *
+ */
+static bool count_and_check(counter_t *counter, size_t n_files, char **file_names, const measurements *expected) {
+    measurements *results;
+
+    if (!c_w_count_files(counter, n_files, file_names, &results, NULL)) {
+        printf("Error counting the files: %s\n", strerror(errno));
+        return false;
+    }
+
+    for (size_t i = 0; i < n_files; i++) {
+        if (memcmp(&results[i], &expected[i], sizeof(measurements)) != 0) {
+            printf(
+                "The file %s has %lu words instead of %lu\n",
+                file_names[i], results[i].n_words, expected[i].n_words
+            );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void *run_counter(void *run_arg) {
+    counter_run *run = run_arg;
+
+    run->success = true;
+
+    for (size_t round = 0; round < N_ROUNDS && run->success; round++) {
+        run->success = count_and_check(run->counter, run->n_files, run->file_names, run->expected);
+    }
+
+    return NULL;
+}
+
+static counter_t *create_or_die(size_t n_threads) {
+    counter_options options = c_w_default_options();
+    counter_t *counter;
+
+    options.placement = PLACEMENT_PIN;
+
+    if ((counter = c_w_create(n_threads, &options)) == NULL) {
+        printf("Error creating a counter of %lu workers: %s\n", n_threads, strerror(errno));
+        exit(1);
+    }
+
+    return counter;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n_files = argc - 1;
+    char **file_names = argv + 1;
+    counter_t *many, *one;
+    measurements *results, *expected;
+    counter_run runs[2];
+    pthread_t threads[2];
+    bool success = true;
+
+    if (n_files == 0) {
+        printf("Usage: %s file...\n", argv[0]);
+        return 1;
+    }
+
+    // The larger counter comes first, the topology of the second one used to overwrite its own.
+    many = create_or_die(4);
+    one = create_or_die(1);
+
+    if (!c_w_count_files(many, n_files, file_names, &results, NULL)) {
+        printf("Error counting the files: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if ((expected = malloc(sizeof(measurements) * n_files)) == NULL) {
+        printf("Error allocating memory for the results: %s\n", strerror(errno));
+        return 1;
+    }
+
+    memcpy(expected, results, sizeof(measurements) * n_files);
+
+    runs[0] = (counter_run) {many, n_files, file_names, expected, false};
+    runs[1] = (counter_run) {one, n_files, file_names, expected, false};
+
+    for (size_t i = 0; i < 2; i++) {
+        if ((errno = pthread_create(&threads[i], NULL, run_counter, &runs[i])) != 0) {
+            printf("Error creating a thread: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        success = success && runs[i].success;
+    }
+
+    if (placement_get_mode(c_w_placement(many)) != placement_get_mode(c_w_placement(one))) {
+        printf("The counters weren't placed the same way\n");
+        success = false;
+    }
+
+    // The placement of the counter left must outlive the other one.
+    c_w_destroy(many);
+    success = success && count_and_check(one, n_files, file_names, expected);
+    placement_report(c_w_placement(one));
+    c_w_destroy(one);
+
+    free(expected);
+
+    printf("%s\n", success ? "OK" : "FAILED");
+    return success ? 0 : 1;
+}
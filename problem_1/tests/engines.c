@@ -0,0 +1,399 @@
+/**
+ * @file engines.c
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Checks that every counting engine, and every vectorized kernel the cpu supports,
+ * gives the exact same results as process_data_scalar(), both on the given files and on generated texts full of bogus
+ * utf8: stray continuation bytes, 0x7f, sequences cut off by ASCII or header bytes and
+ * the header bytes from 0xf8 that ask for more than 3 continuation bytes. Each text is
+ * also cut in small chunks at every byte offset the chunk size gives, whose summaries must
+ * add up to the same results when merged in order and when merged pairwise, like the
+ * workers may merge them, and whose words, found while the chunks are summarized, must be the
+ * ones count_chunk_words() finds in the whole text.
+ *
+ * Build (from problem_1): gcc -Wall -O3 -o tests/engines tests/engines.c $(ls *.c | grep -v main.c) -lpthread
+ * Usage: tests/engines [file...]
+ * @version 0.1
+ * @date 2022-05-12
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../wordcount.h"
+#include "../wordfreq.h"
+
+/**
+ * @brief Number of texts generated for each rate of bogus bytes.
+ *
+ */
+#define N_GENERATED 300
+
+/**
+ * @brief Largest size of a generated text, in bytes.
+ *
+ */
+#define GENERATED_MAX_SIZE 600
+
+/**
+ * @brief Sizes the texts are cut in. The smallest chunks allowed in the middle of a text
+ * are UTF8_MAX_PARTIAL + 1 bytes long.
+ *
+ */
+static const size_t chunk_sizes[] = {UTF8_MAX_PARTIAL + 1, UTF8_MAX_PARTIAL + 2, 13, 64, 100};
+
+/**
+ * @brief Texts that were counted differently by some engine.
+ *
+ */
+static const struct {
+    const char *name;
+    const char *text;
+} fixed_texts[] = {
+    {"0xff cut off by a space", "x\xff\xa1\x9c\x80 "},
+    {"0xff complete", "x\xff\x80\x80\x80\x80\x80\x80 y "},
+    {"0xf8 complete", "ab\xf8\x80\x80\x80\x80 c"},
+    {"0xfc cut off by a header byte", "b\xfc\x80\x80\x80\xc3\xa9 "},
+    {"0xfe complete", "b\xfe\x80\x80\x80\x80\x80\x80."},
+    {"0x7f inside a word", "ab\x7f\x80 cd "},
+    {"0xff across chunks", "abcdefx\xff\x80\x80\x80\x80\x80\x80\x80\x80\x80 yz "},
+    {"0xfe across chunks", "abcdefghijklmx\xfe\x80\x80\x80\x80\x80\x80 b "},
+};
+
+/**
+ * @brief The engines checked against process_data_scalar(), with each vectorized kernel
+ * the cpu supports. The scalar engine is there for the summaries of the chunks.
+ *
+ */
+static const struct {
+    count_engine engine;
+    const char *vector_kernel;
+} engines[] = {
+    {ENGINE_SCALAR, NULL},
+    {ENGINE_VECTOR, "sse2"},
+    {ENGINE_VECTOR, "avx2"},
+    {ENGINE_VECTOR, "avx512"},
+    {ENGINE_DFA, NULL},
+};
+
+/**
+ * @brief Generates a text of mostly ASCII words with the given percentage of bogus bytes,
+ * so the vectorized kernels see both ASCII blocks and blocks they hand to the scalar path.
+ *
+ */
+static size_t generate_text(unsigned char *text, int bogus_percent) {
+    static const unsigned char ascii[] = "abcdefghijklmnopqrstuvwxyz AEIOU_09 .,-\n";
+    static const unsigned char bogus[] = {0x7f, 0x80, 0xa1, 0xbf, 0xc3, 0xe2, 0xf0, 0xf8, 0xfc, 0xfe, 0xff};
+    size_t size = rand() % GENERATED_MAX_SIZE;
+
+    for (size_t i = 0; i < size; i++) {
+        if (rand() % 100 < bogus_percent) {
+            text[i] = rand() % 2 ? bogus[rand() % sizeof(bogus)] : 0x80 + rand() % 0x80;
+        } else {
+            text[i] = ascii[rand() % (sizeof(ascii) - 1)];
+        }
+    }
+
+    return size;
+}
+
+static void *alloc_or_die(size_t size) {
+    void *memory;
+
+    if ((memory = malloc(size)) == NULL) {
+        printf("Error allocating memory: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    return memory;
+}
+
+static void check_or_die(bool success) {
+    if (!success) {
+        printf("Error counting the words: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const word_entry *first = a;
+    const word_entry *second = b;
+
+    if (first->size != second->size) return first->size < second->size ? -1 : 1;
+    return memcmp(first->word, second->word, first->size);
+}
+
+/**
+ * @brief Whether two tables have the same words with the same counts.
+ *
+ */
+static bool same_words(const word_table_t *a, const word_table_t *b) {
+    size_t n_entries, n_other;
+    const word_entry *entries = w_t_entries(a, &n_entries);
+    const word_entry *other_entries = w_t_entries(b, &n_other);
+    word_entry *sorted, *other_sorted;
+    bool same = n_entries == n_other;
+
+    if (!same || n_entries == 0) return same;
+
+    sorted = alloc_or_die(sizeof(word_entry) * n_entries);
+    other_sorted = alloc_or_die(sizeof(word_entry) * n_entries);
+    memcpy(sorted, entries, sizeof(word_entry) * n_entries);
+    memcpy(other_sorted, other_entries, sizeof(word_entry) * n_entries);
+    qsort(sorted, n_entries, sizeof(word_entry), compare_entries);
+    qsort(other_sorted, n_entries, sizeof(word_entry), compare_entries);
+
+    for (size_t i = 0; i < n_entries && same; i++) {
+        same = compare_entries(&sorted[i], &other_sorted[i]) == 0 && sorted[i].count == other_sorted[i].count;
+    }
+
+    free(sorted);
+    free(other_sorted);
+    return same;
+}
+
+/**
+ * @brief Counts the words of a whole text in a new table with count_chunk_words().
+ *
+ */
+static word_table_t *count_text_words(const unsigned char *text, size_t size) {
+    word_table_t *table = w_t_create();
+    word_sink sink;
+    word_edges edges;
+
+    check_or_die(table != NULL);
+    init_word_sink(&sink, table, NULL, NULL);
+    check_or_die(count_chunk_words(&sink, text, size, &edges) && finish_word_edges(&sink, &edges));
+    free_word_sink(&sink);
+    return table;
+}
+
+static bool same_results(const measurements *a, const word_state *a_state, const measurements *b, const word_state *b_state) {
+    return memcmp(a, b, sizeof(measurements)) == 0 &&
+           a_state->in_word == b_state->in_word && a_state->prev_consonant == b_state->prev_consonant;
+}
+
+/**
+ * @brief Summarizes a text cut in chunks, counting their words in a table, and merges the
+ * summaries and the edges of the words in order, or pairwise until one is left.
+ *
+ */
+static void summarize_chunks(
+    const unsigned char *text, size_t size, size_t chunk_size, bool pairwise,
+    chunk_summary *summaries, word_edges *edges, word_table_t *table, measurements *out, word_state *state_out
+) {
+    size_t n_chunks = 0;
+    chunk_summary *summary = &summaries[0];
+    word_sink sink;
+
+    init_word_sink(&sink, table, NULL, NULL);
+    empty_summary(summary);
+    empty_word_edges(&edges[0]);
+
+    for (size_t offset = 0; offset < size; offset += chunk_size) {
+        const size_t data_size = size - offset < chunk_size ? size - offset : chunk_size;
+
+        check_or_die(summarize_chunk_and_words(&sink, text + offset, data_size, &summaries[n_chunks], &edges[n_chunks]));
+        n_chunks++;
+    }
+
+    if (pairwise) {
+        while (n_chunks > 1) {
+            size_t n_merged = 0;
+
+            for (size_t i = 0; i < n_chunks; i += 2) {
+                summaries[n_merged] = summaries[i];
+                edges[n_merged] = edges[i];
+
+                if (i + 1 < n_chunks) {
+                    merge_summaries(&summaries[n_merged], &summaries[i + 1]);
+                    check_or_die(merge_word_edges(&sink, &edges[n_merged], &edges[i + 1]));
+                }
+
+                n_merged++;
+            }
+
+            n_chunks = n_merged;
+        }
+    } else {
+        for (size_t i = 1; i < n_chunks; i++) {
+            merge_summaries(summary, &summaries[i]);
+            check_or_die(merge_word_edges(&sink, &edges[0], &edges[i]));
+        }
+    }
+
+    check_or_die(finish_word_edges(&sink, &edges[0]));
+    free_word_sink(&sink);
+
+    *out = (measurements) {0, 0, 0};
+    summary_results(summary, out);
+    state_out->in_word = (summary->exit_states[0] & 2) != 0;
+    state_out->prev_consonant = (summary->exit_states[0] & 1) != 0;
+}
+
+/**
+ * @brief Counts a text in chunks of every size with the selected engine and compares the
+ * results with the scalar ones.
+ *
+ */
+static bool check_chunks(
+    const char *name, const unsigned char *text, size_t size,
+    const measurements *expected, const word_state *expected_state, const word_table_t *expected_words
+) {
+    chunk_summary *summaries = alloc_or_die(sizeof(chunk_summary) * (size / chunk_sizes[0] + 1));
+    word_edges *edges = alloc_or_die(sizeof(word_edges) * (size / chunk_sizes[0] + 1));
+    bool success = true;
+
+    for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+        for (int pairwise = 0; pairwise <= 1; pairwise++) {
+            word_table_t *words = w_t_create();
+            measurements result;
+            word_state state;
+
+            check_or_die(words != NULL);
+            summarize_chunks(text, size, chunk_sizes[i], pairwise, summaries, edges, words, &result, &state);
+
+            if (!same_words(words, expected_words)) {
+                printf(
+                    "%s: %s in chunks of %lu bytes merged %s found other words than count_chunk_words()\n",
+                    name, process_data_kernel_name(), chunk_sizes[i], pairwise ? "pairwise" : "in order"
+                );
+                success = false;
+            }
+
+            w_t_destroy(words);
+
+            if (!same_results(&result, &state, expected, expected_state)) {
+                printf(
+                    "%s: %s in chunks of %lu bytes merged %s counted %lu %lu %lu instead of %lu %lu %lu\n",
+                    name, process_data_kernel_name(), chunk_sizes[i], pairwise ? "pairwise" : "in order",
+                    result.n_words, result.n_words_start_vowel, result.n_words_end_cons,
+                    expected->n_words, expected->n_words_start_vowel, expected->n_words_end_cons
+                );
+                success = false;
+            }
+        }
+    }
+
+    free(summaries);
+    free(edges);
+    return success;
+}
+
+/**
+ * @brief Counts a text with every engine, whole and in chunks, and compares the results
+ * with the scalar ones.
+ *
+ */
+static bool check_engines(const char *name, const unsigned char *text, size_t size) {
+    measurements expected = {0, 0, 0};
+    word_state expected_state = WORD_STATE_INIT;
+    word_table_t *expected_words = count_text_words(text, size);
+    bool success = true;
+
+    process_data_scalar(text, size, &expected_state, &expected);
+
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        measurements result = {0, 0, 0};
+        word_state state = WORD_STATE_INIT;
+
+        if (engines[i].vector_kernel != NULL && !select_vector_kernel(engines[i].vector_kernel)) continue;
+        if (!select_count_engine(engines[i].engine)) {
+            printf("Error selecting the engine: %s\n", strerror(errno));
+            exit(1);
+        }
+        process_data(text, size, &state, &result);
+
+        if (!same_results(&result, &state, &expected, &expected_state)) {
+            printf(
+                "%s: %s counted %lu %lu %lu instead of %lu %lu %lu\n", name, process_data_kernel_name(),
+                result.n_words, result.n_words_start_vowel, result.n_words_end_cons,
+                expected.n_words, expected.n_words_start_vowel, expected.n_words_end_cons
+            );
+            success = false;
+        }
+
+        success = check_chunks(name, text, size, &expected, &expected_state, expected_words) && success;
+    }
+
+    w_t_destroy(expected_words);
+    return success;
+}
+
+/**
+ * @brief Reads a whole file into memory.
+ *
+ * @return unsigned char* The contents of the file or NULL on failure, with errno set.
+ */
+static unsigned char *read_file(const char *file_name, size_t *size_out) {
+    FILE *file;
+    unsigned char *data;
+    long size;
+
+    if ((file = fopen(file_name, "r")) == NULL) return NULL;
+
+    if (fseek(file, 0, SEEK_END) == -1 || (size = ftell(file)) == -1 || fseek(file, 0, SEEK_SET) == -1) {
+        fclose(file);
+        return NULL;
+    }
+
+    if ((data = malloc(size > 0 ? size : 1)) == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        fclose(file);
+        errno = EIO;
+        return NULL;
+    }
+
+    fclose(file);
+    *size_out = size;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned char text[GENERATED_MAX_SIZE];
+    bool success = true;
+    size_t n_texts = 0;
+
+    for (int i = 1; i < argc; i++) {
+        unsigned char *data;
+        size_t size;
+
+        if ((data = read_file(argv[i], &size)) == NULL) {
+            printf("Error reading the file %s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+
+        success = check_engines(argv[i], data, size) && success;
+        n_texts++;
+        free(data);
+    }
+
+    for (size_t i = 0; i < sizeof(fixed_texts) / sizeof(fixed_texts[0]); i++) {
+        success = check_engines(fixed_texts[i].name, (const unsigned char *) fixed_texts[i].text, strlen(fixed_texts[i].text)) && success;
+        n_texts++;
+    }
+
+    // The same seed every run, so a failure can be reproduced.
+    srand(1);
+
+    for (int bogus_percent = 1; bogus_percent <= 50; bogus_percent *= 7) {
+        for (size_t i = 0; i < N_GENERATED; i++) {
+            char name[64];
+            size_t size = generate_text(text, bogus_percent);
+
+            snprintf(name, sizeof(name), "generated text %lu with %d%% bogus bytes", i, bogus_percent);
+            success = check_engines(name, text, size) && success;
+            n_texts++;
+        }
+    }
+
+    printf("%lu texts, %s\n", n_texts, success ? "OK" : "FAILED");
+    return success ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+Generates utf8tables.c, the lookup tables used by utf8.c to classify and fold
+characters of the basic multilingual plane in constant time.
+
+Both tables have two stages. The first one maps the codepoint without its lower
+6 bits to a block and the second one holds the values of the 64 codepoints of
+each distinct block, so identical blocks (most of them) are only stored once.
+
+    UTF8_CLASS_STAGE2[UTF8_CLASS_STAGE1[cp >> 6]][cp & 63] -> UTF8_CLASS_* bits
+    UTF8_FOLD_STAGE2[UTF8_FOLD_STAGE1[cp >> 6]][cp & 63]   -> (folded cp - cp) mod 2^16
+
+Usage (from problem_1): python3 tools/gen_utf8_tables.py > utf8tables.c
+"""
+import sys
+import unicodedata
+
+# Must match the UTF8_CLASS_* macros in utf8.h
+ALNUM = 0x01
+VOWEL = 0x02
+CONSONANT = 0x04
+SEPARATOR = 0x08
+PUNCTUATION = 0x10
+WHITESPACE = 0x20
+MERGER = 0x40
+
+BLOCK_BITS = 6
+BLOCK_SIZE = 1 << BLOCK_BITS
+N_CODEPOINTS = 0x10000
+
+# The ASCII part of these sets must stay in sync with the vectorized kernels in wordcount.c.
+# The General Punctuation block keeps the characters that were already classified before
+# the tables existed, so U+2014 (em dash) is still left out and the counts of the existing
+# corpora don't change.
+WHITESPACE_CHARS = ' \t\n\r\u0085\u00a0\u1680\u2028\u2029\u202f\u205f\u3000' + \
+                   ''.join(chr(cp) for cp in range(0x2000, 0x200b))
+PUNCTUATION_CHARS = '.,:;?!\u2013\u2026\u00a1\u00bf\u037e\u0387'
+SEPARATOR_CHARS = '-"[]()\u00ab\u00bb\u201c\u201d\u201e\u2039\u203a'
+MERGER_CHARS = '\'\u2018\u2019\u02bc'
+
+SCRIPTS = ('LATIN', 'GREEK', 'CYRILLIC')
+
+VOWELS = {
+    'LATIN': set('aeiou'),
+    'GREEK': set('αεηιουω'),
+    'CYRILLIC': set('аеиоуыэюяіє'),
+}
+
+# Letters without a canonical decomposition that still fold into a base letter.
+FOLD_OVERRIDES = {
+    'æ': 'a', 'œ': 'o', 'ø': 'o', 'ð': 'd', 'þ': 't', 'ß': 's', 'đ': 'd', 'ł': 'l',
+    'ħ': 'h', 'ı': 'i', 'ŧ': 't', 'ŋ': 'n', 'ĸ': 'k', 'ſ': 's', 'ƀ': 'b', 'ɨ': 'i',
+}
+
+# Letters whose diacritic makes them a different letter, so they are only case folded.
+KEEP_DIACRITIC = set('йў')
+
+
+def script_of(char):
+    name = unicodedata.name(char, '')
+    for script in SCRIPTS:
+        if name.startswith(script):
+            return script
+    return None
+
+
+def fold(char):
+    """Lower case letter without diacritics. Other characters are returned as is."""
+    if not unicodedata.category(char).startswith('L'):
+        return char
+
+    folded = char.lower()[0]
+    if script_of(char) is None:
+        return folded
+
+    if folded not in KEEP_DIACRITIC:
+        base = unicodedata.normalize('NFD', folded)[0]
+        if unicodedata.category(base).startswith('L'):
+            folded = base
+
+    return FOLD_OVERRIDES.get(folded, folded)
+
+
+def char_class(char):
+    if char in WHITESPACE_CHARS:
+        return WHITESPACE
+    if char in PUNCTUATION_CHARS:
+        return PUNCTUATION
+    if char in SEPARATOR_CHARS:
+        return SEPARATOR
+    if char in MERGER_CHARS:
+        return MERGER
+
+    category = unicodedata.category(char)
+    if category == 'Nd':
+        return ALNUM
+    if not category.startswith('L'):
+        return 0
+
+    script = script_of(char)
+    if script is None:
+        return ALNUM
+
+    return ALNUM | (VOWEL if fold(char) in VOWELS[script] else CONSONANT)
+
+
+def two_stages(values):
+    """Splits the values in blocks and returns the first stage and the distinct blocks."""
+    blocks = []
+    block_ids = {}
+    stage_1 = []
+
+    for start in range(0, len(values), BLOCK_SIZE):
+        block = tuple(values[start:start + BLOCK_SIZE])
+        if block not in block_ids:
+            block_ids[block] = len(blocks)
+            blocks.append(block)
+        stage_1.append(block_ids[block])
+
+    return stage_1, blocks
+
+
+def check_fits_uint8(name, values):
+    if max(values) >= 0x100:
+        sys.exit(f'{name} has more than 256 blocks, utf8tables.h must be updated')
+
+
+def print_array(out, declaration, values, per_line=16):
+    out.write(f'{declaration} = {{\n')
+    for start in range(0, len(values), per_line):
+        line = ', '.join(str(value) for value in values[start:start + per_line])
+        out.write(f'    {line},\n')
+    out.write('};\n\n')
+
+
+def print_blocks(out, declaration, blocks, per_line=16):
+    out.write(f'{declaration} = {{\n')
+    for block in blocks:
+        out.write('    {\n')
+        for start in range(0, len(block), per_line):
+            line = ', '.join(str(value) for value in block[start:start + per_line])
+            out.write(f'        {line},\n')
+        out.write('    },\n')
+    out.write('};\n\n')
+
+
+def main():
+    chars = [chr(cp) for cp in range(N_CODEPOINTS)]
+    classes = [0 if 0xd800 <= ord(char) < 0xe000 else char_class(char) for char in chars]
+    folds = [0 if 0xd800 <= ord(char) < 0xe000 else (ord(fold(char)) - ord(char)) % N_CODEPOINTS for char in chars]
+
+    class_stage_1, class_blocks = two_stages(classes)
+    fold_stage_1, fold_blocks = two_stages(folds)
+    check_fits_uint8('UTF8_CLASS_STAGE2', class_stage_1)
+    check_fits_uint8('UTF8_FOLD_STAGE2', fold_stage_1)
+
+    out = sys.stdout
+    out.write('/**\n')
+    out.write(' * @file utf8tables.c\n')
+    out.write(f' * @brief Generated by tools/gen_utf8_tables.py from Unicode {unicodedata.unidata_version}.\n')
+    out.write(' * Do not edit by hand.\n')
+    out.write(' *\n')
+    out.write(' */\n')
+    out.write('#include <stdint.h>\n\n')
+    out.write('#include "utf8tables.h"\n\n')
+
+    print_array(out, f'const uint8_t UTF8_CLASS_STAGE1[{len(class_stage_1)}]', class_stage_1)
+    print_blocks(out, f'const uint8_t UTF8_CLASS_STAGE2[{len(class_blocks)}][UTF8_TABLE_BLOCK_SIZE]', class_blocks)
+    print_array(out, f'const uint8_t UTF8_FOLD_STAGE1[{len(fold_stage_1)}]', fold_stage_1)
+    print_blocks(out, f'const uint16_t UTF8_FOLD_STAGE2[{len(fold_blocks)}][UTF8_TABLE_BLOCK_SIZE]', fold_blocks)
+
+    sys.stderr.write(f'{len(class_blocks)} class blocks, {len(fold_blocks)} fold blocks\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Sends files to a countWords server (countWords -n<threads> --serve <socket>) and
+prints their measurements, as 'words words_starting_with_vowel words_ending_with_consonant'.
+
+The requests are all sent before the answers are read, by a thread of their own, so
+the server gets many of them in flight and counts them in batches. See server.h for
+the protocol.
+
+Usage (from problem_1):
+    python3 tools/serve_client.py SOCKET [--inline] [--repeat N] [--quiet] [--stats] FILE...
+
+    --inline    Sends the bytes of the files (DATA requests) instead of their paths (FILE).
+    --repeat    Sends the files N times.
+    --quiet     Only prints the time the answers took and the number of errors.
+    --stats     Asks for the counters of the server after the files.
+"""
+import argparse
+import os
+import socket
+import sys
+import threading
+import time
+
+
+def build_requests(files, inline):
+    requests = []
+
+    for path in files:
+        if inline:
+            with open(path, 'rb') as file:
+                data = file.read()
+            requests.append(b'DATA %d\n' % len(data) + data)
+        else:
+            # The paths are relative to the directory of the server.
+            requests.append(b'FILE ' + os.fsencode(os.path.abspath(path)) + b'\n')
+
+    return requests
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Sends files to a countWords server.')
+    parser.add_argument('socket')
+    parser.add_argument('files', nargs='*')
+    parser.add_argument('--inline', action='store_true')
+    parser.add_argument('--repeat', type=int, default=1)
+    parser.add_argument('--quiet', action='store_true')
+    parser.add_argument('--stats', action='store_true')
+    arguments = parser.parse_intermixed_args()
+
+    requests = build_requests(arguments.files, arguments.inline)
+    names = arguments.files * arguments.repeat
+    payload = b''.join(requests) * arguments.repeat
+    if arguments.stats:
+        payload += b'STATS\n'
+        names.append('STATS')
+
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(arguments.socket)
+
+    start = time.monotonic()
+    sender = threading.Thread(target=client.sendall, args=(payload,))
+    sender.start()
+
+    answers = client.makefile('rb')
+    n_errors = 0
+
+    for name in names:
+        line = answers.readline()
+        if not line:
+            print('The server closed the connection', file=sys.stderr)
+            return 1
+
+        answer = line.decode().rstrip('\n')
+        if answer.startswith('ERROR'):
+            n_errors += 1
+        if not arguments.quiet or name == 'STATS':
+            print('%s: %s' % (name, answer))
+
+    elapsed = time.monotonic() - start
+    sender.join()
+    client.close()
+
+    n_requests = len(names) - arguments.stats
+    print('%d requests answered in %.6f s (%.1f per second), %d errors' %
+          (n_requests, elapsed, n_requests / elapsed if elapsed > 0 else 0.0, n_errors),
+          file=sys.stderr)
+    return 0 if n_errors == 0 else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Checks whether the kernel supports the operations used by this module.
+ *
+ */
+static bool supports_operations(int fd) {
+    const size_t n_ops = IORING_OP_LAST;
+    struct io_uring_probe *probe = calloc(1, sizeof(struct io_uring_probe) + n_ops * sizeof(struct io_uring_probe_op));
+    bool supported;
+
+    if (probe == NULL) return false;
+
+    if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, n_ops) < 0) {
+        free(probe);
+        return false;
+    }
+
+    supported = probe->last_op >= IORING_OP_OPENAT && probe->last_op >= IORING_OP_READ &&
+                (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+                (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+
+    free(probe);
+    if (!supported) errno = EOPNOTSUPP;
+    return supported;
+}
+
+/**
+ * @brief Gets a free submission queue entry, cleared, or NULL if the queue is full.
+ *
+ */
+static struct io_uring_sqe *next_sqe(uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head_ptr, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (ring->sq_tail - head == ring->sq_entries) return NULL;
+
+    idx = ring->sq_tail & *ring->sq_mask_ptr;
+    ring->sq_array[idx] = idx;
+    ring->sq_tail++;
+
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+bool u_r_init(uring_t *ring, unsigned entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(uring_t));
+    memset(&params, 0, sizeof(params));
+
+    if ((ring->fd = io_uring_setup(entries, &params)) < 0) return false;
+
+    if (!supports_operations(ring->fd)) {
+        close(ring->fd);
+        return false;
+    }
+
+    ring->sq_entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Both rings may share a single mapping.
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(
+        NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING
+    );
+    if (ring->sq_ring == MAP_FAILED) goto fail_sq_ring;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(
+            NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING
+        );
+        if (ring->cq_ring == MAP_FAILED) goto fail_cq_ring;
+    }
+
+    ring->sqes = mmap(
+        NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES
+    );
+    if (ring->sqes == MAP_FAILED) goto fail_sqes;
+
+    ring->sq_head_ptr = (unsigned *) ((char *) ring->sq_ring + params.sq_off.head);
+    ring->sq_tail_ptr = (unsigned *) ((char *) ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask_ptr = (unsigned *) ((char *) ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) ((char *) ring->sq_ring + params.sq_off.array);
+    ring->sq_tail = *ring->sq_tail_ptr;
+    ring->cq_head_ptr = (unsigned *) ((char *) ring->cq_ring + params.cq_off.head);
+    ring->cq_tail_ptr = (unsigned *) ((char *) ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask_ptr = (unsigned *) ((char *) ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ring + params.cq_off.cqes);
+
+    return true;
+
+fail_sqes:
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+fail_cq_ring:
+    munmap(ring->sq_ring, ring->sq_ring_size);
+fail_sq_ring:
+    close(ring->fd);
+    return false;
+}
+
+
+bool u_r_queue_open(uring_t *ring, const char *path, uint64_t user_data) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t) (uintptr_t) path;
+    sqe->open_flags = O_RDONLY;
+    sqe->user_data = user_data;
+    return true;
+}
+
+
+bool u_r_queue_read(
+    uring_t *ring, int fd, unsigned char *buffer, size_t size, size_t offset, uint64_t user_data
+) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+
+    if (sqe == NULL) return false;
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buffer;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+
+bool u_r_submit_and_wait(uring_t *ring, unsigned wait_nr) {
+    unsigned to_submit = ring->sq_tail - *ring->sq_tail_ptr;
+
+    __atomic_store_n(ring->sq_tail_ptr, ring->sq_tail, __ATOMIC_RELEASE);
+
+    while (true) {
+        int submitted = io_uring_enter(ring->fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+
+        if (submitted >= 0) {
+            to_submit -= submitted;
+            if (to_submit == 0) return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+
+bool u_r_next_completion(uring_t *ring, uint64_t *user_data_out, int32_t *result_out) {
+    unsigned head = *ring->cq_head_ptr;
+    struct io_uring_cqe *cqe;
+
+    if (head == __atomic_load_n(ring->cq_tail_ptr, __ATOMIC_ACQUIRE)) return false;
+
+    cqe = &ring->cqes[head & *ring->cq_mask_ptr];
+    *user_data_out = cqe->user_data;
+    *result_out = cqe->res;
+
+    __atomic_store_n(ring->cq_head_ptr, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+void u_r_close(uring_t *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file uring.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief A minimal wrapper around the io_uring system calls, with just what is needed to
+ * queue opens and reads of files and collect their completions from a single thread.
+ * @version 0.1
+ * @date 2022-05-08
+ *
+ */
+
+#ifndef URING_GUARD
+#define URING_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief Data structure representing an io_uring instance.
+ * It's fields must not be changed directly.
+ *
+ */
+typedef struct uring_t {
+    int fd;
+    unsigned sq_entries;
+    unsigned sq_tail;       // Tail with the entries queued but not submitted yet.
+    unsigned *sq_head_ptr;
+    unsigned *sq_tail_ptr;
+    unsigned *sq_mask_ptr;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head_ptr;
+    unsigned *cq_tail_ptr;
+    unsigned *cq_mask_ptr;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} uring_t;
+
+/**
+ * @brief Sets up an io_uring instance. Fails if the kernel doesn't support io_uring,
+ * it isn't allowed or the open and read operations aren't available.
+ *
+ * @param ring
+ * @param entries The number of operations that can be in flight at once.
+ * @return true on success and false on failure, with errno set.
+ */
+bool u_r_init(uring_t *ring, unsigned entries);
+
+/**
+ * @brief Queues an openat of a file for reading.
+ *
+ * @param ring
+ * @param path
+ * @param user_data Value returned with the completion.
+ * @return true if it was queued and false if the submission queue is full.
+ */
+bool u_r_queue_open(uring_t *ring, const char *path, uint64_t user_data);
+
+/**
+ * @brief Queues a read of a file at an offset.
+ *
+ * @param ring
+ * @param fd
+ * @param buffer
+ * @param size
+ * @param offset
+ * @param user_data Value returned with the completion.
+ * @return true if it was queued and false if the submission queue is full.
+ */
+bool u_r_queue_read(
+    uring_t *ring, int fd, unsigned char *buffer, size_t size, size_t offset, uint64_t user_data
+);
+
+/**
+ * @brief Submits the queued operations and waits until at least wait_nr completions are available.
+ *
+ * @param ring
+ * @param wait_nr
+ * @return true on success and false on failure, with errno set.
+ */
+bool u_r_submit_and_wait(uring_t *ring, unsigned wait_nr);
+
+/**
+ * @brief Takes the next completion if there is one.
+ *
+ * @param ring
+ * @param user_data_out The user_data of the completed operation.
+ * @param result_out The result of the operation, like the return value of the system call or -errno.
+ * @return true if a completion was taken and false if there are none.
+ */
+bool u_r_next_completion(uring_t *ring, uint64_t *user_data_out, int32_t *result_out);
+
+/**
+ * @brief Tears down the io_uring instance.
+ *
+ * @param ring
+ */
+void u_r_close(uring_t *ring);
+
+#endif
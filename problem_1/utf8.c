@@ -1,105 +1,107 @@
 #include "utf8.h"
+#include "utf8tables.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 
-static uint32_t ACCENT_CONV_TABLE[29] = {
-    0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61,// a
-    0x63, // c
-    0x65, 0x65, 0x65, 0x65, // e
-    0x69, 0x69, 0x69, 0x69, // i
-    0x6f, // o
-    0x6e, // n
-    0x6f, 0x6f, 0x6f, 0x6f, 0x6f, // o
-    0x20, 0x20, // whitespace
-    0x75, 0x75, 0x75, 0x75 // u
-};
-
-static uint32_t conv_latin_to_ascii(uint32_t utf8_char) {
-    // 'à' <= utf8_char && utf8_char <= 'ü'
-    if (0xc3a0 <= utf8_char && utf8_char <= 0xc3bc) {
-        return ACCENT_CONV_TABLE[utf8_char - 0xc3a0];
+#define INVALID_CODEPOINT 0xffffffff
+
+/**
+ * @brief Converts a utf8 character, as given by utf8iter_next_char(), into its codepoint.
+ * Overlong sequences are rejected since they would otherwise pass for ASCII characters.
+ * 
+ * @return uint32_t The codepoint or INVALID_CODEPOINT.
+ */
+static uint32_t utf8_to_codepoint(uint32_t utf8_char) {
+    uint32_t codepoint;
+    uint32_t min_codepoint;
+
+    if (utf8_char < 0x80) return utf8_char;
+
+    if (utf8_char <= 0xffff) {
+        codepoint = ((utf8_char >> 8) & 0x1f) << 6 | (utf8_char & 0x3f);
+        min_codepoint = 0x80;
+    } else if (utf8_char <= 0xffffff) {
+        codepoint = ((utf8_char >> 16) & 0x0f) << 12 | ((utf8_char >> 8) & 0x3f) << 6 | (utf8_char & 0x3f);
+        min_codepoint = 0x800;
+    } else {
+        codepoint = ((utf8_char >> 24) & 0x07) << 18 | ((utf8_char >> 16) & 0x3f) << 12 | \
+                    ((utf8_char >> 8) & 0x3f) << 6 | (utf8_char & 0x3f);
+        min_codepoint = 0x10000;
     }
 
-    // 'À' <= utf8_char && utf8_char <= 'Ü'
-    if (0xc380 <= utf8_char && utf8_char <= 0xc39c) {
-        return ACCENT_CONV_TABLE[utf8_char + 0x20 - 0xc3a0];
-    }
-    
-    return utf8_char;
+    return codepoint < min_codepoint ? INVALID_CODEPOINT : codepoint;
 }
 
-static bool is_ascii_vowel(uint32_t utf8_char) {
-    bool is_lower_vowel = (utf8_char == 'a') || \
-                          (utf8_char == 'e') || \
-                          (utf8_char == 'i') || \
-                          (utf8_char == 'o') || \
-                          (utf8_char == 'u');
-
-    bool is_upper_vowel = (utf8_char == 'A') || \
-                          (utf8_char == 'E') || \
-                          (utf8_char == 'I') || \
-                          (utf8_char == 'O') || \
-                          (utf8_char == 'U');
-    
-    return is_lower_vowel || is_upper_vowel;
-}
+/**
+ * @brief Converts a codepoint into a utf8 character with the same layout
+ * as the ones given by utf8iter_next_char().
+ * 
+ */
+static uint32_t codepoint_to_utf8(uint32_t codepoint) {
+    if (codepoint < 0x80) return codepoint;
 
-static bool is_ascii_alpha(uint32_t utf8_char) {
+    if (codepoint < 0x800) {
+        return (0xc0 | (codepoint >> 6)) << 8 | (0x80 | (codepoint & 0x3f));
+    }
 
-    return ('a' <= utf8_char && utf8_char <= 'z') || \
-           ('A' <= utf8_char && utf8_char <= 'Z') ;
+    if (codepoint < 0x10000) {
+        return (0xe0 | (codepoint >> 12)) << 16 | (0x80 | ((codepoint >> 6) & 0x3f)) << 8 | \
+               (0x80 | (codepoint & 0x3f));
+    }
+
+    return (0xf0 | (codepoint >> 18)) << 24 | (0x80 | ((codepoint >> 12) & 0x3f)) << 16 | \
+           (0x80 | ((codepoint >> 6) & 0x3f)) << 8 | (0x80 | (codepoint & 0x3f));
 }
 
-static bool is_ascii_number(uint32_t utf8_char) {
+uint8_t utf8_char_class(uint32_t utf8_char) {
+    uint32_t codepoint = utf8_to_codepoint(utf8_char);
+
+    if (codepoint >= UTF8_TABLE_CODEPOINTS) return 0;
 
-    return ('0' <= utf8_char && utf8_char <= '9');
+    return UTF8_CLASS_STAGE2[UTF8_CLASS_STAGE1[codepoint >> UTF8_TABLE_BLOCK_BITS]]
+                            [codepoint & (UTF8_TABLE_BLOCK_SIZE - 1)];
 }
 
-static bool is_ascii_consonant(uint32_t utf8_char) {
-    return is_ascii_alpha(utf8_char) && !(is_ascii_vowel(utf8_char));
+uint32_t utf8_fold_char(uint32_t utf8_char) {
+    uint32_t codepoint = utf8_to_codepoint(utf8_char);
+
+    if (codepoint >= UTF8_TABLE_CODEPOINTS) return utf8_char;
+
+    uint16_t delta = UTF8_FOLD_STAGE2[UTF8_FOLD_STAGE1[codepoint >> UTF8_TABLE_BLOCK_BITS]]
+                                     [codepoint & (UTF8_TABLE_BLOCK_SIZE - 1)];
+
+    if (delta == 0) return utf8_char;
+
+    return codepoint_to_utf8((codepoint + delta) & (UTF8_TABLE_CODEPOINTS - 1));
 }
 
 bool is_alphanumeric(uint32_t utf8_char) {
-    uint32_t utf8_char_no_acc = conv_latin_to_ascii(utf8_char);
-
-    return  is_ascii_number(utf8_char) || is_ascii_alpha(utf8_char) || \
-            is_ascii_alpha(utf8_char_no_acc);
+    return utf8_char_class(utf8_char) & UTF8_CLASS_ALNUM;
 }
 
 bool is_vowel(uint32_t utf8_char) {
-    uint32_t utf8_char_no_acc = conv_latin_to_ascii(utf8_char);
-
-    return is_ascii_vowel(utf8_char) ||\
-           is_ascii_vowel(utf8_char_no_acc);
+    return utf8_char_class(utf8_char) & UTF8_CLASS_VOWEL;
 }
 
 bool is_consonant(uint32_t utf8_char) {
-    uint32_t utf8_char_no_acc = conv_latin_to_ascii(utf8_char);
-
-    return is_ascii_consonant(utf8_char) || \
-           is_ascii_consonant(utf8_char_no_acc);
+    return utf8_char_class(utf8_char) & UTF8_CLASS_CONSONANT;
 }
 
 bool is_separator(uint32_t utf8_char) {
-
-    return (utf8_char == '-') || (utf8_char == '\"') || (utf8_char == 0xe2809c) || (utf8_char == 0xe2809d) || \
-           (utf8_char == '[') || (utf8_char == ']') || (utf8_char == ')') || (utf8_char == '(') || \
-           (utf8_char == 0xc2ab) || (utf8_char == 0xc2bb);
+    return utf8_char_class(utf8_char) & UTF8_CLASS_SEPARATOR;
 }
 
 bool is_punctuation(uint32_t utf8_char) {
-    return (utf8_char == '.') || (utf8_char == ',') || (utf8_char == ':') || (utf8_char == ';') || \
-           (utf8_char == '?') || (utf8_char == '!') || \
-           (utf8_char == 0xe28093) || (utf8_char == 0xe280a6);
+    return utf8_char_class(utf8_char) & UTF8_CLASS_PUNCTUATION;
 }
 
 bool is_whitespace(uint32_t utf8_char) {
-    return (utf8_char == ' ') || (utf8_char == 0x9) || (utf8_char == '\n') || (utf8_char == '\r');
+    return utf8_char_class(utf8_char) & UTF8_CLASS_WHITESPACE;
 }
 
 bool is_merger(uint32_t utf8_char) {
-    return (utf8_char == 0x27) || (utf8_char == 0xe28098) || (utf8_char == 0xe28099);
+    return utf8_char_class(utf8_char) & UTF8_CLASS_MERGER;
 }
 
 #if 0
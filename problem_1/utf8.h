@@ -1,8 +1,8 @@
 /**
  * @file utf8.h
  * @author José Gonçalves
- * @brief Module containing functions that allow to convert utf8 to ascii, determine whether it is a consonant
- * or vowel.
+ * @brief Module containing functions that allow to classify utf8 characters, e.g. determine whether
+ * it is a consonant or vowel, and to fold them into their base letter.
  * @version 0.1
  * @date 2022-03-12
  * 
@@ -13,6 +13,36 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * @brief Bits returned by utf8_char_class(). A character might belong to
+ * more than one class, e.g. a vowel is also alphanumeric.
+ * 
+ */
+#define UTF8_CLASS_ALNUM 0x01
+#define UTF8_CLASS_VOWEL 0x02
+#define UTF8_CLASS_CONSONANT 0x04
+#define UTF8_CLASS_SEPARATOR 0x08
+#define UTF8_CLASS_PUNCTUATION 0x10
+#define UTF8_CLASS_WHITESPACE 0x20
+#define UTF8_CLASS_MERGER 0x40
+
+/**
+ * @brief Gets the classes of a utf8 character in constant time. Accented letters of the
+ * Latin, Greek and Cyrillic scripts are vowels or consonants according to their base letter.
+ * 
+ * @return uint8_t The UTF8_CLASS_* bits of the character.
+ */
+uint8_t utf8_char_class(uint32_t utf8_char);
+
+/**
+ * @brief Folds a utf8 character into its lower case form without diacritics,
+ * e.g. 'Ã' becomes 'a' and 'Ά' becomes 'α'. Characters that aren't letters are
+ * returned as they are.
+ * 
+ * @return uint32_t The folded utf8 character.
+ */
+uint32_t utf8_fold_char(uint32_t utf8_char);
+
 /**
  * @brief Determines whether a utf8 character is alphanumeric or not.
  *  
@@ -33,10 +33,11 @@ static size_t count_following_bytes(unsigned char first_byte) {
  */
 #define IS_CONT_BYTE(unsigned_value) (((unsigned_value) >= 0b10000000) && ((unsigned_value) < 0b11000000))
 /**
- * @brief Left shift by x amount of bytes
+ * @brief Left shift by x amount of bytes. The header bytes from 0xf8 ask for 4 or more
+ * continuation bytes, whose bytes are shifted out entirely instead of by an undefined shift.
  * 
  */
-#define LEFT_SHIFT_BYTES(unsigned_value, x) ((unsigned_value) << (x * 8))
+#define LEFT_SHIFT_BYTES(unsigned_value, x) ((x) < 4 ? (unsigned_value) << ((x) * 8) : 0)
 
 uint32_t utf8iter_next_char(utf8iter *iter) {
     uint32_t utf8_char = 0x0;
@@ -33,4 +33,17 @@ typedef struct utf8iter {
  */
 uint32_t utf8iter_next_char(utf8iter *iter);
 
+/**
+ * @brief Gets the next character of the iterator, which must not have reached its end.
+ *
+ * @return true if a character was found and false if the text ended in the middle of
+ * a utf8 sequence, in which case the sequence is dropped.
+ */
+static inline bool utf8iter_next_complete_char(utf8iter *iter, uint32_t *utf8_char_out) {
+    *utf8_char_out = utf8iter_next_char(iter);
+
+    // The iterator also returns 0x0 when it reaches the end, which a real 0x0 byte tells apart.
+    return *utf8_char_out != 0 || iter->line[iter->_pointer - 1] == 0;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+/**
+ * @file utf8tables.h
+ * @author José Gonçalves
+ * @brief Lookup tables that map the codepoints of the basic multilingual plane
+ * to their class bits and to their folded codepoint. The tables are generated
+ * by tools/gen_utf8_tables.py into utf8tables.c.
+ * @version 0.1
+ * @date 2022-05-06
+ * 
+ */
+#ifndef UTF8TABLES_GUARD
+#define UTF8TABLES_GUARD
+
+#include <stdint.h>
+
+/**
+ * @brief Number of bits of the codepoint used to index a block of the second stage.
+ * 
+ */
+#define UTF8_TABLE_BLOCK_BITS 6
+#define UTF8_TABLE_BLOCK_SIZE (1 << UTF8_TABLE_BLOCK_BITS)
+
+/**
+ * @brief Codepoints covered by the tables. Every other codepoint has no class and
+ * folds into itself.
+ * 
+ */
+#define UTF8_TABLE_CODEPOINTS 0x10000
+
+/**
+ * @brief First stage of the class table, indexed by codepoint >> UTF8_TABLE_BLOCK_BITS.
+ * 
+ */
+extern const uint8_t UTF8_CLASS_STAGE1[];
+
+/**
+ * @brief Second stage of the class table. Holds the UTF8_CLASS_* bits from utf8.h.
+ * 
+ */
+extern const uint8_t UTF8_CLASS_STAGE2[][UTF8_TABLE_BLOCK_SIZE];
+
+/**
+ * @brief First stage of the fold table, indexed by codepoint >> UTF8_TABLE_BLOCK_BITS.
+ * 
+ */
+extern const uint8_t UTF8_FOLD_STAGE1[];
+
+/**
+ * @brief Second stage of the fold table. Holds the difference, modulo 0x10000, between
+ * the lower case codepoint without diacritics and the original codepoint.
+ * 
+ */
+extern const uint16_t UTF8_FOLD_STAGE2[][UTF8_TABLE_BLOCK_SIZE];
+
+#endif
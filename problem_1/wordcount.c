@@ -0,0 +1,788 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "wordcount.h"
+#include "worddfa.h"
+#include "utf8iter.h"
+#include "utf8.h"
+
+/**
+ * @brief Whether a character starts a word, ends a word or neither.
+ *
+ */
+static inline bool sets_word_state(uint32_t utf8_char) {
+    return utf8_char == '_' || (utf8_char_class(utf8_char) & (UTF8_CLASS_ALNUM | WORD_END_CLASSES)) != 0;
+}
+
+/**
+ * @brief Updates the word state and the measurements with the next utf8 character and its class.
+ *
+ * @param utf8_char The character to process.
+ * @param char_class The class of the character, as given by utf8_char_class().
+ * @param state The state of the word counting.
+ * @param out Output of the measurements.
+ */
+static inline void process_char_class(uint32_t utf8_char, uint8_t char_class, word_state *state, measurements *out) {
+    if (!state->in_word) {
+        if ((char_class & UTF8_CLASS_ALNUM) || utf8_char == '_') {
+            state->in_word = true;
+            out->n_words++;
+
+            if (char_class & UTF8_CLASS_VOWEL) {
+                out->n_words_start_vowel++;
+            }
+        }
+    } else {
+        if (char_class & WORD_END_CLASSES) {
+            state->in_word = false;
+
+            if (state->prev_consonant) {
+                out->n_words_end_cons++;
+            }
+        }
+    }
+
+    state->prev_consonant = (char_class & UTF8_CLASS_CONSONANT) != 0;
+}
+
+/**
+ * @brief Updates the word state and the measurements with the next utf8 character.
+ *
+ * @param utf8_char The character to process.
+ * @param state The state of the word counting.
+ * @param out Output of the measurements.
+ */
+static inline void process_char(uint32_t utf8_char, word_state *state, measurements *out) {
+    process_char_class(utf8_char, utf8_char_class(utf8_char), state, out);
+}
+
+/**
+ * @brief Processes utf8 characters starting at the byte with index start until
+ * the index until is reached. The last character is processed in full so the
+ * returned index might go past until.
+ *
+ * @return size_t The index of the byte after the last processed character.
+ */
+static size_t process_chars_until(
+    const unsigned char *data, const size_t data_size, const size_t start,
+    const size_t until, word_state *state, measurements *out
+) {
+    utf8iter iter = {data, data_size, start};
+    uint32_t utf8_char;
+
+    while (iter._pointer < until && utf8iter_next_complete_char(&iter, &utf8_char)) {
+        process_char(utf8_char, state, out);
+    }
+
+    return iter._pointer;
+}
+
+void process_data_scalar(const unsigned char *data, const size_t data_size, word_state *state, measurements *out) {
+    process_chars_until(data, data_size, 0, data_size, state, out);
+}
+
+/**
+ * @brief Where summarize_chunk_words() is in the words of a chunk.
+ *
+ * word_start is NULL while in the word the text was entered in, which started before it.
+ * word_end is the byte after the last alphanumeric character of the current word and
+ * last_end the byte after the last character that ended a word, or NULL if none did.
+ */
+typedef struct word_finder {
+    word_fn add_word;
+    void *context;
+    const unsigned char *word_start;
+    const unsigned char *word_end;
+    const unsigned char *last_end;
+} word_finder;
+
+//
+//
+// Vectorized kernels
+//
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/**
+ * @brief Amount of bytes classified at a time by the vectorized kernels.
+ *
+ */
+#define BLOCK_SIZE 64
+
+/**
+ * @brief Classification of a block of bytes. Bit i of each mask
+ * tells whether byte i of the block belongs to the class.
+ *
+ * word: alphanumeric or '_'.
+ * term: whitespace, punctuation or separator, i.e. ends a word.
+ * vowel and consonant: ASCII letters.
+ * non_ascii: bytes the scalar iterator doesn't see as ASCII (>= 0x7f).
+ */
+typedef struct block_masks {
+    uint64_t word;
+    uint64_t term;
+    uint64_t vowel;
+    uint64_t consonant;
+    uint64_t non_ascii;
+} block_masks;
+
+typedef void (*classify_fn)(const unsigned char *block, block_masks *masks);
+
+/**
+ * @brief Gets the number of bytes of a utf8 character, as given by utf8iter_next_char().
+ *
+ */
+static inline size_t char_size(uint32_t utf8_char) {
+    return utf8_char > 0xffffff ? 4 : utf8_char > 0xffff ? 3 : utf8_char > 0xff ? 2 : 1;
+}
+
+/**
+ * @brief Same as process_chars_until() but also hands the words that end to the finder.
+ *
+ */
+static size_t find_chars_until(
+    const unsigned char *data, const size_t data_size, const size_t start,
+    const size_t until, word_state *state, measurements *out, word_finder *finder
+) {
+    utf8iter iter = {data, data_size, start};
+    uint32_t utf8_char;
+
+    while (iter._pointer < until && utf8iter_next_complete_char(&iter, &utf8_char)) {
+        const uint8_t char_class = utf8_char_class(utf8_char);
+
+        if ((char_class & UTF8_CLASS_ALNUM) || utf8_char == '_') {
+            if (!state->in_word) finder->word_start = data + iter._pointer - char_size(utf8_char);
+            finder->word_end = data + iter._pointer;
+        } else if (char_class & WORD_END_CLASSES) {
+            if (state->in_word && finder->word_start != NULL) {
+                finder->add_word(finder->context, finder->word_start, finder->word_end - finder->word_start);
+            }
+
+            finder->last_end = data + iter._pointer;
+        }
+
+        process_char_class(utf8_char, char_class, state, out);
+    }
+
+    return iter._pointer;
+}
+
+/**
+ * @brief Updates the measurements with a block of ASCII characters.
+ *
+ * Whether byte i is inside a word is the class of the last word or term byte at or
+ * before i. The other bytes keep the state, so runs of them that follow a word byte
+ * are filled in by letting a carry ripple through them.
+ *
+ * @param masks The classification of the block.
+ * @param in_word Whether the byte before the block is inside a word. Updated for the next block.
+ * @param prev_cons Whether the byte before the block is a consonant. Updated for the next block.
+ * @param out Output of the measurements.
+ * @param starts_out Output of the bytes that start a word.
+ * @param ends_out Output of the bytes that end a word.
+ */
+static ALWAYS_INLINE void count_block(
+    const block_masks *masks, uint64_t *in_word, uint64_t *prev_cons, measurements *out,
+    uint64_t *starts_out, uint64_t *ends_out
+) {
+    const uint64_t other = ~(masks->word | masks->term);
+    const uint64_t seeds = ((masks->word << 1) | *in_word) & other;
+    const uint64_t inside = masks->word | (((other + seeds) ^ other) & other);
+    const uint64_t prev_inside = (inside << 1) | *in_word;
+    const uint64_t starts = masks->word & ~prev_inside;
+    const uint64_t ends = masks->term & prev_inside;
+    const uint64_t prev_consonant = (masks->consonant << 1) | *prev_cons;
+
+    out->n_words += __builtin_popcountll(starts);
+    out->n_words_start_vowel += __builtin_popcountll(starts & masks->vowel);
+    out->n_words_end_cons += __builtin_popcountll(ends & prev_consonant);
+
+    *in_word = inside >> (BLOCK_SIZE - 1);
+    *prev_cons = masks->consonant >> (BLOCK_SIZE - 1);
+    *starts_out = starts;
+    *ends_out = ends;
+}
+
+/**
+ * @brief Hands the words that end in a block of ASCII characters to the finder. The last
+ * alphanumeric byte before the byte that ends a word is the end of the word, unless the
+ * word has none in the block.
+ *
+ * @param block The bytes of the block.
+ * @param masks The classification of the block.
+ * @param starts The bytes that start a word, as given by count_block().
+ * @param ends The bytes that end a word, as given by count_block().
+ */
+static ALWAYS_INLINE void find_block_words(
+    word_finder *finder, const unsigned char *block, const block_masks *masks, uint64_t starts, uint64_t ends
+) {
+    uint64_t bounds = starts | ends;
+
+    while (bounds != 0) {
+        const int i = __builtin_ctzll(bounds);
+        const uint64_t bit = 1ull << i;
+        const uint64_t word_before = masks->word & (bit - 1);
+
+        bounds &= bounds - 1;
+
+        if (starts & bit) {
+            finder->word_start = block + i;
+            continue;
+        }
+
+        if (word_before != 0) finder->word_end = block + BLOCK_SIZE - __builtin_clzll(word_before);
+        if (finder->word_start != NULL) {
+            finder->add_word(finder->context, finder->word_start, finder->word_end - finder->word_start);
+        }
+    }
+
+    if (masks->word != 0) finder->word_end = block + BLOCK_SIZE - __builtin_clzll(masks->word);
+    if (masks->term != 0) finder->last_end = block + BLOCK_SIZE - __builtin_clzll(masks->term);
+}
+
+/**
+ * @brief Generic loop of the vectorized kernels. Blocks with only ASCII bytes are counted
+ * with the masks while blocks with other bytes go through the scalar path.
+ *
+ * @param finder Where the words are handed to, or NULL if they aren't looked for.
+ */
+static ALWAYS_INLINE void simd_process_data(
+    const unsigned char *data, const size_t data_size, word_state *state,
+    measurements *out, classify_fn classify, word_finder *finder
+) {
+    uint64_t in_word = state->in_word;
+    uint64_t prev_cons = state->prev_consonant;
+    size_t pos = 0;
+
+    while (data_size - pos >= BLOCK_SIZE) {
+        block_masks masks;
+        uint64_t starts, ends;
+
+        classify(data + pos, &masks);
+
+        if (masks.non_ascii != 0) {
+            pos = finder != NULL ? find_chars_until(data, data_size, pos, pos + BLOCK_SIZE, state, out, finder)
+                                 : process_chars_until(data, data_size, pos, pos + BLOCK_SIZE, state, out);
+            in_word = state->in_word;
+            prev_cons = state->prev_consonant;
+            continue;
+        }
+
+        count_block(&masks, &in_word, &prev_cons, out, &starts, &ends);
+        if (finder != NULL) find_block_words(finder, data + pos, &masks, starts, ends);
+        pos += BLOCK_SIZE;
+        state->in_word = in_word;
+        state->prev_consonant = prev_cons;
+    }
+
+    if (finder != NULL) {
+        find_chars_until(data, data_size, pos, data_size, state, out, finder);
+    } else {
+        process_chars_until(data, data_size, pos, data_size, state, out);
+    }
+}
+
+/**
+ * @brief Classifies 16 bytes with SSE2. The masks use the lower 16 bits.
+ *
+ */
+__attribute__((target("sse2")))
+static ALWAYS_INLINE void classify_16_sse2(const unsigned char *bytes, uint32_t masks[5]) {
+    const __m128i v = _mm_loadu_si128((const __m128i *) bytes);
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+    const __m128i alpha = _mm_and_si128(
+        _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))
+    );
+    const __m128i digit = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))
+    );
+    const __m128i word = _mm_or_si128(
+        _mm_or_si128(alpha, digit), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))
+    );
+
+    __m128i vowel = _mm_cmpeq_epi8(lower, _mm_set1_epi8('a'));
+    vowel = _mm_or_si128(vowel, _mm_cmpeq_epi8(lower, _mm_set1_epi8('e')));
+    vowel = _mm_or_si128(vowel, _mm_cmpeq_epi8(lower, _mm_set1_epi8('i')));
+    vowel = _mm_or_si128(vowel, _mm_cmpeq_epi8(lower, _mm_set1_epi8('o')));
+    vowel = _mm_or_si128(vowel, _mm_cmpeq_epi8(lower, _mm_set1_epi8('u')));
+
+    static const char terms[] = " \t\n\r.,:;?!-\"[]()";
+    __m128i term = _mm_setzero_si128();
+    for (size_t i = 0; i < sizeof(terms) - 1; i++) {
+        term = _mm_or_si128(term, _mm_cmpeq_epi8(v, _mm_set1_epi8(terms[i])));
+    }
+
+    masks[0] = _mm_movemask_epi8(word);
+    masks[1] = _mm_movemask_epi8(term);
+    masks[2] = _mm_movemask_epi8(vowel);
+    masks[3] = _mm_movemask_epi8(_mm_andnot_si128(vowel, alpha));
+    masks[4] = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f))));
+}
+
+__attribute__((target("sse2")))
+static ALWAYS_INLINE void classify_block_sse2(const unsigned char *block, block_masks *masks) {
+    uint64_t joined[5] = {0, 0, 0, 0, 0};
+
+    for (size_t i = 0; i < BLOCK_SIZE / 16; i++) {
+        uint32_t part[5];
+
+        classify_16_sse2(block + i * 16, part);
+        for (size_t m = 0; m < 5; m++) {
+            joined[m] |= (uint64_t) part[m] << (i * 16);
+        }
+    }
+
+    masks->word = joined[0];
+    masks->term = joined[1];
+    masks->vowel = joined[2];
+    masks->consonant = joined[3];
+    masks->non_ascii = joined[4];
+}
+
+/**
+ * @brief Classifies 32 bytes with AVX2. The masks use the lower 32 bits.
+ *
+ */
+__attribute__((target("avx2")))
+static ALWAYS_INLINE void classify_32_avx2(const unsigned char *bytes, uint32_t masks[5]) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *) bytes);
+    const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+
+    const __m256i alpha = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)
+    );
+    const __m256i digit = _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v)
+    );
+    const __m256i word = _mm256_or_si256(
+        _mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))
+    );
+
+    __m256i vowel = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('a'));
+    vowel = _mm256_or_si256(vowel, _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('e')));
+    vowel = _mm256_or_si256(vowel, _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('i')));
+    vowel = _mm256_or_si256(vowel, _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('o')));
+    vowel = _mm256_or_si256(vowel, _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('u')));
+
+    static const char terms[] = " \t\n\r.,:;?!-\"[]()";
+    __m256i term = _mm256_setzero_si256();
+    for (size_t i = 0; i < sizeof(terms) - 1; i++) {
+        term = _mm256_or_si256(term, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(terms[i])));
+    }
+
+    masks[0] = (uint32_t) _mm256_movemask_epi8(word);
+    masks[1] = (uint32_t) _mm256_movemask_epi8(term);
+    masks[2] = (uint32_t) _mm256_movemask_epi8(vowel);
+    masks[3] = (uint32_t) _mm256_movemask_epi8(_mm256_andnot_si256(vowel, alpha));
+    masks[4] = (uint32_t) _mm256_movemask_epi8(
+        _mm256_or_si256(v, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)))
+    );
+}
+
+__attribute__((target("avx2")))
+static ALWAYS_INLINE void classify_block_avx2(const unsigned char *block, block_masks *masks) {
+    uint32_t low[5];
+    uint32_t high[5];
+
+    classify_32_avx2(block, low);
+    classify_32_avx2(block + 32, high);
+
+    masks->word = low[0] | ((uint64_t) high[0] << 32);
+    masks->term = low[1] | ((uint64_t) high[1] << 32);
+    masks->vowel = low[2] | ((uint64_t) high[2] << 32);
+    masks->consonant = low[3] | ((uint64_t) high[3] << 32);
+    masks->non_ascii = low[4] | ((uint64_t) high[4] << 32);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static ALWAYS_INLINE void classify_block_avx512(const unsigned char *block, block_masks *masks) {
+    const __m512i v = _mm512_loadu_si512((const void *) block);
+    const __m512i lower = _mm512_or_si512(v, _mm512_set1_epi8(0x20));
+
+    const __mmask64 alpha = _mm512_cmpge_epu8_mask(lower, _mm512_set1_epi8('a')) &
+                            _mm512_cmple_epu8_mask(lower, _mm512_set1_epi8('z'));
+    const __mmask64 digit = _mm512_cmpge_epu8_mask(v, _mm512_set1_epi8('0')) &
+                            _mm512_cmple_epu8_mask(v, _mm512_set1_epi8('9'));
+
+    const __mmask64 vowel = _mm512_cmpeq_epi8_mask(lower, _mm512_set1_epi8('a')) |
+                            _mm512_cmpeq_epi8_mask(lower, _mm512_set1_epi8('e')) |
+                            _mm512_cmpeq_epi8_mask(lower, _mm512_set1_epi8('i')) |
+                            _mm512_cmpeq_epi8_mask(lower, _mm512_set1_epi8('o')) |
+                            _mm512_cmpeq_epi8_mask(lower, _mm512_set1_epi8('u'));
+
+    static const char terms[] = " \t\n\r.,:;?!-\"[]()";
+    __mmask64 term = 0;
+    for (size_t i = 0; i < sizeof(terms) - 1; i++) {
+        term |= _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(terms[i]));
+    }
+
+    masks->word = alpha | digit | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('_'));
+    masks->term = term;
+    masks->vowel = vowel;
+    masks->consonant = alpha & ~vowel;
+    masks->non_ascii = _mm512_cmpge_epu8_mask(v, _mm512_set1_epi8(0x7f));
+}
+
+__attribute__((target("sse2")))
+static void process_data_sse2(
+    const unsigned char *data, const size_t data_size, word_state *state, measurements *out
+) {
+    simd_process_data(data, data_size, state, out, classify_block_sse2, NULL);
+}
+
+__attribute__((target("sse2")))
+static void find_words_sse2(
+    const unsigned char *data, const size_t data_size, word_state *state, measurements *out, word_finder *finder
+) {
+    simd_process_data(data, data_size, state, out, classify_block_sse2, finder);
+}
+
+__attribute__((target("avx2")))
+static void process_data_avx2(
+    const unsigned char *data, const size_t data_size, word_state *state, measurements *out
+) {
+    simd_process_data(data, data_size, state, out, classify_block_avx2, NULL);
+}
+
+__attribute__((target("avx2")))
+static void find_words_avx2(
+    const unsigned char *data, const size_t data_size, word_state *state, measurements *out, word_finder *finder
+) {
+    simd_process_data(data, data_size, state, out, classify_block_avx2, finder);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void process_data_avx512(
+    const unsigned char *data, const size_t data_size, word_state *state, measurements *out
+) {
+    simd_process_data(data, data_size, state, out, classify_block_avx512, NULL);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void find_words_avx512(
+    const unsigned char *data, const size_t data_size, word_state *state, measurements *out, word_finder *finder
+) {
+    simd_process_data(data, data_size, state, out, classify_block_avx512, finder);
+}
+
+#endif
+
+//
+//
+// Kernel selection
+//
+//
+
+/**
+ * @brief The kernel used by process_data().
+ *
+ */
+static void (*kernel)(const unsigned char *, const size_t, word_state *, measurements *) = process_data_scalar;
+
+/**
+ * @brief The name of the kernel used by process_data().
+ *
+ */
+static const char *kernel_name = "scalar";
+
+/**
+ * @brief The widest vectorized kernel the cpu supports and its name, used for ENGINE_VECTOR.
+ *
+ */
+static void (*vector_kernel)(const unsigned char *, const size_t, word_state *, measurements *) = process_data_scalar;
+static const char *vector_kernel_name = "scalar";
+
+/**
+ * @brief The variant of the kernel that also finds the words, used by summarize_chunk_words(),
+ * and the one of the vectorized kernel. NULL if there is none.
+ *
+ */
+static void (*words_kernel)(const unsigned char *, const size_t, word_state *, measurements *, word_finder *) = NULL;
+static void (*vector_words_kernel)(const unsigned char *, const size_t, word_state *, measurements *, word_finder *) = NULL;
+
+/**
+ * @brief Makes sure the kernel is only selected once.
+ *
+ */
+static pthread_once_t kernel_selected = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Picks the widest vectorized kernel the cpu supports.
+ *
+ */
+static void select_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512bw")) {
+        vector_kernel = process_data_avx512;
+        vector_words_kernel = find_words_avx512;
+        vector_kernel_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        vector_kernel = process_data_avx2;
+        vector_words_kernel = find_words_avx2;
+        vector_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        vector_kernel = process_data_sse2;
+        vector_words_kernel = find_words_sse2;
+        vector_kernel_name = "sse2";
+    }
+#endif
+
+    kernel = vector_kernel;
+    words_kernel = vector_words_kernel;
+    kernel_name = vector_kernel_name;
+}
+
+bool select_count_engine(const count_engine engine) {
+    pthread_once(&kernel_selected, select_kernel);
+
+    if (engine == ENGINE_VECTOR) {
+        kernel = vector_kernel;
+        words_kernel = vector_words_kernel;
+        kernel_name = vector_kernel_name;
+    } else if (engine == ENGINE_SCALAR) {
+        kernel = process_data_scalar;
+        words_kernel = NULL;
+        kernel_name = "scalar";
+    } else if (engine == ENGINE_DFA) {
+        if (!build_word_dfa()) return false;
+
+        kernel = process_data_dfa;
+        words_kernel = NULL;
+        kernel_name = "dfa";
+    }
+
+    return true;
+}
+
+bool select_vector_kernel(const char *name) {
+    pthread_once(&kernel_selected, select_kernel);
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512bw")) {
+        vector_kernel = process_data_avx512;
+        vector_words_kernel = find_words_avx512;
+        vector_kernel_name = "avx512";
+    } else if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        vector_kernel = process_data_avx2;
+        vector_words_kernel = find_words_avx2;
+        vector_kernel_name = "avx2";
+    } else if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        vector_kernel = process_data_sse2;
+        vector_words_kernel = find_words_sse2;
+        vector_kernel_name = "sse2";
+    } else {
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void process_data(const unsigned char *data, const size_t data_size, word_state *state, measurements *out) {
+    pthread_once(&kernel_selected, select_kernel);
+
+    kernel(data, data_size, state, out);
+}
+
+const char *process_data_kernel_name() {
+    pthread_once(&kernel_selected, select_kernel);
+
+    return kernel_name;
+}
+
+//
+//
+// Chunk summaries
+//
+//
+
+#define IS_CONT_BYTE(byte) (((byte) & 0xc0) == 0x80)
+
+static inline size_t word_state_idx(const word_state *state) {
+    return state->in_word * 2 + state->prev_consonant;
+}
+
+static inline word_state idx_word_state(const size_t idx) {
+    word_state state = {(idx & 2) != 0, (idx & 1) != 0};
+
+    return state;
+}
+
+static inline void add_measurements(measurements *out, const measurements *other) {
+    out->n_words += other->n_words;
+    out->n_words_start_vowel += other->n_words_start_vowel;
+    out->n_words_end_cons += other->n_words_end_cons;
+}
+
+/**
+ * @brief Length of the utf8 sequence started by a header byte, which is its number of leading
+ * ones like for utf8iter_next_char(). The header bytes from 0xf8 are invalid but still wait for
+ * up to 7 continuation bytes.
+ *
+ */
+static size_t sequence_length(const unsigned char header) {
+    size_t length = 0;
+
+    while (length < 8 && (header & (0x80 >> length))) length++;
+
+    return length;
+}
+
+/**
+ * @brief Summarizes text that starts at a character boundary. An incomplete sequence
+ * at its end is dropped. Only the characters before the first one that starts or ends
+ * a word depend on the word state the text is entered with, so only those are processed
+ * for every word state and the rest goes through process_data() once.
+ *
+ * @param finder Where the words are handed to, or NULL if they aren't looked for. The rest
+ * then goes through words_kernel instead, and a word that starts before it is not handed over.
+ */
+static void summarize_core(const unsigned char *data, const size_t data_size, chunk_summary *out, word_finder *finder) {
+    word_state states[N_WORD_STATES];
+    utf8iter iter = {data, data_size, 0};
+    uint32_t utf8_char;
+    bool state_set = false;
+
+    for (size_t i = 0; i < N_WORD_STATES; i++) {
+        states[i] = idx_word_state(i);
+        out->counts[i] = (measurements) {0, 0, 0};
+    }
+
+    while (!state_set && !UTF8ITER_REACHED_END(&iter) && utf8iter_next_complete_char(&iter, &utf8_char)) {
+        state_set = sets_word_state(utf8_char);
+
+        for (size_t i = 0; i < N_WORD_STATES; i++) {
+            process_char(utf8_char, &states[i], &out->counts[i]);
+        }
+    }
+
+    if (state_set) {
+        word_state state = states[0];
+        measurements rest = {0, 0, 0};
+
+        if (finder == NULL) {
+            process_data(data + iter._pointer, data_size - iter._pointer, &state, &rest);
+        } else {
+            if (!state.in_word) finder->last_end = data + iter._pointer;
+            words_kernel(data + iter._pointer, data_size - iter._pointer, &state, &rest, finder);
+        }
+
+        for (size_t i = 0; i < N_WORD_STATES; i++) {
+            states[i] = state;
+            add_measurements(&out->counts[i], &rest);
+        }
+    }
+
+    for (size_t i = 0; i < N_WORD_STATES; i++) {
+        out->exit_states[i] = word_state_idx(&states[i]);
+    }
+
+    out->head_size = 0;
+    out->tail_size = 0;
+}
+
+size_t partial_tail_size(const unsigned char *data, const size_t data_size) {
+    // Look for the header byte of a sequence that is cut off by the end of the text.
+    for (size_t back = 1; back <= UTF8_MAX_PARTIAL && back <= data_size; back++) {
+        const unsigned char byte = data[data_size - back];
+
+        if (IS_CONT_BYTE(byte)) continue;
+        if (byte >= 0xc0 && sequence_length(byte) > back) return back;
+        break;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Summarizes a chunk, see summarize_chunk(), finding its words if a finder is given.
+ *
+ */
+static void summarize_edges(const unsigned char *data, const size_t data_size, chunk_summary *out, word_finder *finder) {
+    size_t head_size = 0;
+    size_t tail_size;
+
+    while (head_size < UTF8_MAX_PARTIAL && head_size < data_size && IS_CONT_BYTE(data[head_size])) {
+        head_size++;
+    }
+
+    tail_size = partial_tail_size(data + head_size, data_size - head_size);
+
+    summarize_core(data + head_size, data_size - head_size - tail_size, out, finder);
+
+    out->head_size = head_size;
+    out->tail_size = tail_size;
+    memcpy(out->head, data, head_size);
+    memcpy(out->tail, data + data_size - tail_size, tail_size);
+}
+
+void summarize_chunk(const unsigned char *data, const size_t data_size, chunk_summary *out) {
+    summarize_edges(data, data_size, out, NULL);
+}
+
+bool summarize_chunk_words(
+    const unsigned char *data, const size_t data_size, word_fn add_word, void *context,
+    chunk_summary *out, size_t *last_end_out
+) {
+    word_finder finder = {add_word, context, NULL, NULL, NULL};
+
+    pthread_once(&kernel_selected, select_kernel);
+
+    if (words_kernel == NULL) return false;
+
+    summarize_edges(data, data_size, out, &finder);
+    *last_end_out = finder.last_end != NULL ? (size_t) (finder.last_end - data) : 0;
+    return true;
+}
+
+void empty_summary(chunk_summary *out) {
+    for (size_t i = 0; i < N_WORD_STATES; i++) {
+        out->counts[i] = (measurements) {0, 0, 0};
+        out->exit_states[i] = i;
+    }
+
+    out->head_size = 0;
+    out->tail_size = 0;
+}
+
+void merge_summaries(chunk_summary *first, const chunk_summary *second) {
+    unsigned char edge[2 * UTF8_MAX_PARTIAL];
+    chunk_summary middle;
+
+    // The partial sequences on both sides of the edge are put back together.
+    memcpy(edge, first->tail, first->tail_size);
+    memcpy(edge + first->tail_size, second->head, second->head_size);
+    summarize_core(edge, first->tail_size + second->head_size, &middle, NULL);
+
+    for (size_t i = 0; i < N_WORD_STATES; i++) {
+        const size_t middle_idx = first->exit_states[i];
+        const size_t second_idx = middle.exit_states[middle_idx];
+
+        add_measurements(&first->counts[i], &middle.counts[middle_idx]);
+        add_measurements(&first->counts[i], &second->counts[second_idx]);
+        first->exit_states[i] = second->exit_states[second_idx];
+    }
+
+    first->tail_size = second->tail_size;
+    memcpy(first->tail, second->tail, second->tail_size);
+}
+
+void summary_results(const chunk_summary *summary, measurements *out) {
+    word_state initial_state = WORD_STATE_INIT;
+
+    add_measurements(out, &summary->counts[word_state_idx(&initial_state)]);
+}
@@ -0,0 +1,224 @@
+/**
+ * @file wordcount.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Module containing the procedures that count the number of words, the number
+ * of words starting with a vowel and the number of words ending with a consonant.
+ * Besides the scalar procedure, vectorized kernels for ASCII text are available
+ * and the best one for the cpu is picked at runtime.
+ * @version 0.1
+ * @date 2022-05-02
+ *
+ */
+#ifndef WORDCOUNT_GUARD
+#define WORDCOUNT_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "utf8.h"
+
+/**
+ * @brief Classes of the characters that end words. Words start at an alphanumeric character or '_'.
+ *
+ */
+#define WORD_END_CLASSES (UTF8_CLASS_WHITESPACE | UTF8_CLASS_PUNCTUATION | UTF8_CLASS_SEPARATOR)
+
+/**
+ * @brief Struct definition used to store results for a portion of data from a file
+ * or the results of the file as a whole.
+ *
+ */
+typedef struct measurements {
+    size_t n_words;
+    size_t n_words_start_vowel;
+    size_t n_words_end_cons;
+} measurements;
+
+/**
+ * @brief State of the word counting that must be carried from one character to the next.
+ *
+ */
+typedef struct word_state {
+    bool in_word;
+    bool prev_consonant;
+} word_state;
+
+/**
+ * @brief Initial value of the word state at the start of a text.
+ *
+ */
+#define WORD_STATE_INIT {false, false}
+
+/**
+ * @brief Number of different word states. A word state is numbered in_word * 2 + prev_consonant.
+ *
+ */
+#define N_WORD_STATES 4
+
+/**
+ * @brief Maximum number of bytes of a utf8 sequence that can be cut off at an edge of a chunk.
+ * Valid sequences have at most 4 bytes, but utf8iter_next_char() waits for up to the 7
+ * continuation bytes of a bogus 0xff header byte.
+ *
+ */
+#define UTF8_MAX_PARTIAL 7
+
+/**
+ * @brief Summary of a chunk of text that can be merged with the summaries of the
+ * chunks next to it, so a text can be cut at any byte and its chunks processed in any order.
+ *
+ * head holds the continuation bytes at the start of the chunk, which belong to a character
+ * started in the previous chunk, and tail holds the incomplete utf8 sequence at its end.
+ * Everything in between is summarized by the measurements and the word state at the end
+ * for each of the word states the chunk might be entered with.
+ *
+ */
+typedef struct chunk_summary {
+    measurements counts[N_WORD_STATES];
+    uint8_t exit_states[N_WORD_STATES];
+    uint8_t head_size;
+    uint8_t tail_size;
+    unsigned char head[UTF8_MAX_PARTIAL];
+    unsigned char tail[UTF8_MAX_PARTIAL];
+} chunk_summary;
+
+/**
+ * @brief The engines that can be used by process_data().
+ * ENGINE_VECTOR uses the widest vectorized kernel the cpu supports,
+ * ENGINE_SCALAR goes through the text one utf8 character at a time and
+ * ENGINE_DFA uses the table driven automaton from worddfa.h.
+ *
+ */
+typedef enum count_engine {
+    ENGINE_VECTOR,
+    ENGINE_SCALAR,
+    ENGINE_DFA
+} count_engine;
+
+/**
+ * @brief Selects the engine used by process_data(). Must be called before
+ * any thread starts processing. By default ENGINE_VECTOR is used. The tables
+ * of ENGINE_DFA are built here.
+ *
+ * @param engine
+ * @return true on success and false if the tables of the automaton couldn't be built,
+ * with errno set, in which case the engine used doesn't change.
+ */
+bool select_count_engine(const count_engine engine);
+
+/**
+ * @brief Makes ENGINE_VECTOR use the given vectorized kernel instead of the widest one, so
+ * each kernel can be checked. It is used once ENGINE_VECTOR is selected with
+ * select_count_engine(), which must be called afterwards.
+ *
+ * @param name "avx512", "avx2" or "sse2".
+ * @return true if the cpu supports the kernel and false otherwise, in which case nothing changes.
+ */
+bool select_vector_kernel(const char *name);
+
+/**
+ * @brief Procedure to calculate the number of words, number of words starting with a vowel
+ * and number of words ending with a consonant. It uses the selected engine, all of which
+ * give the exact same results as process_data_scalar().
+ *
+ * @param data The text to process.
+ * @param data_size The size of the text in bytes.
+ * @param state The word state before the text. Updated with the word state after it.
+ * @param out Output of the measurements of the text provided.
+ */
+void process_data(const unsigned char *data, const size_t data_size, word_state *state, measurements *out);
+
+/**
+ * @brief Same as process_data() but processes the text one utf8 character at a time.
+ *
+ * @param data The text to process.
+ * @param data_size The size of the text in bytes.
+ * @param state The word state before the text. Updated with the word state after it.
+ * @param out Output of the measurements of the text provided.
+ */
+void process_data_scalar(const unsigned char *data, const size_t data_size, word_state *state, measurements *out);
+
+/**
+ * @brief Summarizes a chunk of text that may start and end anywhere, even in the middle
+ * of a utf8 sequence. The bulk of the chunk goes through process_data() once.
+ *
+ * @param data The chunk to process.
+ * @param data_size The size of the chunk in bytes.
+ * @param out Output of the summary of the chunk.
+ */
+void summarize_chunk(const unsigned char *data, const size_t data_size, chunk_summary *out);
+
+/**
+ * @brief Receives the words found by summarize_chunk_words().
+ *
+ * @param context The context given to summarize_chunk_words().
+ * @param word The bytes of the word, which are part of the chunk.
+ * @param size The number of bytes of the word.
+ */
+typedef void (*word_fn)(void *context, const unsigned char *word, size_t size);
+
+/**
+ * @brief Same as summarize_chunk() but also finds the words of the chunk in the same pass, so
+ * they don't have to be split again. Only the words that come after a character that ends words
+ * and are ended by another one are found, without the characters after their last alphanumeric
+ * one, like count_chunk_words() of wordfreq.h splits them.
+ *
+ * @param data The chunk to process.
+ * @param data_size The size of the chunk in bytes.
+ * @param add_word Called with each word, in the order they are in the chunk.
+ * @param context Passed on to add_word.
+ * @param out Output of the summary of the chunk.
+ * @param last_end_out Output of the index of the byte after the last character that ends a word,
+ * or 0 if there is none.
+ * @return true on success and false if the selected engine isn't ENGINE_VECTOR, the only one that
+ * finds the words as it goes, in which case nothing is done.
+ */
+bool summarize_chunk_words(
+    const unsigned char *data, const size_t data_size, word_fn add_word, void *context,
+    chunk_summary *out, size_t *last_end_out
+);
+
+/**
+ * @brief Gets the size of the incomplete utf8 sequence at the end of a text, if any.
+ *
+ * @param data The text.
+ * @param data_size The size of the text in bytes.
+ * @return size_t The number of bytes of the sequence, at most UTF8_MAX_PARTIAL, or 0.
+ */
+size_t partial_tail_size(const unsigned char *data, const size_t data_size);
+
+/**
+ * @brief Initializes the summary of an empty chunk, which changes nothing when merged.
+ *
+ * @param out Output of the summary.
+ */
+void empty_summary(chunk_summary *out);
+
+/**
+ * @brief Merges the summary of a chunk with the summary of the chunk that follows it.
+ * Merging is associative, so the summaries of a text can be merged in any grouping
+ * as long as their order is kept. Chunks smaller than UTF8_MAX_PARTIAL + 1 bytes
+ * should only be at the end of a text.
+ *
+ * @param first The summary of the first chunk. Updated with the summary of both chunks.
+ * @param second The summary of the chunk that follows it.
+ */
+void merge_summaries(chunk_summary *first, const chunk_summary *second);
+
+/**
+ * @brief Gets the measurements of a whole text from its summary.
+ *
+ * @param summary The summary of the text.
+ * @param out Output of the measurements. They are added to the ones already there.
+ */
+void summary_results(const chunk_summary *summary, measurements *out);
+
+/**
+ * @brief Gets the name of the kernel used by process_data().
+ *
+ * @return const char* "avx512", "avx2", "sse2", "scalar" or "dfa".
+ */
+const char *process_data_kernel_name();
+
+#endif
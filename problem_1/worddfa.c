@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "worddfa.h"
+#include "utf8.h"
+
+/**
+ * @brief What a complete character does to the word counting.
+ *
+ */
+enum char_kind {
+    KIND_OTHER,         // Neither starts nor ends a word.
+    KIND_TERM,          // Whitespace, punctuation or separator.
+    KIND_WORD,          // Starts a word.
+    KIND_WORD_VOWEL,    // Starts a word and is a vowel.
+    KIND_WORD_CONS      // Starts a word and is a consonant.
+};
+
+/**
+ * @brief Bits of a transition that tell which counters to increment.
+ *
+ */
+#define INC_WORD 0x1
+#define INC_VOWEL 0x2
+#define INC_CONS 0x4
+#define INC_BITS 3
+
+/**
+ * @brief Each decoding state is split in the word states, numbered like in wordcount.h.
+ *
+ */
+#define WORD_STATES N_WORD_STATES
+
+#define MAX_DECODE_STATES 256
+#define MAX_STATES (MAX_DECODE_STATES * WORD_STATES)
+#define N_CONT_BYTES 64
+
+/**
+ * @brief Most continuation bytes a header byte asks for, the 7 of 0xff.
+ *
+ */
+#define MAX_AWAITING 7
+
+/**
+ * @brief Decoding state while building the automaton.
+ * awaiting is the number of continuation bytes left to complete the character.
+ * If it is 1, next holds the kind of the character for each continuation byte,
+ * otherwise it holds the next decoding state.
+ *
+ */
+typedef struct decode_state {
+    int awaiting;
+    uint8_t next[N_CONT_BYTES];
+} decode_state;
+
+#define GROUND 0    // Not inside a utf8 sequence.
+#define SINK 1      // Inside a bogus sequence, swallows continuation bytes.
+
+/**
+ * @brief Class of each byte. Bytes with the same class have the same transitions.
+ *
+ */
+static uint8_t byte_classes[256];
+
+/**
+ * @brief Number of byte classes.
+ *
+ */
+static size_t n_classes = 0;
+
+/**
+ * @brief Transitions indexed by state * n_classes + byte class. Each one holds the next
+ * state, already multiplied by n_classes, shifted by INC_BITS and the INC_* bits.
+ *
+ */
+static uint32_t *transitions = NULL;
+
+/**
+ * @brief Whether the tables were built.
+ *
+ */
+static bool tables_built = false;
+
+static uint8_t char_kind(uint32_t utf8_char) {
+    if (is_alphanumeric(utf8_char) || utf8_char == '_') {
+        if (is_vowel(utf8_char)) return KIND_WORD_VOWEL;
+        if (is_consonant(utf8_char)) return KIND_WORD_CONS;
+        return KIND_WORD;
+    }
+
+    if (is_whitespace(utf8_char) || is_punctuation(utf8_char) || is_separator(utf8_char)) {
+        return KIND_TERM;
+    }
+
+    return KIND_OTHER;
+}
+
+/**
+ * @brief Gets the id of a decoding state, adding it if no equal state exists yet.
+ *
+ */
+static uint8_t intern_state(
+    decode_state *states, size_t *n_states, int awaiting, const uint8_t next[N_CONT_BYTES]
+) {
+    for (size_t i = 0; i < *n_states; i++) {
+        if (states[i].awaiting == awaiting && memcmp(states[i].next, next, N_CONT_BYTES) == 0) {
+            return i;
+        }
+    }
+
+    // The sequences are fixed, so only a change to the automaton could need more states.
+    if (*n_states == MAX_DECODE_STATES) abort();
+
+    states[*n_states].awaiting = awaiting;
+    memcpy(states[*n_states].next, next, N_CONT_BYTES);
+
+    return (*n_states)++;
+}
+
+/**
+ * @brief Applies a complete character to a word state.
+ *
+ * @return uint32_t The INC_* bits of the counters to increment.
+ */
+static uint32_t apply_char(uint8_t kind, size_t *word_state) {
+    bool in_word = *word_state & 2;
+    bool prev_consonant = *word_state & 1;
+    uint32_t increments = 0;
+
+    if (!in_word) {
+        if (kind >= KIND_WORD) {
+            in_word = true;
+            increments |= INC_WORD;
+
+            if (kind == KIND_WORD_VOWEL) increments |= INC_VOWEL;
+        }
+    } else if (kind == KIND_TERM) {
+        in_word = false;
+
+        if (prev_consonant) increments |= INC_CONS;
+    }
+
+    *word_state = in_word * 2 + (kind == KIND_WORD_CONS);
+
+    return increments;
+}
+
+/**
+ * @brief Builds the automaton by running every possible utf8 sequence
+ * through the classification functions.
+ *
+ * Sequences of 4 or more bytes are always of kind KIND_OTHER since the classification
+ * functions don't know about characters outside of the basic multilingual plane.
+ * Bogus bytes are treated like utf8iter_next_char() does: stray continuation bytes and
+ * 0x7f are skipped, a sequence is dropped when an ASCII or header byte interrupts it and
+ * the header bytes from 0xf8 wait for as many continuation bytes as their leading ones
+ * tell, up to the 7 of 0xff.
+ *
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool build_tables() {
+    static decode_state states[MAX_DECODE_STATES];
+    uint32_t (*columns)[MAX_STATES];
+    size_t n_states = 0;
+    uint8_t lead_states[256] = {0};
+    uint8_t next[N_CONT_BYTES];
+
+    memset(next, 0, N_CONT_BYTES);
+    intern_state(states, &n_states, 0, next);  // GROUND
+    intern_state(states, &n_states, -1, next); // SINK
+
+    // Sequences of 2 bytes.
+    for (uint32_t lead = 0xc0; lead < 0xe0; lead++) {
+        for (uint32_t cont = 0; cont < N_CONT_BYTES; cont++) {
+            next[cont] = char_kind((lead << 8) | (0x80 + cont));
+        }
+        lead_states[lead] = intern_state(states, &n_states, 1, next);
+    }
+
+    // Sequences of 3 bytes.
+    for (uint32_t lead = 0xe0; lead < 0xf0; lead++) {
+        uint8_t second[N_CONT_BYTES];
+
+        for (uint32_t cont_1 = 0; cont_1 < N_CONT_BYTES; cont_1++) {
+            for (uint32_t cont_2 = 0; cont_2 < N_CONT_BYTES; cont_2++) {
+                next[cont_2] = char_kind((lead << 16) | ((0x80 + cont_1) << 8) | (0x80 + cont_2));
+            }
+            second[cont_1] = intern_state(states, &n_states, 1, next);
+        }
+        lead_states[lead] = intern_state(states, &n_states, 2, second);
+    }
+
+    // Sequences of 4 or more bytes, a chain of states for each number of bytes awaited.
+    uint8_t others[MAX_AWAITING + 1];
+
+    others[0] = KIND_OTHER;
+    for (int awaiting = 1; awaiting <= MAX_AWAITING; awaiting++) {
+        memset(next, others[awaiting - 1], N_CONT_BYTES);
+        others[awaiting] = intern_state(states, &n_states, awaiting, next);
+    }
+    for (uint32_t lead = 0xf0; lead < 0x100; lead++) {
+        int leading_ones = 0;
+
+        while (leading_ones < 8 && (lead & (0x80 >> leading_ones))) leading_ones++;
+        lead_states[lead] = others[leading_ones - 1];
+    }
+
+    // Transitions for every state and byte.
+    const size_t n_full_states = n_states * WORD_STATES;
+
+    if ((columns = malloc(256 * sizeof(*columns))) == NULL) return false;
+
+    for (size_t state = 0; state < n_full_states; state++) {
+        const decode_state *decoding = &states[state / WORD_STATES];
+
+        for (uint32_t byte = 0; byte < 256; byte++) {
+            size_t word_state = state % WORD_STATES;
+            size_t next_decoding = GROUND;
+            uint32_t increments = 0;
+
+            if (byte < 0x7f) {
+                increments = apply_char(char_kind(byte), &word_state);
+            } else if (byte == 0x7f) {
+                next_decoding = SINK;
+            } else if (byte < 0xc0) {
+                if (decoding->awaiting <= 0) {
+                    next_decoding = state / WORD_STATES;
+                } else if (decoding->awaiting == 1) {
+                    increments = apply_char(decoding->next[byte - 0x80], &word_state);
+                } else {
+                    next_decoding = decoding->next[byte - 0x80];
+                }
+            } else {
+                next_decoding = lead_states[byte];
+            }
+
+            columns[byte][state] = ((next_decoding * WORD_STATES + word_state) << INC_BITS) | increments;
+        }
+    }
+
+    // Bytes with equal columns share a class.
+    uint8_t class_bytes[256];
+
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        size_t byte_class = 0;
+        const size_t column_size = n_full_states * sizeof(uint32_t);
+
+        while (byte_class < n_classes && memcmp(columns[class_bytes[byte_class]], columns[byte], column_size) != 0) {
+            byte_class++;
+        }
+
+        if (byte_class == n_classes) class_bytes[n_classes++] = byte;
+        byte_classes[byte] = byte_class;
+    }
+
+    if ((transitions = malloc(n_full_states * n_classes * sizeof(uint32_t))) == NULL) {
+        int error = errno;
+
+        free(columns);
+        n_classes = 0;
+        errno = error;
+        return false;
+    }
+
+    // Premultiply the next states by the number of classes so they can be used as row offsets.
+    for (size_t state = 0; state < n_full_states; state++) {
+        for (size_t byte_class = 0; byte_class < n_classes; byte_class++) {
+            const uint32_t column = columns[class_bytes[byte_class]][state];
+            const uint32_t next_state = column >> INC_BITS;
+            const uint32_t increments = column & ((1 << INC_BITS) - 1);
+
+            transitions[state * n_classes + byte_class] = ((next_state * n_classes) << INC_BITS) | increments;
+        }
+    }
+
+    free(columns);
+    return true;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+bool build_word_dfa() {
+    if (!tables_built) tables_built = build_tables();
+
+    return tables_built;
+}
+
+
+void process_data_dfa(const unsigned char *data, const size_t data_size, word_state *state, measurements *out) {
+    const uint32_t *table = transitions;
+    const uint8_t *classes = byte_classes;
+    uint32_t dfa_state = (GROUND * WORD_STATES + state->in_word * 2 + state->prev_consonant) * n_classes;
+    size_t n_words = 0;
+    size_t n_words_start_vowel = 0;
+    size_t n_words_end_cons = 0;
+
+    for (size_t i = 0; i < data_size; i++) {
+        const uint32_t transition = table[dfa_state + classes[data[i]]];
+
+        dfa_state = transition >> INC_BITS;
+        n_words += transition & INC_WORD;
+        n_words_start_vowel += (transition & INC_VOWEL) >> 1;
+        n_words_end_cons += (transition & INC_CONS) >> 2;
+    }
+
+    // A sequence cut off by the end of the text is dropped, only the word state is kept.
+    const size_t word_state_idx = dfa_state / n_classes % WORD_STATES;
+
+    state->in_word = (word_state_idx & 2) != 0;
+    state->prev_consonant = (word_state_idx & 1) != 0;
+
+    out->n_words += n_words;
+    out->n_words_start_vowel += n_words_start_vowel;
+    out->n_words_end_cons += n_words_end_cons;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file worddfa.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Module containing a table driven automaton that decodes utf8 and counts
+ * words in a single walk over the bytes of a text. Its states cover both the position
+ * inside a utf8 sequence and whether we are inside a word, so no characters are
+ * ever reconstructed and there are no data dependent branches.
+ * @version 0.1
+ * @date 2022-05-04
+ *
+ */
+#ifndef WORDDFA_GUARD
+#define WORDDFA_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "wordcount.h"
+
+/**
+ * @brief Builds the tables of the automaton from the classification functions in utf8.h,
+ * unless they were already built. Must be called before any thread starts processing,
+ * select_count_engine() does it for ENGINE_DFA.
+ *
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+bool build_word_dfa();
+
+/**
+ * @brief Same as process_data_scalar() but using the automaton, whose tables must have been
+ * built with build_word_dfa().
+ *
+ * @param data The text to process.
+ * @param data_size The size of the text in bytes.
+ * @param state The word state before the text. Updated with the word state after it.
+ * @param out Output of the measurements of the text provided.
+ */
+void process_data_dfa(const unsigned char *data, const size_t data_size, word_state *state, measurements *out);
+
+#endif
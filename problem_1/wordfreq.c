@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wordfreq.h"
+#include "wordcount.h"
+#include "utf8iter.h"
+#include "utf8.h"
+#include "utf8tables.h"
+
+/**
+ * @brief Gets the number of bytes of a utf8 character, as given by utf8iter_next_char().
+ *
+ */
+static inline size_t char_size(uint32_t utf8_char) {
+    return utf8_char > 0xffffff ? 4 : utf8_char > 0xffff ? 3 : utf8_char > 0xff ? 2 : 1;
+}
+
+/**
+ * @brief Writes a utf8 character, as given by utf8iter_next_char(), as bytes.
+ *
+ * @return size_t The number of bytes written.
+ */
+static inline size_t put_char(unsigned char *out, uint32_t utf8_char) {
+    size_t n_bytes = char_size(utf8_char);
+
+    for (size_t i = 0; i < n_bytes; i++) {
+        out[i] = utf8_char >> ((n_bytes - 1 - i) * 8);
+    }
+
+    return n_bytes;
+}
+
+/**
+ * @brief Decodes the two byte utf8 sequence at the start of some bytes, the length of most of
+ * the letters with diacritics. Overlong sequences are left out, like utf8_to_codepoint() does.
+ *
+ * @return size_t 2 or 0 if there isn't such a sequence.
+ */
+static inline size_t decode_pair(const unsigned char *bytes, size_t size, uint32_t *codepoint_out) {
+    if (bytes[0] < 0xc2 || bytes[0] >= 0xe0 || size < 2 || (bytes[1] & 0xc0) != 0x80) return 0;
+
+    *codepoint_out = (bytes[0] & 0x1f) << 6 | (bytes[1] & 0x3f);
+    return 2;
+}
+
+/**
+ * @brief Gets the class of a codepoint the tables cover, like utf8_char_class() does.
+ *
+ */
+static inline uint8_t codepoint_class(uint32_t codepoint) {
+    return UTF8_CLASS_STAGE2[UTF8_CLASS_STAGE1[codepoint >> UTF8_TABLE_BLOCK_BITS]][codepoint & (UTF8_TABLE_BLOCK_SIZE - 1)];
+}
+
+/**
+ * @brief Folds a codepoint the tables cover and writes it as utf8, like utf8_fold_char() does
+ * without the call and the conversions.
+ *
+ * @return size_t The number of bytes written.
+ */
+static inline size_t put_folded(unsigned char *out, uint32_t codepoint) {
+    uint16_t delta = UTF8_FOLD_STAGE2[UTF8_FOLD_STAGE1[codepoint >> UTF8_TABLE_BLOCK_BITS]]
+                                     [codepoint & (UTF8_TABLE_BLOCK_SIZE - 1)];
+
+    codepoint = (codepoint + delta) & (UTF8_TABLE_CODEPOINTS - 1);
+
+    if (codepoint < 0x80) {
+        out[0] = codepoint;
+        return 1;
+    }
+
+    if (codepoint < 0x800) {
+        out[0] = 0xc0 | (codepoint >> 6);
+        out[1] = 0x80 | (codepoint & 0x3f);
+        return 2;
+    }
+
+    out[0] = 0xe0 | (codepoint >> 12);
+    out[1] = 0x80 | ((codepoint >> 6) & 0x3f);
+    out[2] = 0x80 | (codepoint & 0x3f);
+    return 3;
+}
+
+/**
+ * @brief Folds a word into lower case without diacritics and adds it to the sink.
+ *
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool add_word(word_sink *sink, const unsigned char *word, size_t size) {
+    size_t folded_size;
+    uint64_t hash;
+
+    // A folded character never takes more than 4 bytes and the others take at least 1.
+    if (size * 4 > sink->folded_size) {
+        free(sink->folded);
+        sink->folded_size = 0;
+
+        if ((sink->folded = malloc(size * 4)) == NULL) return false;
+        sink->folded_size = size * 4;
+    }
+
+    folded_size = fold_word(word, size, sink->folded);
+
+    if (sink->table != NULL && !w_t_add(sink->table, sink->folded, folded_size, 1)) return false;
+    if (sink->patterns != NULL) a_c_count(sink->patterns, sink->folded, folded_size, sink->match_visits);
+    if (sink->sketch == NULL && sink->top == NULL) return true;
+
+    hash = w_t_hash(sink->folded, folded_size);
+    if (sink->sketch != NULL) h_l_add(sink->sketch, hash);
+    if (sink->top != NULL && !s_s_add(sink->top, sink->folded, folded_size, hash)) return false;
+
+    return true;
+}
+
+/**
+ * @brief Gets the next character of the text and its class.
+ *
+ * @param char_start_out Index of the first byte of the character. The iterator skips
+ * invalid bytes, which are left before it.
+ * @return true if a character was found and false if the text ended in the middle of a sequence.
+ */
+static inline bool next_char_class(
+    utf8iter *iter, size_t *char_start_out, uint32_t *utf8_char_out, uint8_t *char_class_out
+) {
+    uint32_t utf8_char = iter->line[iter->_pointer];
+    uint32_t codepoint;
+    size_t sequence_size;
+
+    // ASCII characters and two byte sequences are looked up here, without the calls.
+    if (utf8_char < 0x7f) {
+        *char_start_out = iter->_pointer++;
+        *utf8_char_out = utf8_char;
+        *char_class_out = codepoint_class(utf8_char);
+        return true;
+    }
+
+    if ((sequence_size = decode_pair(iter->line + iter->_pointer, iter->size - iter->_pointer, &codepoint)) != 0) {
+        *char_start_out = iter->_pointer;
+        *utf8_char_out = utf8_char << 8 | iter->line[iter->_pointer + 1];
+        iter->_pointer += sequence_size;
+        *char_class_out = codepoint_class(codepoint);
+        return true;
+    }
+
+    if (!utf8iter_next_complete_char(iter, &utf8_char)) return false;
+
+    *char_start_out = iter->_pointer - char_size(utf8_char);
+    *utf8_char_out = utf8_char;
+    *char_class_out = utf8_char_class(utf8_char);
+    return true;
+}
+
+/**
+ * @brief Counts the words of a text starting at the byte with index start, which must not be
+ * inside a word. Trailing characters that aren't alphanumeric are left out of the words.
+ *
+ * @param close_at_end Whether the word at the end of the text is counted. It isn't when the
+ * text may go on in another chunk.
+ * @param last_end_out The index of the byte after the last character that ended a word or start if none did.
+ * Can be NULL.
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool count_words(
+    word_sink *sink, const unsigned char *data, size_t size, size_t start, bool close_at_end, size_t *last_end_out
+) {
+    utf8iter iter = {data, size, start};
+    size_t last_end = start;
+    size_t word_start = 0;
+    size_t word_end = 0;
+    bool in_word = false;
+    uint32_t utf8_char;
+    uint8_t char_class;
+
+    while (iter._pointer < size) {
+        size_t char_start;
+
+        if (!next_char_class(&iter, &char_start, &utf8_char, &char_class)) break;
+
+        if ((char_class & UTF8_CLASS_ALNUM) || utf8_char == '_') {
+            if (!in_word) word_start = char_start;
+
+            in_word = true;
+            word_end = iter._pointer;
+        } else if (char_class & WORD_END_CLASSES) {
+            if (in_word && !add_word(sink, data + word_start, word_end - word_start)) return false;
+
+            in_word = false;
+            last_end = iter._pointer;
+        }
+    }
+
+    if (in_word && close_at_end && !add_word(sink, data + word_start, word_end - word_start)) return false;
+
+    if (last_end_out != NULL) *last_end_out = last_end;
+    return true;
+}
+
+/**
+ * @brief The sink of the words found by summarize_chunk_words() and whether one of them
+ * couldn't be added, after which the rest are left out.
+ *
+ */
+typedef struct found_words {
+    word_sink *sink;
+    int error;
+} found_words;
+
+/**
+ * @brief Adds a word found by summarize_chunk_words() to the sink.
+ *
+ */
+static void add_found_word(void *context, const unsigned char *word, size_t size) {
+    found_words *found = context;
+
+    if (found->error == 0 && !add_word(found->sink, word, size)) found->error = errno;
+}
+
+/**
+ * @brief Copies bytes into a new buffer, or NULL if there are none.
+ *
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ */
+static bool copy_bytes(const unsigned char *bytes, size_t size, unsigned char **copy_out) {
+    *copy_out = NULL;
+
+    if (size == 0) return true;
+    if ((*copy_out = malloc(size)) == NULL) return false;
+
+    memcpy(*copy_out, bytes, size);
+    return true;
+}
+
+/**
+ * @brief Appends bytes to a buffer, which is grown to fit them.
+ *
+ * @return true on success and false if memory couldn't be allocated, leaving the buffer as it was.
+ */
+static bool append_bytes(unsigned char **bytes, size_t *size, const unsigned char *more, size_t more_size) {
+    unsigned char *grown;
+
+    if (more_size == 0) return true;
+    if ((grown = realloc(*bytes, *size + more_size)) == NULL) return false;
+
+    memcpy(grown + *size, more, more_size);
+    *bytes = grown;
+    *size += more_size;
+    return true;
+}
+
+/**
+ * @brief Finds the first character of a chunk that ends a word. Nothing before it is known
+ * to be a whole word.
+ *
+ * @param first_end_out Index of the byte after the character, if there is one.
+ * @return size_t The index of the first byte of the character, or size if there is none.
+ */
+static size_t find_head(const unsigned char *data, size_t size, size_t *first_end_out) {
+    utf8iter iter = {data, size, 0};
+    uint32_t utf8_char;
+    uint8_t char_class;
+
+    while (iter._pointer < size) {
+        size_t char_start;
+
+        if (!next_char_class(&iter, &char_start, &utf8_char, &char_class)) break;
+
+        if (char_class & WORD_END_CLASSES) {
+            *first_end_out = iter._pointer;
+            return char_start;
+        }
+    }
+
+    return size;
+}
+
+/**
+ * @brief Copies the edges of a chunk, whose words in between are counted by the caller.
+ *
+ * @param head_size As given by find_head(). If it is size, all of the chunk is the head.
+ * @param tail_start Index of the byte after the last character that ends a word.
+ * @return true on success and false if memory couldn't be allocated, with errno set, in which
+ * case the edges are empty.
+ */
+static bool copy_edges(const unsigned char *data, size_t size, size_t head_size, size_t tail_start, word_edges *edges_out) {
+    empty_word_edges(edges_out);
+
+    if (head_size == size) {
+        if (!copy_bytes(data, size, &edges_out->head)) return false;
+
+        edges_out->head_size = size;
+        return true;
+    }
+
+    if (!copy_bytes(data, head_size, &edges_out->head) || !copy_bytes(data + tail_start, size - tail_start, &edges_out->tail)) {
+        free_word_edges(edges_out);
+        return false;
+    }
+
+    edges_out->head_size = head_size;
+    edges_out->tail_size = size - tail_start;
+    edges_out->open = false;
+    return true;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+size_t fold_word(const unsigned char *word, size_t size, unsigned char *folded_out) {
+    size_t folded_size = 0;
+    utf8iter iter = {word, size, 0};
+    uint32_t utf8_char, codepoint;
+    size_t sequence_size;
+
+    while (iter._pointer < size) {
+        utf8_char = word[iter._pointer];
+
+        if (utf8_char < 0x7f) {
+            folded_out[folded_size++] = utf8_char >= 'A' && utf8_char <= 'Z' ? utf8_char + ('a' - 'A') : utf8_char;
+            iter._pointer++;
+            continue;
+        }
+
+        if ((sequence_size = decode_pair(word + iter._pointer, size - iter._pointer, &codepoint)) != 0) {
+            folded_size += put_folded(folded_out + folded_size, codepoint);
+            iter._pointer += sequence_size;
+            continue;
+        }
+
+        if (!utf8iter_next_complete_char(&iter, &utf8_char)) break;
+
+        folded_size += put_char(folded_out + folded_size, utf8_fold_char(utf8_char));
+    }
+
+    return folded_size;
+}
+
+
+void init_word_sink(word_sink *sink, word_table_t *table, hll_sketch_t *sketch, space_saving_t *top) {
+    sink->table = table;
+    sink->sketch = sketch;
+    sink->top = top;
+    sink->patterns = NULL;
+    sink->match_visits = NULL;
+    sink->folded = NULL;
+    sink->folded_size = 0;
+}
+
+
+void free_word_sink(word_sink *sink) {
+    free(sink->folded);
+    sink->folded = NULL;
+    sink->folded_size = 0;
+}
+
+
+bool count_chunk_words(word_sink *sink, const unsigned char *data, size_t size, word_edges *edges_out) {
+    size_t first_end, tail_start = size;
+    size_t head_size = find_head(data, size, &first_end);
+
+    empty_word_edges(edges_out);
+
+    if (head_size < size && !count_words(sink, data, size, first_end, false, &tail_start)) return false;
+
+    return copy_edges(data, size, head_size, tail_start, edges_out);
+}
+
+
+bool summarize_chunk_and_words(
+    word_sink *sink, const unsigned char *data, size_t size, chunk_summary *summary_out, word_edges *edges_out
+) {
+    found_words found = {sink, 0};
+    size_t first_end, tail_start;
+
+    if (!summarize_chunk_words(data, size, add_found_word, &found, summary_out, &tail_start)) {
+        summarize_chunk(data, size, summary_out);
+        return count_chunk_words(sink, data, size, edges_out);
+    }
+
+    if (found.error != 0) {
+        empty_word_edges(edges_out);
+        errno = found.error;
+        return false;
+    }
+
+    return copy_edges(data, size, find_head(data, size, &first_end), tail_start, edges_out);
+}
+
+
+void empty_word_edges(word_edges *edges) {
+    edges->head = NULL;
+    edges->head_size = 0;
+    edges->tail = NULL;
+    edges->tail_size = 0;
+    edges->open = true;
+}
+
+
+void free_word_edges(word_edges *edges) {
+    free(edges->head);
+    free(edges->tail);
+    empty_word_edges(edges);
+}
+
+
+bool merge_word_edges(word_sink *sink, word_edges *first, word_edges *second) {
+    bool success;
+
+    if (first->open) {
+        success = append_bytes(&first->head, &first->head_size, second->head, second->head_size);
+        free(second->head);
+
+        first->tail = second->tail;
+        first->tail_size = second->tail_size;
+        first->open = second->open;
+        empty_word_edges(second);
+        return success;
+    }
+
+    success = append_bytes(&first->tail, &first->tail_size, second->head, second->head_size);
+    free(second->head);
+    second->head = NULL;
+
+    if (!success || second->open) {
+        free(second->tail);
+        empty_word_edges(second);
+        return success;
+    }
+
+    // The tail of the first chunk and the head of the second one are now whole words.
+    success = count_words(sink, first->tail, first->tail_size, 0, true, NULL);
+    free(first->tail);
+
+    first->tail = second->tail;
+    first->tail_size = second->tail_size;
+    empty_word_edges(second);
+    return success;
+}
+
+
+bool finish_word_edges(word_sink *sink, word_edges *edges) {
+    bool success = count_words(sink, edges->head, edges->head_size, 0, true, NULL) &&
+                   (edges->open || count_words(sink, edges->tail, edges->tail_size, 0, true, NULL));
+
+    free_word_edges(edges);
+    return success;
+}
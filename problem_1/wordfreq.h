@@ -0,0 +1,147 @@
+/**
+ * @file wordfreq.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief Module containing the procedures that split chunks of text into words and count them
+ * in a word table, estimate how many distinct ones there are in a HyperLogLog sketch, keep the
+ * most frequent ones in a Space-Saving summary, count the patterns found in them with an
+ * Aho-Corasick automaton or any of them together.
+ * The words are folded into lower case without diacritics with utf8_fold_char().
+ * Like the chunk summaries, the words cut at the edges of a chunk are kept apart and counted
+ * once the chunks next to it are merged, so a text can be cut at any byte.
+ * @version 0.1
+ * @date 2022-05-09
+ *
+ */
+#ifndef WORDFREQ_GUARD
+#define WORDFREQ_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "wordcount.h"
+#include "wordtable.h"
+#include "hyperloglog.h"
+#include "spacesaving.h"
+#include "ahocorasick.h"
+
+/**
+ * @brief Where the words of a text go.
+ *
+ */
+typedef struct word_sink {
+    word_table_t *table;            // Counts every word, or NULL.
+    hll_sketch_t *sketch;           // Estimates the distinct words, or NULL.
+    space_saving_t *top;            // Keeps the most frequent words, or NULL.
+    const ac_automaton_t *patterns; // Finds patterns in the words, or NULL.
+    uint64_t *match_visits;         // Visits to each state of the patterns with matches, see a_c_count().
+    unsigned char *folded;          // Buffer where words are folded before being added.
+    size_t folded_size;
+} word_sink;
+
+/**
+ * @brief The bytes of a chunk whose words depend on the chunks next to it.
+ * The words of the bytes in between are already counted.
+ *
+ */
+typedef struct word_edges {
+    unsigned char *head;    // Bytes before the first character that ends a word.
+    size_t head_size;
+    unsigned char *tail;    // Bytes after the last character that ends a word.
+    size_t tail_size;
+    bool open;              // No character ends a word, so all of the bytes are in head.
+} word_edges;
+
+/**
+ * @brief Folds a word into lower case without diacritics, as the words of a sink are.
+ *
+ * @param word
+ * @param size The number of bytes of the word.
+ * @param folded_out Where the folded word is written, which must have room for 4 times its bytes.
+ * @return size_t The number of bytes of the folded word.
+ */
+size_t fold_word(const unsigned char *word, size_t size, unsigned char *folded_out);
+
+/**
+ * @brief Initializes a sink over a table, a sketch, a summary or any of them. It has no patterns,
+ * which are set in its fields along with their visits.
+ *
+ * @param sink
+ * @param table Can be NULL.
+ * @param sketch Can be NULL, and changed later, e.g. for each file.
+ * @param top Can be NULL.
+ */
+void init_word_sink(word_sink *sink, word_table_t *table, hll_sketch_t *sketch, space_saving_t *top);
+
+/**
+ * @brief Frees the buffer of a sink, but not its table, sketch or summary.
+ *
+ * @param sink
+ */
+void free_word_sink(word_sink *sink);
+
+/**
+ * @brief Counts the words of a chunk of text in the sink, except for the ones at its edges.
+ *
+ * @param sink The sink of the thread processing the chunk.
+ * @param data The chunk of text.
+ * @param size The number of bytes in the chunk.
+ * @param edges_out The edges of the chunk. Their bytes are copied, so the chunk can be reused.
+ * @return true on success and false if memory couldn't be allocated, with errno set, in which case
+ * the edges are empty and the words counted so far stay in the sink.
+ */
+bool count_chunk_words(word_sink *sink, const unsigned char *data, size_t size, word_edges *edges_out);
+
+/**
+ * @brief Summarizes a chunk like summarize_chunk() and counts its words in the sink like
+ * count_chunk_words(). With ENGINE_VECTOR the words are found while the chunk is summarized,
+ * so it is only gone through once, and with the other engines one pass does each.
+ *
+ * @param sink The sink of the thread processing the chunk.
+ * @param data The chunk of text.
+ * @param size The number of bytes in the chunk.
+ * @param summary_out Output of the summary of the chunk, which is complete even on failure.
+ * @param edges_out The edges of the chunk. Their bytes are copied, so the chunk can be reused.
+ * @return true on success and false if memory couldn't be allocated, with errno set, in which case
+ * the edges are empty and the words counted so far stay in the sink.
+ */
+bool summarize_chunk_and_words(
+    word_sink *sink, const unsigned char *data, size_t size, chunk_summary *summary_out, word_edges *edges_out
+);
+
+/**
+ * @brief Initializes the edges of an empty text. Merging them with other edges changes nothing.
+ *
+ * @param edges
+ */
+void empty_word_edges(word_edges *edges);
+
+/**
+ * @brief Frees the bytes of some edges without counting their words and empties them.
+ *
+ * @param edges
+ */
+void free_word_edges(word_edges *edges);
+
+/**
+ * @brief Merges the edges of a chunk with the edges of the chunk right after it, counting the
+ * words cut between them in the sink.
+ *
+ * @param sink
+ * @param first The edges of the first chunk. Updated with the edges of both chunks.
+ * @param second The edges of the second chunk. Their bytes are taken over or freed, and it is left empty.
+ * @return true on success and false if memory couldn't be allocated, with errno set. The bytes of
+ * second are still taken over or freed, and first can be freed with free_word_edges().
+ */
+bool merge_word_edges(word_sink *sink, word_edges *first, word_edges *second);
+
+/**
+ * @brief Counts the words left in the edges of a whole file in the sink and frees them.
+ *
+ * @param sink
+ * @param edges
+ * @return true on success and false if memory couldn't be allocated, with errno set.
+ * The edges are freed either way.
+ */
+bool finish_word_edges(word_sink *sink, word_edges *edges);
+
+#endif
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "wordtable.h"
+
+/**
+ * @brief Number of slots and entries of a new table.
+ *
+ */
+#define INITIAL_SLOTS (1 << 16)
+#define INITIAL_ENTRIES (1 << 15)
+
+/**
+ * @brief Hashes a word 8 bytes at a time.
+ *
+ */
+static uint64_t hash_word(const unsigned char *word, size_t size) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+    uint64_t block;
+
+    for (; size >= 8; word += 8, size -= 8) {
+        memcpy(&block, word, 8);
+        hash = (hash ^ block) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+
+    if (size > 0) {
+        block = 0;
+        memcpy(&block, word, size);
+        hash = (hash ^ block) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief Copies a word into the arena of the table.
+ *
+ * @return const unsigned char* The copy or NULL if memory couldn't be allocated.
+ */
+static const unsigned char *arena_copy(word_table_t *table, const unsigned char *word, size_t size) {
+    word_arena_block *block = table->arena;
+
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > WORD_ARENA_BLOCK_SIZE ? size : WORD_ARENA_BLOCK_SIZE;
+
+        if ((block = malloc(sizeof(word_arena_block) + capacity)) == NULL) return NULL;
+
+        block->used = 0;
+        block->capacity = capacity;
+
+        // A block of a single long word goes after the current one, which may still have room.
+        if (size > WORD_ARENA_BLOCK_SIZE && table->arena != NULL) {
+            block->next = table->arena->next;
+            table->arena->next = block;
+        } else {
+            block->next = table->arena;
+            table->arena = block;
+        }
+    }
+
+    memcpy(block->data + block->used, word, size);
+    block->used += size;
+    return block->data + block->used - size;
+}
+
+/**
+ * @brief Doubles the number of slots and puts the entries back in them.
+ *
+ * @return true on success and false if memory couldn't be allocated, leaving the slots as they were.
+ */
+static bool grow_slots(word_table_t *table) {
+    size_t n_slots = table->n_slots * 2;
+    uint32_t *slots = calloc(n_slots, sizeof(uint32_t));
+
+    if (slots == NULL) return false;
+
+    for (size_t i = 0; i < table->n_entries; i++) {
+        size_t slot = table->entries[i].hash & (n_slots - 1);
+
+        while (slots[slot] != 0) slot = (slot + 1) & (n_slots - 1);
+        slots[slot] = i + 1;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->n_slots = n_slots;
+    return true;
+}
+
+/**
+ * @brief Adds count occurrences of a word with the given hash. The word is only copied
+ * into the arena if copy is set, otherwise the table points to it.
+ *
+ * @return true on success and false if memory couldn't be allocated, leaving the table as it was.
+ */
+static bool insert_word(
+    word_table_t *table, const unsigned char *word, uint32_t size, uint32_t hash, uint64_t count, bool copy
+) {
+    size_t mask = table->n_slots - 1;
+    size_t slot = hash & mask;
+    word_entry *entry;
+
+    for (; table->slots[slot] != 0; slot = (slot + 1) & mask) {
+        entry = &table->entries[table->slots[slot] - 1];
+
+        if (entry->hash == hash && entry->size == size && memcmp(entry->word, word, size) == 0) {
+            entry->count += count;
+            table->n_words += count;
+            return true;
+        }
+    }
+
+    if (table->n_entries == table->entries_capacity) {
+        size_t capacity = table->entries_capacity * 2;
+        word_entry *entries = realloc(table->entries, sizeof(word_entry) * capacity);
+
+        if (entries == NULL) return false;
+
+        table->entries = entries;
+        table->entries_capacity = capacity;
+    }
+
+    // Keep at most half of the slots used so probes stay short.
+    if ((table->n_entries + 1) * 2 > table->n_slots) {
+        if (!grow_slots(table)) return false;
+
+        mask = table->n_slots - 1;
+        for (slot = hash & mask; table->slots[slot] != 0; slot = (slot + 1) & mask);
+    }
+
+    entry = &table->entries[table->n_entries];
+    if ((entry->word = copy ? arena_copy(table, word, size) : word) == NULL) return false;
+
+    entry->size = size;
+    entry->hash = hash;
+    entry->count = count;
+
+    table->slots[slot] = ++table->n_entries;
+    table->n_words += count;
+    return true;
+}
+
+/**
+ * @brief Tells whether the first entry is less frequent than the second one, or as frequent
+ * with a word that sorts after it.
+ *
+ */
+static bool entry_less(const word_entry *a, const word_entry *b) {
+    size_t size = a->size < b->size ? a->size : b->size;
+    int order;
+
+    if (a->count != b->count) return a->count < b->count;
+
+    order = memcmp(a->word, b->word, size);
+    if (order != 0) return order > 0;
+    return a->size > b->size;
+}
+
+static int compare_entries_desc(const void *a, const void *b) {
+    if (entry_less(a, b)) return 1;
+    if (entry_less(b, a)) return -1;
+    return 0;
+}
+
+/**
+ * @brief Moves the entry at index down a min heap until the heap is valid again.
+ *
+ */
+static void sift_down(word_entry *heap, size_t size, size_t index) {
+    while (true) {
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+
+        if (left < size && entry_less(&heap[left], &heap[smallest])) smallest = left;
+        if (right < size && entry_less(&heap[right], &heap[smallest])) smallest = right;
+        if (smallest == index) return;
+
+        word_entry swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+/**
+ * @brief Work of a thread merging the tables into a shard.
+ *
+ */
+typedef struct shard_merge {
+    word_table_t **tables;
+    size_t n_tables;
+    size_t shard;
+    size_t n_shards;
+    word_table_t *result;
+    int error;              // Why the shard couldn't be merged, or 0.
+} shard_merge;
+
+/**
+ * @brief Procedure of the threads merging the shards. The shard of a word is taken from
+ * the upper bits of its hash, since the lower ones pick its slot.
+ *
+ */
+static void *merge_shard(void *arg) {
+    shard_merge *merge = arg;
+
+    if ((merge->result = w_t_create()) == NULL) {
+        merge->error = errno;
+        return NULL;
+    }
+
+    for (size_t table_idx = 0; table_idx < merge->n_tables; table_idx++) {
+        const word_table_t *table = merge->tables[table_idx];
+
+        for (size_t i = 0; i < table->n_entries; i++) {
+            const word_entry *entry = &table->entries[i];
+
+            if (((uint64_t) entry->hash * merge->n_shards) >> 32 != merge->shard) continue;
+
+            if (!insert_word(merge->result, entry->word, entry->size, entry->hash, entry->count, false)) {
+                merge->error = errno;
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Writes a number as a LEB128 varint.
+ *
+ */
+static bool write_varint(FILE *file, uint64_t value) {
+    unsigned char bytes[10];
+    size_t n_bytes = 0;
+
+    do {
+        bytes[n_bytes++] = (value & 0x7f) | (value >= 0x80 ? 0x80 : 0);
+        value >>= 7;
+    } while (value != 0);
+
+    return fwrite(bytes, 1, n_bytes, file) == n_bytes;
+}
+
+//
+//
+// PUBLIC FUNCTIONS
+//
+//
+
+
+word_table_t *w_t_create() {
+    word_table_t *table;
+
+    if ((table = calloc(1, sizeof(word_table_t))) == NULL) return NULL;
+
+    table->slots = calloc(INITIAL_SLOTS, sizeof(uint32_t));
+    table->entries = malloc(sizeof(word_entry) * INITIAL_ENTRIES);
+
+    if (table->slots == NULL || table->entries == NULL) {
+        free(table->slots);
+        free(table->entries);
+        free(table);
+        return NULL;
+    }
+
+    table->n_slots = INITIAL_SLOTS;
+    table->entries_capacity = INITIAL_ENTRIES;
+    return table;
+}
+
+
+bool w_t_add(word_table_t *table, const unsigned char *word, size_t size, uint64_t count) {
+    // Words this long don't happen in text, they are cut rather than not counted.
+    if (size > UINT32_MAX) size = UINT32_MAX;
+
+    return insert_word(table, word, size, hash_word(word, size) >> 32, count, true);
+}
+
+
+uint64_t w_t_hash(const unsigned char *word, size_t size) {
+    return hash_word(word, size);
+}
+
+
+size_t w_t_size(const word_table_t *table) {
+    return table->n_entries;
+}
+
+
+const word_entry *w_t_entries(const word_table_t *table, size_t *n_entries_out) {
+    *n_entries_out = table->n_entries;
+    return table->entries;
+}
+
+
+word_table_t **w_t_merge_sharded(word_table_t **tables, size_t n_tables, size_t n_shards) {
+    pthread_t threads[n_shards];
+    shard_merge merges[n_shards];
+    word_table_t **shards;
+    size_t n_started = 0;
+    int error = 0;
+
+    if ((shards = malloc(sizeof(word_table_t *) * n_shards)) == NULL) return NULL;
+
+    for (; n_started < n_shards; n_started++) {
+        merges[n_started] = (shard_merge) {tables, n_tables, n_started, n_shards, NULL, 0};
+
+        if ((error = pthread_create(&threads[n_started], NULL, merge_shard, &merges[n_started])) != 0) break;
+    }
+
+    for (size_t shard = 0; shard < n_started; shard++) {
+        pthread_join(threads[shard], NULL);
+        shards[shard] = merges[shard].result;
+        if (error == 0) error = merges[shard].error;
+    }
+
+    if (error != 0) {
+        for (size_t shard = 0; shard < n_started; shard++) {
+            if (shards[shard] != NULL) w_t_destroy(shards[shard]);
+        }
+
+        free(shards);
+        errno = error;
+        return NULL;
+    }
+
+    return shards;
+}
+
+
+size_t w_t_top(word_table_t **tables, size_t n_tables, size_t n, word_entry *top_out) {
+    size_t size = 0;
+
+    if (n == 0) return 0;
+
+    // Keep the n most frequent words in a min heap, so the least frequent is the one replaced.
+    for (size_t table_idx = 0; table_idx < n_tables; table_idx++) {
+        const word_table_t *table = tables[table_idx];
+
+        for (size_t i = 0; i < table->n_entries; i++) {
+            const word_entry *entry = &table->entries[i];
+
+            if (size < n) {
+                top_out[size++] = *entry;
+
+                if (size == n) {
+                    for (size_t j = n / 2; j-- > 0;) sift_down(top_out, size, j);
+                }
+            } else if (entry_less(&top_out[0], entry)) {
+                top_out[0] = *entry;
+                sift_down(top_out, size, 0);
+            }
+        }
+    }
+
+    qsort(top_out, size, sizeof(word_entry), compare_entries_desc);
+    return size;
+}
+
+
+bool w_t_dump(word_table_t **tables, size_t n_tables, const char *file_name) {
+    uint64_t n_words = 0;
+    unsigned char n_words_bytes[8];
+    FILE *file;
+    bool written;
+
+    if ((file = fopen(file_name, "wb")) == NULL) return false;
+
+    for (size_t table_idx = 0; table_idx < n_tables; table_idx++) {
+        n_words += tables[table_idx]->n_entries;
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        n_words_bytes[i] = (n_words >> (i * 8)) & 0xff;
+    }
+
+    written = fwrite(WORD_DUMP_MAGIC, 1, 8, file) == 8 && fwrite(n_words_bytes, 1, 8, file) == 8;
+
+    for (size_t table_idx = 0; table_idx < n_tables && written; table_idx++) {
+        const word_table_t *table = tables[table_idx];
+
+        for (size_t i = 0; i < table->n_entries && written; i++) {
+            const word_entry *entry = &table->entries[i];
+
+            written = write_varint(file, entry->count) && write_varint(file, entry->size) &&
+                      fwrite(entry->word, 1, entry->size, file) == entry->size;
+        }
+    }
+
+    if (fclose(file) != 0) written = false;
+    return written;
+}
+
+
+void w_t_destroy(word_table_t *table) {
+    while (table->arena != NULL) {
+        word_arena_block *next = table->arena->next;
+
+        free(table->arena);
+        table->arena = next;
+    }
+
+    free(table->slots);
+    free(table->entries);
+    free(table);
+}
@@ -0,0 +1,157 @@
+/**
+ * @file wordtable.h
+ * @author José Gonçalves, Maria João Sousa
+ * @brief This module contains a hash table that counts how many times each word was seen.
+ * It uses open addressing over an array of entries and keeps the words in an arena, so
+ * adding a word never allocates memory by itself. Each worker thread fills its own table
+ * and the tables are only merged at the end, by shards of the hashes of the words.
+ * @version 0.1
+ * @date 2022-05-09
+ *
+ */
+
+#ifndef WORDTABLE_GUARD
+#define WORDTABLE_GUARD
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of the blocks the words are kept in. Longer words get a block of their own.
+ *
+ */
+#define WORD_ARENA_BLOCK_SIZE (1024 * 1024)
+
+/**
+ * @brief Magic bytes at the start of the files written by w_t_dump().
+ *
+ */
+#define WORD_DUMP_MAGIC "CLEWORD1"
+
+/**
+ * @brief A word of a table and how many times it was seen.
+ *
+ */
+typedef struct word_entry {
+    const unsigned char *word;  // Not null terminated.
+    uint64_t count;
+    uint32_t size;
+    uint32_t hash;
+} word_entry;
+
+/**
+ * @brief A block of memory where the words of a table are kept.
+ *
+ */
+typedef struct word_arena_block {
+    struct word_arena_block *next;
+    size_t used;
+    size_t capacity;
+    unsigned char data[];
+} word_arena_block;
+
+/**
+ * @brief Data structure representing a table of words.
+ * It's fields must not be changed directly.
+ *
+ */
+typedef struct word_table_t {
+    uint32_t *slots;            // Index of the entry plus one, or 0 if the slot is empty.
+    size_t n_slots;             // Always a power of 2.
+    word_entry *entries;
+    size_t n_entries;
+    size_t entries_capacity;
+    word_arena_block *arena;
+    uint64_t n_words;           // Sum of the counts of all entries.
+} word_table_t;
+
+/**
+ * @brief Creates an empty table.
+ *
+ * @return word_table_t* A pointer to the table on success or NULL on failure.
+ */
+word_table_t *w_t_create();
+
+/**
+ * @brief Adds count occurrences of a word to the table. The word is copied into
+ * the arena of the table the first time it is seen.
+ *
+ * @param table
+ * @param word
+ * @param size The number of bytes of the word.
+ * @param count
+ * @return true on success and false if memory couldn't be allocated, with errno set,
+ * in which case the table is left as it was.
+ */
+bool w_t_add(word_table_t *table, const unsigned char *word, size_t size, uint64_t count);
+
+/**
+ * @brief Hashes a word the way the tables do. All 64 bits of the hash are well mixed,
+ * though the tables only use the upper 32.
+ *
+ * @param word
+ * @param size The number of bytes of the word.
+ * @return uint64_t
+ */
+uint64_t w_t_hash(const unsigned char *word, size_t size);
+
+/**
+ * @brief Gets the number of distinct words in the table.
+ *
+ */
+size_t w_t_size(const word_table_t *table);
+
+/**
+ * @brief Gets the entries of the table, in no particular order.
+ *
+ * @param table
+ * @param n_entries_out The number of entries.
+ * @return const word_entry*
+ */
+const word_entry *w_t_entries(const word_table_t *table, size_t *n_entries_out);
+
+/**
+ * @brief Merges tables into n_shards tables, in parallel with one thread per shard.
+ * The words are split among the shards by their hash, so no word is in more than one shard.
+ * The shards point to the words of the given tables, which must outlive them.
+ *
+ * @param tables
+ * @param n_tables
+ * @param n_shards
+ * @return word_table_t** The shards on success or NULL on failure, with errno set.
+ */
+word_table_t **w_t_merge_sharded(word_table_t **tables, size_t n_tables, size_t n_shards);
+
+/**
+ * @brief Gets the n most frequent words of tables holding distinct words, like the shards
+ * of w_t_merge_sharded(). Ties are broken by the bytes of the words.
+ *
+ * @param tables
+ * @param n_tables
+ * @param n
+ * @param top_out Array of at least n entries, filled from the most frequent word.
+ * @return size_t The number of entries in top_out, less than n if there aren't n words.
+ */
+size_t w_t_top(word_table_t **tables, size_t n_tables, size_t n, word_entry *top_out);
+
+/**
+ * @brief Writes all words of tables holding distinct words into a file. The file has
+ * WORD_DUMP_MAGIC, the number of words as 8 bytes little endian and then, for each word,
+ * its count and size as LEB128 varints followed by its bytes.
+ *
+ * @param tables
+ * @param n_tables
+ * @param file_name
+ * @return true on success and false on failure, with errno set.
+ */
+bool w_t_dump(word_table_t **tables, size_t n_tables, const char *file_name);
+
+/**
+ * @brief Deallocates the table.
+ *
+ * @param table
+ */
+void w_t_destroy(word_table_t *table);
+
+#endif
@@ -8,6 +8,14 @@
 #include <time.h>
 #include <pthread.h>
 #include "matrix.h"
+#include "placement.h"
+
+/**
+ * @brief Values getopt_long() returns for the options that only have a long name.
+ * 
+ */
+#define OPTION_PIN 256
+#define OPTION_NUMA 257
 
 
 //structure needed to send all important information to the workers
@@ -17,6 +25,7 @@ struct info {
     FILE *filehandle;
     int *statusProd;
     int n_matrices;
+    placement_t *placement;
 };
 
 //lock access to read a matrix
@@ -111,11 +120,13 @@ static double calculate_determinant(matrix *mat) {
  * @param filehandle File with the data
  * @param order_matrices 
  * @param n_matrices  
+ * @param data Buffer of the worker where the matrix is read into
+ * @param id Worker id
+ * @param placement Placement of the workers
  */
-static void life_cycle (FILE *filehandle, int order_matrices, int n_matrices){
+static void life_cycle (FILE *filehandle, int order_matrices, int n_matrices, double *data, int id, placement_t *placement){
 
     size_t data_size = order_matrices * order_matrices;
-    double data[data_size];
     int index = -1;
 
     //sets timer 
@@ -152,6 +163,8 @@ static void life_cycle (FILE *filehandle, int order_matrices, int n_matrices){
 
         
 
+        placement_count_data(placement, id, data);
+
         //creates a matrix and calculates its determinant
         matrix mat = SQUARE_MATRIX(order_matrices, data);
         double determinant = calculate_determinant(&mat);
@@ -188,13 +201,24 @@ static void *worker (void *data)
 
     int id = info->prod;  /* worker id */
 
+    //the worker is placed before allocating its matrix buffer, so the buffer is on its node
+    placement_place_worker(info->placement, id);
+
+    double *matrix_data = malloc(sizeof(double) * info->order_matrices * info->order_matrices);
+    if (matrix_data == NULL)
+    { perror ("error on allocating the matrix buffer");
+        exit (EXIT_FAILURE);
+    }
+
     //life cycle of the thread
     while(stillProcessing == true){
 
-        life_cycle(info->filehandle, info->order_matrices, info->n_matrices); 
+        life_cycle(info->filehandle, info->order_matrices, info->n_matrices, matrix_data, id, info->placement); 
 
     }     
 
+    free(matrix_data);
+
     info->statusProd[id] = EXIT_SUCCESS;
     pthread_exit (&info->statusProd[id]);
         
@@ -206,8 +230,9 @@ static void *worker (void *data)
  * 
  * @param filename Name of the file to process
  * @param number_of_threads Number of threads that will be initiated to handle the task
+ * @param placement How the threads are placed on the CPUs and NUMA nodes
  */
-static void process_file(const char *filename, int number_of_threads) {
+static void process_file(const char *filename, int number_of_threads, placement_mode placement) {
 
     //initiate shared timer
     elapsedTime = 0.0;
@@ -246,6 +271,17 @@ static void process_file(const char *filename, int number_of_threads) {
     pthread_t tIdProd[N];
     int statusProd[N];
 
+    placement_t *workers_placement = placement_create(placement, N);
+
+    if (workers_placement == NULL) {
+        printf("The CPU topology couldn't be read, the threads won't be pinned\n");
+
+        if ((workers_placement = placement_create(PLACEMENT_NONE, N)) == NULL)
+        { perror ("error on allocating the placement of the threads");
+            exit (EXIT_FAILURE);
+        }
+    }
+
     for (int i = 0; i < N; i++){
    
         struct info *info = malloc(sizeof(struct info));
@@ -255,6 +291,7 @@ static void process_file(const char *filename, int number_of_threads) {
         info->filehandle = filehandle;
         info->statusProd = statusProd;        
         info->n_matrices = n_matrices;
+        info->placement = workers_placement;
 
 
         if (pthread_create (&tIdProd[i], NULL, worker, info) != 0)                              /* thread worker */
@@ -279,6 +316,9 @@ static void process_file(const char *filename, int number_of_threads) {
     fclose(filehandle);
 
     printf ("\nElapsed time = %.6f s\n", elapsedTime);
+
+    placement_report(workers_placement);
+    placement_destroy(workers_placement);
 }
 
 
@@ -288,6 +328,8 @@ static void print_usage(const char *cmd_name) {
     fprintf(stderr, "  -h        --- print this message\n");
     fprintf(stderr, "  -f        --- the name of the file containing the matrices\n");
     fprintf(stderr, "  -n        --- number of threads that will be processing. Default = 10\n");
+    fprintf(stderr, "  --pin     --- pins each thread to a CPU, spread over the NUMA nodes and then over the physical cores\n");
+    fprintf(stderr, "  --numa    --- pins the threads and allocates the matrix buffer of each one on its NUMA node\n");
 }
 
 
@@ -296,8 +338,14 @@ int main(int argc, char *argv[]) {
     int opt;
     char *filename = NULL;
     int number_of_threads = 10;
+    placement_mode placement = PLACEMENT_NONE;
+    struct option long_options[] = {
+        {"pin", no_argument, NULL, OPTION_PIN},
+        {"numa", no_argument, NULL, OPTION_NUMA},
+        {NULL, 0, NULL, 0}
+    };
 
-    while((opt = getopt(argc, argv, ":f:n:h")) != -1) {
+    while((opt = getopt_long(argc, argv, ":f:n:h", long_options, NULL)) != -1) {
 
         switch (opt) {
         case 'h': // Help option
@@ -322,6 +370,14 @@ int main(int argc, char *argv[]) {
             strcpy(filename, optarg);
             break;
         
+        case OPTION_PIN: // Pin the threads
+            if (placement == PLACEMENT_NONE) placement = PLACEMENT_PIN;
+            break;
+
+        case OPTION_NUMA: // Pin the threads and keep their memory on their node
+            placement = PLACEMENT_NUMA;
+            break;
+
         case '?': // Invalid option
             fprintf(stderr, "%s: Invalid option\n", basename(argv[0]));
             print_usage(basename(argv[0]));
@@ -340,7 +396,7 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
     
-    process_file(filename, number_of_threads);
+    process_file(filename, number_of_threads, placement);
 
     return 0;
 }
\ No newline at end of file